@@ -131,10 +131,10 @@ SettingsPanel {
             CheckGroup {
                 name: qsTr("Cache & Network")
 
-                Label { text: qsTr("Cache size:") }
+                Label { text: qsTr("Cache size (MiB):") }
                 LabledSlider {
                     id: cache_size_slider;
-                    from: 1000; to: 20000; stepSize: 1000;
+                    from: 256; to: 8192; stepSize: 256;
                 }
 
             }
@@ -61,6 +61,32 @@ Rectangle {
 
     Component.onCompleted: responsive_update()
 
+    function format_mib(bytes) {
+        return (bytes / (1024 * 1024)).toFixed(1) + " MiB";
+    }
+
+    // timings are in microseconds, shown as p50 / p95 / p99 in milliseconds.
+    function format_tile_telemetry(t) {
+        if (!t || !t.timings_us)
+            return "no data yet";
+        let lines = [];
+        for (const name in t.timings_us) {
+            const d = t.timings_us[name];
+            lines.push(name + ": " + [d.p50, d.p95, d.p99].map(v => (v / 1000).toFixed(1)).join(" / ") + " ms (" + d.count + ")");
+        }
+        for (const name in t.gauges) {
+            const g = t.gauges[name];
+            if (name.endsWith("_bytes"))
+                lines.push(name + ": " + format_mib(g.current));
+            else
+                lines.push(name + ": " + g.current + " (p95 " + g.p95 + ")");
+        }
+        lines.push("bytes_received: " + format_mib(t.counters.bytes_received));
+        lines.push("network_errors: " + t.counters.network_errors + " / " + t.counters.network_requests);
+        lines.push("cache_hit_ratio: " + (t.cache_hit_ratio * 100).toFixed(1) + " %");
+        return lines.join("\n");
+    }
+
     Connections {
         target: main
         function onWidthChanged() {
@@ -491,7 +517,7 @@ Rectangle {
                 id: cache_fill_slider
                 from: 0
                 to: map.tile_cache_size
-                value: map.cached_tiles
+                value: map.tile_telemetry.gauges ? map.tile_telemetry.gauges.ram_cache_bytes.current / (1024 * 1024) : 0
             }
 
             Label {
@@ -505,6 +531,17 @@ Rectangle {
                 value: map.queued_tiles
             }
         }
+        CheckGroup {
+            name: "Tile Pipeline"
+
+            Label {
+                Layout.columnSpan: 2
+                Layout.fillWidth: true
+                font.family: "monospace"
+                font.pixelSize: 11
+                text: statsMenu.format_tile_telemetry(map.tile_telemetry)
+            }
+        }
     }
 
 }
@@ -37,6 +37,7 @@
 #include "gl_engine/Window.h"
 #include "nucleus/camera/Controller.h"
 #include "nucleus/Controller.h"
+#include "nucleus/tile_scheduler/MemoryGovernor.h"
 #include "nucleus/tile_scheduler/Scheduler.h"
 #include "nucleus/srs.h"
 #include "nucleus/utils/sun_calculations.h"
@@ -124,15 +125,16 @@ QQuickFramebufferObject::Renderer* TerrainRendererItem::createRenderer() const
         const auto permissible_error = 1.0f / new_render_quality;
         tile_scheduler->set_permissible_screen_space_error(permissible_error);
     });
-    connect(this, &TerrainRendererItem::tile_cache_size_changed, tile_scheduler, &nucleus::tile_scheduler::Scheduler::set_ram_quad_limit);
-    connect(tile_scheduler, &nucleus::tile_scheduler::Scheduler::quads_requested, this, [this](const std::vector<tile::Id>& ids) {
-        const_cast<TerrainRendererItem*>(this)->set_queued_tiles(unsigned(ids.size()));
+    connect(this, &TerrainRendererItem::tile_cache_size_changed, r->controller()->memory_governor(), &nucleus::tile_scheduler::MemoryGovernor::set_max_ram_budget);
+    connect(tile_scheduler, &nucleus::tile_scheduler::Scheduler::quads_requested, this, [this](const std::vector<nucleus::tile_scheduler::tile_types::QuadRequest>& requests) {
+        const_cast<TerrainRendererItem*>(this)->set_queued_tiles(unsigned(requests.size()));
     });
     connect(tile_scheduler, &nucleus::tile_scheduler::Scheduler::quad_received, this, [this]() {
         const_cast<TerrainRendererItem*>(this)->set_queued_tiles(std::max(this->queued_tiles(), 1u) - 1);
     });
     connect(tile_scheduler, &nucleus::tile_scheduler::Scheduler::statistics_updated, this, [this](const nucleus::tile_scheduler::Scheduler::Statistics& stats) {
         const_cast<TerrainRendererItem*>(this)->set_cached_tiles(stats.n_tiles_in_ram_cache);
+        const_cast<TerrainRendererItem*>(this)->set_tile_telemetry(stats.telemetry.to_json().toVariantMap());
     });
 
     // connect glWindow to forward key events.
@@ -449,6 +451,19 @@ void TerrainRendererItem::set_cached_tiles(unsigned int new_cached_tiles)
     emit cached_tiles_changed(m_cached_tiles);
 }
 
+QVariantMap TerrainRendererItem::tile_telemetry() const
+{
+    return m_tile_telemetry;
+}
+
+void TerrainRendererItem::set_tile_telemetry(const QVariantMap& new_tile_telemetry)
+{
+    if (m_tile_telemetry == new_tile_telemetry)
+        return;
+    m_tile_telemetry = new_tile_telemetry;
+    emit tile_telemetry_changed();
+}
+
 unsigned int TerrainRendererItem::tile_cache_size() const
 {
     return m_tile_cache_size;
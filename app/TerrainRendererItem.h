@@ -27,6 +27,7 @@
 #include <QVector3D>
 #include <QVector2D>
 #include <QDateTime>
+#include <QVariantMap>
 #include <map>
 
 #include "nucleus/camera/Definition.h"
@@ -52,6 +53,7 @@ class TerrainRendererItem : public QQuickFramebufferObject {
     Q_PROPERTY(unsigned int in_flight_tiles READ in_flight_tiles NOTIFY in_flight_tiles_changed)
     Q_PROPERTY(unsigned int queued_tiles READ queued_tiles NOTIFY queued_tiles_changed)
     Q_PROPERTY(unsigned int cached_tiles READ cached_tiles NOTIFY cached_tiles_changed)
+    Q_PROPERTY(QVariantMap tile_telemetry READ tile_telemetry NOTIFY tile_telemetry_changed)
     Q_PROPERTY(unsigned int tile_cache_size READ tile_cache_size WRITE set_tile_cache_size NOTIFY tile_cache_size_changed)
     Q_PROPERTY(bool render_looped READ render_looped WRITE set_render_looped NOTIFY render_looped_changed)
     Q_PROPERTY(unsigned int selected_camera_position_index MEMBER m_selected_camera_position_index WRITE set_selected_camera_position_index)
@@ -99,6 +101,8 @@ signals:
 
     void cached_tiles_changed(unsigned new_n);
 
+    void tile_telemetry_changed();
+
     void tile_cache_size_changed(unsigned new_cache_size);
 
     void gui_update_global_cursor_pos(double latitude, double longitude, double altitude);
@@ -179,6 +183,9 @@ public:
     [[nodiscard]] unsigned int cached_tiles() const;
     void set_cached_tiles(unsigned int new_cached_tiles);
 
+    [[nodiscard]] QVariantMap tile_telemetry() const;
+    void set_tile_telemetry(const QVariantMap& new_tile_telemetry);
+
     [[nodiscard]] unsigned int tile_cache_size() const;
     void set_tile_cache_size(unsigned int new_tile_cache_size);
 
@@ -197,8 +204,13 @@ private:
     float m_camera_operation_centre_distance = 1;
     float m_field_of_view = 60;
     int m_frame_limit = 60;
-    unsigned m_tile_cache_size = 12000;
+#ifdef __ANDROID__
+    unsigned m_tile_cache_size = 512; // MiB, see nucleus::Controller
+#else
+    unsigned m_tile_cache_size = 2048; // MiB, see nucleus::Controller
+#endif
     unsigned m_cached_tiles = 0;
+    QVariantMap m_tile_telemetry;
     unsigned m_queued_tiles = 0;
     unsigned m_in_flight_tiles = 0;
     unsigned int m_selected_camera_position_index = 0;
@@ -0,0 +1,231 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "GeometryArena.h"
+
+#include <cassert>
+
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLVertexArrayObject>
+
+#include "nucleus/tile_scheduler/tile_types.h"
+
+using gl_engine::GeometryArena;
+namespace mesh_format = nucleus::tile_scheduler::tile_types::mesh_format;
+
+namespace {
+std::unique_ptr<QOpenGLBuffer> make_buffer(QOpenGLBuffer::Type type, size_t n_bytes)
+{
+    auto buffer = std::make_unique<QOpenGLBuffer>(type);
+    buffer->create();
+    buffer->bind();
+    buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    buffer->allocate(int(n_bytes));
+    return buffer;
+}
+
+// a larger buffer with the contents of the old one.
+std::unique_ptr<QOpenGLBuffer> grow_buffer(const QOpenGLBuffer& old_buffer, size_t old_n_bytes, size_t n_bytes)
+{
+    auto* f = QOpenGLContext::currentContext()->extraFunctions();
+    auto buffer = make_buffer(old_buffer.type(), n_bytes);
+    f->glBindBuffer(GL_COPY_READ_BUFFER, old_buffer.bufferId());
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->bufferId());
+    f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(old_n_bytes));
+    f->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return buffer;
+}
+} // namespace
+
+bool GeometryArena::Allocation::empty() const
+{
+    return n_vertices == 0 || n_index_bytes == 0;
+}
+
+size_t GeometryArena::Allocation::n_bytes() const
+{
+    return n_vertices * (mesh_format::position_size + mesh_format::uv_size) + n_index_bytes;
+}
+
+GeometryArena::GeometryArena() = default;
+GeometryArena::~GeometryArena() = default;
+
+void GeometryArena::init(size_t n_vertices, size_t n_index_bytes)
+{
+    auto* context = QOpenGLContext::currentContext();
+    assert(context);
+#ifdef __EMSCRIPTEN__
+    m_draw_elements_base_vertex = nullptr; // webgl 2 has no base vertex draws
+#else
+    const auto resolve = [context](const char* name) { return reinterpret_cast<DrawElementsBaseVertex>(context->getProcAddress(name)); };
+    if (context->format().version() >= qMakePair(3, 2))
+        m_draw_elements_base_vertex = resolve("glDrawElementsBaseVertex");
+    else if (context->hasExtension("GL_EXT_draw_elements_base_vertex"))
+        m_draw_elements_base_vertex = resolve("glDrawElementsBaseVertexEXT");
+    else if (context->hasExtension("GL_OES_draw_elements_base_vertex"))
+        m_draw_elements_base_vertex = resolve("glDrawElementsBaseVertexOES");
+    else if (context->hasExtension("GL_ARB_draw_elements_base_vertex"))
+        m_draw_elements_base_vertex = resolve("glDrawElementsBaseVertex");
+    else
+        m_draw_elements_base_vertex = nullptr;
+#endif
+
+    m_vao = std::make_unique<QOpenGLVertexArrayObject>();
+    m_vao->create();
+    m_vao->bind();
+    m_positions = make_buffer(QOpenGLBuffer::VertexBuffer, n_vertices * mesh_format::position_size);
+    m_uvs = make_buffer(QOpenGLBuffer::VertexBuffer, n_vertices * mesh_format::uv_size);
+    m_indices = make_buffer(QOpenGLBuffer::IndexBuffer, n_index_bytes); // vao state
+    m_vao->release();
+    m_vertex_allocator = nucleus::utils::RangeAllocator(n_vertices);
+    m_index_allocator = nucleus::utils::RangeAllocator(n_index_bytes);
+}
+
+void GeometryArena::set_attribute_locations(int positions, int uvs)
+{
+    m_position_location = positions;
+    m_uv_location = uvs;
+    m_vao->bind();
+    connect_attributes(0);
+    m_vao->release();
+}
+
+GeometryArena::Allocation GeometryArena::add(const QByteArray& indices, const QByteArray& positions, const QByteArray& uvs)
+{
+    Allocation allocation;
+    allocation.n_vertices = size_t(positions.size()) / mesh_format::position_size;
+    allocation.n_index_bytes = size_t(indices.size());
+    if (allocation.empty())
+        return {}; // e.g., tiles that weren't found or couldn't be decoded
+    assert(size_t(uvs.size()) / mesh_format::uv_size == allocation.n_vertices);
+    const auto index_size = mesh_format::index_size(allocation.n_vertices);
+    allocation.n_indices = int(allocation.n_index_bytes / index_size);
+    allocation.index_type = index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    auto first_vertex = m_vertex_allocator.allocate(allocation.n_vertices);
+    if (!first_vertex) {
+        grow_vertex_buffers(std::max(2 * m_vertex_allocator.capacity(), m_vertex_allocator.capacity() + allocation.n_vertices));
+        first_vertex = m_vertex_allocator.allocate(allocation.n_vertices);
+    }
+    auto index_offset = m_index_allocator.allocate(allocation.n_index_bytes, index_size);
+    if (!index_offset) {
+        grow_index_buffer(std::max(2 * m_index_allocator.capacity(), m_index_allocator.capacity() + allocation.n_index_bytes + index_size));
+        index_offset = m_index_allocator.allocate(allocation.n_index_bytes, index_size);
+    }
+    assert(first_vertex && index_offset);
+    allocation.first_vertex = *first_vertex;
+    allocation.index_offset = *index_offset;
+
+    m_positions->bind();
+    m_positions->write(int(allocation.first_vertex * mesh_format::position_size), positions.constData(), int(positions.size()));
+    m_uvs->bind();
+    m_uvs->write(int(allocation.first_vertex * mesh_format::uv_size), uvs.constData(), int(uvs.size()));
+    m_uvs->release();
+    m_vao->bind(); // the index buffer binding is vao state
+    m_indices->bind();
+    m_indices->write(int(allocation.index_offset), indices.constData(), int(indices.size()));
+    m_vao->release();
+    return allocation;
+}
+
+void GeometryArena::remove(const Allocation& allocation)
+{
+    if (allocation.empty())
+        return;
+    m_vertex_allocator.free(allocation.first_vertex, allocation.n_vertices);
+    m_index_allocator.free(allocation.index_offset, allocation.n_index_bytes);
+}
+
+void GeometryArena::bind() const
+{
+    m_vao->bind();
+}
+
+void GeometryArena::release() const
+{
+    m_vao->release();
+}
+
+void GeometryArena::draw(const Allocation& allocation) const
+{
+    if (allocation.empty())
+        return;
+    const auto* indices = reinterpret_cast<const void*>(allocation.index_offset);
+    if (m_draw_elements_base_vertex) {
+        m_draw_elements_base_vertex(GL_TRIANGLES, allocation.n_indices, allocation.index_type, indices, GLint(allocation.first_vertex));
+        return;
+    }
+    auto* f = QOpenGLContext::currentContext()->extraFunctions();
+    connect_attributes(allocation.first_vertex);
+    f->glDrawElements(GL_TRIANGLES, allocation.n_indices, allocation.index_type, indices);
+}
+
+size_t GeometryArena::n_bytes() const
+{
+    return m_vertex_allocator.capacity() * (mesh_format::position_size + mesh_format::uv_size) + m_index_allocator.capacity();
+}
+
+size_t GeometryArena::n_used_bytes() const
+{
+    return m_vertex_allocator.n_allocated() * (mesh_format::position_size + mesh_format::uv_size) + m_index_allocator.n_allocated();
+}
+
+bool GeometryArena::uses_base_vertex() const
+{
+    return m_draw_elements_base_vertex != nullptr;
+}
+
+void GeometryArena::connect_attributes(size_t first_vertex) const
+{
+    if (m_position_location == -1 || m_uv_location == -1)
+        return;
+    auto* f = QOpenGLContext::currentContext()->extraFunctions();
+    m_positions->bind();
+    f->glEnableVertexAttribArray(GLuint(m_position_location));
+    f->glVertexAttribPointer(GLuint(m_position_location), /*size*/ 3, /*type*/ GL_UNSIGNED_SHORT, /*normalised*/ GL_TRUE, /*stride*/ mesh_format::position_size,
+        reinterpret_cast<const void*>(first_vertex * mesh_format::position_size));
+    m_uvs->bind();
+    f->glEnableVertexAttribArray(GLuint(m_uv_location));
+    f->glVertexAttribPointer(GLuint(m_uv_location), /*size*/ 2, /*type*/ GL_UNSIGNED_SHORT, /*normalised*/ GL_TRUE, /*stride*/ mesh_format::uv_size,
+        reinterpret_cast<const void*>(first_vertex * mesh_format::uv_size));
+    m_uvs->release();
+}
+
+void GeometryArena::grow_vertex_buffers(size_t n_vertices)
+{
+    const auto old_n_vertices = m_vertex_allocator.capacity();
+    m_positions = grow_buffer(*m_positions, old_n_vertices * mesh_format::position_size, n_vertices * mesh_format::position_size);
+    m_uvs = grow_buffer(*m_uvs, old_n_vertices * mesh_format::uv_size, n_vertices * mesh_format::uv_size);
+    m_vertex_allocator.grow(n_vertices);
+    // the attribute pointers still point to the old buffers
+    m_vao->bind();
+    connect_attributes(0);
+    m_vao->release();
+}
+
+void GeometryArena::grow_index_buffer(size_t n_bytes)
+{
+    m_vao->bind();
+    m_indices = grow_buffer(*m_indices, m_index_allocator.capacity(), n_bytes);
+    m_indices->bind();
+    m_vao->release();
+    m_index_allocator.grow(n_bytes);
+}
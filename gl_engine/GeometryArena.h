@@ -0,0 +1,92 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <memory>
+
+#include <QByteArray>
+#include <qopengl.h>
+
+#include "nucleus/utils/RangeAllocator.h"
+
+class QOpenGLBuffer;
+class QOpenGLVertexArrayObject;
+
+namespace gl_engine {
+
+/// Vertex and index buffers shared by all tiles. Tile meshes are sub allocated from a few large buffers (positions, uvs and indices) instead of
+/// creating and destroying buffers per tile, and everything is drawn through one vao: with a base vertex where available (OpenGL (ES) 3.2, or
+/// GLES 3.0 / 3.1 with GL_EXT_draw_elements_base_vertex or GL_OES_draw_elements_base_vertex), otherwise the attribute pointers are moved to the
+/// first vertex of the tile before its draw call (WebGL). The buffers grow by doubling, they don't shrink.
+class GeometryArena {
+public:
+    static constexpr size_t initial_n_vertices = size_t(1) << 18;
+    static constexpr size_t initial_n_index_bytes = size_t(4) << 20;
+
+    struct Allocation {
+        size_t first_vertex = 0;
+        size_t n_vertices = 0;
+        size_t index_offset = 0; // bytes
+        size_t n_index_bytes = 0;
+        int n_indices = 0;
+        unsigned index_type = 0; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        /// nothing was allocated, remove and draw do nothing.
+        [[nodiscard]] bool empty() const;
+        [[nodiscard]] size_t n_bytes() const;
+    };
+
+    GeometryArena();
+    ~GeometryArena();
+    /// needs an OpenGL context.
+    void init(size_t n_vertices = initial_n_vertices, size_t n_index_bytes = initial_n_index_bytes);
+    /// of the tile shader, (re)connects the vertex attributes.
+    void set_attribute_locations(int positions, int uvs);
+
+    /// positions and uvs in tile_types::mesh_format, the index size depends on the number of vertices. empty meshes get an empty allocation.
+    [[nodiscard]] Allocation add(const QByteArray& indices, const QByteArray& positions, const QByteArray& uvs);
+    void remove(const Allocation& allocation);
+
+    void bind() const;
+    void release() const;
+    /// between bind and release.
+    void draw(const Allocation& allocation) const;
+
+    /// allocated on the gpu, used or not.
+    [[nodiscard]] size_t n_bytes() const;
+    [[nodiscard]] size_t n_used_bytes() const;
+    [[nodiscard]] bool uses_base_vertex() const;
+
+private:
+    void connect_attributes(size_t first_vertex) const;
+    void grow_vertex_buffers(size_t n_vertices);
+    void grow_index_buffer(size_t n_bytes);
+
+    std::unique_ptr<QOpenGLVertexArrayObject> m_vao;
+    std::unique_ptr<QOpenGLBuffer> m_positions;
+    std::unique_ptr<QOpenGLBuffer> m_uvs;
+    std::unique_ptr<QOpenGLBuffer> m_indices;
+    nucleus::utils::RangeAllocator m_vertex_allocator; // in vertices, the same range for positions and uvs
+    nucleus::utils::RangeAllocator m_index_allocator; // in bytes
+    int m_position_location = -1;
+    int m_uv_location = -1;
+    using DrawElementsBaseVertex = void(QOPENGLF_APIENTRYP)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint base_vertex);
+    DrawElementsBaseVertex m_draw_elements_base_vertex = nullptr; // core, ext or oes variant, nullptr if there is none
+};
+
+} // namespace gl_engine
@@ -18,7 +18,10 @@
  *****************************************************************************/
 #include "TileManager.h"
 
+#include <optional>
+
 #include <QOpenGLBuffer>
+#include <QOpenGLContext>
 #include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
@@ -26,12 +29,38 @@
 
 #include "ShaderProgram.h"
 #include "nucleus/camera/Definition.h"
+#include "nucleus/tile_scheduler/Telemetry.h"
+#include "nucleus/tile_scheduler/utils.h"
 #include "nucleus/utils/terrain_mesh_index_generator.h"
 
 using gl_engine::TileManager;
 using gl_engine::TileSet;
 
 namespace {
+// total and available vram in bytes. the extensions report kib.
+std::optional<std::pair<size_t, size_t>> query_gpu_memory()
+{
+    constexpr GLenum GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+    constexpr GLenum GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+    constexpr GLenum TEXTURE_FREE_MEMORY_ATI = 0x87FC;
+    auto* context = QOpenGLContext::currentContext();
+    auto* f = context->functions();
+    if (context->hasExtension("GL_NVX_gpu_memory_info")) {
+        GLint total = 0;
+        GLint available = 0;
+        f->glGetIntegerv(GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+        f->glGetIntegerv(GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+        return std::make_pair(size_t(total) * 1024, size_t(available) * 1024);
+    }
+    if (context->hasExtension("GL_ATI_meminfo")) {
+        // free texture memory, largest free block, free auxiliary memory, largest auxiliary block. there is no total.
+        std::array<GLint, 4> info = {};
+        f->glGetIntegerv(TEXTURE_FREE_MEMORY_ATI, info.data());
+        return std::make_pair(size_t(0), size_t(info[0]) * 1024);
+    }
+    return {};
+}
+
 template <typename T>
 int bufferLengthInBytes(const std::vector<T>& vec)
 {
@@ -99,11 +128,12 @@ void TileManager::init()
     }
     auto* f = QOpenGLContext::currentContext()->extraFunctions();
     f->glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &m_max_anisotropy);
+    m_geometry.init();
 }
 
 const std::vector<TileSet>& TileManager::tiles() const
 {
-    return m_gpu_tiles;
+    return m_gpu_tiles.values();
 }
 
 bool compareTileSetPair(std::pair<float, const TileSet*> t1, std::pair<float, const TileSet*> t2)
@@ -119,7 +149,6 @@ void TileManager::draw(ShaderProgram* shader_program, const nucleus::camera::Def
                        const nucleus::tile_scheduler::DrawListGenerator::TileSet draw_tiles,
                        bool sort_tiles, glm::dvec3 sort_position) const
 {
-    QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
     // shader_program->set_uniform("n_edge_vertices", N_EDGE_VERTICES);
     shader_program->set_uniform("texture_sampler", 1);
     // shader_program->set_uniform("height_sampler", 1);
@@ -141,32 +170,38 @@ void TileManager::draw(ShaderProgram* shader_program, const nucleus::camera::Def
     }
     if (sort_tiles) std::sort(tile_list.begin(), tile_list.end(), compareTileSetPair);
 
+    m_geometry.bind();
     for (const auto& tileset : tile_list) {
         // qDebug() << "Drawing tileset:";
         // for (auto& tile : tileset.second->tiles) {
         //     qDebug() << "    TILE " << tile.first.zoom_level << "/" << tile.first.coords[0] << "/" << tile.first.coords[1];
         // }
-        tileset.second->vao->bind();
         shader_program->set_uniform_array("bounds", boundsArray(*tileset.second, camera.position())); // Kept this, so that I dont get a "unused param" error
         shader_program->set_uniform("tileset_id", (int)((tileset.second->tiles[0].first.coords[0] + tileset.second->tiles[0].first.coords[1])));
         shader_program->set_uniform("tileset_zoomlevel", tileset.second->tiles[0].first.zoom_level);
+        // the origin is made camera relative in double precision, the quantised positions are only scaled and moved on the gpu.
+        shader_program->set_uniform("tile_origin_cws", glm::vec3(tileset.second->position_offset - camera.position()));
+        shader_program->set_uniform("tile_scale", tileset.second->position_scale);
         tileset.second->texture->bind(1);
-        f->glDrawElements(GL_TRIANGLES, tileset.second->gl_element_count, tileset.second->gl_index_type, nullptr);
+        m_geometry.draw(tileset.second->geometry);
     }
-    f->glBindVertexArray(0);
+    m_geometry.release();
 }
 
 void TileManager::remove_tile(const tile::Id& tile_id)
 {
     if (!QOpenGLContext::currentContext()) // can happen during shutdown.
         return;
-    // clear slot
-    // or remove from list and free resources
-    const auto found_tile = std::find_if(m_gpu_tiles.begin(), m_gpu_tiles.end(), [&tile_id](const TileSet& tileset) {
-        return tileset.tiles.front().first == tile_id;
-    });
-    if (found_tile != m_gpu_tiles.end())
-        m_gpu_tiles.erase(found_tile);
+    const auto found_key = m_gpu_tile_keys.find(tile_id);
+    if (found_key != m_gpu_tile_keys.end()) {
+        const auto* tileset = m_gpu_tiles.find(found_key->second);
+        assert(tileset);
+        m_gpu_bytes -= tileset->n_bytes;
+        m_geometry.remove(tileset->geometry);
+        m_gpu_tiles.erase(found_key->second);
+        m_gpu_tile_keys.erase(found_key);
+        nucleus::tile_scheduler::Telemetry::instance().set(nucleus::tile_scheduler::Telemetry::Gauge::GpuBytes, m_gpu_bytes);
+    }
     m_draw_list_generator.remove_tile(tile_id);
 
     emit tiles_changed();
@@ -176,6 +211,7 @@ void TileManager::initilise_attribute_locations(ShaderProgram* program)
 {
     m_attribute_locations.vertices = program->attribute_location("in_pos");
     m_attribute_locations.uvs = program->attribute_location("in_uv");
+    m_geometry.set_attribute_locations(m_attribute_locations.vertices, m_attribute_locations.uvs);
 }
 
 void TileManager::set_aabb_decorator(const nucleus::tile_scheduler::utils::AabbDecoratorPtr& new_aabb_decorator)
@@ -183,67 +219,69 @@ void TileManager::set_aabb_decorator(const nucleus::tile_scheduler::utils::AabbD
     m_draw_list_generator.set_aabb_decorator(new_aabb_decorator);
 }
 
-void TileManager::add_tile(const tile::Id& id, tile::SrsAndHeightBounds bounds, std::shared_ptr<QByteArray> indices, std::shared_ptr<QByteArray> positions,
-    std::shared_ptr<QByteArray> uvs, std::shared_ptr<QImage> texture)
+size_t TileManager::add_tile(const tile::Id& id, tile::SrsAndHeightBounds bounds, std::shared_ptr<QByteArray> indices, std::shared_ptr<QByteArray> positions,
+    std::shared_ptr<QByteArray> uvs, std::shared_ptr<const nucleus::tile_scheduler::tile_types::GpuTexture> texture, const glm::dvec3& position_offset,
+    const glm::vec3& position_scale)
 {
+    using namespace nucleus::tile_scheduler::tile_types;
+    using nucleus::tile_scheduler::Telemetry;
     if (!QOpenGLContext::currentContext()) // can happen during shutdown.
-        return;
+        return 0;
+    const Telemetry::ScopedTiming timing(Telemetry::Timing::GpuUpload);
 
     // qDebug() << "Add tile " << id.zoom_level << "/" << id.coords[0] << "/" << id.coords[1];
 
     assert(m_attribute_locations.vertices != -1);
     assert(m_attribute_locations.uvs != -1);
-    auto* f = QOpenGLContext::currentContext()->extraFunctions();
     // need to call GLWindow::makeCurrent, when calling through signals?
-    // find an empty slot => todo, for now just create a new tile every time.
-    // setup / copy data to gpu
+    if (m_gpu_tile_keys.contains(id))
+        remove_tile(id);
     TileSet tileset;
     tileset.tiles.emplace_back(id, tile::SrsBounds(bounds));
-    tileset.vao = std::make_unique<QOpenGLVertexArrayObject>();
-    tileset.vao->create();
-    tileset.vao->bind();
-    { // vao state
-        tileset.index_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::IndexBuffer);
-        tileset.index_buffer->create();
-        tileset.index_buffer->bind();
-        tileset.index_buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
-        tileset.index_buffer->allocate(indices->data(), indices->size());
-
-        tileset.gl_element_count = indices->size();
-        tileset.gl_index_type = GL_UNSIGNED_INT;
-
-        tileset.vertex_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
-        tileset.vertex_buffer->create();
-        tileset.vertex_buffer->bind();
-        tileset.vertex_buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
-        tileset.vertex_buffer->allocate(positions->data(), positions->size());
-
-        f->glEnableVertexAttribArray(GLuint(m_attribute_locations.vertices));
-        f->glVertexAttribPointer(
-            GLuint(m_attribute_locations.vertices), /*size*/ 3, /*type*/ GL_FLOAT, /*normalised*/ GL_FALSE, /*stride*/ 3 * sizeof(float), nullptr);
-
-        tileset.uv_buffer = std::make_unique<QOpenGLBuffer>(QOpenGLBuffer::VertexBuffer);
-        tileset.uv_buffer->create();
-        tileset.uv_buffer->bind();
-        tileset.uv_buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
-        tileset.uv_buffer->allocate(uvs->data(), uvs->size());
-
-        f->glEnableVertexAttribArray(GLuint(m_attribute_locations.uvs));
-        f->glVertexAttribPointer(
-            GLuint(m_attribute_locations.uvs), /*size*/ 2, /*type*/ GL_FLOAT, /*normalised*/ GL_FALSE, /*stride*/ 2 * sizeof(float), nullptr);
+    tileset.position_offset = position_offset;
+    tileset.position_scale = position_scale;
+    tileset.geometry = m_geometry.add(*indices, *positions, *uvs);
+
+    // the mip chain was built (and possibly block compressed) by the scheduler, we only upload it.
+    using nucleus::utils::texture_compression::Algorithm;
+    assert(!texture->levels.empty());
+    tileset.texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2D);
+    switch (texture->format) {
+    case Algorithm::Uncompressed_RGBA:
+        tileset.texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+        break;
+    case Algorithm::ETC1:
+        tileset.texture->setFormat(QOpenGLTexture::RGB8_ETC2); // etc1 is a subset of etc2
+        break;
+    case Algorithm::DXT1:
+        tileset.texture->setFormat(QOpenGLTexture::RGB_DXT1);
+        break;
+    }
+    tileset.texture->setSize(int(texture->width), int(texture->height));
+    tileset.texture->setMipLevels(int(texture->levels.size()));
+    tileset.texture->allocateStorage();
+    for (size_t level = 0; level < texture->levels.size(); ++level) {
+        const auto& data = texture->levels[level];
+        if (texture->format == Algorithm::Uncompressed_RGBA)
+            tileset.texture->setData(int(level), QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, data.constData());
+        else
+            tileset.texture->setCompressedData(int(level), int(data.size()), data.constData());
     }
-    tileset.vao->release();
-    tileset.texture = std::make_unique<QOpenGLTexture>(*texture);
     tileset.texture->setMaximumAnisotropy(m_max_anisotropy);
+    tileset.n_bytes = tileset.geometry.n_bytes();
+    for (const auto& level : texture->levels)
+        tileset.n_bytes += size_t(level.size());
+    m_gpu_bytes += tileset.n_bytes;
+    Telemetry::instance().set(Telemetry::Gauge::GpuBytes, m_gpu_bytes);
     tileset.texture->setWrapMode(QOpenGLTexture::WrapMode::ClampToEdge);
     tileset.texture->setMinMagFilters(QOpenGLTexture::Filter::LinearMipMapLinear, QOpenGLTexture::Filter::Linear);
-    tileset.texture->generateMipMaps();
 
-    // add to m_gpu_tiles
-    m_gpu_tiles.push_back(std::move(tileset));
-    m_draw_list_generator.add_tile(id);
+    const auto n_bytes = tileset.n_bytes;
+    m_gpu_tile_keys[id] = m_gpu_tiles.insert(std::move(tileset));
+    m_draw_list_generator.add_tile(id, bounds);
 
     emit tiles_changed();
+    return n_bytes;
 }
 
 void TileManager::set_permissible_screen_space_error(float new_permissible_screen_space_error)
@@ -254,6 +292,7 @@ void TileManager::set_permissible_screen_space_error(float new_permissible_scree
 void TileManager::update_gpu_quads(const std::vector<nucleus::tile_scheduler::tile_types::GpuTileQuad>& new_quads, const std::vector<tile::Id>& deleted_quads)
 {
     for (const auto& quad : new_quads) {
+        size_t n_bytes = 0;
         for (const auto& tile : quad.tiles) {
             // test for validity
             assert(tile.id.zoom_level < 100);
@@ -261,12 +300,23 @@ void TileManager::update_gpu_quads(const std::vector<nucleus::tile_scheduler::ti
             assert(tile.positions);
             assert(tile.uvs);
             assert(tile.texture);
-            add_tile(tile.id, tile.bounds, tile.indices, tile.positions, tile.uvs, tile.texture);
+            n_bytes += add_tile(tile.id, tile.bounds, tile.indices, tile.positions, tile.uvs, tile.texture, tile.position_offset, tile.position_scale);
         }
+        emit quad_uploaded(quad.id, n_bytes);
     }
     for (const auto& quad : deleted_quads) {
         for (const auto& id : quad.children()) {
             remove_tile(id);
         }
     }
+
+    const auto now = nucleus::tile_scheduler::utils::time_since_epoch();
+    if (QOpenGLContext::currentContext() && now - m_last_gpu_memory_query >= 1000) {
+        m_last_gpu_memory_query = now;
+        if (const auto memory = query_gpu_memory()) {
+            // ati doesn't report the total, the tiles we hold plus what is free is the part we can compete for.
+            const auto total = memory->first > 0 ? memory->first : memory->second + m_gpu_bytes;
+            emit gpu_memory_info_updated(total, memory->second);
+        }
+    }
 }
@@ -20,14 +20,17 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 
 #include <QObject>
 
 #include <nucleus/tile_scheduler/tile_types.h>
 
+#include "gl_engine/GeometryArena.h"
 #include "gl_engine/TileSet.h"
 #include "nucleus/Tile.h"
 #include "nucleus/tile_scheduler/DrawListGenerator.h"
+#include "nucleus/utils/SlotMap.h"
 
 namespace camera {
 class Definition;
@@ -54,6 +57,10 @@ public:
 
 signals:
     void tiles_changed();
+    /// the vram allocated for the buffers and textures of a quad, after it was uploaded.
+    void quad_uploaded(const tile::Id& quad_id, size_t n_bytes);
+    /// queried at most once a second after uploads, if GL_NVX_gpu_memory_info or GL_ATI_meminfo is available.
+    void gpu_memory_info_updated(size_t total, size_t available);
 
 public slots:
     void update_gpu_quads(const std::vector<nucleus::tile_scheduler::tile_types::GpuTileQuad>& new_quads, const std::vector<tile::Id>& deleted_quads);
@@ -62,8 +69,10 @@ public slots:
     void set_aabb_decorator(const nucleus::tile_scheduler::utils::AabbDecoratorPtr& new_aabb_decorator);
 
 private:
-    void add_tile(const tile::Id& id, tile::SrsAndHeightBounds bounds, std::shared_ptr<QByteArray> indices, std::shared_ptr<QByteArray> positions,
-        std::shared_ptr<QByteArray> uvs, std::shared_ptr<QImage> texture);
+    /// returns the allocated bytes.
+    size_t add_tile(const tile::Id& id, tile::SrsAndHeightBounds bounds, std::shared_ptr<QByteArray> indices, std::shared_ptr<QByteArray> positions,
+        std::shared_ptr<QByteArray> uvs, std::shared_ptr<const nucleus::tile_scheduler::tile_types::GpuTexture> texture, const glm::dvec3& position_offset,
+        const glm::vec3& position_scale);
     struct TileGLAttributeLocations {
         int vertices = -1;
         int uvs = -1;
@@ -73,7 +82,9 @@ private:
     static constexpr auto MAX_TILES_PER_TILESET = 1;
     float m_max_anisotropy = 0;
 
-    std::vector<TileSet> m_gpu_tiles;
+    GeometryArena m_geometry;
+    nucleus::utils::SlotMap<TileSet> m_gpu_tiles;
+    std::unordered_map<tile::Id, nucleus::utils::SlotMap<TileSet>::Key, tile::Id::Hasher> m_gpu_tile_keys;
     // indexbuffers for 4^index tiles,
     // e.g., for single tile tile sets take index 0
     //       for 4 tiles take index 1, for 16 2..
@@ -81,6 +92,8 @@ private:
     std::vector<std::pair<std::unique_ptr<QOpenGLBuffer>, size_t>> m_index_buffers;
     TileGLAttributeLocations m_attribute_locations;
     unsigned m_tiles_per_set = 1;
+    size_t m_gpu_bytes = 0;
+    uint64_t m_last_gpu_memory_query = 0;
     nucleus::tile_scheduler::DrawListGenerator m_draw_list_generator;
     const nucleus::tile_scheduler::DrawListGenerator::TileSet m_last_draw_list; // buffer last generated draw list
 };
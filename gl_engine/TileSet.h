@@ -22,12 +22,12 @@
 #include <memory>
 #include <vector>
 
-#include <QOpenGLBuffer>
 #include <QOpenGLTexture>
-#include <QOpenGLVertexArrayObject>
 
 #include "radix/tile.h"
 
+#include "GeometryArena.h"
+
 // we want to be flexible and have the ability to draw several tiles at once.
 // GpuTileSets can have an arbitrary number of slots, each slot is an index in the corresponding
 // vao buffers and textures.
@@ -43,14 +43,12 @@ struct TileSet {
         }
         [[nodiscard]] bool isValid() const { return tile_id.zoom_level < 100; }
     };
-    std::unique_ptr<QOpenGLBuffer> index_buffer; // uvec3
-    std::unique_ptr<QOpenGLBuffer> vertex_buffer; // dvec3
-    std::unique_ptr<QOpenGLBuffer> uv_buffer; // dvec2
+    GeometryArena::Allocation geometry; // positions relative to position_offset and position_scale
     std::unique_ptr<QOpenGLTexture> texture;
-    std::unique_ptr<QOpenGLVertexArrayObject> vao;
     std::vector<std::pair<tile::Id, tile::SrsBounds>> tiles;
-    int gl_element_count = -1;
-    unsigned gl_index_type = 0;
+    glm::dvec3 position_offset = {};
+    glm::vec3 position_scale = {};
+    size_t n_bytes = 0; // geometry and texture
     // texture
 };
 }
@@ -79,6 +79,8 @@
      : m_camera({ 1822577.0, 6141664.0 - 500, 171.28 + 500 }, { 1822577.0, 6141664.0, 171.28 }) // should point right at the stephansdom
  {
      m_tile_manager = std::make_unique<TileManager>();
+     connect(m_tile_manager.get(), &TileManager::quad_uploaded, this, &AbstractRenderWindow::gpu_quad_uploaded);
+     connect(m_tile_manager.get(), &TileManager::gpu_memory_info_updated, this, &AbstractRenderWindow::gpu_memory_info_updated);
      m_map_label_manager = std::make_unique<MapLabelManager>();
      QTimer::singleShot(1, [this]() { emit update_requested(); });
 }
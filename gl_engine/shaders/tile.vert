@@ -29,6 +29,8 @@ layout(location = 1) in highp vec2 in_uv;
 // uniform highp int n_edge_vertices;
 uniform highp int tileset_id;
 uniform highp int tileset_zoomlevel;
+uniform highp vec3 tile_origin_cws;
+uniform highp vec3 tile_scale;
 // uniform highp sampler2D height_sampler;
 
 out highp vec2 uv;
@@ -129,10 +131,9 @@ void main() {
 //         var_normal = normal_by_finite_difference_method(uv, edge_vertices_count_float, tile_width, tile_height, altitude_correction_factor);
 //     }
 
-    // Our positions are in WS,
-    // since we need to transform to Clip Space with a local view matrix, we need to manually transform
-    // the positions to camera relative positions
-    var_pos_cws = in_pos - camera.position.xyz;
+    // Our positions are unorm16, quantised to the tile aabb. the tile origin is already camera relative (computed in double on the cpu),
+    // so we only need to scale and move them to get camera relative positions for the local view matrix
+    var_pos_cws = tile_origin_cws + in_pos * tile_scale;
     uv = in_uv;
     gl_Position = camera.view_proj_matrix * vec4(var_pos_cws, 1);
 
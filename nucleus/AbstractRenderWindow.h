@@ -65,6 +65,10 @@ signals:
     void key_released(const QKeyCombination&) const;
     void gpu_ready_changed(bool ready);
     void update_camera_requested() const;
+    /// vram allocated for a quad, see Scheduler::update_gpu_quad_size.
+    void gpu_quad_uploaded(const tile::Id& quad_id, size_t n_bytes);
+    /// from gl memory info extensions, if available. see tile_scheduler::MemoryGovernor.
+    void gpu_memory_info_updated(size_t total, size_t available);
 };
 
 }
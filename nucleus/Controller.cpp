@@ -29,10 +29,12 @@
 #include "AbstractRenderWindow.h"
 #include "nucleus/camera/Controller.h"
 #include "nucleus/camera/PositionStorage.h"
+#include "nucleus/tile_scheduler/MemoryGovernor.h"
 #include "nucleus/tile_scheduler/QuadAssembler.h"
 #include "nucleus/tile_scheduler/RateLimiter.h"
 #include "nucleus/tile_scheduler/Scheduler.h"
 #include "nucleus/tile_scheduler/SlotLimiter.h"
+#include "nucleus/tile_scheduler/TileArchiveService.h"
 #include "nucleus/tile_scheduler/TileLoadService.h"
 #include "nucleus/tile_scheduler/utils.h"
 #include "radix/TileHeights.h"
@@ -49,11 +51,30 @@ Controller::Controller(AbstractRenderWindow* render_window)
     qRegisterMetaType<nucleus::event_parameter::Wheel>();
 
     m_gltf_terrain_service = std::make_unique<TileLoadService>("http://localhost/", TileLoadService::UrlPattern::ZYX_yPointingSouth, ".simplified.glb");
+    // servers that serve whole quads as one bundle (see quad_bundle.h) are opted into by their file ending, e.g. ".quad".
+    if (const auto bundle_ending = qEnvironmentVariable("ALP_QUAD_BUNDLE_FILE_ENDING"); !bundle_ending.isEmpty())
+        m_gltf_terrain_service->set_quad_bundle_file_ending(bundle_ending);
+    // offline installs and benchmarks serve the tiles from a local archive instead (see TileArchive).
+    if (const auto archive_path = qEnvironmentVariable("ALP_TILE_ARCHIVE"); !archive_path.isEmpty()) {
+        m_tile_archive_service = std::make_unique<TileArchiveService>(archive_path.toStdString());
+        if (!m_tile_archive_service->is_open())
+            m_tile_archive_service.reset();
+    }
 
     m_tile_scheduler = std::make_unique<nucleus::tile_scheduler::Scheduler>();
+#ifdef __ANDROID__
+    // etc2 is guaranteed on gles3, block compression cuts the texture memory by 8x on our low memory devices. astc isn't used, not all
+    // gles3 devices have it and encoding it on the cpu is much slower (see texture_compression.h).
+    m_tile_scheduler->set_texture_compression(nucleus::utils::texture_compression::Algorithm::ETC1);
+#endif
     m_tile_scheduler->read_disk_cache();
-    m_tile_scheduler->set_gpu_quad_limit(500);
-    m_tile_scheduler->set_ram_quad_limit(12000);
+#ifdef __ANDROID__
+    m_tile_scheduler->set_gpu_budget(256);
+    m_tile_scheduler->set_ram_budget(512);
+#else
+    m_tile_scheduler->set_gpu_budget(1024);
+    m_tile_scheduler->set_ram_budget(2048);
+#endif
     {
         QFile file(":/map/height_data.atb");
         const auto open = file.open(QIODeviceBase::OpenModeFlag::ReadOnly);
@@ -72,19 +93,48 @@ Controller::Controller(AbstractRenderWindow* render_window)
         SlotLimiter* sl = new SlotLimiter(sch);
         RateLimiter* rl = new RateLimiter(sch);
         QuadAssembler* qa = new QuadAssembler(sch);
-        GLTFReader* gltf_reader = new GLTFReader();
+        GLTFReader* gltf_reader = new GLTFReader(sch);
 
         connect(sch, &Scheduler::quads_requested, sl, &SlotLimiter::request_quads);
         connect(sl, &SlotLimiter::quad_requested, rl, &RateLimiter::request_quad);
         connect(rl, &RateLimiter::quad_requested, qa, &QuadAssembler::load);
 
-        connect(qa, &QuadAssembler::tile_requested, m_gltf_terrain_service.get(), &TileLoadService::load);
-        connect(m_gltf_terrain_service.get(), &TileLoadService::load_finished, gltf_reader, &GLTFReader::deliver_tile);
+        if (m_tile_archive_service) {
+            connect(qa, &QuadAssembler::quad_requested, m_tile_archive_service.get(), &TileArchiveService::load_quad);
+            connect(m_tile_archive_service.get(), &TileArchiveService::load_finished, gltf_reader, &GLTFReader::deliver_tile);
+        } else {
+            // load_quad falls back to tile requests unless ALP_QUAD_BUNDLE_FILE_ENDING is set (and the server supports it).
+            connect(qa, &QuadAssembler::quad_requested, m_gltf_terrain_service.get(), &TileLoadService::load_quad);
+            connect(m_gltf_terrain_service.get(), &TileLoadService::load_finished, gltf_reader, &GLTFReader::deliver_tile);
+            connect(sl, &SlotLimiter::quad_cancelled, m_gltf_terrain_service.get(), &TileLoadService::cancel_quad);
+            // the right limit differs wildly between a lan tile server, mobile networks and the public cdn.
+            sl->set_limit_mode(SlotLimiter::LimitMode::Adaptive);
+        }
+        connect(sl, &SlotLimiter::quad_cancelled, rl, &RateLimiter::cancel_quad);
+        connect(sl, &SlotLimiter::quad_cancelled, qa, &QuadAssembler::cancel);
         connect(gltf_reader, &GLTFReader::tile_read, qa, &QuadAssembler::deliver_tile);
 
         connect(qa, &QuadAssembler::quad_loaded, sl, &SlotLimiter::deliver_quad);
         connect(sl, &SlotLimiter::quad_delivered, sch, &Scheduler::receive_quad);
     }
+    {
+        // the budgets set above are the upper limits, the governor lowers them when memory gets scarce.
+        m_memory_governor = new MemoryGovernor(std::make_unique<SystemMemorySource>(), m_tile_scheduler.get());
+        auto settings = m_memory_governor->settings();
+        settings.max_ram_budget = m_tile_scheduler->ram_budget();
+        settings.max_gpu_budget = m_tile_scheduler->gpu_budget();
+        m_memory_governor->set_settings(settings);
+        auto* sch = m_tile_scheduler.get();
+        connect(m_memory_governor, &MemoryGovernor::ram_budget_changed, sch, &Scheduler::set_ram_budget);
+        connect(m_memory_governor, &MemoryGovernor::gpu_budget_changed, sch, &Scheduler::set_gpu_budget);
+        connect(m_memory_governor, &MemoryGovernor::pressure_rising, sch, &Scheduler::purge_ram_cache);
+        connect(m_memory_governor, &MemoryGovernor::pressure_rising, sch, &Scheduler::update_gpu_quads);
+        connect(sch, &Scheduler::statistics_updated, m_memory_governor, [governor = m_memory_governor](const Scheduler::Statistics& stats) {
+            governor->update_cache_usage(stats.n_bytes_in_ram_cache, stats.n_bytes_in_gpu_cache);
+        });
+        connect(m_render_window, &AbstractRenderWindow::gpu_memory_info_updated, m_memory_governor, &MemoryGovernor::update_gpu_memory);
+        m_memory_governor->set_update_interval(1000);
+    }
     if (QNetworkInformation::loadDefaultBackend() && QNetworkInformation::instance()) {
         QNetworkInformation* n = QNetworkInformation::instance();
         m_tile_scheduler->set_network_reachability(n->reachability());
@@ -100,6 +150,8 @@ Controller::Controller(AbstractRenderWindow* render_window)
 #else
     m_gltf_terrain_service->moveToThread(m_scheduler_thread.get());
 #endif
+    if (m_tile_archive_service)
+        m_tile_archive_service->moveToThread(m_scheduler_thread.get());
     m_tile_scheduler->moveToThread(m_scheduler_thread.get());
     m_scheduler_thread->start();
 #endif
@@ -113,10 +165,12 @@ Controller::Controller(AbstractRenderWindow* render_window)
     // At the time of writing, an additional connection from tile_ready and tile_expired to the notifier is made.
     // this only works if ALP_ENABLE_THREADING is on, i.e., the tile scheduler is on an extra thread. -> potential issue on webassembly
     connect(m_camera_controller.get(), &nucleus::camera::Controller::definition_changed, m_tile_scheduler.get(), &Scheduler::update_camera);
+    connect(m_camera_controller.get(), &nucleus::camera::Controller::predicted_definitions_changed, m_tile_scheduler.get(), &Scheduler::update_prefetch_cameras);
     connect(m_camera_controller.get(), &nucleus::camera::Controller::definition_changed, m_render_window, &AbstractRenderWindow::update_camera);
 
     connect(m_tile_scheduler.get(), &Scheduler::gpu_quads_updated, m_render_window, &AbstractRenderWindow::update_gpu_quads);
     connect(m_tile_scheduler.get(), &Scheduler::gpu_quads_updated, m_render_window, &AbstractRenderWindow::update_requested);
+    connect(m_render_window, &AbstractRenderWindow::gpu_quad_uploaded, m_tile_scheduler.get(), &Scheduler::update_gpu_quad_size);
 
     m_camera_controller->update();
 }
@@ -138,4 +192,9 @@ Scheduler* Controller::tile_scheduler() const
 {
     return m_tile_scheduler.get();
 }
+
+MemoryGovernor* Controller::memory_governor() const
+{
+    return m_memory_governor;
+}
 }
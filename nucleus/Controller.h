@@ -27,7 +27,9 @@ class AbstractRenderWindow;
 class DataQuerier;
 namespace tile_scheduler {
 class TileLoadService;
+class TileArchiveService;
 class Scheduler;
+class MemoryGovernor;
 }
 namespace camera {
 class Controller;
@@ -43,6 +45,9 @@ public:
 
     tile_scheduler::Scheduler* tile_scheduler() const;
 
+    /// lives on the scheduler thread.
+    tile_scheduler::MemoryGovernor* memory_governor() const;
+
 private:
     AbstractRenderWindow* m_render_window;
     QNetworkAccessManager m_network_manager;
@@ -51,8 +56,10 @@ private:
 #endif
     std::unique_ptr<tile_scheduler::TileLoadService> m_terrain_service;
     std::unique_ptr<tile_scheduler::TileLoadService> m_gltf_terrain_service;
+    std::unique_ptr<tile_scheduler::TileArchiveService> m_tile_archive_service;
     std::unique_ptr<tile_scheduler::TileLoadService> m_ortho_service;
     std::unique_ptr<tile_scheduler::Scheduler> m_tile_scheduler;
+    tile_scheduler::MemoryGovernor* m_memory_governor = nullptr; // owned by m_tile_scheduler
     std::unique_ptr<DataQuerier> m_data_querier;
     std::unique_ptr<camera::Controller> m_camera_controller;
 };
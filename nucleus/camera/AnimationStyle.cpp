@@ -34,3 +34,8 @@ std::optional<float> AnimationStyle::operation_centre_distance(Definition)
 {
     return {};
 }
+
+std::vector<Definition> AnimationStyle::predicted_path(Definition) const
+{
+    return {};
+}
@@ -19,6 +19,7 @@
 #pragma once
 
 #include <optional>
+#include <vector>
 
 #include "Definition.h"
 
@@ -32,6 +33,8 @@ public:
     virtual std::optional<Definition> update(Definition camera, AbstractDepthTester* depth_tester);
     virtual std::optional<glm::vec2> operation_centre();
     virtual std::optional<float> operation_centre_distance(Definition camera);
+    /// cameras the animation will pass through, ending with the final one. used for prefetching tiles.
+    virtual std::vector<Definition> predicted_path(Definition camera) const;
 };
 
 } // namespace nucleus::camera
@@ -108,9 +108,46 @@ void Controller::orbit(const glm::dvec3& centre, const glm::dvec2& degrees)
     update();
 }
 
-void Controller::update() const
+void Controller::update()
 {
+    update_velocity();
     emit definition_changed(m_definition);
+    auto predicted = predicted_definitions();
+    if (predicted.empty() && !m_prediction_emitted)
+        return;
+    m_prediction_emitted = !predicted.empty();
+    emit predicted_definitions_changed(predicted);
+}
+
+void Controller::update_velocity()
+{
+    // updates come in with the frame rate, longer pauses mean that the camera stood still in between.
+    constexpr auto max_frame_time = 0.5;
+    constexpr auto smoothing = 0.3;
+    const auto now = std::chrono::steady_clock::now();
+    const auto dt = std::chrono::duration<double>(now - m_last_frame_time).count();
+    const auto position = m_definition.position();
+    if (m_animation_style || dt > max_frame_time) {
+        m_velocity = {};
+    } else if (dt > 0.001) {
+        m_velocity = glm::mix(m_velocity, (position - m_last_position) / dt, smoothing);
+    }
+    m_last_position = position;
+    m_last_frame_time = now;
+}
+
+std::vector<Definition> Controller::predicted_definitions() const
+{
+    constexpr auto horizon = 1.0; // seconds
+    constexpr auto min_distance = 1.0; // metres
+    if (m_animation_style)
+        return m_animation_style->predicted_path(m_definition);
+    const auto movement = m_velocity * horizon;
+    if (glm::length(movement) < min_distance)
+        return {};
+    auto predicted = m_definition;
+    predicted.move(movement);
+    return { predicted };
 }
 
 void Controller::mouse_press(const event_parameter::Mouse& e)
@@ -50,6 +50,8 @@ public:
     [[nodiscard]] const Definition& definition() const;
     std::optional<glm::vec2> operation_centre();
     std::optional<float> operation_centre_distance();
+    /// where the camera is going to be: the path of the running animation, or the current camera moved by its recent velocity.
+    [[nodiscard]] std::vector<Definition> predicted_definitions() const;
 
 	void report_global_cursor_position(const QPointF& screen_pos);
 
@@ -62,7 +64,7 @@ public slots:
     void set_field_of_view(float fov_degrees);
     void move(const glm::dvec3& v);
     void orbit(const glm::dvec3& centre, const glm::dvec2& degrees);
-    void update() const;
+    void update();
 
     void mouse_press(const event_parameter::Mouse&);
     void mouse_move(const event_parameter::Mouse&);
@@ -74,9 +76,12 @@ public slots:
 
 signals:
     void definition_changed(const Definition& new_definition) const;
+    /// emitted with definition_changed, unless both the old and new prediction are empty.
+    void predicted_definitions_changed(const std::vector<Definition>& predicted_definitions) const;
     void global_cursor_position_changed(glm::dvec3 pos) const;
 
 private:
+    void update_velocity();
     void set_interaction_style(std::unique_ptr<InteractionStyle> new_style);
     void set_animation_style(std::unique_ptr<InteractionStyle> new_style);
 
@@ -86,6 +91,9 @@ private:
     std::unique_ptr<InteractionStyle> m_interaction_style;
     std::unique_ptr<AnimationStyle> m_animation_style;
     std::chrono::steady_clock::time_point m_last_frame_time;
+    glm::dvec3 m_last_position = {};
+    glm::dvec3 m_velocity = {}; // metres per second, smoothed
+    bool m_prediction_emitted = false;
 };
 
 }
@@ -20,6 +20,8 @@
 #include "LinearCameraAnimation.h"
 #include "AbstractDepthTester.h"
 
+#include <algorithm>
+
 #include <QDebug>
 
 namespace nucleus::camera {
@@ -54,6 +56,21 @@ std::optional<Definition> LinearCameraAnimation::update(Definition camera, Abstr
     return camera;
 }
 
+std::vector<Definition> LinearCameraAnimation::predicted_path(Definition camera) const
+{
+    // the half way point covers the area flown over at a lower altitude than the start, when going far.
+    std::vector<Definition> path;
+    const auto t_now = ease_in_out(std::min(m_current_duration / float(m_total_duration), 1.f));
+    for (const auto t : { 0.5f, 1.f }) {
+        const auto mix_factor = ease_in_out(t);
+        if (mix_factor <= t_now)
+            continue;
+        camera.set_camera_space_to_world_matrix(m_start * double(1 - mix_factor) + m_end * double(mix_factor));
+        path.push_back(camera);
+    }
+    return path;
+}
+
 float LinearCameraAnimation::ease_in_out(float t)
 {
     // this one is untested, but works for now
@@ -35,8 +35,9 @@ class LinearCameraAnimation : public AnimationStyle
 public:
     LinearCameraAnimation(Definition start, Definition end);
     std::optional<Definition> update(Definition camera, AbstractDepthTester* depth_tester) override;
+    std::vector<Definition> predicted_path(Definition camera) const override;
 
 private:
-    float ease_in_out(float t);
+    static float ease_in_out(float t);
 };
 }
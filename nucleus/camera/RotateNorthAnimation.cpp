@@ -69,6 +69,16 @@ std::optional<glm::vec2> RotateNorthAnimation::operation_centre()
     return m_operation_centre_screen;
 }
 
+std::vector<Definition> RotateNorthAnimation::predicted_path(Definition camera) const
+{
+    if (m_current_duration >= m_total_duration)
+        return {};
+    const auto remaining = 1 - ease_in_out(float(m_current_duration) / float(m_total_duration));
+    const auto sign = camera.z_axis().x > 0 ? -1.f : 1.f;
+    camera.orbit(m_operation_centre, glm::vec2(sign * m_degrees_from_north * remaining, 0));
+    return { camera };
+}
+
 float RotateNorthAnimation::ease_in_out(float t)
 {
     const float p = 0.3f;
@@ -34,8 +34,9 @@ public:
     RotateNorthAnimation(Definition camera, AbstractDepthTester* depth_tester);
     std::optional<Definition> update(Definition camera, AbstractDepthTester* depth_tester) override;
     std::optional<glm::vec2> operation_centre() override;
+    std::vector<Definition> predicted_path(Definition camera) const override;
 private:
-    float ease_in_out(float t);
+    static float ease_in_out(float t);
     glm::vec2 m_operation_centre_screen = {};
 };
 }
@@ -19,10 +19,16 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
+#include <tuple>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <QFile>
@@ -30,6 +36,10 @@
 #include <tl/expected.hpp>
 #include <zpp_bits.h>
 
+#include "CacheSnapshot.h"
+#include "EvictionPolicy.h"
+#include "FlatQuadTree.h"
+#include "PackStore.h"
 #include "radix/tile.h"
 #include "tile_types.h"
 #include "utils.h"
@@ -48,11 +58,29 @@ constexpr auto serialize(auto & archive, glm::vec<2, T> & vec)
     return archive(vec.x, vec.y);
 }
 
+template<typename T>
+constexpr auto serialize(auto & archive, const glm::vec<3, T> & vec)
+{
+    return archive(vec.x, vec.y, vec.z);
+}
+
+template<typename T>
+constexpr auto serialize(auto & archive, glm::vec<3, T> & vec)
+{
+    return archive(vec.x, vec.y, vec.z);
+}
+
 }
 
 namespace nucleus::tile_scheduler {
 
 /// This class is thread safe. be careful with the visit method as it writes the cache and therefore locks an internal mutex.
+/// Tiles can also be on disk only: read_index_from_disk reads only the index, payloads come in with load_from_disk.
+/// Those tiles are not visible to contains, peak_at and visit, but they are kept on disk by write_to_disk and ranked by purge.
+/// Changes are tracked in a dirty set, write_to_disk writes only those and can run on another thread than the one changing the cache.
+/// Tiles in ram are stored in a FlatQuadTree, so visit walks indices in one arena instead of hashing every node.
+/// purge_bytes ranks by an EvictionPolicy, tiles that are already on disk are only dropped from ram there (they become disk only).
+/// Every change of the tiles in ram publishes a new CacheSnapshot, readers on other threads use snapshot() and never wait for the cache lock.
 template<tile_types::NamedTile T>
 class Cache
 {
@@ -63,40 +91,98 @@ class Cache
 
     struct CacheObject {
         MetaData meta;
+        size_t n_bytes = 0;
+        bool persisted = false; // on disk in this version
         T data;
     };
 
-    std::unordered_map<tile::Id, CacheObject, tile::Id::Hasher> m_data;
+    struct DiskOnlyObject {
+        MetaData meta;
+        size_t n_bytes = 0; // size on disk
+    };
+
+    FlatQuadTree<CacheObject> m_data;
+    std::unordered_map<tile::Id, DiskOnlyObject, tile::Id::Hasher> m_disk_only; // protected by m_data_mutex
+    std::unordered_set<tile::Id, tile::Id::Hasher> m_dirty; // protected by m_data_mutex, only used for serialisable tiles
+    size_t m_n_bytes = 0; // protected by m_data_mutex
+    size_t m_n_disk_only_bytes = 0; // protected by m_data_mutex
     mutable std::shared_mutex m_data_mutex;
-    std::unordered_map<tile::Id, MetaData, tile::Id::Hasher> m_disk_cached;
+    PackStore m_disk_cached;
     mutable std::shared_mutex m_disk_cached_mutex;
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::atomic<std::shared_ptr<const CacheSnapshot<T>>> m_snapshot = std::make_shared<const CacheSnapshot<T>>();
+#else
+    // the android libc++ doesn't have std::atomic<std::shared_ptr>, only use std::atomic_load and std::atomic_store.
+    std::shared_ptr<const CacheSnapshot<T>> m_snapshot = std::make_shared<const CacheSnapshot<T>>();
+#endif
 
 public:
+    /// bytes appended to the disk cache between two commits (fsyncs) in write_to_disk.
+    static constexpr size_t default_write_batch_size = 8u * 1024 * 1024;
+
     Cache() = default;
     void insert(const T& tile);
     [[nodiscard]] bool contains(const tile::Id& id) const;
     [[nodiscard]] unsigned n_cached_objects() const;
+    [[nodiscard]] bool is_on_disk_only(const tile::Id& id) const;
+    [[nodiscard]] unsigned n_disk_only_objects() const;
+    /// most recently visited first, i.e., the reverse of the purge order.
+    [[nodiscard]] std::vector<tile::Id> disk_only_ids() const;
+    /// inserted, visited or purged since the last write_to_disk.
+    [[nodiscard]] unsigned n_dirty_objects() const;
+    /// bytes of the objects in ram, as reported by T::n_bytes() (0 for tiles without) or set_n_bytes.
+    [[nodiscard]] size_t n_bytes() const;
+    [[nodiscard]] size_t n_disk_only_bytes() const;
+    /// overrides the size taken from T::n_bytes() on insertion, e.g., once the actual size is known.
+    void set_n_bytes(const tile::Id& id, size_t n_bytes);
     /// functor should return true, if the given tile should be marked visited. stops descending if false is returned. don't do heavy lifting in the functort, as it blocks all other access!
     template<typename VisitorFunction>
     void visit(const VisitorFunction& functor);
     const T& peak_at(const tile::Id& id) const;
+    /// the tiles in ram as of the last change. doesn't lock, the snapshot stays valid and unchanged as long as it is held.
+    [[nodiscard]] std::shared_ptr<const CacheSnapshot<T>> snapshot() const;
     std::vector<T> purge(unsigned remaining_capacity);
-
-    [[nodiscard]] tl::expected<void, std::string> write_to_disk(const std::filesystem::path& path);
+    /// keeps the objects in ram with the highest retention value that fit into remaining_bytes, plus the pinned ones. returns the others,
+    /// those that are on disk already stay there as disk only objects.
+    std::vector<T> purge_bytes(size_t remaining_bytes, const EvictionPolicy& policy = LruEvictionPolicy());
+    /// the same for the objects on disk only, counted with their size on disk.
+    void purge_disk_only_bytes(size_t remaining_bytes, const EvictionPolicy& policy = LruEvictionPolicy());
+
+    /// writes the dirty set, or reconciles everything if the disk cache at path isn't open yet. the disk cache is locked only for one
+    /// batch of max_batch_size bytes at a time, each batch ends with a commit. on failure the disk cache is closed.
+    [[nodiscard]] tl::expected<void, std::string> write_to_disk(const std::filesystem::path& path, size_t max_batch_size = default_write_batch_size);
+    /// reads the index and all payloads.
     [[nodiscard]] tl::expected<void, std::string> read_from_disk(const std::filesystem::path& path);
+    /// reads only the index, all tiles are on disk only afterwards. the time doesn't depend on the payload size.
+    [[nodiscard]] tl::expected<void, std::string> read_index_from_disk(const std::filesystem::path& path);
+    /// moves the given tiles from disk into ram. ids that are not on disk only are skipped. tiles that fail to load, or that are missing in
+    /// the disk cache, are dropped.
+    [[nodiscard]] tl::expected<void, std::string> load_from_disk(const std::vector<tile::Id>& ids);
+    /// closes the disk cache, removes its files and forgets the tiles on disk only. the tiles in ram are written again by the next write_to_disk.
+    void clear_disk(const std::filesystem::path& path);
 
 private:
-    template<typename VisitorFunction>
-    void visit(const tile::Id& start_node,
-               const VisitorFunction& functor,
-               uint64_t visited_stamp); // must stay private or protected by mutex
-
-    static std::filesystem::path tile_path(const std::filesystem::path& base_path, const tile::Id& id)
+    [[nodiscard]] tl::expected<void, std::string> open_disk_cache(const std::filesystem::path& path); // must be protected by m_disk_cached_mutex
+
+    // must be protected by m_data_mutex
+    void mark_dirty(const tile::Id& id);
+    bool erase_disk_only(const tile::Id& id);
+    void clear();
+    void publish(const std::vector<typename CacheSnapshot<T>::Change>& changes);
+    std::vector<T> purge_sorted(std::vector<std::pair<tile::Id, uint64_t>>::iterator begin, std::vector<std::pair<tile::Id, uint64_t>>::iterator end);
+    /// candidates ordered by the policy, the first n_kept are kept.
+    static std::pair<std::vector<EvictionCandidate>, size_t> rank(std::vector<EvictionCandidate> candidates, size_t remaining_bytes, const EvictionPolicy& policy);
+
+    static size_t n_bytes_of(const T& tile)
     {
-        return base_path / fmt::format("{}_{}_{}.alp_tile", id.zoom_level, id.coords.x, id.coords.y);
+        if constexpr (requires { tile.n_bytes(); })
+            return tile.n_bytes();
+        else
+            return 0;
     }
 
-    static std::filesystem::path meta_info_path(const std::filesystem::path& base_path)
+    /// the format before the pack store, one file per tile.
+    static std::filesystem::path legacy_meta_info_path(const std::filesystem::path& base_path)
     {
         return base_path / "meta_info.alp";
     }
@@ -109,9 +195,17 @@ void Cache<T>::insert(const T& tile)
 {
     auto locker = std::scoped_lock(m_data_mutex);
     const auto time_stamp = utils::time_since_epoch();
-    m_data[tile.id].meta.visited = time_stamp * 100 - tile.id.zoom_level;
-    m_data[tile.id].meta.created = time_stamp;
-    m_data[tile.id].data = tile;
+    erase_disk_only(tile.id);
+    mark_dirty(tile.id);
+    auto& object = m_data[tile.id];
+    object.meta.visited = time_stamp * 100 - tile.id.zoom_level;
+    object.meta.created = time_stamp;
+    object.data = tile;
+    object.persisted = false;
+    m_n_bytes -= object.n_bytes;
+    object.n_bytes = n_bytes_of(tile);
+    m_n_bytes += object.n_bytes;
+    publish({ { tile.id, std::make_shared<const T>(tile) } });
 }
 
 template <tile_types::NamedTile T>
@@ -129,238 +223,502 @@ unsigned int Cache<T>::n_cached_objects() const
 }
 
 template <tile_types::NamedTile T>
-const T& Cache<T>::peak_at(const tile::Id& id) const
+bool Cache<T>::is_on_disk_only(const tile::Id& id) const
 {
     auto locker = std::shared_lock(m_data_mutex);
-    return m_data.at(id).data;
+    return m_disk_only.contains(id);
 }
 
 template <tile_types::NamedTile T>
-tl::expected<void, std::string> Cache<T>::write_to_disk(const std::filesystem::path& base_path)
+unsigned Cache<T>::n_disk_only_objects() const
 {
-    static_assert(tile_types::SerialisableTile<T>);
-    std::filesystem::create_directories(base_path);
-    std::unordered_map<tile::Id, CacheObject, tile::Id::Hasher> data;
+    auto locker = std::shared_lock(m_data_mutex);
+    return unsigned(m_disk_only.size());
+}
+
+template <tile_types::NamedTile T>
+std::vector<tile::Id> Cache<T>::disk_only_ids() const
+{
+    std::vector<std::pair<tile::Id, uint64_t>> tiles;
     {
-        auto locker = std::scoped_lock(m_data_mutex);
-        data = m_data; // copies only metadata and references to tiles
+        auto locker = std::shared_lock(m_data_mutex);
+        tiles.reserve(m_disk_only.size());
+        for (const auto& [id, object] : m_disk_only)
+            tiles.emplace_back(id, object.meta.visited);
     }
-    auto locker = std::scoped_lock(m_disk_cached_mutex);
-
-    const auto write = [](const auto& bytes, const auto& path) -> tl::expected<void, std::string> {
-        QFile file(path);
-        const auto success = file.open(QIODeviceBase::WriteOnly);
-        if (!success)
-            return tl::unexpected<std::string>(
-                fmt::format("Couldn't open file '{}' for writing!", path.string()));
-        file.write(bytes.data(), qint64(bytes.size()));
-        return {};
-    };
+    std::sort(tiles.begin(), tiles.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    std::vector<tile::Id> ids;
+    ids.reserve(tiles.size());
+    std::transform(tiles.cbegin(), tiles.cend(), std::back_inserter(ids), [](const auto& v) { return v.first; });
+    return ids;
+}
 
-    std::unordered_map<tile::Id, MetaData, tile::Id::Hasher> disk_cached_old;
-    std::swap(m_disk_cached, disk_cached_old);
-    m_disk_cached.reserve(data.size());
+template <tile_types::NamedTile T>
+unsigned Cache<T>::n_dirty_objects() const
+{
+    auto locker = std::shared_lock(m_data_mutex);
+    return unsigned(m_dirty.size());
+}
 
-    // removing disk cache items, that were removed or updated in ram
-    for (const auto& item : disk_cached_old) {
-        const tile::Id& id = item.first;
-        const MetaData& meta = item.second;
-        if (data.contains(id) && data.at(id).meta.created == meta.created) {
-            continue;
-        }
-        std::filesystem::remove(tile_path(base_path, id));
-    }
+template <tile_types::NamedTile T>
+size_t Cache<T>::n_bytes() const
+{
+    auto locker = std::shared_lock(m_data_mutex);
+    return m_n_bytes;
+}
 
-        // write new or updated items to disk
-        for (const auto& item : data) {
-            const tile::Id& id = item.first;
-            const CacheObject& cache_object = item.second;
-            m_disk_cached[id] = cache_object.meta;
+template <tile_types::NamedTile T>
+size_t Cache<T>::n_disk_only_bytes() const
+{
+    auto locker = std::shared_lock(m_data_mutex);
+    return m_n_disk_only_bytes;
+}
 
-            if (disk_cached_old.contains(id) && disk_cached_old.at(id).created == cache_object.meta.created)
-                continue;
+template <tile_types::NamedTile T>
+void Cache<T>::set_n_bytes(const tile::Id& id, size_t n_bytes)
+{
+    auto locker = std::scoped_lock(m_data_mutex);
+    auto* object = m_data.find(id);
+    if (!object)
+        return;
+    m_n_bytes = m_n_bytes - object->n_bytes + n_bytes;
+    object->n_bytes = n_bytes;
+}
 
-            std::vector<char> bytes;
-            zpp::bits::out out(bytes);
-            const std::remove_cvref_t<decltype(T::version_information)> version = T::version_information;
-            {
-                const auto r = out(version);
-                if (failure(r))
-                    return tl::unexpected(std::make_error_code(r).message());
-            }
-            {
-                const auto r = out(cache_object.data);
-                if (failure(r))
-                    return tl::unexpected(std::make_error_code(r).message());
-            }
-            {
-                const auto r = write(bytes, tile_path(base_path, id));
-                if (!r.has_value())
-                    return r;
-            }
-        }
+template <tile_types::NamedTile T>
+void Cache<T>::mark_dirty(const tile::Id& id)
+{
+    if constexpr (tile_types::SerialisableTile<T>)
+        m_dirty.insert(id);
+}
 
-        std::vector<char> bytes;
-        zpp::bits::out out(bytes);
-        const std::remove_cvref_t<decltype(T::version_information)> version = T::version_information;
-        {
-            const auto r = out(version);
-            if (failure(r))
-                return tl::unexpected(std::make_error_code(r).message());
-        }
+template <tile_types::NamedTile T>
+bool Cache<T>::erase_disk_only(const tile::Id& id)
+{
+    const auto iter = m_disk_only.find(id);
+    if (iter == m_disk_only.end())
+        return false;
+    m_n_disk_only_bytes -= iter->second.n_bytes;
+    m_disk_only.erase(iter);
+    return true;
+}
 
-        {
-            const auto r = out(m_disk_cached);
-            if (failure(r))
-                return tl::unexpected(std::make_error_code(r).message());
-        }
+template <tile_types::NamedTile T>
+void Cache<T>::clear()
+{
+    m_data.clear();
+    m_disk_only.clear();
+    m_dirty.clear();
+    m_n_bytes = 0;
+    m_n_disk_only_bytes = 0;
+#if defined(__cpp_lib_atomic_shared_ptr)
+    m_snapshot.store(m_snapshot.load()->cleared());
+#else
+    std::atomic_store(&m_snapshot, std::atomic_load(&m_snapshot)->cleared());
+#endif
+}
+
+template <tile_types::NamedTile T>
+void Cache<T>::publish(const std::vector<typename CacheSnapshot<T>::Change>& changes)
+{
+    if (changes.empty())
+        return;
+    // writers are serialised by m_data_mutex, so nothing is published in between.
+#if defined(__cpp_lib_atomic_shared_ptr)
+    m_snapshot.store(m_snapshot.load()->with(changes));
+#else
+    std::atomic_store(&m_snapshot, std::atomic_load(&m_snapshot)->with(changes));
+#endif
+}
 
-        const auto r = write(bytes, meta_info_path(base_path));
-        if (!r.has_value())
-            return r;
+template <tile_types::NamedTile T>
+std::shared_ptr<const CacheSnapshot<T>> Cache<T>::snapshot() const
+{
+#if defined(__cpp_lib_atomic_shared_ptr)
+    return m_snapshot.load();
+#else
+    return std::atomic_load(&m_snapshot);
+#endif
+}
 
-        return {};
+template <tile_types::NamedTile T>
+const T& Cache<T>::peak_at(const tile::Id& id) const
+{
+    auto locker = std::shared_lock(m_data_mutex);
+    return m_data.at(id).data;
 }
 
 template <tile_types::NamedTile T>
-tl::expected<void, std::string> Cache<T>::read_from_disk(const std::filesystem::path& base_path)
+tl::expected<void, std::string> Cache<T>::open_disk_cache(const std::filesystem::path& path)
 {
-    auto locker = std::scoped_lock(m_data_mutex, m_disk_cached_mutex);
-    assert(tile_types::SerialisableTile<T>);
-    const auto check_version = [](auto* in, const auto& path) -> tl::expected<void, std::string> {
-        std::remove_cvref_t<decltype(T::version_information)> version_info = {};
-        {
-            const auto r = (*in)(version_info);
-            if (failure(r))
-                return tl::unexpected(std::make_error_code(r).message());
-        }
-        if (version_info != T::version_information) {
-            version_info[version_info.size() - 1] = 0;  // make sure that the string is 0 terminated.
-
-            return tl::unexpected(fmt::format("Cache file '{}' has incompatible version! Disk "
-                                              "version is '{}', but we expected '{}'.",
-                path.string(),
-                version_info.data(),
-                T::version_information.data()));
-        }
+    if (m_disk_cached.is_open() && m_disk_cached.directory() == path)
         return {};
-    };
-    const auto read_all = [](const auto& path) -> tl::expected<QByteArray, std::string> {
-        QFile file(path);
-        const auto success = file.open(QIODeviceBase::ReadOnly);
-        if (!success)
-            return tl::unexpected(fmt::format("Couldn't open file '{}' for reading!", path.string()));
-        return file.readAll();
-    };
-    const auto clean_up = [&]() {
-        m_disk_cached.clear();
-        m_data.clear();
-    };
+    if (std::filesystem::exists(legacy_meta_info_path(path)))
+        return tl::unexpected(fmt::format("Disk cache '{}' uses the old one file per tile format.", path.string()));
+    return m_disk_cached.open(path, QByteArrayView(T::version_information.data(), qsizetype(T::version_information.size())));
+}
 
-    clean_up();
-    {
-        const auto path = meta_info_path(base_path);
-        const auto bytes = read_all(path);
-        if (!bytes.has_value()) {
-            clean_up();
-            return tl::unexpected(bytes.error());
-        }
-        zpp::bits::in in(bytes.value());
+template <tile_types::NamedTile T>
+tl::expected<void, std::string> Cache<T>::write_to_disk(const std::filesystem::path& base_path, size_t max_batch_size)
+{
+    static_assert(tile_types::SerialisableTile<T>);
+    const auto write = [&]() -> tl::expected<void, std::string> {
+        std::vector<tile::Id> dirty;
         {
-            const auto r = check_version(&in, path);
-            if (!r.has_value()) {
-                clean_up();
+            auto locker = std::scoped_lock(m_disk_cached_mutex);
+            const auto reconcile = !m_disk_cached.is_open() || m_disk_cached.directory() != base_path;
+            if (const auto r = open_disk_cache(base_path); !r.has_value())
                 return r;
+            auto data_locker = std::scoped_lock(m_data_mutex);
+            if (reconcile) {
+                for (const auto& [id, entry] : m_disk_cached.entries())
+                    m_dirty.insert(id);
+                m_data.for_each([this](const tile::Id& id, const CacheObject&) { m_dirty.insert(id); });
             }
+            dirty.assign(m_dirty.cbegin(), m_dirty.cend());
+            m_dirty.clear();
         }
-        {
-            const auto r = in(m_disk_cached);
-            if (failure(r)) {
-                clean_up();
-                return tl::unexpected(std::make_error_code(r).message());
+
+        std::vector<char> bytes;
+        std::vector<std::pair<tile::Id, uint64_t>> persisted; // id, created
+        auto next = dirty.cbegin();
+        while (next != dirty.cend()) {
+            auto locker = std::scoped_lock(m_disk_cached_mutex);
+            size_t batch_size = 0;
+            persisted.clear();
+            for (; next != dirty.cend() && batch_size < max_batch_size; ++next) {
+                const auto& id = *next;
+                std::optional<CacheObject> cache_object;
+                std::optional<MetaData> disk_only;
+                {
+                    auto data_locker = std::shared_lock(m_data_mutex);
+                    if (const auto* object = m_data.find(id))
+                        cache_object = *object; // copies only metadata and references to tiles
+                    if (const auto iter = m_disk_only.find(id); iter != m_disk_only.end())
+                        disk_only = iter->second.meta;
+                }
+                const auto entry = m_disk_cached.entries().find(id);
+                const auto on_disk = entry != m_disk_cached.entries().end();
+                if (!cache_object.has_value()) {
+                    // purged, or only dropped from ram
+                    if (on_disk && !disk_only)
+                        m_disk_cached.remove(id);
+                    if (on_disk && disk_only && entry->second.meta.visited != disk_only->visited)
+                        m_disk_cached.update_meta(id, { disk_only->visited, disk_only->created });
+                    continue;
+                }
+                const auto meta = PackStore::Meta { cache_object->meta.visited, cache_object->meta.created };
+                persisted.emplace_back(id, meta.created);
+                if (on_disk && entry->second.meta.created == meta.created) {
+                    if (entry->second.meta.visited != meta.visited)
+                        m_disk_cached.update_meta(id, meta);
+                    continue;
+                }
+                bytes.clear();
+                zpp::bits::out out(bytes);
+                if (const auto r = out(cache_object->data); failure(r))
+                    return tl::unexpected(std::make_error_code(r).message());
+                if (const auto r = m_disk_cached.put(id, QByteArrayView(bytes.data(), qsizetype(bytes.size())), meta); !r.has_value())
+                    return r;
+                batch_size += bytes.size();
+            }
+            if (const auto r = m_disk_cached.commit(); !r.has_value())
+                return r;
+            auto data_locker = std::scoped_lock(m_data_mutex);
+            for (const auto& [id, created] : persisted) {
+                // unless it was replaced in the mean time
+                if (auto* object = m_data.find(id); object && object->meta.created == created)
+                    object->persisted = true;
             }
         }
+        // in batches as well, loads from the disk cache take the same lock.
+        for (;;) {
+            auto locker = std::scoped_lock(m_disk_cached_mutex);
+            const auto r = m_disk_cached.compact_step(0.5f, max_batch_size);
+            if (!r.has_value())
+                return tl::unexpected(r.error());
+            if (!*r)
+                return {};
+        }
+    };
+
+    const auto r = write();
+    if (!r.has_value()) {
+        // the dirty set is gone, the next write reconciles everything.
+        auto locker = std::scoped_lock(m_disk_cached_mutex);
+        m_disk_cached.close();
+        auto data_locker = std::scoped_lock(m_data_mutex);
+        m_data.for_each([](const tile::Id&, CacheObject& cache_object) { cache_object.persisted = false; });
+    }
+    return r;
+}
+
+template <tile_types::NamedTile T>
+tl::expected<void, std::string> Cache<T>::read_from_disk(const std::filesystem::path& base_path)
+{
+    if (const auto r = read_index_from_disk(base_path); !r.has_value())
+        return r;
+    if (const auto r = load_from_disk(disk_only_ids()); !r.has_value()) {
+        auto locker = std::scoped_lock(m_data_mutex, m_disk_cached_mutex);
+        m_disk_cached.close();
+        clear();
+        return r;
+    }
+    return {};
+}
+
+template <tile_types::NamedTile T>
+tl::expected<void, std::string> Cache<T>::read_index_from_disk(const std::filesystem::path& base_path)
+{
+    auto locker = std::scoped_lock(m_data_mutex, m_disk_cached_mutex);
+    assert(tile_types::SerialisableTile<T>);
+    m_disk_cached.close();
+    clear();
+    if (const auto r = open_disk_cache(base_path); !r.has_value()) {
+        m_disk_cached.close();
+        return r;
     }
+    m_disk_only.reserve(m_disk_cached.entries().size());
+    for (const auto& [id, entry] : m_disk_cached.entries()) {
+        m_disk_only[id] = { { entry.meta.visited, entry.meta.created }, size_t(entry.size) };
+        m_n_disk_only_bytes += size_t(entry.size);
+    }
+    return {};
+}
 
-    for (const auto& entry : m_disk_cached) {
-        const tile::Id& id = entry.first;
-        const MetaData& meta = entry.second;
+template <tile_types::NamedTile T>
+tl::expected<void, std::string> Cache<T>::load_from_disk(const std::vector<tile::Id>& ids)
+{
+    std::vector<tile::Id> wanted;
+    {
+        auto locker = std::shared_lock(m_data_mutex);
+        std::copy_if(ids.cbegin(), ids.cend(), std::back_inserter(wanted), [this](const auto& id) { return m_disk_only.contains(id); });
+    }
+    if (wanted.empty())
+        return {};
 
-        const auto path = tile_path(base_path, id);
-        const auto bytes = read_all(path);
-        if (!bytes.has_value()) {
-            clean_up();
-            return tl::unexpected(bytes.error());
+    std::vector<CacheObject> loaded;
+    std::vector<tile::Id> failed;
+    std::vector<tile::Id> missing;
+    std::string error;
+    {
+        auto locker = std::scoped_lock(m_disk_cached_mutex);
+        std::vector<std::pair<tile::Id, PackStore::Entry>> entries;
+        entries.reserve(wanted.size());
+        for (const auto& id : wanted) {
+            // it might have been purged and removed from disk in the mean time (then erase_disk_only does nothing),
+            // or the disk cache was closed or replaced.
+            if (const auto entry = m_disk_cached.entries().find(id); entry != m_disk_cached.entries().end())
+                entries.emplace_back(id, entry->second);
+            else
+                missing.push_back(id);
         }
-        zpp::bits::in in(bytes.value());
-        {
-            const auto r = check_version(&in, path);
-            if (!r.has_value()) {
-                clean_up();
-                return r;
+        // in file order, that is mostly sequential reading.
+        std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+            return std::tie(a.second.segment, a.second.offset) < std::tie(b.second.segment, b.second.offset);
+        });
+        loaded.reserve(entries.size());
+        for (const auto& [id, entry] : entries) {
+            const auto bytes = m_disk_cached.read(id);
+            if (!bytes.has_value()) {
+                failed.push_back(id);
+                error = bytes.error();
+                continue;
             }
-        }
-
-        CacheObject d;
-        {
-            const auto r = in(d.data);
-            if (failure(r)) {
-                clean_up();
-                return tl::unexpected(std::make_error_code(r).message());
+            zpp::bits::in in(bytes.value());
+            CacheObject d;
+            if (const auto r = in(d.data); failure(r) || d.data.id != id) {
+                failed.push_back(id);
+                error = failure(r) ? std::make_error_code(r).message() : fmt::format("Disk cache entry {}/{}/{} contains a different tile.", id.zoom_level, id.coords.x, id.coords.y);
+                continue;
             }
+            d.meta = { entry.meta.visited, entry.meta.created };
+            d.n_bytes = n_bytes_of(d.data);
+            d.persisted = true;
+            loaded.push_back(std::move(d));
         }
-        d.meta = meta;
-        m_data[d.data.id] = d;
     }
 
+    auto locker = std::scoped_lock(m_data_mutex);
+    std::vector<typename CacheSnapshot<T>::Change> changes;
+    changes.reserve(loaded.size());
+    for (auto& d : loaded) {
+        // a fresh tile might have been inserted in the mean time.
+        if (erase_disk_only(d.data.id)) {
+            m_n_bytes += d.n_bytes;
+            changes.emplace_back(d.data.id, std::make_shared<const T>(d.data));
+            m_data[d.data.id] = std::move(d);
+        }
+    }
+    publish(changes);
+    for (const auto& id : failed)
+        erase_disk_only(id);
+    for (const auto& id : missing)
+        erase_disk_only(id);
+    if (!failed.empty())
+        return tl::unexpected(error);
     return {};
 }
 
 template <tile_types::NamedTile T>
-template <typename VisitorFunction>
-void Cache<T>::visit(const VisitorFunction& functor)
+void Cache<T>::clear_disk(const std::filesystem::path& path)
 {
-    auto locker = std::scoped_lock(m_data_mutex);
-    const auto visited = utils::time_since_epoch();
-    static_assert(requires { { functor(T()) } -> utils::convertible_to<bool>; }, "VisitorFunction must accept a const NamedTile and return a bool.");
-    const auto root = tile::Id { 0, { 0, 0 } };
-    visit(root, functor, visited);
+    auto locker = std::scoped_lock(m_data_mutex, m_disk_cached_mutex);
+    m_disk_cached.close();
+    std::error_code ec;
+    std::filesystem::remove_all(path, ec);
+    m_disk_only.clear();
+    m_n_disk_only_bytes = 0;
+    // the next write_to_disk opens a fresh disk cache and reconciles, i.e., writes all of them.
+    m_data.for_each([](const tile::Id&, CacheObject& cache_object) { cache_object.persisted = false; });
 }
 
 template <tile_types::NamedTile T>
 template <typename VisitorFunction>
-void Cache<T>::visit(const tile::Id& node, const VisitorFunction& functor, uint64_t visited_stamp)
+void Cache<T>::visit(const VisitorFunction& functor)
 {
-    static_assert(requires { { functor(T()) } -> utils::convertible_to<bool>; });
-    if (m_data.contains(node)) {
-        const auto should_continue = functor(m_data[node].data);
-        if (!should_continue)
-            return;
-        m_data[node].meta.visited = visited_stamp * 100 - m_data[node].data.id.zoom_level;
-        const auto children = node.children();
-        for (const auto& id : children) {
-            visit(id, functor, visited_stamp);
-        }
-    }
+    auto locker = std::scoped_lock(m_data_mutex);
+    const auto visited = utils::time_since_epoch();
+    static_assert(requires { { functor(T()) } -> utils::convertible_to<bool>; }, "VisitorFunction must accept a const NamedTile and return a bool.");
+    m_data.visit([&](const tile::Id& id, CacheObject& object) {
+        if (!functor(std::as_const(object.data)))
+            return false;
+        object.meta.visited = visited * 100 - id.zoom_level;
+        mark_dirty(id);
+        return true;
+    });
 }
 
 template<tile_types::NamedTile T>
 std::vector<T> Cache<T>::purge(unsigned remaining_capacity)
 {
     auto locker = std::scoped_lock(m_data_mutex);
-    if (remaining_capacity >= m_data.size())
+    if (remaining_capacity >= m_data.size() + m_disk_only.size())
         return {};
     std::vector<std::pair<tile::Id, uint64_t>> tiles;
-    tiles.reserve(m_data.size());
-    std::transform(m_data.cbegin(), m_data.cend(), std::back_inserter(tiles), [](const auto& entry) { return std::make_pair(entry.first, entry.second.meta.visited); });
+    tiles.reserve(m_data.size() + m_disk_only.size());
+    m_data.for_each([&tiles](const tile::Id& id, const CacheObject& object) { tiles.emplace_back(id, object.meta.visited); });
+    std::transform(m_disk_only.cbegin(), m_disk_only.cend(), std::back_inserter(tiles), [](const auto& entry) { return std::make_pair(entry.first, entry.second.meta.visited); });
     const auto nth_iter = tiles.begin() + remaining_capacity;
     std::nth_element(tiles.begin(), nth_iter, tiles.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    return purge_sorted(nth_iter, tiles.end());
+}
+
+template <tile_types::NamedTile T>
+std::vector<T> Cache<T>::purge_bytes(size_t remaining_bytes, const EvictionPolicy& policy)
+{
+    auto locker = std::scoped_lock(m_data_mutex);
+    if (remaining_bytes >= m_n_bytes)
+        return {};
+    std::vector<EvictionCandidate> candidates;
+    candidates.reserve(m_data.size());
+    m_data.for_each([&candidates](const tile::Id& id, const CacheObject& object) {
+        // objects that can't be serialised are derived from something else, e.g., gpu quads from the quads in ram.
+        auto source = RefetchSource::Ram;
+        if constexpr (tile_types::SerialisableTile<T>)
+            source = object.persisted ? RefetchSource::Disk : RefetchSource::Network;
+        candidates.push_back({ id, object.meta.visited, object.n_bytes, source });
+    });
+    const auto [ranked, n_kept] = rank(std::move(candidates), remaining_bytes, policy);
+
+    std::vector<T> purged_tiles;
+    purged_tiles.reserve(ranked.size() - n_kept);
+    std::vector<typename CacheSnapshot<T>::Change> changes;
+    changes.reserve(ranked.size() - n_kept);
+    for (auto candidate = ranked.cbegin() + ptrdiff_t(n_kept); candidate != ranked.cend(); ++candidate) {
+        auto* object = m_data.find(candidate->id);
+        m_n_bytes -= object->n_bytes;
+        if (object->persisted) {
+            // the size in ram is close enough to the size on disk.
+            m_disk_only[candidate->id] = { object->meta, object->n_bytes };
+            m_n_disk_only_bytes += object->n_bytes;
+        } else {
+            mark_dirty(candidate->id);
+        }
+        purged_tiles.push_back(std::move(object->data));
+        m_data.erase(candidate->id);
+        changes.emplace_back(candidate->id, nullptr);
+    }
+    publish(changes);
+    return purged_tiles;
+}
+
+template <tile_types::NamedTile T>
+void Cache<T>::purge_disk_only_bytes(size_t remaining_bytes, const EvictionPolicy& policy)
+{
+    auto locker = std::scoped_lock(m_data_mutex);
+    if (remaining_bytes >= m_n_disk_only_bytes)
+        return;
+    std::vector<EvictionCandidate> candidates;
+    candidates.reserve(m_disk_only.size());
+    for (const auto& [id, object] : m_disk_only)
+        candidates.push_back({ id, object.meta.visited, object.n_bytes, RefetchSource::Network });
+    const auto [ranked, n_kept] = rank(std::move(candidates), remaining_bytes, policy);
+    for (auto candidate = ranked.cbegin() + ptrdiff_t(n_kept); candidate != ranked.cend(); ++candidate) {
+        mark_dirty(candidate->id);
+        erase_disk_only(candidate->id);
+    }
+}
+
+template <tile_types::NamedTile T>
+std::pair<std::vector<EvictionCandidate>, size_t> Cache<T>::rank(std::vector<EvictionCandidate> candidates, size_t remaining_bytes, const EvictionPolicy& policy)
+{
+    std::vector<std::pair<double, EvictionCandidate>> ranked;
+    ranked.reserve(candidates.size());
+    for (const auto& candidate : candidates) {
+        const auto value = policy.is_pinned(candidate.id) ? std::numeric_limits<double>::infinity() : policy.retention_value(candidate);
+        ranked.emplace_back(value, candidate);
+    }
+    // ancestors are worth at least as much as their descendants, tiles below a purged one aren't reached any more (FlatQuadTree::visit).
+    FlatQuadTree<size_t> index_of;
+    for (size_t i = 0; i < ranked.size(); ++i)
+        index_of[ranked[i].second.id] = i;
+    std::vector<size_t> finest_first(ranked.size());
+    for (size_t i = 0; i < finest_first.size(); ++i)
+        finest_first[i] = i;
+    std::sort(finest_first.begin(), finest_first.end(), [&ranked](size_t a, size_t b) { return ranked[a].second.id.zoom_level > ranked[b].second.id.zoom_level; });
+    for (const auto i : finest_first) {
+        for (auto ancestor = ranked[i].second.id; ancestor.zoom_level > 0;) {
+            ancestor = ancestor.parent();
+            if (const auto* parent = index_of.find(ancestor)) {
+                ranked[*parent].first = std::max(ranked[*parent].first, ranked[i].first);
+                break;
+            }
+        }
+    }
+    // on ties, coarser first, so that the cut between kept and purged doesn't separate a parent from its children.
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second.id.zoom_level < b.second.id.zoom_level;
+    });
+    size_t n_bytes = 0;
+    size_t n_kept = 0;
+    for (; n_kept < ranked.size(); ++n_kept) {
+        n_bytes += ranked[n_kept].second.n_bytes;
+        if (n_bytes > remaining_bytes && ranked[n_kept].first != std::numeric_limits<double>::infinity())
+            break;
+    }
+    for (size_t i = 0; i < ranked.size(); ++i)
+        candidates[i] = ranked[i].second;
+    return { std::move(candidates), n_kept };
+}
+
+template <tile_types::NamedTile T>
+std::vector<T> Cache<T>::purge_sorted(std::vector<std::pair<tile::Id, uint64_t>>::iterator begin, std::vector<std::pair<tile::Id, uint64_t>>::iterator end)
+{
     std::vector<T> purged_tiles;
-    purged_tiles.reserve(tiles.size() - remaining_capacity);
-    std::for_each(nth_iter, tiles.end(), [this, &purged_tiles](const auto& v) {
-        purged_tiles.push_back(m_data[v.first].data);
+    purged_tiles.reserve(size_t(std::distance(begin, end)));
+    std::vector<typename CacheSnapshot<T>::Change> changes;
+    std::for_each(begin, end, [this, &purged_tiles, &changes](const auto& v) {
+        mark_dirty(v.first);
+        if (erase_disk_only(v.first))
+            return;
+        auto* object = m_data.find(v.first);
+        m_n_bytes -= object->n_bytes;
+        purged_tiles.push_back(std::move(object->data));
         m_data.erase(v.first);
+        changes.emplace_back(v.first, nullptr);
     });
+    publish(changes);
     return purged_tiles;
 }
 
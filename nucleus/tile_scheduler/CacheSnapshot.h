@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "FlatQuadTree.h"
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+/// An immutable version of the tiles in a Cache, for readers on other threads. Versions share their nodes, a new version copies only the paths from
+/// the root to the changed tiles. Like Cache::visit, visit descends only through tiles that are there, but it doesn't mark anything visited.
+template <typename T>
+class CacheSnapshot {
+    struct Node {
+        std::shared_ptr<const T> tile;
+        std::array<std::shared_ptr<const Node>, 4> children;
+    };
+
+    std::shared_ptr<const Node> m_root;
+    uint64_t m_version = 0;
+    size_t m_size = 0;
+
+public:
+    /// a null tile erases.
+    using Change = std::pair<tile::Id, std::shared_ptr<const T>>;
+
+    CacheSnapshot() = default;
+    [[nodiscard]] uint64_t version() const { return m_version; }
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    [[nodiscard]] const T* find(const tile::Id& id) const
+    {
+        const auto key = morton::encode(id);
+        const Node* node = m_root.get();
+        for (unsigned level = 1; node && level <= id.zoom_level; ++level)
+            node = node->children[morton::quadrant(key, level)].get();
+        return node ? node->tile.get() : nullptr;
+    }
+
+    /// functor(const T&) returns whether to descend.
+    template <typename VisitorFunction>
+    void visit(const VisitorFunction& functor) const
+    {
+        if (m_root)
+            visit(*m_root, functor);
+    }
+
+    /// the next version, this one stays as it is.
+    [[nodiscard]] std::shared_ptr<const CacheSnapshot> with(const std::vector<Change>& changes) const
+    {
+        auto next = std::make_shared<CacheSnapshot>(*this);
+        ++next->m_version;
+        for (const auto& [id, tile] : changes)
+            next->m_root = with(next->m_root, morton::encode(id), 0, id.zoom_level, tile, next->m_size);
+        return next;
+    }
+
+    [[nodiscard]] std::shared_ptr<const CacheSnapshot> cleared() const
+    {
+        auto next = std::make_shared<CacheSnapshot>();
+        next->m_version = m_version + 1;
+        return next;
+    }
+
+private:
+    static std::shared_ptr<const Node> with(const std::shared_ptr<const Node>& node, uint64_t key, unsigned level, unsigned zoom_level, const std::shared_ptr<const T>& tile, size_t& size)
+    {
+        auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+        if (level == zoom_level) {
+            size = size - (copy->tile ? 1 : 0) + (tile ? 1 : 0);
+            copy->tile = tile;
+        } else {
+            auto& child = copy->children[morton::quadrant(key, level + 1)];
+            child = with(child, key, level + 1, zoom_level, tile, size);
+        }
+        // paths without tiles are dropped
+        if (!copy->tile && std::all_of(copy->children.cbegin(), copy->children.cend(), [](const auto& c) { return !c; }))
+            return {};
+        return copy;
+    }
+
+    template <typename VisitorFunction>
+    static void visit(const Node& node, const VisitorFunction& functor)
+    {
+        if (!node.tile || !functor(*node.tile))
+            return;
+        for (const auto& child : node.children) {
+            if (child)
+                visit(*child, functor);
+        }
+    }
+};
+
+} // namespace nucleus::tile_scheduler
@@ -18,7 +18,6 @@
 
 #include "DrawListGenerator.h"
 
-#include "radix/iterator.h"
 #include "radix/quad_tree.h"
 
 using nucleus::tile_scheduler::DrawListGenerator;
@@ -33,11 +32,15 @@ DrawListGenerator::DrawListGenerator()
 void DrawListGenerator::set_permissible_screen_space_error(float new_permissible_screen_space_error)
 {
     m_permissible_screen_space_error = new_permissible_screen_space_error;
+    m_lod_cut_camera.reset();
 }
 
 void DrawListGenerator::set_aabb_decorator(const tile_scheduler::utils::AabbDecoratorPtr& new_aabb_decorator)
 {
-    m_aabb_decorator = new_aabb_decorator;
+    // a copy, add_tile sets mesh heights on it.
+    m_aabb_decorator = std::make_shared<utils::AabbDecorator>(*new_aabb_decorator);
+    m_lod_cut.reset();
+    m_lod_cut_camera.reset();
 }
 
 void DrawListGenerator::add_tile(const tile::Id& id)
@@ -45,36 +48,55 @@ void DrawListGenerator::add_tile(const tile::Id& id)
     m_available_tiles.insert(id);
 }
 
+void DrawListGenerator::add_tile(const tile::Id& id, const tile::SrsAndHeightBounds& bounds)
+{
+    m_available_tiles.insert(id);
+    if (m_aabb_decorator->has_mesh_heights(id))
+        return;
+    m_aabb_decorator->set_mesh_heights(id, bounds.min.z, bounds.max.z);
+    m_lod_cut.invalidate(id);
+    m_lod_cut_camera.reset();
+}
+
 void DrawListGenerator::remove_tile(const tile::Id& id)
 {
     m_available_tiles.erase(id);
+    if (m_aabb_decorator && m_aabb_decorator->remove_mesh_heights(id)) {
+        m_lod_cut.invalidate(id);
+        m_lod_cut_camera.reset();
+    }
 }
 
 DrawListGenerator::TileSet DrawListGenerator::generate_for(const nucleus::camera::Definition& camera) const
 {
-    const auto tile_refine_functor
-        = tile_scheduler::utils::refineFunctor(camera,
-                                               m_aabb_decorator,
-                                               m_permissible_screen_space_error);
-    const auto draw_refine_functor = [&tile_refine_functor, this](const tile::Id &tile) {
+    if (!m_lod_cut_camera || !(*m_lod_cut_camera == camera)) {
+        m_lod_cut.update(camera, m_aabb_decorator, m_permissible_screen_space_error);
+        m_lod_cut_camera = camera;
+    }
+    const auto draw_refine_functor = [this](const tile::Id &tile) {
+        if (!m_lod_cut.is_refined(tile))
+            return false;
         bool all = true;
         for (const auto &child : tile.children()) {
             all = all && m_available_tiles.contains(child);
         }
-        return all && tile_refine_functor(tile);
+        return all;
     };
 
     const auto all_leaves = quad_tree::onTheFlyTraverse(tile::Id { 0, { 0, 0 } }, draw_refine_functor, [](const tile::Id& v) { return v.children(); });
     TileSet visible_leaves;
     visible_leaves.reserve(all_leaves.size());
 
-    const auto camera_frustum = camera.frustum();
-
-    const auto is_visible = [camera_frustum, this](const tile::Id& tile) {
-        (void)tile;
-        return tile_scheduler::utils::camera_frustum_contains_tile(camera_frustum, m_aabb_decorator->aabb(tile));
-    };
+    TileCuller::Bounds bounds;
+    bounds.reserve(all_leaves.size());
+    for (const auto& tile : all_leaves)
+        bounds.push_back(m_aabb_decorator->aabb(tile));
+    std::vector<uint8_t> visible(all_leaves.size());
+    TileCuller(camera).evaluate_visibility(bounds, visible);
 
-    std::copy_if(all_leaves.begin(), all_leaves.end(), radix::unordered_inserter(visible_leaves), is_visible);
+    for (size_t i = 0; i < all_leaves.size(); ++i) {
+        if (visible[i])
+            visible_leaves.insert(all_leaves[i]);
+    }
     return visible_leaves;
 }
@@ -18,9 +18,11 @@
 
 #pragma once
 
+#include "LodCut.h"
 #include "nucleus/camera/Definition.h"
 #include "utils.h"
 
+#include <optional>
 #include <unordered_set>
 
 namespace nucleus::tile_scheduler {
@@ -34,6 +36,8 @@ public:
     void set_permissible_screen_space_error(float new_permissible_screen_space_error);
     void set_aabb_decorator(const utils::AabbDecoratorPtr& new_aabb_decorator);
     void add_tile(const tile::Id& id);
+    /// with the bounds of its mesh, which are then used instead of the coarse ones.
+    void add_tile(const tile::Id& id, const tile::SrsAndHeightBounds& bounds);
     void remove_tile(const tile::Id& id);
     [[nodiscard]] TileSet generate_for(const camera::Definition& camera) const;
 
@@ -41,5 +45,8 @@ private:
     utils::AabbDecoratorPtr m_aabb_decorator;
     TileSet m_available_tiles;
     float m_permissible_screen_space_error = 2.0;
+    // refinement without availability, updated incrementally from one generate_for to the next
+    mutable LodCut m_lod_cut;
+    mutable std::optional<camera::Definition> m_lod_cut_camera;
 };
 }
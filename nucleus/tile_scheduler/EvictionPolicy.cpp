@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "EvictionPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "nucleus/srs.h"
+
+namespace nucleus::tile_scheduler {
+
+bool EvictionPolicy::is_pinned(const tile::Id&) const
+{
+    return false;
+}
+
+void EvictionPolicy::update_view(const glm::dvec3&, const std::vector<tile::Id>&, uint64_t) { }
+
+double LruEvictionPolicy::retention_value(const EvictionCandidate& candidate) const
+{
+    // exact, the stamps are below 2^53
+    return double(candidate.visited);
+}
+
+CostAwareEvictionPolicy::CostAwareEvictionPolicy(const Settings& settings)
+    : m_settings(settings)
+{
+}
+
+void CostAwareEvictionPolicy::set_settings(const Settings& settings)
+{
+    m_settings = settings;
+}
+
+const CostAwareEvictionPolicy::Settings& CostAwareEvictionPolicy::settings() const
+{
+    return m_settings;
+}
+
+bool CostAwareEvictionPolicy::is_pinned(const tile::Id& id) const
+{
+    return id.zoom_level <= m_settings.pinned_zoom_level;
+}
+
+void CostAwareEvictionPolicy::update_view(const glm::dvec3& camera_position, const std::vector<tile::Id>& visible_cut, uint64_t now)
+{
+    m_camera_position = camera_position;
+    m_visible_cut.clear();
+    m_visible_cut.insert(visible_cut.cbegin(), visible_cut.cend());
+    m_now = now;
+}
+
+double CostAwareEvictionPolicy::refetch_cost(const EvictionCandidate& candidate) const
+{
+    const auto mib = double(candidate.n_bytes) / (1024 * 1024);
+    switch (candidate.refetch_source) {
+    case RefetchSource::Ram:
+        return m_settings.ram_request_cost + mib * m_settings.ram_cost_per_mib;
+    case RefetchSource::Disk:
+        return m_settings.disk_request_cost + mib * m_settings.disk_cost_per_mib;
+    case RefetchSource::Network:
+        break;
+    }
+    return m_settings.network_request_cost + mib * m_settings.network_cost_per_mib;
+}
+
+double CostAwareEvictionPolicy::retention_value(const EvictionCandidate& candidate) const
+{
+    const auto visited = (candidate.visited + 99) / 100; // undo the zoom level tiebreak
+    const auto age = double(m_now > visited ? m_now - visited : 0);
+    const auto recency = std::exp2(-age / std::max(double(m_settings.age_half_life), 1.0));
+
+    const auto bounds = srs::tile_bounds(candidate.id);
+    const auto centre = (bounds.min + bounds.max) * 0.5;
+    const auto distance = glm::distance(centre, glm::dvec2(m_camera_position)) / std::max(bounds.size().x, 1.0);
+    const auto proximity = 1.0 / (1.0 + distance / std::max(double(m_settings.distance_half_value), 0.001));
+
+    const auto weight = m_visible_cut.contains(candidate.id) ? double(m_settings.visible_cut_weight) : 1.0;
+    // per byte, evicting one large entry frees as much as many small ones.
+    const auto kib = std::max(double(candidate.n_bytes) / 1024, 1.0);
+    return refetch_cost(candidate) * recency * proximity * weight / kib;
+}
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,91 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+/// where an entry comes from again, if it is needed after eviction.
+enum class RefetchSource { Ram, Disk, Network };
+
+/// what Cache knows about an entry when purging.
+struct EvictionCandidate {
+    tile::Id id;
+    uint64_t visited = 0; // Cache stamp, time_since_epoch() * 100 - zoom_level
+    size_t n_bytes = 0;
+    RefetchSource refetch_source = RefetchSource::Network;
+};
+
+/// Ranks cache entries for Cache::purge_bytes. Entries with a lower retention value are evicted first, pinned ones never (even if that exceeds the budget).
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() = default;
+    [[nodiscard]] virtual bool is_pinned(const tile::Id& id) const;
+    [[nodiscard]] virtual double retention_value(const EvictionCandidate& candidate) const = 0;
+    /// called by the scheduler before purging. visible_cut are the quads of the current view including their ancestors.
+    virtual void update_view(const glm::dvec3& camera_position, const std::vector<tile::Id>& visible_cut, uint64_t now);
+};
+
+/// least recently visited first, and finer levels first among those visited at the same time.
+class LruEvictionPolicy : public EvictionPolicy {
+public:
+    [[nodiscard]] double retention_value(const EvictionCandidate& candidate) const override;
+};
+
+/// Keeps what is expensive to get back per byte: the refetch cost (msecs) of an entry is weighted down with its age and its distance from the camera,
+/// weighted up if it is part of the visible cut, and divided by its size. Levels up to pinned_zoom_level are never evicted.
+class CostAwareEvictionPolicy : public EvictionPolicy {
+public:
+    struct Settings {
+        unsigned pinned_zoom_level = 5; // 1365 quads at most
+        float age_half_life = 60'000; // msecs
+        float network_request_cost = 200; // msecs
+        float network_cost_per_mib = 400;
+        float disk_request_cost = 2;
+        float disk_cost_per_mib = 10;
+        float ram_request_cost = 0.5; // e.g., uploading a quad to the gpu again
+        float ram_cost_per_mib = 1;
+        float visible_cut_weight = 8;
+        float distance_half_value = 4; // in tile widths, the value halves at this distance from the camera
+    };
+
+    explicit CostAwareEvictionPolicy(const Settings& settings = {});
+    void set_settings(const Settings& settings);
+    [[nodiscard]] const Settings& settings() const;
+
+    [[nodiscard]] bool is_pinned(const tile::Id& id) const override;
+    [[nodiscard]] double retention_value(const EvictionCandidate& candidate) const override;
+    void update_view(const glm::dvec3& camera_position, const std::vector<tile::Id>& visible_cut, uint64_t now) override;
+
+    [[nodiscard]] double refetch_cost(const EvictionCandidate& candidate) const;
+
+private:
+    Settings m_settings;
+    glm::dvec3 m_camera_position = {};
+    std::unordered_set<tile::Id, tile::Id::Hasher> m_visible_cut;
+    uint64_t m_now = 0;
+};
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,268 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+namespace morton {
+    constexpr unsigned max_zoom_level = 29;
+    constexpr uint64_t path_mask = (uint64_t(1) << 58) - 1;
+
+    /// spreads the lower 32 bits of v to the even bits.
+    constexpr uint64_t spread(uint64_t v)
+    {
+        v &= 0xffffffff;
+        v = (v | (v << 16)) & 0x0000ffff0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0f;
+        v = (v | (v << 2)) & 0x3333333333333333;
+        v = (v | (v << 1)) & 0x5555555555555555;
+        return v;
+    }
+
+    constexpr uint64_t compact(uint64_t v)
+    {
+        v &= 0x5555555555555555;
+        v = (v | (v >> 1)) & 0x3333333333333333;
+        v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0f;
+        v = (v | (v >> 4)) & 0x00ff00ff00ff00ff;
+        v = (v | (v >> 8)) & 0x0000ffff0000ffff;
+        v = (v | (v >> 16)) & 0x00000000ffffffff;
+        return v;
+    }
+
+    /// zoom level in the upper 6 bits, x in the even and y in the odd bits below. the two bits of level l (from the top) are the quadrant on the path from the root.
+    inline uint64_t encode(const tile::Id& id)
+    {
+        assert(id.zoom_level <= max_zoom_level);
+        return (uint64_t(id.zoom_level) << 58) | spread(id.coords.x) | (spread(id.coords.y) << 1);
+    }
+
+    inline tile::Id decode(uint64_t key)
+    {
+        const auto path = key & path_mask;
+        return { unsigned(key >> 58), { unsigned(compact(path)), unsigned(compact(path >> 1)) } };
+    }
+
+    /// 0..3, the child of the ancestor on level zoom_level - 1 that leads to key.
+    inline unsigned quadrant(uint64_t key, unsigned zoom_level)
+    {
+        const auto key_zoom_level = unsigned(key >> 58);
+        assert(zoom_level >= 1 && zoom_level <= key_zoom_level);
+        return unsigned(key >> (2 * (key_zoom_level - zoom_level))) & 3u;
+    }
+} // namespace morton
+
+/// A quad tree in one arena: node 0 is the root and the 4 children of a node are consecutive nodes, so lookups walk indices along the morton path
+/// instead of hashing, and for_each is a linear scan. Indices are stable, freed child blocks are reused. Not thread safe.
+template <typename Value>
+class FlatQuadTree {
+    static constexpr uint32_t no_children = std::numeric_limits<uint32_t>::max();
+
+    struct Node {
+        uint64_t key = 0;
+        uint32_t children = no_children;
+        bool occupied = false;
+    };
+
+    std::vector<Node> m_nodes = { Node {} };
+    std::vector<std::optional<Value>> m_values = std::vector<std::optional<Value>>(1);
+    std::vector<uint32_t> m_free_blocks;
+    size_t m_size = 0;
+
+public:
+    [[nodiscard]] size_t size() const { return m_size; }
+    [[nodiscard]] bool contains(const tile::Id& id) const { return index_of(id) != no_children; }
+
+    Value* find(const tile::Id& id)
+    {
+        const auto index = index_of(id);
+        return index == no_children ? nullptr : &*m_values[index];
+    }
+    const Value* find(const tile::Id& id) const
+    {
+        const auto index = index_of(id);
+        return index == no_children ? nullptr : &*m_values[index];
+    }
+    const Value& at(const tile::Id& id) const
+    {
+        const auto* value = find(id);
+        if (!value)
+            throw std::out_of_range("FlatQuadTree::at");
+        return *value;
+    }
+
+    /// default constructs the value if it isn't there yet.
+    Value& operator[](const tile::Id& id)
+    {
+        const auto key = morton::encode(id);
+        uint32_t index = 0;
+        for (unsigned level = 1; level <= id.zoom_level; ++level) {
+            if (m_nodes[index].children == no_children) {
+                const auto block = allocate_block(key, level);
+                m_nodes[index].children = block;
+            }
+            index = m_nodes[index].children + morton::quadrant(key, level);
+        }
+        auto& node = m_nodes[index];
+        if (!node.occupied) {
+            node.occupied = true;
+            m_values[index].emplace();
+            ++m_size;
+        }
+        return *m_values[index];
+    }
+
+    /// frees the child blocks that became empty on the way up.
+    bool erase(const tile::Id& id)
+    {
+        const auto key = morton::encode(id);
+        uint32_t path[morton::max_zoom_level + 1];
+        path[0] = 0;
+        for (unsigned level = 1; level <= id.zoom_level; ++level) {
+            if (m_nodes[path[level - 1]].children == no_children)
+                return false;
+            path[level] = m_nodes[path[level - 1]].children + morton::quadrant(key, level);
+        }
+        const auto index = path[id.zoom_level];
+        if (!m_nodes[index].occupied)
+            return false;
+        m_nodes[index].occupied = false;
+        m_values[index].reset();
+        --m_size;
+
+        for (unsigned level = id.zoom_level; level >= 1; --level) {
+            const auto parent = path[level - 1];
+            const auto block = m_nodes[parent].children;
+            for (uint32_t i = block; i < block + 4; ++i) {
+                if (m_nodes[i].occupied || m_nodes[i].children != no_children)
+                    return true;
+            }
+            m_nodes[parent].children = no_children;
+            m_free_blocks.push_back(block);
+            if (m_nodes[parent].occupied)
+                return true;
+        }
+        return true;
+    }
+
+    void clear()
+    {
+        m_nodes = { Node {} };
+        m_values = std::vector<std::optional<Value>>(1);
+        m_free_blocks.clear();
+        m_size = 0;
+    }
+
+    /// in arena order.
+    template <typename Function>
+    void for_each(const Function& function)
+    {
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].occupied)
+                function(morton::decode(m_nodes[i].key), *m_values[i]);
+        }
+    }
+    template <typename Function>
+    void for_each(const Function& function) const
+    {
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].occupied)
+                function(morton::decode(m_nodes[i].key), *m_values[i]);
+        }
+    }
+
+    /// depth first from the root, through occupied nodes only. descends if function(id, value) returns true.
+    template <typename Function>
+    void visit(const Function& function)
+    {
+        std::vector<uint32_t> stack = { 0 };
+        while (!stack.empty()) {
+            const auto index = stack.back();
+            stack.pop_back();
+            const auto& node = m_nodes[index];
+            if (!node.occupied || !function(morton::decode(node.key), *m_values[index]))
+                continue;
+            if (node.children == no_children)
+                continue;
+            // reversed, so that the first child is visited first
+            for (uint32_t i = 4; i > 0; --i)
+                stack.push_back(node.children + i - 1);
+        }
+    }
+
+    template <typename Function>
+    void visit(const Function& function) const
+    {
+        std::vector<uint32_t> stack = { 0 };
+        while (!stack.empty()) {
+            const auto index = stack.back();
+            stack.pop_back();
+            const auto& node = m_nodes[index];
+            if (!node.occupied || !function(morton::decode(node.key), *m_values[index]))
+                continue;
+            if (node.children == no_children)
+                continue;
+            for (uint32_t i = 4; i > 0; --i)
+                stack.push_back(node.children + i - 1);
+        }
+    }
+
+private:
+    [[nodiscard]] uint32_t index_of(const tile::Id& id) const
+    {
+        const auto key = morton::encode(id);
+        uint32_t index = 0;
+        for (unsigned level = 1; level <= id.zoom_level; ++level) {
+            if (m_nodes[index].children == no_children)
+                return no_children;
+            index = m_nodes[index].children + morton::quadrant(key, level);
+        }
+        return m_nodes[index].occupied ? index : no_children;
+    }
+
+    /// the children on the given level of the path to key.
+    uint32_t allocate_block(uint64_t key, unsigned zoom_level)
+    {
+        const auto parent_path = (key & morton::path_mask) >> (2 * (unsigned(key >> 58) - zoom_level + 1));
+        uint32_t block = 0;
+        if (m_free_blocks.empty()) {
+            block = uint32_t(m_nodes.size());
+            m_nodes.resize(m_nodes.size() + 4);
+            m_values.resize(m_values.size() + 4);
+        } else {
+            block = m_free_blocks.back();
+            m_free_blocks.pop_back();
+        }
+        for (uint32_t i = 0; i < 4; ++i)
+            m_nodes[block + i] = Node { (uint64_t(zoom_level) << 58) | (parent_path << 2) | i, no_children, false };
+        return block;
+    }
+};
+
+} // namespace nucleus::tile_scheduler
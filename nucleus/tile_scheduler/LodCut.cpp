@@ -0,0 +1,153 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LodCut.h"
+
+#include <limits>
+
+namespace nucleus::tile_scheduler {
+
+bool LodCut::update(const camera::Definition& camera, const utils::AabbDecoratorPtr& aabb_decorator, float error_threshold_px, double tile_size)
+{
+    const auto view = View { glm::dmat3(camera.camera_space_to_world_matrix()), camera.projection_matrix(), camera.viewport_size(), aabb_decorator.get(), error_threshold_px, tile_size };
+    if (m_view != view) {
+        m_evaluations.clear();
+        m_view = view;
+    }
+    const auto frustum = camera.frustum();
+    const auto culler = TileCuller(camera, tile_size);
+    const auto position = camera.position();
+    m_n_evaluations = 0;
+    const auto changed = update_cut(
+        [&](const tile::Id& id) {
+            auto& evaluation = m_evaluations[id];
+            if (evaluation.margin > 0 && glm::distance(evaluation.position, position) < evaluation.margin)
+                return evaluation.refine;
+            ++m_n_evaluations;
+            evaluation = evaluate(id, camera, frustum, culler, view);
+            return evaluation.refine;
+        },
+        [&aabb_decorator](const tile::Id& id) { return aabb_decorator->has_mesh_heights(id); });
+    // decisions of tiles that left the frontier are dropped from time to time.
+    if (m_evaluations.size() > 8 * (m_refined.size() + 1))
+        m_evaluations.clear();
+    return changed;
+}
+
+void LodCut::reset()
+{
+    m_refined.clear();
+    m_evaluations.clear();
+    m_view.reset();
+}
+
+void LodCut::invalidate(const tile::Id& id)
+{
+    m_evaluations.erase(id);
+    // the aabbs of the descendants didn't change, their decisions are still valid when the subtree is split again.
+    if (m_refined.contains(id))
+        erase_subtree(id);
+}
+
+void LodCut::erase_subtree(const tile::Id& id)
+{
+    std::vector<tile::Id> subtree = { id };
+    while (!subtree.empty()) {
+        const auto tile = subtree.back();
+        subtree.pop_back();
+        for (const auto& child : tile.children()) {
+            if (m_refined.contains(child))
+                subtree.push_back(child);
+        }
+        m_refined.erase(tile);
+    }
+    if (id.zoom_level == 0)
+        return;
+    auto* n_refined_siblings = m_refined.find(id.parent());
+    assert(n_refined_siblings && *n_refined_siblings > 0);
+    --*n_refined_siblings;
+}
+
+bool LodCut::is_refined(const tile::Id& id) const
+{
+    return m_refined.contains(id);
+}
+
+std::vector<tile::Id> LodCut::refined_tiles() const
+{
+    std::vector<tile::Id> tiles;
+    tiles.reserve(m_refined.size());
+    m_refined.visit([&tiles](const tile::Id& id, unsigned) {
+        tiles.push_back(id);
+        return true;
+    });
+    return tiles;
+}
+
+size_t LodCut::n_refined_tiles() const
+{
+    return m_refined.size();
+}
+
+unsigned LodCut::n_evaluations() const
+{
+    return m_n_evaluations;
+}
+
+LodCut::Evaluation LodCut::evaluate(const tile::Id& tile, const camera::Definition& camera, const nucleus::camera::Frustum& frustum, const TileCuller& culler, const View& view)
+{
+    // the same decision as refineFunctor, plus how far the camera can move before it could flip.
+    constexpr auto sqrt2 = 1.414213562373095;
+    constexpr auto safety = 0.99;
+    const auto position = camera.position();
+    if (tile.zoom_level >= 19)
+        return { false, std::numeric_limits<double>::infinity(), position };
+
+    const auto corner_in_direction = [](const tile::SrsAndHeightBounds& aabb, const glm::dvec3& direction) {
+        return glm::dvec3 { direction.x > 0 ? aabb.max.x : aabb.min.x, direction.y > 0 ? aabb.max.y : aabb.min.y, direction.z > 0 ? aabb.max.z : aabb.min.z };
+    };
+
+    const auto aabb = view.aabb_decorator->aabb(tile);
+    if (!culler.contains(aabb)) {
+        // the frustum moves with the camera, the tile stays outside while the camera moves less than it is behind a clipping plane.
+        double gap = 0;
+        for (const auto& plane : frustum.clipping_planes)
+            gap = std::max(gap, -geometry::distance(plane, corner_in_direction(aabb, plane.normal)));
+        return { false, gap * safety, position };
+    }
+
+    const auto camera_distance = float(geometry::distance(aabb, position));
+    const auto pixel_size = float(sqrt2 * aabb.size().x / view.tile_size);
+    const auto error = camera.to_screen_space(pixel_size, camera_distance);
+    const auto refine = error >= view.error_threshold_px;
+    if (camera_distance <= 0)
+        return { refine, 0, position };
+    // the error is inversely proportional to the distance, and the distance changes at most as much as the camera moves.
+    const auto ratio = double(error) / double(view.error_threshold_px);
+    auto margin = double(camera_distance) * (refine ? ratio - 1 : 1 - ratio);
+    if (refine) {
+        // and it must stay inside the frustum. only tiles inside all clipping planes are known to do so.
+        double inside = std::numeric_limits<double>::infinity();
+        for (const auto& plane : frustum.clipping_planes)
+            inside = std::min(inside, geometry::distance(plane, corner_in_direction(aabb, -plane.normal)));
+        margin = std::min(margin, std::max(inside, 0.0));
+    }
+    return { refine, margin * safety, position };
+}
+
+} // namespace nucleus::tile_scheduler
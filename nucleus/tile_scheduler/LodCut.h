@@ -0,0 +1,174 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "FlatQuadTree.h"
+#include "nucleus/camera/Definition.h"
+#include "radix/tile.h"
+#include "utils.h"
+
+namespace nucleus::tile_scheduler {
+
+/// The refined tiles of a quad tree traversal from the root (like quad_tree::onTheFlyTraverse), kept from one update to the next.
+/// update re-evaluates only the frontier, i.e., the leaves (can split) and the refined tiles without refined children (can merge), and splits and
+/// merges until nothing changes. This gives the same cut as a traversal from the root, if refinement is monotonic (a tile is refined only if its
+/// parent is, which holds for refineFunctor as long as the aabb of a tile contains those of its children). Mesh heights break that, so refined tiles
+/// with mesh heights are decided again even if their children are refined. Call invalidate when the aabb of a tile changes.
+class LodCut {
+public:
+    /// the cut of refineFunctor(camera, aabb_decorator, error_threshold_px, tile_size). while the camera only moves (no rotation or projection change),
+    /// a frontier decision is kept until the camera moved as far as the decision could flip (screen space error and gap to the frustum are bounded
+    /// by the distance). returns whether the cut changed.
+    bool update(const camera::Definition& camera, const utils::AabbDecoratorPtr& aabb_decorator, float error_threshold_px, double tile_size = 256);
+    /// any monotonic refine function, the whole frontier is evaluated.
+    template <typename RefineFunction>
+    bool update(const RefineFunction& refine);
+    /// the next update traverses from the root.
+    void reset();
+    /// the aabb of id changed. its decision is dropped and so are its refined descendants, the next update refines that subtree again from id.
+    /// decisions elsewhere are kept.
+    void invalidate(const tile::Id& id);
+
+    [[nodiscard]] bool is_refined(const tile::Id& id) const;
+    /// parents before their children, in depth first order.
+    [[nodiscard]] std::vector<tile::Id> refined_tiles() const;
+    [[nodiscard]] size_t n_refined_tiles() const;
+    /// refinement decisions computed in the last update, the others were still known.
+    [[nodiscard]] unsigned n_evaluations() const;
+
+private:
+    struct Evaluation {
+        bool refine = false;
+        double margin = 0; // the decision holds while the camera is closer than that to position
+        glm::dvec3 position = {};
+    };
+    struct View {
+        glm::dmat3 rotation = {};
+        glm::dmat4 projection = {};
+        glm::uvec2 viewport_size = {};
+        const utils::AabbDecorator* aabb_decorator = nullptr;
+        float error_threshold_px = 0;
+        double tile_size = 0;
+        bool operator==(const View&) const = default;
+    };
+
+    /// unnested(id) is true for tiles whose aabb might not contain those of their children.
+    template <typename DecideFunction, typename UnnestedFunction>
+    bool update_cut(const DecideFunction& decide, const UnnestedFunction& unnested);
+    void erase_subtree(const tile::Id& id);
+    [[nodiscard]] static Evaluation evaluate(const tile::Id& tile, const camera::Definition& camera, const nucleus::camera::Frustum& frustum, const TileCuller& culler, const View& view);
+
+    FlatQuadTree<unsigned> m_refined; // number of refined children
+    FlatQuadTree<Evaluation> m_evaluations;
+    std::optional<View> m_view;
+    unsigned m_n_evaluations = 0;
+};
+
+template <typename RefineFunction>
+bool LodCut::update(const RefineFunction& refine)
+{
+    m_evaluations.clear();
+    m_view.reset();
+    m_n_evaluations = 0;
+    return update_cut(
+        [&](const tile::Id& id) {
+            ++m_n_evaluations;
+            return bool(refine(id));
+        },
+        [](const tile::Id&) { return false; });
+}
+
+template <typename DecideFunction, typename UnnestedFunction>
+bool LodCut::update_cut(const DecideFunction& decide, const UnnestedFunction& unnested)
+{
+    bool changed = false;
+    std::unordered_set<tile::Id, tile::Id::Hasher> merged;
+
+    // refined tiles that aren't nested with their children can merge their whole subtree, coarse first.
+    std::vector<tile::Id> inner;
+    m_refined.for_each([&inner, &unnested](const tile::Id& id, unsigned n_refined_children) {
+        if (n_refined_children > 0 && unnested(id))
+            inner.push_back(id);
+    });
+    std::sort(inner.begin(), inner.end(), [](const tile::Id& a, const tile::Id& b) { return a.zoom_level < b.zoom_level; });
+    for (const auto& id : inner) {
+        if (!m_refined.contains(id) || decide(id))
+            continue;
+        erase_subtree(id);
+        merged.insert(id);
+        changed = true;
+    }
+
+    // merge, bottom up
+    std::vector<tile::Id> candidates;
+    m_refined.for_each([&candidates](const tile::Id& id, unsigned n_refined_children) {
+        if (n_refined_children == 0)
+            candidates.push_back(id);
+    });
+    while (!candidates.empty()) {
+        const auto id = candidates.back();
+        candidates.pop_back();
+        if (decide(id))
+            continue;
+        m_refined.erase(id);
+        merged.insert(id);
+        changed = true;
+        if (id.zoom_level == 0)
+            continue;
+        auto* n_refined_siblings = m_refined.find(id.parent());
+        assert(n_refined_siblings && *n_refined_siblings > 0);
+        if (--*n_refined_siblings == 0)
+            candidates.push_back(id.parent());
+    }
+
+    // split, top down. tiles merged above are leaves now, they were just decided.
+    const auto root = tile::Id { 0, { 0, 0 } };
+    std::vector<tile::Id> leaves;
+    if (!m_refined.contains(root) && !merged.contains(root))
+        leaves.push_back(root);
+    m_refined.for_each([this, &leaves, &merged](const tile::Id& id, unsigned n_refined_children) {
+        if (n_refined_children == 4)
+            return;
+        for (const auto& child : id.children()) {
+            if (!m_refined.contains(child) && !merged.contains(child))
+                leaves.push_back(child);
+        }
+    });
+    while (!leaves.empty()) {
+        const auto id = leaves.back();
+        leaves.pop_back();
+        if (!decide(id))
+            continue;
+        m_refined[id] = 0;
+        if (id.zoom_level > 0)
+            ++m_refined[id.parent()];
+        changed = true;
+        for (const auto& child : id.children())
+            leaves.push_back(child);
+    }
+    return changed;
+}
+
+} // namespace nucleus::tile_scheduler
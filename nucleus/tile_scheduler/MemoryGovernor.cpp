@@ -0,0 +1,232 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "MemoryGovernor.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include <QFile>
+#include <QTimer>
+
+namespace nucleus::tile_scheduler {
+
+namespace {
+    constexpr size_t mib = 1024 * 1024;
+
+    std::optional<QByteArray> read_file(const std::filesystem::path& path)
+    {
+        QFile file(QString::fromStdString(path.string()));
+        if (!file.open(QIODeviceBase::ReadOnly))
+            return {};
+        return file.readAll().trimmed();
+    }
+
+    std::optional<size_t> read_number(const std::filesystem::path& path)
+    {
+        const auto content = read_file(path);
+        if (!content)
+            return {};
+        bool ok = false;
+        const auto number = content->toULongLong(&ok);
+        if (!ok)
+            return {}; // e.g., "max"
+        return size_t(number);
+    }
+} // namespace
+
+SystemMemorySource::SystemMemorySource(const std::filesystem::path& root)
+    : m_root(root)
+{
+}
+
+std::optional<MemoryReading> SystemMemorySource::read()
+{
+    const auto cgroup = read_cgroup(m_root);
+    const auto meminfo = read_meminfo(m_root);
+    if (cgroup && (!meminfo || cgroup->total < meminfo->total))
+        return cgroup;
+    return meminfo;
+}
+
+std::optional<MemoryReading> SystemMemorySource::read_cgroup(const std::filesystem::path& root)
+{
+    const auto cgroups = read_file(root / "proc/self/cgroup");
+    if (!cgroups)
+        return {};
+    // cgroup v2 has a single line "0::<path>".
+    std::optional<std::string> relative_path;
+    for (const auto& line : cgroups->split('\n')) {
+        if (line.startsWith("0::"))
+            relative_path = line.sliced(3).toStdString();
+    }
+    if (!relative_path)
+        return {};
+    const auto cgroup_root = root / "sys/fs/cgroup";
+    auto path = cgroup_root / std::filesystem::path(*relative_path).relative_path();
+    const auto current = read_number(path / "memory.current");
+    if (!current)
+        return {};
+    std::optional<size_t> limit;
+    while (true) {
+        if (const auto max = read_number(path / "memory.max"))
+            limit = std::min(limit.value_or(*max), *max);
+        if (path == cgroup_root || !path.has_relative_path() || path.parent_path() == path)
+            break;
+        path = path.parent_path();
+    }
+    if (!limit)
+        return {};
+    return MemoryReading { *limit, *current };
+}
+
+std::optional<MemoryReading> SystemMemorySource::read_meminfo(const std::filesystem::path& root)
+{
+    const auto meminfo = read_file(root / "proc/meminfo");
+    if (!meminfo)
+        return {};
+    std::optional<size_t> total;
+    std::optional<size_t> available;
+    for (const auto& line : meminfo->split('\n')) {
+        // "MemTotal:       16318460 kB"
+        const auto parts = line.simplified().split(' ');
+        if (parts.size() < 2)
+            continue;
+        bool ok = false;
+        const auto kib = size_t(parts[1].toULongLong(&ok));
+        if (!ok)
+            continue;
+        if (parts[0] == "MemTotal:")
+            total = kib * 1024;
+        else if (parts[0] == "MemAvailable:")
+            available = kib * 1024;
+    }
+    if (!total || !available)
+        return {};
+    return MemoryReading { *total, *total - std::min(*total, *available) };
+}
+
+MemoryGovernor::MemoryGovernor(std::unique_ptr<AbstractMemorySource> ram_source, QObject* parent)
+    : QObject { parent }
+    , m_ram_source(std::move(ram_source))
+    , m_ram_budget(m_settings.max_ram_budget)
+    , m_gpu_budget(m_settings.max_gpu_budget)
+{
+    m_update_timer = std::make_unique<QTimer>(this);
+    connect(m_update_timer.get(), &QTimer::timeout, this, &MemoryGovernor::update);
+}
+
+MemoryGovernor::~MemoryGovernor() = default;
+
+void MemoryGovernor::set_settings(const Settings& settings)
+{
+    assert(settings.min_ram_budget <= settings.max_ram_budget);
+    assert(settings.min_gpu_budget <= settings.max_gpu_budget);
+    m_settings = settings;
+    m_ram_budget = std::clamp(m_ram_budget, m_settings.min_ram_budget, m_settings.max_ram_budget);
+    m_gpu_budget = std::clamp(m_gpu_budget, m_settings.min_gpu_budget, m_settings.max_gpu_budget);
+}
+
+const MemoryGovernor::Settings& MemoryGovernor::settings() const
+{
+    return m_settings;
+}
+
+void MemoryGovernor::set_update_interval(unsigned msecs)
+{
+    if (msecs == 0) {
+        m_update_timer->stop();
+        return;
+    }
+    m_update_timer->start(int(msecs));
+}
+
+unsigned MemoryGovernor::ram_budget() const
+{
+    return m_ram_budget;
+}
+
+unsigned MemoryGovernor::gpu_budget() const
+{
+    return m_gpu_budget;
+}
+
+unsigned MemoryGovernor::next_budget(
+    unsigned budget, size_t cache_bytes, const MemoryReading& reading, unsigned min_budget, unsigned max_budget, float reserve_ratio, float growth_ratio)
+{
+    const auto reserve = size_t(double(reading.total) * double(reserve_ratio));
+    const auto usable = cache_bytes + reading.available();
+    const auto target = unsigned(std::min(usable > reserve ? (usable - reserve) / mib : 0, size_t(max_budget)));
+    if (target <= budget)
+        return std::clamp(target, min_budget, max_budget);
+    const auto max_growth = std::max(1u, unsigned(float(budget) * growth_ratio));
+    return std::clamp(std::min(target, budget + max_growth), min_budget, max_budget);
+}
+
+void MemoryGovernor::update()
+{
+    bool pressure = false;
+    if (const auto reading = m_ram_source->read()) {
+        const auto budget = next_budget(m_ram_budget, m_ram_cache_bytes, *reading, m_settings.min_ram_budget, m_settings.max_ram_budget,
+            m_settings.reserve_ratio, m_settings.growth_ratio);
+        pressure |= budget < m_ram_budget && reading->available() < size_t(double(reading->total) * double(m_settings.reserve_ratio));
+        if (budget != m_ram_budget) {
+            m_ram_budget = budget;
+            emit ram_budget_changed(m_ram_budget);
+        }
+    }
+    if (m_gpu_reading) {
+        const auto budget = next_budget(m_gpu_budget, m_gpu_cache_bytes, *m_gpu_reading, m_settings.min_gpu_budget, m_settings.max_gpu_budget,
+            m_settings.reserve_ratio, m_settings.growth_ratio);
+        pressure |= budget < m_gpu_budget && m_gpu_reading->available() < size_t(double(m_gpu_reading->total) * double(m_settings.reserve_ratio));
+        if (budget != m_gpu_budget) {
+            m_gpu_budget = budget;
+            emit gpu_budget_changed(m_gpu_budget);
+        }
+    }
+    if (pressure)
+        emit pressure_rising();
+}
+
+void MemoryGovernor::update_cache_usage(size_t ram_cache_bytes, size_t gpu_cache_bytes)
+{
+    m_ram_cache_bytes = ram_cache_bytes;
+    m_gpu_cache_bytes = gpu_cache_bytes;
+}
+
+void MemoryGovernor::update_gpu_memory(size_t total, size_t available)
+{
+    if (total == 0) {
+        m_gpu_reading.reset();
+        return;
+    }
+    m_gpu_reading = MemoryReading { total, total - std::min(total, available) };
+}
+
+void MemoryGovernor::set_max_ram_budget(unsigned max_ram_budget)
+{
+    auto settings = m_settings;
+    settings.max_ram_budget = std::max(max_ram_budget, settings.min_ram_budget);
+    const auto old_budget = m_ram_budget;
+    set_settings(settings);
+    if (m_ram_budget != old_budget)
+        emit ram_budget_changed(m_ram_budget);
+    update();
+}
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,113 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include <QObject>
+
+class QTimer;
+
+namespace nucleus::tile_scheduler {
+
+/// a memory pool, i.e., ram (of the cgroup or the system) or vram.
+struct MemoryReading {
+    size_t total = 0;
+    size_t used = 0;
+    [[nodiscard]] size_t available() const { return total > used ? total - used : 0; }
+};
+
+class AbstractMemorySource {
+public:
+    virtual ~AbstractMemorySource() = default;
+    /// empty if nothing can be read.
+    [[nodiscard]] virtual std::optional<MemoryReading> read() = 0;
+};
+
+/// cgroup v2 memory.max and memory.current if the process runs in a cgroup with a lower limit than the system, /proc/meminfo otherwise.
+/// all paths are relative to root, so tests can provide their own files.
+class SystemMemorySource : public AbstractMemorySource {
+public:
+    explicit SystemMemorySource(const std::filesystem::path& root = "/");
+    [[nodiscard]] std::optional<MemoryReading> read() override;
+
+    /// the lowest memory.max on the way from the process' cgroup to the root.
+    [[nodiscard]] static std::optional<MemoryReading> read_cgroup(const std::filesystem::path& root);
+    [[nodiscard]] static std::optional<MemoryReading> read_meminfo(const std::filesystem::path& root);
+
+private:
+    std::filesystem::path m_root;
+};
+
+/// Resizes the ram and gpu cache budgets (MiB) with the free memory. A budget is the cache usage plus the free memory, minus a reserve
+/// for everything else. Budgets shrink at once, and pressure_rising is emitted if the free memory fell below the reserve. They grow by at
+/// most growth_ratio per update, so a short spike of free memory doesn't fill the cache.
+/// ram is polled from the source, vram is pushed by the renderer (update_gpu_memory), as it can only be queried on the gl thread.
+class MemoryGovernor : public QObject {
+    Q_OBJECT
+public:
+    struct Settings {
+        unsigned min_ram_budget = 128;
+        unsigned max_ram_budget = 4096;
+        unsigned min_gpu_budget = 64;
+        unsigned max_gpu_budget = 2048;
+        float reserve_ratio = 0.15f; // of the total memory
+        float growth_ratio = 0.1f;
+    };
+
+    explicit MemoryGovernor(std::unique_ptr<AbstractMemorySource> ram_source, QObject* parent = nullptr);
+    ~MemoryGovernor() override;
+
+    void set_settings(const Settings& settings);
+    [[nodiscard]] const Settings& settings() const;
+    /// 0 stops polling.
+    void set_update_interval(unsigned msecs);
+    [[nodiscard]] unsigned ram_budget() const;
+    [[nodiscard]] unsigned gpu_budget() const;
+
+    [[nodiscard]] static unsigned next_budget(unsigned budget, size_t cache_bytes, const MemoryReading& reading, unsigned min_budget, unsigned max_budget,
+        float reserve_ratio, float growth_ratio);
+
+public slots:
+    void update();
+    void update_cache_usage(size_t ram_cache_bytes, size_t gpu_cache_bytes);
+    /// total == 0 means unknown.
+    void update_gpu_memory(size_t total, size_t available);
+    void set_max_ram_budget(unsigned max_ram_budget);
+
+signals:
+    void ram_budget_changed(unsigned budget);
+    void gpu_budget_changed(unsigned budget);
+    /// a budget shrank because the free memory fell below the reserve, the caches should be purged right away.
+    void pressure_rising();
+
+private:
+    std::unique_ptr<AbstractMemorySource> m_ram_source;
+    std::unique_ptr<QTimer> m_update_timer;
+    Settings m_settings;
+    unsigned m_ram_budget = 0;
+    unsigned m_gpu_budget = 0;
+    size_t m_ram_cache_bytes = 0;
+    size_t m_gpu_cache_bytes = 0;
+    std::optional<MemoryReading> m_gpu_reading;
+};
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,464 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "PackStore.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+
+#include <QDebug>
+#include <QSaveFile>
+#include <fmt/format.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace nucleus::tile_scheduler;
+
+namespace {
+static_assert(std::endian::native == std::endian::little, "records are written in place, big endian would need byte swapping.");
+
+constexpr char index_magic[4] = { 'A', 'L', 'P', 'I' };
+constexpr char block_magic[4] = { 'A', 'L', 'P', 'B' };
+constexpr char record_magic[4] = { 'A', 'L', 'P', 'R' };
+
+struct RecordHeader {
+    char magic[4];
+    uint32_t zoom_level;
+    uint32_t x;
+    uint32_t y;
+    uint32_t size;
+};
+static_assert(sizeof(RecordHeader) == 20);
+constexpr uint64_t block_overhead = 12; // magic, n_records, checksum
+constexpr uint64_t min_checkpoint_journal_size = 64 * 1024;
+
+uint32_t checksum(const char* data, size_t size)
+{
+    uint32_t hash = 2166136261u; // fnv-1a
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= uint8_t(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool sync(QFile& file)
+{
+    if (!file.flush())
+        return false;
+#if defined(_WIN32)
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+std::string to_string(const QString& s) { return s.toStdString(); }
+} // namespace
+
+PackStore::PackStore() = default;
+
+PackStore::~PackStore() { close(); }
+
+std::filesystem::path PackStore::segment_path(const std::filesystem::path& directory, uint32_t segment)
+{
+    return directory / fmt::format("segment_{}.alp_pack", segment);
+}
+
+std::filesystem::path PackStore::index_path(const std::filesystem::path& directory) { return directory / "index.alp_index"; }
+
+tl::expected<void, std::string> PackStore::open(const std::filesystem::path& directory, QByteArrayView format)
+{
+    close();
+    m_directory = directory;
+    m_format = format.toByteArray();
+    const auto fail = [&](const std::string& message) -> tl::expected<void, std::string> {
+        close();
+        return tl::unexpected(fmt::format("Pack store '{}': {}", directory.string(), message));
+    };
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec)
+        return fail(fmt::format("couldn't create directory ({})!", ec.message()));
+
+    if (const auto r = replay_journal(format); !r.has_value())
+        return fail(r.error());
+
+    // segments that the index doesn't know about are left overs of a compaction that crashed before deleting.
+    uint32_t last_segment = 0;
+    for (const auto& file : std::filesystem::directory_iterator(directory, ec)) {
+        const auto name = file.path().filename().string();
+        unsigned segment = 0;
+        if (std::sscanf(name.c_str(), "segment_%u.alp_pack", &segment) != 1 || name != segment_path({}, segment).string())
+            continue;
+        m_segments[segment].size = uint64_t(file.file_size(ec));
+        last_segment = std::max(last_segment, uint32_t(segment));
+    }
+    for (auto it = m_segments.begin(); it != m_segments.end();) {
+        if (it->second.live == 0 && it->first != last_segment) {
+            std::filesystem::remove(segment_path(directory, it->first), ec);
+            it = m_segments.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    const auto active = m_segments.contains(last_segment) && m_segments[last_segment].size < m_max_segment_size ? last_segment : last_segment + 1;
+    if (const auto r = open_active_segment(active); !r.has_value())
+        return fail(r.error());
+    m_open = true;
+    return {};
+}
+
+void PackStore::close()
+{
+    for (auto& [segment, mapping] : m_mappings) {
+        if (mapping.data)
+            mapping.file->unmap(const_cast<uchar*>(mapping.data));
+    }
+    m_mappings.clear();
+    m_active_segment.close();
+    m_entries.clear();
+    m_segments.clear();
+    m_pending.clear();
+    m_journal_size = 0;
+    m_open = false;
+}
+
+bool PackStore::is_open() const { return m_open; }
+
+const std::filesystem::path& PackStore::directory() const { return m_directory; }
+
+void PackStore::set_max_segment_size(uint64_t max_segment_size) { m_max_segment_size = max_segment_size; }
+
+const PackStore::Entries& PackStore::entries() const { return m_entries; }
+
+const std::map<uint32_t, PackStore::SegmentInfo>& PackStore::segments() const { return m_segments; }
+
+uint64_t PackStore::journal_size() const { return m_journal_size; }
+
+QByteArray PackStore::header() const
+{
+    QByteArray bytes(index_magic, sizeof(index_magic));
+    const uint32_t format_size = uint32_t(m_format.size());
+    bytes.append(reinterpret_cast<const char*>(&version), sizeof(version));
+    bytes.append(reinterpret_cast<const char*>(&format_size), sizeof(format_size));
+    bytes.append(m_format);
+    return bytes;
+}
+
+tl::expected<void, std::string> PackStore::replay_journal(QByteArrayView format)
+{
+    QFile file(QString::fromStdString(index_path(m_directory).string()));
+    if (!file.exists())
+        return write_checkpoint();
+    if (!file.open(QIODeviceBase::ReadWrite))
+        return tl::unexpected(fmt::format("couldn't open index '{}' ({})!", index_path(m_directory).string(), to_string(file.errorString())));
+    const auto bytes = file.readAll();
+    const auto expected_header = header();
+    if (bytes.size() < 12 || std::memcmp(bytes.constData(), index_magic, sizeof(index_magic)) != 0)
+        return tl::unexpected(std::string("index is damaged!"));
+    if (!bytes.startsWith(expected_header)) {
+        uint32_t file_version = 0;
+        std::memcpy(&file_version, bytes.constData() + 4, sizeof(file_version));
+        if (file_version != version)
+            return tl::unexpected(fmt::format("index has version {}, but we expected {}!", file_version, version));
+        return tl::unexpected(fmt::format("index has an incompatible format, expected '{}'!", format.toByteArray().toStdString()));
+    }
+
+    auto position = uint64_t(expected_header.size());
+    const auto size = uint64_t(bytes.size());
+    while (position + block_overhead <= size) {
+        const char* block = bytes.constData() + position;
+        uint32_t n_records = 0;
+        std::memcpy(&n_records, block + 4, sizeof(n_records));
+        const auto records_size = uint64_t(n_records) * sizeof(JournalRecord);
+        if (std::memcmp(block, block_magic, sizeof(block_magic)) != 0 || position + block_overhead + records_size > size)
+            break;
+        uint32_t stored_checksum = 0;
+        std::memcpy(&stored_checksum, block + 8 + records_size, sizeof(stored_checksum));
+        if (stored_checksum != checksum(block + 8, records_size))
+            break;
+        for (uint32_t i = 0; i < n_records; ++i) {
+            JournalRecord record;
+            std::memcpy(&record, block + 8 + i * sizeof(JournalRecord), sizeof(JournalRecord));
+            apply(record);
+        }
+        position += block_overhead + records_size;
+    }
+    if (position < size) {
+        // a commit was interrupted, everything before it is intact.
+        qDebug() << "Pack store: dropping" << (size - position) << "bytes of an incomplete commit in" << file.fileName();
+        if (!file.resize(qint64(position)))
+            return tl::unexpected(fmt::format("couldn't truncate index ({})!", to_string(file.errorString())));
+    }
+    m_journal_size = position;
+    return {};
+}
+
+void PackStore::apply(const JournalRecord& record)
+{
+    static_assert(sizeof(JournalRecord) == 48, "journal records are written in place.");
+    const auto id = tile::Id { record.zoom_level, { record.x, record.y } };
+    switch (record.op) {
+    case Op::Put:
+        release(id);
+        m_entries[id] = { { record.visited, record.created }, record.segment, record.size, record.offset };
+        m_segments[record.segment].live += sizeof(RecordHeader) + record.size;
+        break;
+    case Op::Meta:
+        if (const auto entry = m_entries.find(id); entry != m_entries.end())
+            entry->second.meta = { record.visited, record.created };
+        break;
+    case Op::Remove:
+        release(id);
+        m_entries.erase(id);
+        break;
+    }
+}
+
+void PackStore::release(const tile::Id& id)
+{
+    const auto entry = m_entries.find(id);
+    if (entry == m_entries.end())
+        return;
+    auto& segment = m_segments[entry->second.segment];
+    segment.live -= std::min(segment.live, uint64_t(sizeof(RecordHeader)) + entry->second.size);
+}
+
+tl::expected<void, std::string> PackStore::write_checkpoint()
+{
+    QByteArray block(block_magic, sizeof(block_magic));
+    const auto n_records = uint32_t(m_entries.size());
+    block.append(reinterpret_cast<const char*>(&n_records), sizeof(n_records));
+    for (const auto& [id, entry] : m_entries) {
+        const JournalRecord record { Op::Put, id.zoom_level, id.coords.x, id.coords.y, entry.segment, entry.size, entry.offset, entry.meta.visited,
+            entry.meta.created };
+        block.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    const auto block_checksum = checksum(block.constData() + 8, size_t(block.size() - 8));
+    block.append(reinterpret_cast<const char*>(&block_checksum), sizeof(block_checksum));
+
+    QSaveFile file(QString::fromStdString(index_path(m_directory).string()));
+    if (!file.open(QIODeviceBase::WriteOnly))
+        return tl::unexpected(fmt::format("couldn't open index for writing ({})!", to_string(file.errorString())));
+    const auto bytes = header() + block;
+    file.write(bytes);
+    if (!file.commit())
+        return tl::unexpected(fmt::format("couldn't write index ({})!", to_string(file.errorString())));
+    m_journal_size = uint64_t(bytes.size());
+    m_pending.clear();
+    return {};
+}
+
+tl::expected<void, std::string> PackStore::open_active_segment(uint32_t segment)
+{
+    if (m_active_segment.isOpen() && !sync(m_active_segment))
+        return tl::unexpected(fmt::format("couldn't sync segment ({})!", to_string(m_active_segment.errorString())));
+    m_active_segment.close();
+    m_active_segment.setFileName(QString::fromStdString(segment_path(m_directory, segment).string()));
+    if (!m_active_segment.open(QIODeviceBase::WriteOnly | QIODeviceBase::Append))
+        return tl::unexpected(fmt::format("couldn't open segment '{}' ({})!", segment_path(m_directory, segment).string(), to_string(m_active_segment.errorString())));
+    m_active_segment_id = segment;
+    m_segments[segment].size = uint64_t(m_active_segment.size());
+    return {};
+}
+
+tl::expected<void, std::string> PackStore::put(const tile::Id& id, QByteArrayView payload, const Meta& meta)
+{
+    assert(m_open);
+    const auto record_size = sizeof(RecordHeader) + uint64_t(payload.size());
+    if (m_segments[m_active_segment_id].size > 0 && m_segments[m_active_segment_id].size + record_size > m_max_segment_size) {
+        if (const auto r = open_active_segment(m_active_segment_id + 1); !r.has_value())
+            return r;
+    }
+    auto& segment = m_segments[m_active_segment_id];
+    RecordHeader header { {}, id.zoom_level, id.coords.x, id.coords.y, uint32_t(payload.size()) };
+    std::memcpy(header.magic, record_magic, sizeof(record_magic));
+    const auto offset = segment.size;
+    if (m_active_segment.write(reinterpret_cast<const char*>(&header), sizeof(header)) != qint64(sizeof(header))
+        || m_active_segment.write(payload.data(), payload.size()) != payload.size())
+        return tl::unexpected(fmt::format("couldn't append to segment ({})!", to_string(m_active_segment.errorString())));
+    segment.size += record_size;
+
+    const JournalRecord record { Op::Put, id.zoom_level, id.coords.x, id.coords.y, m_active_segment_id, uint32_t(payload.size()), offset + sizeof(RecordHeader),
+        meta.visited, meta.created };
+    apply(record);
+    m_pending.push_back(record);
+    return {};
+}
+
+void PackStore::update_meta(const tile::Id& id, const Meta& meta)
+{
+    if (!m_entries.contains(id))
+        return;
+    const JournalRecord record { Op::Meta, id.zoom_level, id.coords.x, id.coords.y, 0, 0, 0, meta.visited, meta.created };
+    apply(record);
+    m_pending.push_back(record);
+}
+
+void PackStore::remove(const tile::Id& id)
+{
+    if (!m_entries.contains(id))
+        return;
+    const JournalRecord record { Op::Remove, id.zoom_level, id.coords.x, id.coords.y, 0, 0, 0, 0, 0 };
+    apply(record);
+    m_pending.push_back(record);
+}
+
+void PackStore::unmap(uint32_t segment) const
+{
+    const auto mapping = m_mappings.find(segment);
+    if (mapping == m_mappings.end())
+        return;
+    if (mapping->second.data)
+        mapping->second.file->unmap(const_cast<uchar*>(mapping->second.data));
+    m_mappings.erase(mapping);
+}
+
+tl::expected<QByteArray, std::string> PackStore::read(const tile::Id& id) const
+{
+    const auto entry = m_entries.find(id);
+    if (entry == m_entries.end())
+        return tl::unexpected(fmt::format("tile {}/{}/{} is not in the pack store!", id.zoom_level, id.coords.x, id.coords.y));
+    const auto& e = entry->second;
+    const auto begin = e.offset - sizeof(RecordHeader);
+    const auto end = e.offset + e.size;
+
+    auto mapping = m_mappings.find(e.segment);
+    if (mapping == m_mappings.end() || mapping->second.size < end) {
+        // the active segment grows, map it again. buffered writes must reach the file first.
+        unmap(e.segment);
+        if (e.segment == m_active_segment_id)
+            m_active_segment.flush();
+        Mapping m { std::make_unique<QFile>(QString::fromStdString(segment_path(m_directory, e.segment).string())) };
+        if (!m.file->open(QIODeviceBase::ReadOnly))
+            return tl::unexpected(fmt::format("couldn't open segment {} ({})!", e.segment, to_string(m.file->errorString())));
+        m.size = uint64_t(m.file->size());
+        m.data = m.file->map(0, qint64(m.size));
+        mapping = m_mappings.emplace(e.segment, std::move(m)).first;
+    }
+    const auto& m = mapping->second;
+    if (m.size < end)
+        return tl::unexpected(fmt::format("segment {} is truncated!", e.segment));
+
+    QByteArray record;
+    if (m.data) {
+        record = QByteArray(reinterpret_cast<const char*>(m.data + begin), qsizetype(end - begin));
+    } else { // mapping is not supported everywhere, e.g., on the web
+        m.file->seek(qint64(begin));
+        record = m.file->read(qint64(end - begin));
+    }
+    RecordHeader header;
+    if (uint64_t(record.size()) != end - begin)
+        return tl::unexpected(fmt::format("couldn't read from segment {}!", e.segment));
+    std::memcpy(&header, record.constData(), sizeof(header));
+    if (std::memcmp(header.magic, record_magic, sizeof(record_magic)) != 0 || tile::Id { header.zoom_level, { header.x, header.y } } != id
+        || header.size != e.size)
+        return tl::unexpected(fmt::format("record of tile {}/{}/{} in segment {} is damaged!", id.zoom_level, id.coords.x, id.coords.y, e.segment));
+    return record.sliced(sizeof(RecordHeader));
+}
+
+tl::expected<void, std::string> PackStore::commit()
+{
+    assert(m_open);
+    if (m_pending.empty())
+        return {};
+    // the data must be on disk before the index points to it.
+    if (!sync(m_active_segment))
+        return tl::unexpected(fmt::format("couldn't sync segment ({})!", to_string(m_active_segment.errorString())));
+
+    const auto checkpoint_size = uint64_t(header().size()) + block_overhead + m_entries.size() * sizeof(JournalRecord);
+    if (m_journal_size > min_checkpoint_journal_size && m_journal_size > 4 * checkpoint_size)
+        return write_checkpoint();
+
+    QByteArray block(block_magic, sizeof(block_magic));
+    const auto n_records = uint32_t(m_pending.size());
+    block.append(reinterpret_cast<const char*>(&n_records), sizeof(n_records));
+    block.append(reinterpret_cast<const char*>(m_pending.data()), qsizetype(m_pending.size() * sizeof(JournalRecord)));
+    const auto block_checksum = checksum(block.constData() + 8, size_t(block.size() - 8));
+    block.append(reinterpret_cast<const char*>(&block_checksum), sizeof(block_checksum));
+
+    QFile file(QString::fromStdString(index_path(m_directory).string()));
+    if (!file.open(QIODeviceBase::WriteOnly | QIODeviceBase::Append) || file.write(block) != block.size() || !sync(file))
+        return tl::unexpected(fmt::format("couldn't append to index ({})!", to_string(file.errorString())));
+    m_journal_size += uint64_t(block.size());
+    m_pending.clear();
+    return {};
+}
+
+tl::expected<bool, std::string> PackStore::compact_step(float max_garbage_ratio, uint64_t max_bytes)
+{
+    assert(m_open);
+    std::optional<uint32_t> candidate;
+    float candidate_ratio = max_garbage_ratio;
+    for (const auto& [segment, info] : m_segments) {
+        if (segment == m_active_segment_id || info.size == 0)
+            continue;
+        const auto ratio = 1.f - float(info.live) / float(info.size);
+        if (ratio > candidate_ratio) {
+            candidate = segment;
+            candidate_ratio = ratio;
+        }
+    }
+    if (!candidate) {
+        if (const auto r = commit(); !r.has_value())
+            return tl::unexpected(r.error());
+        return false;
+    }
+
+    // the moved records don't count as live in the candidate any more, so it stays the candidate until it is empty.
+    std::vector<std::pair<tile::Id, Meta>> live;
+    uint64_t n_bytes = 0;
+    bool done = true;
+    for (const auto& [id, entry] : m_entries) {
+        if (entry.segment != *candidate)
+            continue;
+        if (!live.empty() && n_bytes + entry.size > max_bytes) {
+            done = false;
+            break;
+        }
+        live.emplace_back(id, entry.meta);
+        n_bytes += entry.size;
+    }
+    for (const auto& [id, meta] : live) {
+        const auto payload = read(id);
+        if (!payload.has_value())
+            return tl::unexpected(payload.error());
+        if (const auto r = put(id, *payload, meta); !r.has_value())
+            return tl::unexpected(r.error());
+    }
+    if (const auto r = commit(); !r.has_value())
+        return tl::unexpected(r.error());
+    if (!done)
+        return true;
+    // a crash before this point leaves an unreferenced segment, which is deleted when opening.
+    unmap(*candidate);
+    std::error_code ec;
+    std::filesystem::remove(segment_path(m_directory, *candidate), ec);
+    m_segments.erase(*candidate);
+    return false;
+}
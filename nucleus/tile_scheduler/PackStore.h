@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <tl/expected.hpp>
+
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+/// log structured storage for the disk cache, replacing one file per tile.
+/// payloads are appended to segment files (segment_<n>.alp_pack), which are never rewritten. every payload is preceded by a small
+/// record header (magic, tile id, size), so a read can verify that it got what the index promised.
+/// the index (index.alp_index) is a journal: a header with the format (e.g., the tile type version), followed by blocks of changes.
+/// a commit syncs the segment first and then appends one checksummed block, a crash in between leaves a truncated block that is
+/// dropped when opening. when the journal grows much larger than the index, it is checkpointed into a fresh file (atomic rename).
+/// compaction moves the live records of a segment with much garbage to the active segment, at most one segment per call.
+/// not thread safe.
+class PackStore {
+public:
+    struct Meta {
+        uint64_t visited = 0;
+        uint64_t created = 0;
+    };
+    struct Entry {
+        Meta meta;
+        uint32_t segment = 0;
+        uint32_t size = 0;
+        uint64_t offset = 0; // of the payload, after the record header
+    };
+    struct SegmentInfo {
+        uint64_t size = 0;
+        uint64_t live = 0; // bytes of records that are referenced by the index
+    };
+    using Entries = std::unordered_map<tile::Id, Entry, tile::Id::Hasher>;
+    static constexpr uint32_t version = 1;
+    static constexpr uint64_t default_max_segment_size = 64ull * 1024 * 1024;
+
+    PackStore();
+    PackStore(const PackStore&) = delete;
+    PackStore& operator=(const PackStore&) = delete;
+    ~PackStore();
+
+    /// opens or creates the store. fails if it was written with a different format, or the index is damaged beyond the last commit.
+    [[nodiscard]] tl::expected<void, std::string> open(const std::filesystem::path& directory, QByteArrayView format);
+    void close();
+    [[nodiscard]] bool is_open() const;
+    [[nodiscard]] const std::filesystem::path& directory() const;
+    /// segments are not split, a single record can be larger.
+    void set_max_segment_size(uint64_t max_segment_size);
+
+    [[nodiscard]] const Entries& entries() const;
+    /// appends the payload to the active segment. it is durable after the next commit.
+    [[nodiscard]] tl::expected<void, std::string> put(const tile::Id& id, QByteArrayView payload, const Meta& meta);
+    void update_meta(const tile::Id& id, const Meta& meta);
+    void remove(const tile::Id& id);
+    [[nodiscard]] tl::expected<QByteArray, std::string> read(const tile::Id& id) const;
+    [[nodiscard]] tl::expected<void, std::string> commit();
+    /// compacts the segment with the most garbage, if its garbage ratio is above max_garbage_ratio. includes a commit.
+    /// moves about max_bytes of records per call (at least one), and returns true if that segment isn't done yet. the caller can release its
+    /// locks in between, so that reads don't wait for a whole segment.
+    [[nodiscard]] tl::expected<bool, std::string> compact_step(float max_garbage_ratio = 0.5f, uint64_t max_bytes = std::numeric_limits<uint64_t>::max());
+
+    [[nodiscard]] const std::map<uint32_t, SegmentInfo>& segments() const;
+    [[nodiscard]] uint64_t journal_size() const;
+
+    static std::filesystem::path segment_path(const std::filesystem::path& directory, uint32_t segment);
+    static std::filesystem::path index_path(const std::filesystem::path& directory);
+
+private:
+    enum class Op : uint32_t { Put = 0, Meta = 1, Remove = 2 };
+    struct JournalRecord {
+        Op op;
+        uint32_t zoom_level;
+        uint32_t x;
+        uint32_t y;
+        uint32_t segment;
+        uint32_t size;
+        uint64_t offset;
+        uint64_t visited;
+        uint64_t created;
+    };
+    struct Mapping {
+        std::unique_ptr<QFile> file;
+        const uchar* data = nullptr;
+        uint64_t size = 0;
+    };
+
+    [[nodiscard]] tl::expected<void, std::string> replay_journal(QByteArrayView format);
+    [[nodiscard]] tl::expected<void, std::string> write_checkpoint();
+    [[nodiscard]] tl::expected<void, std::string> open_active_segment(uint32_t segment);
+    void apply(const JournalRecord& record);
+    void release(const tile::Id& id);
+    void unmap(uint32_t segment) const;
+    [[nodiscard]] QByteArray header() const;
+
+    std::filesystem::path m_directory;
+    QByteArray m_format;
+    Entries m_entries;
+    std::map<uint32_t, SegmentInfo> m_segments;
+    std::vector<JournalRecord> m_pending;
+    mutable QFile m_active_segment; // flushed before reading from it
+    uint32_t m_active_segment_id = 0;
+    uint64_t m_journal_size = 0;
+    uint64_t m_max_segment_size = default_max_segment_size;
+    bool m_open = false;
+    mutable std::unordered_map<uint32_t, Mapping> m_mappings;
+};
+
+} // namespace nucleus::tile_scheduler
@@ -18,6 +18,10 @@
 
 #include "QuadAssembler.h"
 
+#include <algorithm>
+
+#include "Telemetry.h"
+
 using namespace nucleus::tile_scheduler;
 
 QuadAssembler::QuadAssembler(QObject *parent)
@@ -33,6 +37,8 @@ size_t QuadAssembler::n_items_in_flight() const
 void QuadAssembler::load(const tile::Id& tile_id)
 {
     m_quads[tile_id].id = tile_id;
+    Telemetry::instance().set(Telemetry::Gauge::QuadAssemblerInFlight, m_quads.size());
+    emit quad_requested(tile_id);
     for (const auto& child_id : tile_id.children()) {
         emit tile_requested(child_id);
     }
@@ -40,10 +46,26 @@ void QuadAssembler::load(const tile::Id& tile_id)
 
 void QuadAssembler::deliver_tile(const tile_types::LayeredTile& tile)
 {
-    auto& quad = m_quads[tile.id.parent()];
+    const auto quad_iter = m_quads.find(tile.id.parent());
+    if (quad_iter == m_quads.end())
+        return; // cancelled
+    auto& quad = quad_iter->second;
+    // a quad that was cancelled and requested again can receive a tile twice
+    const auto duplicate = std::find_if(quad.tiles.begin(), quad.tiles.begin() + quad.n_tiles, [&tile](const auto& t) { return t.id == tile.id; });
+    if (duplicate != quad.tiles.begin() + quad.n_tiles) {
+        *duplicate = tile;
+        return;
+    }
     quad.tiles[quad.n_tiles++] = tile;
     if (quad.n_tiles == 4) {
         emit quad_loaded(quad);
         m_quads.erase(quad.id);
+        Telemetry::instance().set(Telemetry::Gauge::QuadAssemblerInFlight, m_quads.size());
     }
 }
+
+void QuadAssembler::cancel(const tile::Id& tile_id)
+{
+    m_quads.erase(tile_id);
+    Telemetry::instance().set(Telemetry::Gauge::QuadAssemblerInFlight, m_quads.size());
+}
@@ -40,8 +40,12 @@ public:
 public slots:
     void load(const tile::Id& tile_id);
     void deliver_tile(const tile_types::LayeredTile& tile);
+    /// forgets the quad, tiles arriving later for it are dropped.
+    void cancel(const tile::Id& tile_id);
 
 signals:
+    /// emitted once per quad, before the tile_requested of its children. connect either this (TileLoadService::load_quad) or tile_requested.
+    void quad_requested(const tile::Id& quad_id);
     void tile_requested(const tile::Id& tile_id);
     void quad_loaded(const tile_types::TileQuad& tile);
 };
@@ -0,0 +1,76 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "tile_types.h"
+
+namespace nucleus::tile_scheduler {
+
+/// max heap of quad requests. requests with equal priority come out in the order they were pushed.
+class QuadRequestQueue {
+    struct Item {
+        tile_types::QuadRequest request;
+        uint64_t sequence;
+    };
+    static bool less_urgent(const Item& a, const Item& b)
+    {
+        return a.request.priority < b.request.priority || (a.request.priority == b.request.priority && a.sequence > b.sequence);
+    }
+
+    std::vector<Item> m_heap;
+    uint64_t m_sequence = 0;
+
+public:
+    void push(const tile_types::QuadRequest& request)
+    {
+        m_heap.push_back({ request, m_sequence++ });
+        std::push_heap(m_heap.begin(), m_heap.end(), less_urgent);
+    }
+    [[nodiscard]] const tile_types::QuadRequest& top() const
+    {
+        assert(!m_heap.empty());
+        return m_heap.front().request;
+    }
+    tile_types::QuadRequest pop()
+    {
+        assert(!m_heap.empty());
+        std::pop_heap(m_heap.begin(), m_heap.end(), less_urgent);
+        const auto request = m_heap.back().request;
+        m_heap.pop_back();
+        return request;
+    }
+    void erase(const tile::Id& id)
+    {
+        if (std::erase_if(m_heap, [&id](const Item& item) { return item.request.id == id; }) > 0)
+            std::make_heap(m_heap.begin(), m_heap.end(), less_urgent);
+    }
+    [[nodiscard]] bool empty() const { return m_heap.empty(); }
+    [[nodiscard]] size_t size() const { return m_heap.size(); }
+    void clear()
+    {
+        m_heap.clear();
+        m_sequence = 0;
+    }
+};
+
+} // namespace nucleus::tile_scheduler
@@ -20,6 +20,7 @@
 
 #include <QTimer>
 
+#include "Telemetry.h"
 #include "utils.h"
 
 using namespace nucleus::tile_scheduler;
@@ -52,25 +53,26 @@ size_t RateLimiter::queue_size() const
     return m_request_queue.size();
 }
 
-void RateLimiter::request_quad(const tile::Id& id)
+void RateLimiter::request_quad(const tile::Id& id, float priority)
 {
-    m_request_queue.push_back(id);
+    m_request_queue.push({ id, priority });
     process_request_queue();
 }
 
+void RateLimiter::cancel_quad(const tile::Id& id)
+{
+    m_request_queue.erase(id);
+    Telemetry::instance().set(Telemetry::Gauge::RateLimiterQueued, m_request_queue.size());
+}
+
 void RateLimiter::process_request_queue()
 {
     const auto current_msecs = utils::time_since_epoch();
     std::erase_if(m_in_flight, [&current_msecs, this](const auto& x) { return x < current_msecs - m_rate_period_msecs; });
-    unsigned requested_now = 0;
-    for (const auto& id : m_request_queue) {
-        if (m_in_flight.size() >= m_rate)
-            break;
+    while (!m_request_queue.empty() && m_in_flight.size() < m_rate) {
         m_in_flight.push_back(current_msecs);
-        ++requested_now;
-        emit quad_requested(id);
+        emit quad_requested(m_request_queue.pop().id);
     }
-    m_request_queue.erase(m_request_queue.cbegin(), m_request_queue.cbegin() + requested_now);
 
     if (!m_request_queue.empty()) {
         const auto age_of_oldest_in_flight = current_msecs - m_in_flight.front();
@@ -78,4 +80,5 @@ void RateLimiter::process_request_queue()
 
         m_update_timer->start(int(1 + m_rate_period_msecs - age_of_oldest_in_flight));
     }
+    Telemetry::instance().set(Telemetry::Gauge::RateLimiterQueued, m_request_queue.size());
 }
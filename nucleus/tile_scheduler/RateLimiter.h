@@ -24,6 +24,8 @@
 
 #include <radix/tile.h>
 
+#include "QuadRequestQueue.h"
+
 class QTimer;
 
 namespace nucleus::tile_scheduler {
@@ -33,7 +35,7 @@ class RateLimiter : public QObject
     Q_OBJECT
     unsigned m_rate = 100;
     unsigned m_rate_period_msecs = 1000 * 1;
-    std::vector<tile::Id> m_request_queue;
+    QuadRequestQueue m_request_queue;
     std::vector<uint64_t> m_in_flight;
     std::unique_ptr<QTimer> m_update_timer;
 
@@ -45,7 +47,10 @@ public:
     size_t queue_size() const;
 
 public slots:
-    void request_quad(const tile::Id& id);
+    /// queued requests are sent in the order of their priority once the rate permits.
+    void request_quad(const tile::Id& id, float priority = 0);
+    /// drops the request, if it is still queued.
+    void cancel_quad(const tile::Id& id);
 
 private slots:
     void process_request_queue();
@@ -18,12 +18,17 @@
 
 #include "Scheduler.h"
 
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <QBuffer>
 #include <QDebug>
 #include <QNetworkInformation>
 #include <QStandardPaths>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 
 #include "nucleus/tile_scheduler/utils.h"
@@ -31,6 +36,19 @@
 #include "radix/quad_tree.h"
 
 using namespace nucleus::tile_scheduler;
+using nucleus::utils::texture_compression::Algorithm;
+
+namespace {
+tile_types::GpuTexture to_gpu_texture(const std::vector<QImage>& mip_chain, Algorithm algorithm)
+{
+    assert(!mip_chain.empty());
+    tile_types::GpuTexture texture { algorithm, unsigned(mip_chain.front().width()), unsigned(mip_chain.front().height()), {} };
+    texture.levels.reserve(mip_chain.size());
+    for (const auto& level : mip_chain)
+        texture.levels.push_back(nucleus::utils::texture_compression::compress(level, algorithm));
+    return texture;
+}
+} // namespace
 
 Scheduler::Scheduler(QObject* parent)
     : Scheduler { white_jpeg_tile(m_ortho_tile_size), black_png_tile(m_height_tile_size), parent }
@@ -53,15 +71,47 @@ Scheduler::Scheduler(const QByteArray& default_ortho_tile, const QByteArray& def
     m_persist_timer->setSingleShot(true);
     connect(m_persist_timer.get(), &QTimer::timeout, this, &Scheduler::persist_tiles);
 
+    m_gpu_update_timer = std::make_unique<QTimer>(this);
+    m_gpu_update_timer->setSingleShot(true);
+    connect(m_gpu_update_timer.get(), &QTimer::timeout, this, &Scheduler::update_gpu_quads);
+
     m_default_ortho_tile = std::make_shared<QByteArray>(default_ortho_tile);
     m_default_height_tile = std::make_shared<QByteArray>(default_height_tile);
+    m_default_ortho_texture = std::make_shared<const tile_types::GpuTexture>(
+        to_gpu_texture(nucleus::utils::tile_conversion::toMipChainRGBA(*m_default_ortho_tile), m_texture_compression));
+
+    m_texture_decoder_pool = std::make_unique<QThreadPool>();
+    m_disk_cache_loader = std::make_unique<QThreadPool>();
+    m_disk_cache_loader->setMaxThreadCount(1);
+    m_working_set_loader = std::make_unique<QThreadPool>();
+    m_working_set_loader->setMaxThreadCount(1);
+    m_disk_cache_writer = std::make_unique<QThreadPool>();
+    m_disk_cache_writer->setMaxThreadCount(1);
+#ifdef ALP_ENABLE_THREADING
+    set_n_texture_decoder_threads(unsigned(std::clamp(QThread::idealThreadCount() / 2, 1, 4)));
+#endif
 }
 
-Scheduler::~Scheduler() = default;
+Scheduler::~Scheduler()
+{
+    // decoders post their results back to this object, they must be done before it goes away.
+    m_texture_decoder_pool->waitForDone();
+    m_disk_cache_loader_cancelled = true;
+    m_disk_cache_loader->waitForDone();
+    m_working_set_loader->waitForDone();
+    m_disk_cache_writer->waitForDone();
+}
 
 void Scheduler::update_camera(const camera::Definition& camera)
 {
     m_current_camera = camera;
+    m_lod_cut_outdated = true;
+    schedule_update();
+}
+
+void Scheduler::update_prefetch_cameras(const std::vector<camera::Definition>& cameras)
+{
+    m_prefetch_cameras = cameras;
     schedule_update();
 }
 
@@ -73,6 +123,8 @@ void Scheduler::receive_quad(const tile_types::TileQuad& new_quad)
     // so we'll simply treat any 404 as network error.
     // however, we need to pass tiles with zoomlevel < 10, otherwise the top of the tree won't be built.
     if (new_quad.network_info().status == Status::Good || new_quad.id.zoom_level < 10) {
+        m_working_set_failed.erase(new_quad.id);
+        refine_bounds(new_quad);
         m_ram_cache.insert(new_quad);
         schedule_purge();
         schedule_update();
@@ -83,6 +135,8 @@ void Scheduler::receive_quad(const tile_types::TileQuad& new_quad)
     switch (new_quad.network_info().status) {
     case Status::Good:
     case Status::NotFound:
+        m_working_set_failed.erase(new_quad.id);
+        refine_bounds(new_quad);
         m_ram_cache.insert(new_quad);
         schedule_purge();
         schedule_update();
@@ -120,33 +174,67 @@ void Scheduler::set_network_reachability(QNetworkInformation::Reachability reach
 
 void Scheduler::update_gpu_quads()
 {
-    const auto should_refine = tile_scheduler::utils::refineFunctor(m_current_camera, m_aabb_decorator, m_permissible_screen_space_error, m_ortho_tile_size);
-    std::vector<tile_types::TileQuad> gpu_candidates;
-    m_ram_cache.visit([this, &gpu_candidates, &should_refine](const tile_types::TileQuad& quad) {
+    const auto& cut = lod_cut();
+    const auto should_refine = [&cut](const tile::Id& id) { return cut.is_refined(id); };
+    const auto now = utils::time_since_epoch();
+    std::erase_if(m_gpu_evicted, [&](const auto& entry) { return !should_refine(entry.first) || entry.second + gpu_eviction_retry_interval < now; });
+    std::vector<tile_types::TileQuad> wanted_quads;
+    m_ram_cache.visit([this, &wanted_quads, &should_refine](const tile_types::TileQuad& quad) {
         if (!should_refine(quad.id))
             return false;
         if (m_gpu_cached.contains(quad.id))
             return true;
 
-        gpu_candidates.push_back(quad);
+        wanted_quads.push_back(quad);
         return true;
     });
 
+    // quads only go to the gpu once their textures are decoded, and never before their parent (wanted_quads is in depth first order).
+    std::vector<tile_types::TileQuad> gpu_candidates;
+    std::unordered_set<tile::Id, tile::Id::Hasher> candidate_ids;
+    std::unordered_set<tile::Id, tile::Id::Hasher> pending_ids;
+    for (const auto& quad : wanted_quads) {
+        if (!m_decoded_textures.contains(quad.id) && !m_gpu_evicted.contains(quad.id))
+            decode_textures(quad);
+        const auto parent_ready = quad.id.zoom_level == 0 || m_gpu_cached.contains(quad.id.parent()) || candidate_ids.contains(quad.id.parent());
+        if (parent_ready && m_decoded_textures.contains(quad.id)) {
+            gpu_candidates.push_back(quad);
+            candidate_ids.insert(quad.id);
+        } else {
+            pending_ids.insert(quad.id);
+        }
+    }
+
     for (const auto& q : gpu_candidates) {
-        m_gpu_cached.insert(tile_types::GpuCacheInfo { q.id });
+        // the same bytes as GpuTileQuad::n_bytes, the textures are already decoded.
+        size_t n_bytes = 0;
+        for (unsigned i = 0; i < 4; ++i) {
+            for (const auto& array : { q.tiles[i].indices, q.tiles[i].positions, q.tiles[i].uvs })
+                n_bytes += array ? size_t(array->size()) : 0;
+            for (const auto& level : m_decoded_textures.at(q.id)[i]->levels)
+                n_bytes += size_t(level.size());
+        }
+        m_gpu_cached.insert(tile_types::GpuCacheInfo { q.id, n_bytes });
     }
 
-    m_gpu_cached.visit([&should_refine](const tile_types::GpuCacheInfo& quad) {
-        return should_refine(quad.id);
+    std::vector<tile::Id> visible_cut;
+    m_gpu_cached.visit([&should_refine, &visible_cut](const tile_types::GpuCacheInfo& quad) {
+        if (!should_refine(quad.id))
+            return false;
+        visible_cut.push_back(quad.id);
+        return true;
     });
 
-    const auto superfluous_quads = m_gpu_cached.purge(m_gpu_quad_limit);
+    m_gpu_eviction_policy->update_view(m_current_camera.position(), visible_cut, now);
+    const auto superfluous_quads = m_gpu_cached.purge_bytes(size_t(m_gpu_budget_mib) * 1024 * 1024, *m_gpu_eviction_policy);
 
     // elimitate double entries (happens when the gpu has not enough space for all quads selected above)
     std::unordered_set<tile::Id, tile::Id::Hasher> superfluous_ids;
     superfluous_ids.reserve(superfluous_quads.size());
-    for (const auto& quad : superfluous_quads)
+    for (const auto& quad : superfluous_quads) {
         superfluous_ids.insert(quad.id);
+        m_gpu_evicted[quad.id] = now;
+    }
 
     std::erase_if(gpu_candidates, [&superfluous_ids](const auto& quad) {
         if (superfluous_ids.contains(quad.id)) {
@@ -166,6 +254,8 @@ void Scheduler::update_gpu_quads()
                        tile_types::GpuTileQuad gpu_quad;
                        gpu_quad.id = quad.id;
                        assert(quad.n_tiles == 4);
+                       const auto& textures = m_decoded_textures.at(quad.id);
+                       refine_bounds(quad); // quads from the disk cache didn't pass receive_quad
                        for (unsigned i = 0; i < 4; ++i) {
                            gpu_quad.tiles[i].id = quad.tiles[i].id;
                            gpu_quad.tiles[i].bounds = m_aabb_decorator->aabb(quad.tiles[i].id);
@@ -173,65 +263,205 @@ void Scheduler::update_gpu_quads()
                            gpu_quad.tiles[i].indices = quad.tiles[i].indices;
                            gpu_quad.tiles[i].positions = quad.tiles[i].positions;
                            gpu_quad.tiles[i].uvs = quad.tiles[i].uvs;
-
-                           const auto* texture_data = m_default_ortho_tile.get();
-                           if (quad.tiles[i].texture->size()) {
-                               texture_data = quad.tiles[i].texture.get();
-                           }
-
-                           auto texture = nucleus::utils::tile_conversion::toQImage(*texture_data);
-                           gpu_quad.tiles[i].texture = std::make_shared<QImage>(std::move(texture));
-                           // qDebug() << "Texture: " << gpu_quad.tiles[i].texture->width() << "x" << gpu_quad.tiles[i].texture->height();
+                           gpu_quad.tiles[i].position_offset = quad.tiles[i].position_offset;
+                           gpu_quad.tiles[i].position_scale = quad.tiles[i].position_scale;
+                           gpu_quad.tiles[i].texture = textures[i];
                        }
                        return gpu_quad;
                    });
 
+    // decoded textures are only kept for quads that are still waiting for their parent.
+    std::erase_if(m_decoded_textures, [&pending_ids](const auto& entry) { return !pending_ids.contains(entry.first); });
+
     emit gpu_quads_updated(new_gpu_quads, { superfluous_ids.cbegin(), superfluous_ids.cend() });
     update_stats();
 }
 
+void Scheduler::update_gpu_quad_size(const tile::Id& quad_id, size_t n_bytes)
+{
+    // the quad might have been purged while it was uploaded, set_n_bytes ignores it then.
+    m_gpu_cached.set_n_bytes(quad_id, n_bytes);
+}
+
+void Scheduler::decode_textures(const tile_types::TileQuad& quad)
+{
+    if (m_textures_in_decoding.contains(quad.id))
+        return;
+
+    std::array<std::shared_ptr<QByteArray>, 4> encoded;
+    std::array<tile::Id, 4> ids;
+    std::array<uint64_t, 4> timestamps;
+    for (unsigned i = 0; i < 4; ++i) {
+        encoded[i] = quad.tiles[i].texture;
+        ids[i] = quad.tiles[i].id;
+        timestamps[i] = quad.tiles[i].network_info.timestamp;
+    }
+    const auto decode = [encoded, ids, timestamps, algorithm = m_texture_compression, cache = m_transcoded_texture_cache,
+                            default_texture = m_default_ortho_texture]() {
+        QuadTextures textures;
+        for (unsigned i = 0; i < 4; ++i) {
+            textures[i] = default_texture;
+            if (!encoded[i] || encoded[i]->isEmpty())
+                continue;
+            if (cache) {
+                auto cached = cache->read(ids[i], timestamps[i]);
+                if (cached) {
+                    textures[i] = std::make_shared<const tile_types::GpuTexture>(std::move(*cached));
+                    continue;
+                }
+            }
+            std::shared_ptr<const tile_types::GpuTexture> texture;
+            {
+                const Telemetry::ScopedTiming timing(Telemetry::Timing::TextureDecode);
+                const auto mip_chain = nucleus::utils::tile_conversion::toMipChainRGBA(*encoded[i]);
+                if (!mip_chain.empty())
+                    texture = std::make_shared<const tile_types::GpuTexture>(to_gpu_texture(mip_chain, algorithm));
+            }
+            if (!texture)
+                continue;
+            if (cache) {
+                const auto r = cache->write(ids[i], timestamps[i], *texture);
+                if (!r.has_value())
+                    qDebug() << QString("Caching transcoded texture failed: %1").arg(QString::fromStdString(r.error()));
+            }
+            textures[i] = std::move(texture);
+        }
+        return textures;
+    };
+
+    if (m_n_texture_decoder_threads == 0) {
+        m_decoded_textures[quad.id] = decode();
+        return;
+    }
+
+    m_textures_in_decoding.insert(quad.id);
+    m_texture_decoder_pool->start([this, id = quad.id, generation = m_texture_generation, decode]() {
+        auto textures = decode();
+        QMetaObject::invokeMethod(
+            this,
+            [this, id, generation, textures = std::move(textures)]() {
+                if (generation != m_texture_generation)
+                    return; // decoded for another texture compression
+                m_textures_in_decoding.erase(id);
+                m_decoded_textures[id] = textures;
+                if (m_enabled && !m_gpu_update_timer->isActive())
+                    m_gpu_update_timer->start(0);
+            },
+            Qt::QueuedConnection);
+    });
+}
+
 void Scheduler::send_quad_requests()
 {
     if (!m_network_requests_enabled)
         return;
-    auto currently_active_tiles = tiles_for_current_camera_position();
     const auto current_time = utils::time_since_epoch();
-    std::erase_if(currently_active_tiles, [this, current_time](const tile::Id& id) {
-        return m_ram_cache.contains(id) && m_ram_cache.peak_at(id).network_info().timestamp + m_retirement_age_for_tile_cache > current_time;
-    });
-    emit quads_requested(currently_active_tiles);
+    std::unordered_map<tile::Id, float, tile::Id::Hasher> priorities;
+    std::vector<tile_types::QuadRequest> requests;
+
+    // a quad is only shown once its parent is, so a child never goes before its parent. parents come first in the traversal order.
+    // visible quads have a positive priority. prefetched quads are mapped into (-1, 0), so they go only when no visible quad waits.
+    size_t n_hits = 0;
+    const auto add_requests = [&](const camera::Definition& camera, bool prefetch) {
+        const auto priority = tile_scheduler::utils::priorityFunctor(camera, m_aabb_decorator, m_ortho_tile_size);
+        const auto ids = prefetch ? tiles_for_camera(camera) : tiles_for_current_camera_position();
+        // reading from the disk cache is cheap compared to the network, quads on disk are not requested.
+        load_working_set(ids);
+        for (const auto& id : ids) {
+            if (prefetch && priorities.contains(id))
+                continue;
+            auto p = prefetch ? -1.f / (1.f + priority(id)) : priority(id);
+            if (id.zoom_level > 0) {
+                if (const auto parent = priorities.find(id.parent()); parent != priorities.end())
+                    p = std::min(p, parent->second);
+            }
+            priorities[id] = p;
+            if (m_working_set_in_loading.contains(id)
+                || (m_ram_cache.contains(id) && m_ram_cache.peak_at(id).network_info().timestamp + m_retirement_age_for_tile_cache > current_time)) {
+                n_hits += prefetch ? 0 : 1;
+                continue;
+            }
+            requests.push_back({ id, p });
+        }
+    };
+    add_requests(m_current_camera, false);
+    // the hit ratio is about the quads the current camera needs, prefetching is speculative.
+    Telemetry::instance().add(Telemetry::Counter::CacheHits, n_hits);
+    Telemetry::instance().add(Telemetry::Counter::CacheMisses, requests.size());
+    for (const auto& camera : m_prefetch_cameras)
+        add_requests(camera, true);
+    emit quads_requested(requests);
 }
 
 void Scheduler::purge_ram_cache()
 {
-    if (m_ram_cache.n_cached_objects() <= unsigned(float(m_ram_quad_limit) * 1.05f)){
+    const auto ram_budget = size_t(m_ram_budget_mib) * 1024 * 1024;
+    const auto disk_budget = tile_disk_budget();
+    if (m_ram_cache.n_bytes() <= size_t(double(ram_budget) * 1.05) && m_ram_cache.n_disk_only_bytes() <= size_t(double(disk_budget) * 1.05)) {
         return;
     }
 
-    const auto should_refine = tile_scheduler::utils::refineFunctor(m_current_camera, m_aabb_decorator, m_permissible_screen_space_error, m_ortho_tile_size);
-    m_ram_cache.visit(
-        [&should_refine](const tile_types::TileQuad& quad) { return should_refine(quad.id); });
-    m_ram_cache.purge(m_ram_quad_limit);
+    const auto& cut = lod_cut();
+    const auto should_refine = [&cut](const tile::Id& id) { return cut.is_refined(id); };
+    std::vector<tile::Id> visible_cut;
+    m_ram_cache.visit([&should_refine, &visible_cut](const tile_types::TileQuad& quad) {
+        if (!should_refine(quad.id))
+            return false;
+        visible_cut.push_back(quad.id);
+        return true;
+    });
+    m_eviction_policy->update_view(m_current_camera.position(), visible_cut, utils::time_since_epoch());
+    // quads dropped from ram stay on disk, if they were written already. so the disk budget is applied afterwards.
+    const auto purged_quads = m_ram_cache.purge_bytes(ram_budget, *m_eviction_policy);
+    m_ram_cache.purge_disk_only_bytes(disk_budget, *m_eviction_policy);
+    if (m_aabb_decorator) {
+        bool bounds_changed = false;
+        for (const auto& quad : purged_quads) {
+            for (const auto& tile : quad.tiles) {
+                if (m_aabb_decorator->remove_mesh_heights(tile.id)) {
+                    m_lod_cut.invalidate(tile.id);
+                    bounds_changed = true;
+                }
+            }
+        }
+        m_lod_cut_outdated = m_lod_cut_outdated || bounds_changed;
+    }
     update_stats();
 }
 
 void Scheduler::persist_tiles()
 {
-    const auto start = std::chrono::steady_clock::now();
-    const auto r = m_ram_cache.write_to_disk(disk_cache_path());
-    const auto diff = std::chrono::steady_clock::now() - start;
-
-    if (diff > std::chrono::milliseconds(50))
-        qDebug() << QString("Scheduler::persist_tiles took %1ms for %2 quads.")
-                        .arg(std::chrono::duration_cast<std::chrono::milliseconds>(diff).count())
-                        .arg(m_ram_cache.n_cached_objects());
-
-    if (!r.has_value()) {
-        qDebug() << QString("Writing tiles to disk into %1 failed: %2. Removing all files.")
-                        .arg(QString::fromStdString(disk_cache_path().string()))
-                        .arg(QString::fromStdString(r.error()));
-        std::filesystem::remove_all(disk_cache_path());
+    if (m_persist_in_flight) {
+        schedule_persist();
+        return;
     }
+    m_persist_in_flight = true;
+    // only the dirty set is taken under the cache lock, serialisation, file io and fsyncs happen on the writer thread.
+    const auto write = [this, cleanup = transcoded_texture_cleanup()]() {
+        const auto start = std::chrono::steady_clock::now();
+        const auto r = m_ram_cache.write_to_disk(disk_cache_path());
+        cleanup();
+        const auto diff = std::chrono::steady_clock::now() - start;
+        QMetaObject::invokeMethod(
+            this,
+            [this, r, diff]() {
+                m_persist_in_flight = false;
+                if (diff > std::chrono::milliseconds(500))
+                    qDebug() << QString("Scheduler::persist_tiles took %1ms in the background.").arg(std::chrono::duration_cast<std::chrono::milliseconds>(diff).count());
+                if (!r.has_value()) {
+                    qDebug() << QString("Writing tiles to disk into %1 failed: %2. Removing all files.")
+                                    .arg(QString::fromStdString(disk_cache_path().string()))
+                                    .arg(QString::fromStdString(r.error()));
+                    m_ram_cache.clear_disk(disk_cache_path());
+                }
+            },
+            Qt::QueuedConnection);
+    };
+#ifdef ALP_ENABLE_THREADING
+    m_disk_cache_writer->start(write);
+#else
+    write();
+#endif
 }
 
 void Scheduler::schedule_update()
@@ -261,28 +491,151 @@ void Scheduler::update_stats()
 {
     m_statistics.n_tiles_in_ram_cache = m_ram_cache.n_cached_objects();
     m_statistics.n_tiles_in_gpu_cache = m_gpu_cached.n_cached_objects();
+    m_statistics.n_bytes_in_ram_cache = m_ram_cache.n_bytes();
+    m_statistics.n_bytes_on_disk_only = m_ram_cache.n_disk_only_bytes();
+    m_statistics.n_bytes_in_gpu_cache = m_gpu_cached.n_bytes();
+    // walking the ram cache and the histograms isn't free, and this is called for every received quad.
+    const auto now = utils::time_since_epoch();
+    if (now - m_last_telemetry_update >= telemetry_interval) {
+        m_last_telemetry_update = now;
+        auto& telemetry = Telemetry::instance();
+        telemetry.set(Telemetry::Gauge::RamCacheBytes, m_ram_cache.n_bytes());
+        m_statistics.telemetry = telemetry.snapshot();
+    }
     emit statistics_updated(m_statistics);
 }
 
 void Scheduler::read_disk_cache()
 {
-    const auto r = m_ram_cache.read_from_disk(disk_cache_path());
+    m_disk_cache_loader_cancelled = true;
+    m_disk_cache_loader->waitForDone();
+    m_working_set_loader->waitForDone();
+    const auto r = m_ram_cache.read_index_from_disk(disk_cache_path());
     if (r.has_value()) {
         update_stats();
+        load_disk_cache_in_background();
     } else {
         qDebug() << QString("Reading tiles from disk cache (%1) failed: \n%2\nRemoving all files.")
                         .arg(QString::fromStdString(disk_cache_path().string()))
                         .arg(QString::fromStdString(r.error()));
-        std::filesystem::remove_all(disk_cache_path());
+        m_ram_cache.clear_disk(disk_cache_path());
     }
 }
 
-std::vector<tile::Id> Scheduler::tiles_for_current_camera_position() const
+void Scheduler::load_disk_cache_in_background()
+{
+#ifdef ALP_ENABLE_THREADING
+    m_disk_cache_loader_cancelled = false;
+    // most recently visited first, until the ram budget is used up. the rest stays on disk until the cameras need it.
+    m_disk_cache_loader->start([this, cleanup = transcoded_texture_cleanup(), ram_budget = size_t(m_ram_budget_mib) * 1024 * 1024]() {
+        cleanup();
+        const auto ids = m_ram_cache.disk_only_ids();
+        for (size_t i = 0; i < ids.size() && !m_disk_cache_loader_cancelled && m_ram_cache.n_bytes() < ram_budget; i += disk_cache_load_batch_size) {
+            const auto batch = std::vector<tile::Id>(ids.cbegin() + ptrdiff_t(i), ids.cbegin() + ptrdiff_t(std::min(i + disk_cache_load_batch_size, ids.size())));
+            if (const auto r = m_ram_cache.load_from_disk(batch); !r.has_value())
+                qDebug() << QString("Loading quads from the disk cache failed: %1. They will be requested again.").arg(QString::fromStdString(r.error()));
+            QMetaObject::invokeMethod(this, [this]() { schedule_purge(); }, Qt::QueuedConnection);
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this]() {
+                update_stats();
+                schedule_update();
+            },
+            Qt::QueuedConnection);
+    });
+#endif
+}
+
+void Scheduler::load_working_set(const std::vector<tile::Id>& ids)
+{
+    std::vector<tile::Id> on_disk;
+    std::copy_if(ids.cbegin(), ids.cend(), std::back_inserter(on_disk), [this](const tile::Id& id) {
+        return !m_working_set_in_loading.contains(id) && !m_working_set_failed.contains(id) && m_ram_cache.is_on_disk_only(id);
+    });
+    if (on_disk.empty())
+        return;
+    const auto load = [this](const std::vector<tile::Id>& ids) {
+        if (const auto r = m_ram_cache.load_from_disk(ids); !r.has_value())
+            qDebug() << QString("Loading quads from the disk cache failed: %1. They will be requested again.").arg(QString::fromStdString(r.error()));
+    };
+#ifdef ALP_ENABLE_THREADING
+    m_working_set_in_loading.insert(on_disk.cbegin(), on_disk.cend());
+    m_working_set_loader->start([this, load, on_disk]() {
+        load(on_disk);
+        QMetaObject::invokeMethod(
+            this,
+            [this, on_disk]() {
+                for (const auto& id : on_disk) {
+                    m_working_set_in_loading.erase(id);
+                    // not loaded again, until it comes from the network.
+                    if (!m_ram_cache.contains(id))
+                        m_working_set_failed.insert(id);
+                }
+                // failed quads are requested from the network, the rest goes to the gpu.
+                update_stats();
+                schedule_update();
+                schedule_purge();
+            },
+            Qt::QueuedConnection);
+    });
+#else
+    load(on_disk);
+#endif
+}
+
+std::function<void()> Scheduler::transcoded_texture_cleanup() const
+{
+    if (!m_transcoded_texture_cache)
+        return []() {};
+    const auto max_bytes = size_t(m_disk_budget_mib) * 1024 * 1024 / transcoded_texture_disk_share;
+    return [this, cache = m_transcoded_texture_cache, max_bytes]() {
+        cache->remove_unless(
+            [this](const tile::Id& id) { return id.zoom_level > 0 && (m_ram_cache.contains(id.parent()) || m_ram_cache.is_on_disk_only(id.parent())); },
+            max_bytes);
+    };
+}
+
+size_t Scheduler::tile_disk_budget() const
+{
+    const auto disk_budget = size_t(m_disk_budget_mib) * 1024 * 1024;
+    return m_transcoded_texture_cache ? disk_budget - disk_budget / transcoded_texture_disk_share : disk_budget;
+}
+
+std::vector<tile::Id> Scheduler::tiles_for_current_camera_position()
+{
+    return lod_cut().refined_tiles();
+}
+
+void Scheduler::refine_bounds(const tile_types::TileQuad& quad)
+{
+    if (!m_aabb_decorator)
+        return;
+    for (const auto& tile : quad.tiles) {
+        if (!tile.positions || tile.positions->isEmpty() || m_aabb_decorator->has_mesh_heights(tile.id))
+            continue;
+        // +-0.5 like utils::make_bounds, the positions are quantised to the box of offset and scale.
+        m_aabb_decorator->set_mesh_heights(tile.id, tile.position_offset.z - 0.5, tile.position_offset.z + double(tile.position_scale.z) + 0.5);
+        m_lod_cut.invalidate(tile.id);
+        m_lod_cut_outdated = true;
+    }
+}
+
+const LodCut& Scheduler::lod_cut()
+{
+    if (m_lod_cut_outdated) {
+        m_lod_cut.update(m_current_camera, m_aabb_decorator, m_permissible_screen_space_error, m_ortho_tile_size);
+        m_lod_cut_outdated = false;
+    }
+    return m_lod_cut;
+}
+
+std::vector<tile::Id> Scheduler::tiles_for_camera(const camera::Definition& camera) const
 {
     std::vector<tile::Id> all_inner_nodes;
     const auto all_leaves = quad_tree::onTheFlyTraverse(
         tile::Id{0, {0, 0}},
-        tile_scheduler::utils::refineFunctor(m_current_camera,
+        tile_scheduler::utils::refineFunctor(camera,
                                              m_aabb_decorator,
                                              m_permissible_screen_space_error,
                                              m_ortho_tile_size),
@@ -304,6 +657,38 @@ void Scheduler::set_retirement_age_for_tile_cache(unsigned int new_retirement_ag
     m_retirement_age_for_tile_cache = new_retirement_age_for_tile_cache;
 }
 
+void Scheduler::set_n_texture_decoder_threads(unsigned int n_texture_decoder_threads)
+{
+    m_n_texture_decoder_threads = n_texture_decoder_threads;
+    if (m_n_texture_decoder_threads > 0)
+        m_texture_decoder_pool->setMaxThreadCount(int(m_n_texture_decoder_threads));
+}
+
+unsigned Scheduler::n_texture_decoder_threads() const
+{
+    return m_n_texture_decoder_threads;
+}
+
+void Scheduler::set_texture_compression(Algorithm algorithm)
+{
+    if (algorithm == m_texture_compression)
+        return;
+    m_texture_compression = algorithm;
+    m_transcoded_texture_cache.reset();
+    if (m_texture_compression != Algorithm::Uncompressed_RGBA)
+        m_transcoded_texture_cache = std::make_shared<const TranscodedTextureCache>(texture_cache_path(), m_texture_compression);
+    m_default_ortho_texture = std::make_shared<const tile_types::GpuTexture>(
+        to_gpu_texture(nucleus::utils::tile_conversion::toMipChainRGBA(*m_default_ortho_tile), m_texture_compression));
+    ++m_texture_generation;
+    m_decoded_textures.clear();
+    m_textures_in_decoding.clear();
+}
+
+Algorithm Scheduler::texture_compression() const
+{
+    return m_texture_compression;
+}
+
 unsigned int Scheduler::persist_timeout() const
 {
     return m_persist_timeout;
@@ -358,6 +743,13 @@ std::filesystem::path Scheduler::disk_cache_path()
     return  base_path / "tile_cache";
 }
 
+std::filesystem::path Scheduler::texture_cache_path()
+{
+    const auto base_path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString());
+    std::filesystem::create_directories(base_path);
+    return base_path / "texture_cache";
+}
+
 void Scheduler::set_purge_timeout(unsigned int new_purge_timeout)
 {
     assert(new_purge_timeout < unsigned(std::numeric_limits<int>::max()));
@@ -368,24 +760,74 @@ void Scheduler::set_purge_timeout(unsigned int new_purge_timeout)
     }
 }
 
-void Scheduler::set_ram_quad_limit(unsigned int new_ram_quad_limit)
+void Scheduler::set_ram_budget(unsigned int new_ram_budget_mib)
+{
+    m_ram_budget_mib = new_ram_budget_mib;
+    schedule_purge();
+}
+
+unsigned int Scheduler::ram_budget() const
+{
+    return m_ram_budget_mib;
+}
+
+void Scheduler::set_gpu_budget(unsigned int new_gpu_budget_mib)
+{
+    m_gpu_budget_mib = new_gpu_budget_mib;
+    m_gpu_evicted.clear();
+    schedule_update();
+}
+
+unsigned int Scheduler::gpu_budget() const
+{
+    return m_gpu_budget_mib;
+}
+
+void Scheduler::set_disk_budget(unsigned int new_disk_budget_mib)
+{
+    m_disk_budget_mib = new_disk_budget_mib;
+    schedule_purge();
+}
+
+unsigned int Scheduler::disk_budget() const
+{
+    return m_disk_budget_mib;
+}
+
+void Scheduler::set_eviction_policy(std::shared_ptr<EvictionPolicy> new_eviction_policy)
+{
+    assert(new_eviction_policy);
+    m_eviction_policy = std::move(new_eviction_policy);
+}
+
+const std::shared_ptr<EvictionPolicy>& Scheduler::eviction_policy() const
+{
+    return m_eviction_policy;
+}
+
+void Scheduler::set_gpu_eviction_policy(std::shared_ptr<EvictionPolicy> new_gpu_eviction_policy)
 {
-    m_ram_quad_limit = new_ram_quad_limit;
+    assert(new_gpu_eviction_policy);
+    m_gpu_eviction_policy = std::move(new_gpu_eviction_policy);
 }
 
-void Scheduler::set_gpu_quad_limit(unsigned int new_gpu_quad_limit)
+const std::shared_ptr<EvictionPolicy>& Scheduler::gpu_eviction_policy() const
 {
-    m_gpu_quad_limit = new_gpu_quad_limit;
+    return m_gpu_eviction_policy;
 }
 
 void Scheduler::set_aabb_decorator(const utils::AabbDecoratorPtr& new_aabb_decorator)
 {
-    m_aabb_decorator = new_aabb_decorator;
+    // a copy, the mesh heights of received quads are set on it in the scheduler thread.
+    m_aabb_decorator = new_aabb_decorator ? std::make_shared<utils::AabbDecorator>(*new_aabb_decorator) : nullptr;
+    m_lod_cut.reset();
+    m_lod_cut_outdated = true;
 }
 
 void Scheduler::set_permissible_screen_space_error(float new_permissible_screen_space_error)
 {
     m_permissible_screen_space_error = new_permissible_screen_space_error;
+    m_lod_cut_outdated = true;
 }
 
 bool Scheduler::enabled() const
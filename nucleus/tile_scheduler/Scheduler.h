@@ -18,7 +18,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <QNetworkInformation>
 #include <QObject>
@@ -27,8 +31,13 @@
 #include "radix/tile.h"
 
 #include "Cache.h"
+#include "EvictionPolicy.h"
+#include "LodCut.h"
+#include "Telemetry.h"
+#include "TranscodedTextureCache.h"
 #include "tile_types.h"
 
+class QThreadPool;
 class QTimer;
 
 namespace nucleus::tile_scheduler {
@@ -43,7 +52,19 @@ public:
     struct Statistics {
         unsigned n_tiles_in_ram_cache = 0;
         unsigned n_tiles_in_gpu_cache = 0;
+        size_t n_bytes_in_ram_cache = 0;
+        size_t n_bytes_on_disk_only = 0;
+        size_t n_bytes_in_gpu_cache = 0;
+        /// refreshed at most every telemetry_interval msecs.
+        Telemetry::Snapshot telemetry;
     };
+    static constexpr unsigned telemetry_interval = 500;
+    /// quads per Cache::load_from_disk call of the background loader, it checks for cancellation in between.
+    static constexpr unsigned disk_cache_load_batch_size = 64;
+    static constexpr unsigned transcoded_texture_disk_share = 4;
+    static constexpr unsigned gpu_pinned_zoom_level = 1;
+    /// msecs, quads the gpu budget pushed out are tried again after that, even if they didn't leave the cut.
+    static constexpr unsigned gpu_eviction_retry_interval = 10'000;
 
     explicit Scheduler(QObject* parent = nullptr);
     explicit Scheduler(const QByteArray& default_ortho_tile, const QByteArray& default_height_tile, QObject* parent = nullptr);
@@ -58,9 +79,27 @@ public:
 
     void set_aabb_decorator(const utils::AabbDecoratorPtr& new_aabb_decorator);
 
-    void set_gpu_quad_limit(unsigned int new_gpu_quad_limit);
+    /// vram for quads on the gpu, counted from what TileManager reports (see update_gpu_quad_size).
+    void set_gpu_budget(unsigned int new_gpu_budget_mib);
+    [[nodiscard]] unsigned int gpu_budget() const;
 
-    void set_ram_quad_limit(unsigned int new_ram_quad_limit);
+    /// ram for cached quads. quads that are on disk already are only dropped from ram when purging.
+    void set_ram_budget(unsigned int new_ram_budget_mib);
+    [[nodiscard]] unsigned int ram_budget() const;
+
+    /// disk space for quads that are on disk only, counted with their size on disk. with texture compression, a part of it
+    /// (1 / transcoded_texture_disk_share) goes to the transcoded textures.
+    void set_disk_budget(unsigned int new_disk_budget_mib);
+    [[nodiscard]] unsigned int disk_budget() const;
+
+    /// ranks quads when purging the ram cache and the disk cache. CostAwareEvictionPolicy by default.
+    void set_eviction_policy(std::shared_ptr<EvictionPolicy> new_eviction_policy);
+    [[nodiscard]] const std::shared_ptr<EvictionPolicy>& eviction_policy() const;
+
+    /// ranks quads when purging the gpu. CostAwareEvictionPolicy pinning only up to gpu_pinned_zoom_level by default (5 quads): pinning
+    /// the levels of the ram cache would take more than a small gpu budget, and the memory governor couldn't take it back.
+    void set_gpu_eviction_policy(std::shared_ptr<EvictionPolicy> new_gpu_eviction_policy);
+    [[nodiscard]] const std::shared_ptr<EvictionPolicy>& gpu_eviction_policy() const;
 
     void set_purge_timeout(unsigned int new_purge_timeout);
 
@@ -74,23 +113,41 @@ public:
     [[nodiscard]] unsigned int persist_timeout() const;
     void set_persist_timeout(unsigned int new_persist_timeout);
 
+    /// reads only the index of the disk cache. quads needed by the cameras are loaded on demand in send_quad_requests,
+    /// the rest is loaded on a background thread (if threading is enabled), most recently visited first, as long as it fits into the ram budget.
     void read_disk_cache();
 
     void set_retirement_age_for_tile_cache(unsigned int new_retirement_age_for_tile_cache);
 
+    /// textures are decoded (and their mip chains built) on this many worker threads, when a quad becomes a gpu candidate.
+    /// 0 decodes synchronously in update_gpu_quads.
+    void set_n_texture_decoder_threads(unsigned n_texture_decoder_threads);
+    [[nodiscard]] unsigned n_texture_decoder_threads() const;
+
+    /// ortho textures are block compressed on the decoder threads, results are cached on disk in texture_cache_path().
+    /// set this before read_disk_cache, the background loader drops transcoded textures of tiles that are no longer cached.
+    void set_texture_compression(nucleus::utils::texture_compression::Algorithm algorithm);
+    [[nodiscard]] nucleus::utils::texture_compression::Algorithm texture_compression() const;
+    static std::filesystem::path texture_cache_path();
+
 signals:
     void statistics_updated(Statistics stats);
     void quad_received(const tile::Id& ids);
-    void quads_requested(const std::vector<tile::Id>& ids);
+    void quads_requested(const std::vector<tile_types::QuadRequest>& requests);
     void gpu_quads_updated(const std::vector<tile_types::GpuTileQuad>& new_quads, const std::vector<tile::Id>& deleted_quads);
 
 public slots:
     void update_camera(const nucleus::camera::Definition& camera);
+    /// quads for these cameras are requested in a lower priority tier than the visible ones, so they are resident when the camera gets there.
+    void update_prefetch_cameras(const std::vector<nucleus::camera::Definition>& cameras);
     void receive_quad(const tile_types::TileQuad& new_quad);
     void set_network_reachability(QNetworkInformation::Reachability reachability);
     void update_gpu_quads();
+    /// the vram the gpu actually allocated for a quad. until then its size is estimated from the upload.
+    void update_gpu_quad_size(const tile::Id& quad_id, size_t n_bytes);
     void send_quad_requests();
     void purge_ram_cache();
+    /// hands the dirty quads to the persistence thread. if a write is still running, the next one is scheduled instead.
     void persist_tiles();
 
 protected:
@@ -98,25 +155,70 @@ protected:
     void schedule_purge();
     void schedule_persist();
     void update_stats();
-    std::vector<tile::Id> tiles_for_current_camera_position() const;
+    /// the refined quads of the current camera, from the lod cut.
+    std::vector<tile::Id> tiles_for_current_camera_position();
+    std::vector<tile::Id> tiles_for_camera(const camera::Definition& camera) const;
 
 private:
+    using QuadTextures = std::array<std::shared_ptr<const tile_types::GpuTexture>, 4>;
+    void decode_textures(const tile_types::TileQuad& quad);
+    void load_disk_cache_in_background();
+    /// loads the quads of ids that are on disk only, on m_working_set_loader if threading is enabled. the disk cache lock is held by the
+    /// writer for whole batches, the scheduler thread must not wait for it.
+    void load_working_set(const std::vector<tile::Id>& ids);
+    /// drops transcoded textures of quads that are no longer cached and applies their part of the disk budget. walks the directory,
+    /// the returned function is meant for the loader or the writer thread.
+    [[nodiscard]] std::function<void()> transcoded_texture_cleanup() const;
+    [[nodiscard]] size_t tile_disk_budget() const;
+    /// brings the lod cut to the current camera, if it changed since. shared by requests, gpu updates and purging.
+    const LodCut& lod_cut();
+    /// tightens the bounds of the tiles of quad to their meshes.
+    void refine_bounds(const tile_types::TileQuad& quad);
+
     unsigned m_retirement_age_for_tile_cache = 10u * 24u * 3600u * 1000u; // 10 days
     float m_permissible_screen_space_error = 2;
     unsigned m_update_timeout = 100;
     unsigned m_purge_timeout = 1000;
     unsigned m_persist_timeout = 10000;
-    unsigned m_gpu_quad_limit = 300;
-    unsigned m_ram_quad_limit = 15000;
+    unsigned m_gpu_budget_mib = 512;
+    unsigned m_ram_budget_mib = 1024;
+    unsigned m_disk_budget_mib = 4096;
+    std::shared_ptr<EvictionPolicy> m_eviction_policy = std::make_shared<CostAwareEvictionPolicy>();
+    std::shared_ptr<EvictionPolicy> m_gpu_eviction_policy
+        = std::make_shared<CostAwareEvictionPolicy>(CostAwareEvictionPolicy::Settings { .pinned_zoom_level = gpu_pinned_zoom_level });
     static constexpr unsigned m_ortho_tile_size = 256;
     static constexpr unsigned m_height_tile_size = 64;
     bool m_enabled = false;
     bool m_network_requests_enabled = true;
     Statistics m_statistics;
+    uint64_t m_last_telemetry_update = 0;
     std::unique_ptr<QTimer> m_update_timer;
     std::unique_ptr<QTimer> m_purge_timer;
     std::unique_ptr<QTimer> m_persist_timer;
+    std::unique_ptr<QTimer> m_gpu_update_timer;
+    std::unique_ptr<QThreadPool> m_texture_decoder_pool;
+    unsigned m_n_texture_decoder_threads = 0;
+    std::unique_ptr<QThreadPool> m_disk_cache_loader;
+    std::unique_ptr<QThreadPool> m_working_set_loader;
+    std::unordered_set<tile::Id, tile::Id::Hasher> m_working_set_in_loading;
+    std::unordered_set<tile::Id, tile::Id::Hasher> m_working_set_failed; // loads that didn't produce a quad, they are requested from the network
+    std::unique_ptr<QThreadPool> m_disk_cache_writer;
+    bool m_persist_in_flight = false;
+    std::atomic<bool> m_disk_cache_loader_cancelled = false;
+    std::unordered_map<tile::Id, QuadTextures, tile::Id::Hasher> m_decoded_textures;
+    std::unordered_set<tile::Id, tile::Id::Hasher> m_textures_in_decoding;
+    unsigned m_texture_generation = 0; // changes with the texture compression, results of older decodes are dropped
+    // quads the gpu budget pushed out (or didn't take), with the time of eviction. they are not decoded again until they leave the cut, the
+    // budget changes or gpu_eviction_retry_interval passed, otherwise decoding, uploading and evicting feed each other when the budget can't
+    // hold all wanted quads.
+    std::unordered_map<tile::Id, uint64_t, tile::Id::Hasher> m_gpu_evicted;
+    std::shared_ptr<const tile_types::GpuTexture> m_default_ortho_texture;
+    nucleus::utils::texture_compression::Algorithm m_texture_compression = nucleus::utils::texture_compression::Algorithm::Uncompressed_RGBA;
+    std::shared_ptr<const TranscodedTextureCache> m_transcoded_texture_cache;
     camera::Definition m_current_camera;
+    LodCut m_lod_cut;
+    bool m_lod_cut_outdated = true;
+    std::vector<camera::Definition> m_prefetch_cameras;
     utils::AabbDecoratorPtr m_aabb_decorator;
     Cache<tile_types::TileQuad> m_ram_cache;
     Cache<tile_types::GpuCacheInfo> m_gpu_cached;
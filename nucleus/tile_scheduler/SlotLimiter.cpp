@@ -18,17 +18,30 @@
 
 #include "SlotLimiter.h"
 
+#include <algorithm>
+
+#include <QTimer>
+
+#include "Telemetry.h"
+#include "utils.h"
+
 using namespace nucleus::tile_scheduler;
 
 SlotLimiter::SlotLimiter(QObject* parent)
     : QObject { parent }
+    , m_cancellation_timer(std::make_unique<QTimer>(this))
 {
+    m_cancellation_timer->setSingleShot(true);
+    connect(m_cancellation_timer.get(), &QTimer::timeout, this, &SlotLimiter::cancel_stale_quads);
 }
 
+SlotLimiter::~SlotLimiter() = default;
+
 void SlotLimiter::set_limit(unsigned new_limit)
 {
     assert(new_limit > 0);
     m_limit = new_limit;
+    m_adaptive_limit = float(new_limit);
 }
 
 unsigned SlotLimiter::limit() const
@@ -41,29 +54,139 @@ unsigned SlotLimiter::slots_taken() const
     return unsigned(m_in_flight.size());
 }
 
-void SlotLimiter::request_quads(const std::vector<tile::Id>& ids)
+void SlotLimiter::set_limit_mode(LimitMode mode)
+{
+    m_limit_mode = mode;
+    if (m_limit_mode == LimitMode::Adaptive) {
+        m_adaptive_limit = std::clamp(float(m_limit), float(m_min_limit), float(m_max_limit));
+        m_limit = unsigned(m_adaptive_limit);
+    }
+}
+
+SlotLimiter::LimitMode SlotLimiter::limit_mode() const
+{
+    return m_limit_mode;
+}
+
+void SlotLimiter::set_adaptive_limit_range(unsigned min_limit, unsigned max_limit)
+{
+    assert(min_limit > 0);
+    assert(min_limit <= max_limit);
+    m_min_limit = min_limit;
+    m_max_limit = max_limit;
+    set_limit_mode(m_limit_mode);
+}
+
+std::pair<unsigned, unsigned> SlotLimiter::adaptive_limit_range() const
+{
+    return { m_min_limit, m_max_limit };
+}
+
+float SlotLimiter::smoothed_latency() const
+{
+    return m_smoothed_latency;
+}
+
+void SlotLimiter::set_cancellation_grace_period(unsigned msecs)
+{
+    assert(msecs < unsigned(std::numeric_limits<int>::max()));
+    m_cancellation_grace_period = msecs;
+}
+
+unsigned SlotLimiter::cancellation_grace_period() const
 {
+    return m_cancellation_grace_period;
+}
+
+void SlotLimiter::request_quads(const std::vector<tile_types::QuadRequest>& requests)
+{
+    const auto now = utils::time_since_epoch();
+    for (auto& [id, in_flight] : m_in_flight) {
+        if (in_flight.stale_since == 0)
+            in_flight.stale_since = now;
+    }
     m_request_queue.clear();
-    for (const tile::Id& id : ids) {
-        if (m_in_flight.contains(id))
-            continue;
-        if (m_in_flight.size() >= m_limit) {
-            m_request_queue.push_back(id);
-        } else {
-            m_in_flight.insert(id);
-            emit quad_requested(id);
-        }
+    for (const auto& request : requests) {
+        if (const auto in_flight = m_in_flight.find(request.id); in_flight != m_in_flight.end())
+            in_flight->second.stale_since = 0;
+        else
+            m_request_queue.push(request);
     }
+    cancel_stale_quads();
 }
 
 void SlotLimiter::deliver_quad(const tile_types::TileQuad& tile)
 {
-    m_in_flight.erase(tile.id);
+    if (const auto in_flight = m_in_flight.find(tile.id); in_flight != m_in_flight.end()) {
+        const auto latency = utils::time_since_epoch() - in_flight->second.requested;
+        Telemetry::instance().record(Telemetry::Timing::QuadLatency, latency * 1000);
+        if (m_limit_mode == LimitMode::Adaptive)
+            adapt_limit(latency, tile.network_info().status == tile_types::NetworkInfo::Status::NetworkError);
+        m_in_flight.erase(in_flight);
+    }
     emit quad_delivered(tile);
-    if (m_request_queue.empty())
-        return;
+    fill_free_slots();
+}
+
+void SlotLimiter::cancel_stale_quads()
+{
+    const auto now = utils::time_since_epoch();
+    uint64_t oldest_remaining = 0;
+    std::vector<tile::Id> cancelled;
+    for (const auto& [id, in_flight] : m_in_flight) {
+        if (in_flight.stale_since == 0)
+            continue;
+        if (now - in_flight.stale_since >= m_cancellation_grace_period)
+            cancelled.push_back(id);
+        else if (oldest_remaining == 0 || in_flight.stale_since < oldest_remaining)
+            oldest_remaining = in_flight.stale_since;
+    }
+    for (const auto& id : cancelled) {
+        m_in_flight.erase(id);
+        emit quad_cancelled(id);
+    }
+    if (oldest_remaining != 0)
+        m_cancellation_timer->start(int(1 + oldest_remaining + m_cancellation_grace_period - now));
+    fill_free_slots();
+}
+
+void SlotLimiter::fill_free_slots()
+{
+    const auto now = utils::time_since_epoch();
+    while (m_in_flight.size() < m_limit && !m_request_queue.empty()) {
+        const auto request = m_request_queue.pop();
+        m_in_flight[request.id] = { now, 0 };
+        emit quad_requested(request.id, request.priority);
+    }
+    auto& telemetry = Telemetry::instance();
+    telemetry.set(Telemetry::Gauge::SlotLimiterInFlight, m_in_flight.size());
+    telemetry.set(Telemetry::Gauge::SlotLimiterQueued, m_request_queue.size());
+}
 
-    m_in_flight.insert(m_request_queue.front());
-    emit quad_requested(m_request_queue.front());
-    m_request_queue.erase(m_request_queue.cbegin());
+void SlotLimiter::adapt_limit(uint64_t latency, bool failed)
+{
+    const auto now = utils::time_since_epoch();
+    latency = std::max(latency, uint64_t(1));
+
+    if (now - m_base_latency_window_start > base_latency_window) {
+        m_base_latency = m_base_latency_current_window;
+        m_base_latency_current_window = 0;
+        m_base_latency_window_start = now;
+    }
+    if (!failed) {
+        m_base_latency_current_window = m_base_latency_current_window == 0 ? latency : std::min(m_base_latency_current_window, latency);
+        m_base_latency = m_base_latency == 0 ? latency : std::min(m_base_latency, latency);
+        m_smoothed_latency = m_smoothed_latency == 0 ? float(latency) : m_smoothed_latency * 0.875f + float(latency) * 0.125f;
+    }
+    const auto queued = m_base_latency == 0 ? 0.f : m_adaptive_limit * (1.f - float(m_base_latency) / std::max(m_smoothed_latency, float(m_base_latency)));
+    // decrease at most once per round trip, the deliveries of that round trip still reflect the old limit.
+    const auto may_decrease = now - m_last_decrease > uint64_t(m_smoothed_latency);
+    if ((failed || queued > adaptive_queue_high) && may_decrease) {
+        m_adaptive_limit *= failed ? 0.5f : 0.8f;
+        m_last_decrease = now;
+    } else if (!failed && queued < adaptive_queue_low) {
+        m_adaptive_limit += 1.f / m_adaptive_limit;
+    }
+    m_adaptive_limit = std::clamp(m_adaptive_limit, float(m_min_limit), float(m_max_limit));
+    m_limit = unsigned(m_adaptive_limit);
 }
@@ -18,37 +18,91 @@
 
 #pragma once
 
-#include <unordered_set>
+#include <memory>
+#include <unordered_map>
 
 #include <QObject>
 
 #include <radix/tile.h>
 
+#include "QuadRequestQueue.h"
 #include "tile_types.h"
 
+class QTimer;
+
 namespace nucleus::tile_scheduler {
 
+/// in flight quads, that are missing in the latest request list, are cancelled after a grace period (they might come back,
+/// e.g., when the camera swings back and forth). the slot is freed immediately, a late delivery is still sent on.
+///
+/// in adaptive mode the limit follows the observed quad latency (request to delivery), similar to tcp vegas: the number of quads
+/// waiting in queues somewhere is estimated as limit * (1 - base_latency / latency). the limit grows by one per round trip while
+/// that estimate is below adaptive_queue_low, and shrinks multiplicatively when it is above adaptive_queue_high or quads fail.
 class SlotLimiter : public QObject {
     Q_OBJECT
+public:
+    enum class LimitMode { Fixed, Adaptive };
+
+private:
+    struct InFlight {
+        uint64_t requested = 0;
+        uint64_t stale_since = 0; // time since which the quad is no longer requested, 0 if it is
+    };
 
     unsigned m_limit = 16;
-    std::unordered_set<tile::Id, tile::Id::Hasher> m_in_flight;
-    std::vector<tile::Id> m_request_queue;
+    unsigned m_cancellation_grace_period = 500;
+    std::unordered_map<tile::Id, InFlight, tile::Id::Hasher> m_in_flight;
+    QuadRequestQueue m_request_queue;
+    std::unique_ptr<QTimer> m_cancellation_timer;
+
+    LimitMode m_limit_mode = LimitMode::Fixed;
+    unsigned m_min_limit = 2;
+    unsigned m_max_limit = 64;
+    float m_adaptive_limit = 16;
+    float m_smoothed_latency = 0;
+    uint64_t m_last_decrease = 0;
+    uint64_t m_base_latency_window_start = 0;
+    uint64_t m_base_latency = 0; // minimum over the current and the last window, so it can recover when the route changes
+    uint64_t m_base_latency_current_window = 0;
 
 public:
+    static constexpr float adaptive_queue_low = 2;
+    static constexpr float adaptive_queue_high = 4;
+    static constexpr unsigned base_latency_window = 10'000; // msecs
+
     explicit SlotLimiter(QObject* parent = nullptr);
+    ~SlotLimiter() override;
 
+    /// in adaptive mode, this sets the starting point.
     void set_limit(unsigned int new_limit);
     [[nodiscard]] unsigned int limit() const;
     unsigned int slots_taken() const;
+    void set_limit_mode(LimitMode mode);
+    [[nodiscard]] LimitMode limit_mode() const;
+    void set_adaptive_limit_range(unsigned min_limit, unsigned max_limit);
+    [[nodiscard]] std::pair<unsigned, unsigned> adaptive_limit_range() const;
+    /// 0 until the first quad was delivered in adaptive mode.
+    [[nodiscard]] float smoothed_latency() const;
+    /// in msecs. 0 cancels stale quads with the next request list.
+    void set_cancellation_grace_period(unsigned msecs);
+    [[nodiscard]] unsigned cancellation_grace_period() const;
 
 public slots:
-    void request_quads(const std::vector<tile::Id>& id);
+    /// replaces the queue. free slots go to the requests with the highest priority.
+    void request_quads(const std::vector<tile_types::QuadRequest>& requests);
     void deliver_quad(const tile_types::TileQuad& tile);
 
 signals:
-    void quad_requested(const tile::Id& tile_id);
+    void quad_requested(const tile::Id& tile_id, float priority);
+    void quad_cancelled(const tile::Id& tile_id);
     void quad_delivered(const tile_types::TileQuad& id);
+
+private slots:
+    void cancel_stale_quads();
+
+private:
+    void fill_free_slots();
+    void adapt_limit(uint64_t latency, bool failed);
 };
 
 }
@@ -0,0 +1,184 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "Telemetry.h"
+
+#include <QJsonArray>
+
+namespace nucleus::tile_scheduler {
+
+namespace {
+    Telemetry::Distribution distribution(const nucleus::utils::Histogram& histogram)
+    {
+        return { histogram.count(), histogram.min(), histogram.max(), histogram.mean(), histogram.percentile(50), histogram.percentile(95), histogram.percentile(99) };
+    }
+
+    QJsonObject to_json(const Telemetry::Distribution& d)
+    {
+        return { { "count", qint64(d.count) }, { "min", qint64(d.min) }, { "max", qint64(d.max) }, { "mean", d.mean }, { "p50", qint64(d.p50) },
+            { "p95", qint64(d.p95) }, { "p99", qint64(d.p99) } };
+    }
+} // namespace
+
+double Telemetry::Snapshot::cache_hit_ratio() const
+{
+    const auto hits = counters[size_t(Counter::CacheHits)];
+    const auto lookups = hits + counters[size_t(Counter::CacheMisses)];
+    return lookups == 0 ? 0.0 : double(hits) / double(lookups);
+}
+
+QJsonObject Telemetry::Snapshot::to_json() const
+{
+    QJsonObject json_timings;
+    for (size_t i = 0; i < timings.size(); ++i)
+        json_timings.insert(name(Timing(i)), nucleus::tile_scheduler::to_json(timings[i]));
+    QJsonObject json_gauges;
+    for (size_t i = 0; i < gauges.size(); ++i) {
+        auto g = nucleus::tile_scheduler::to_json(gauge_distributions[i]);
+        g.insert("current", qint64(gauges[i]));
+        json_gauges.insert(name(Gauge(i)), g);
+    }
+    QJsonObject json_counters;
+    for (size_t i = 0; i < counters.size(); ++i)
+        json_counters.insert(name(Counter(i)), qint64(counters[i]));
+    return { { "timings_us", json_timings }, { "gauges", json_gauges }, { "counters", json_counters }, { "cache_hit_ratio", cache_hit_ratio() } };
+}
+
+Telemetry::ScopedTiming::ScopedTiming(Timing timing)
+    : m_timing(timing)
+    , m_start(std::chrono::steady_clock::now())
+{
+}
+
+Telemetry::ScopedTiming::~ScopedTiming()
+{
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start);
+    Telemetry::instance().record(m_timing, uint64_t(duration.count()));
+}
+
+Telemetry& Telemetry::instance()
+{
+    static Telemetry telemetry;
+    return telemetry;
+}
+
+void Telemetry::record(Timing timing, uint64_t usecs)
+{
+    std::scoped_lock lock(m_mutex);
+    m_timings[size_t(timing)].record(usecs);
+}
+
+void Telemetry::set(Gauge gauge, uint64_t value)
+{
+    std::scoped_lock lock(m_mutex);
+    m_gauges[size_t(gauge)] = value;
+    m_gauge_histograms[size_t(gauge)].record(value);
+}
+
+void Telemetry::add(Counter counter, uint64_t value)
+{
+    std::scoped_lock lock(m_mutex);
+    m_counters[size_t(counter)] += value;
+}
+
+Telemetry::Snapshot Telemetry::snapshot() const
+{
+    std::scoped_lock lock(m_mutex);
+    Snapshot s;
+    for (size_t i = 0; i < m_timings.size(); ++i)
+        s.timings[i] = distribution(m_timings[i]);
+    for (size_t i = 0; i < m_gauges.size(); ++i)
+        s.gauge_distributions[i] = distribution(m_gauge_histograms[i]);
+    s.gauges = m_gauges;
+    s.counters = m_counters;
+    return s;
+}
+
+void Telemetry::reset()
+{
+    std::scoped_lock lock(m_mutex);
+    for (auto& h : m_timings)
+        h.reset();
+    for (auto& h : m_gauge_histograms)
+        h.reset();
+    m_gauges = {};
+    m_counters = {};
+}
+
+const char* Telemetry::name(Timing timing)
+{
+    switch (timing) {
+    case Timing::NetworkRtt:
+        return "network_rtt";
+    case Timing::QuadLatency:
+        return "quad_latency";
+    case Timing::GltfDecode:
+        return "gltf_decode";
+    case Timing::TextureDecode:
+        return "texture_decode";
+    case Timing::GpuUpload:
+        return "gpu_upload";
+    case Timing::Count:
+        break;
+    }
+    return "unknown";
+}
+
+const char* Telemetry::name(Gauge gauge)
+{
+    switch (gauge) {
+    case Gauge::SlotLimiterInFlight:
+        return "slot_limiter_in_flight";
+    case Gauge::SlotLimiterQueued:
+        return "slot_limiter_queued";
+    case Gauge::RateLimiterQueued:
+        return "rate_limiter_queued";
+    case Gauge::QuadAssemblerInFlight:
+        return "quad_assembler_in_flight";
+    case Gauge::GltfReaderInFlight:
+        return "gltf_reader_in_flight";
+    case Gauge::RamCacheBytes:
+        return "ram_cache_bytes";
+    case Gauge::GpuBytes:
+        return "gpu_bytes";
+    case Gauge::Count:
+        break;
+    }
+    return "unknown";
+}
+
+const char* Telemetry::name(Counter counter)
+{
+    switch (counter) {
+    case Counter::NetworkRequests:
+        return "network_requests";
+    case Counter::NetworkErrors:
+        return "network_errors";
+    case Counter::BytesReceived:
+        return "bytes_received";
+    case Counter::CacheHits:
+        return "cache_hits";
+    case Counter::CacheMisses:
+        return "cache_misses";
+    case Counter::Count:
+        break;
+    }
+    return "unknown";
+}
+
+} // namespace nucleus::tile_scheduler
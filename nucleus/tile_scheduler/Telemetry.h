@@ -0,0 +1,101 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <mutex>
+
+#include <QJsonObject>
+
+#include "nucleus/utils/Histogram.h"
+
+namespace nucleus::tile_scheduler {
+
+/// process wide collection of tile pipeline metrics, so it is possible to tell which stage is the bottleneck when streaming is slow.
+/// recording is thread safe (the stages live on the scheduler thread, decoder pools and the render thread).
+/// timings are in microseconds. gauges keep their current value and a histogram of all values they were set to.
+class Telemetry {
+public:
+    enum class Timing : unsigned { NetworkRtt, QuadLatency, GltfDecode, TextureDecode, GpuUpload, Count };
+    enum class Gauge : unsigned {
+        SlotLimiterInFlight,
+        SlotLimiterQueued,
+        RateLimiterQueued,
+        QuadAssemblerInFlight,
+        GltfReaderInFlight,
+        RamCacheBytes,
+        GpuBytes,
+        Count
+    };
+    enum class Counter : unsigned { NetworkRequests, NetworkErrors, BytesReceived, CacheHits, CacheMisses, Count };
+
+    struct Distribution {
+        uint64_t count = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        double mean = 0;
+        uint64_t p50 = 0;
+        uint64_t p95 = 0;
+        uint64_t p99 = 0;
+    };
+    struct Snapshot {
+        std::array<Distribution, size_t(Timing::Count)> timings = {};
+        std::array<uint64_t, size_t(Gauge::Count)> gauges = {};
+        std::array<Distribution, size_t(Gauge::Count)> gauge_distributions = {};
+        std::array<uint64_t, size_t(Counter::Count)> counters = {};
+        /// 0 if there were no cache lookups yet.
+        [[nodiscard]] double cache_hit_ratio() const;
+        [[nodiscard]] QJsonObject to_json() const;
+    };
+
+    /// records the time from construction to destruction.
+    class ScopedTiming {
+    public:
+        explicit ScopedTiming(Timing timing);
+        ~ScopedTiming();
+        ScopedTiming(const ScopedTiming&) = delete;
+        ScopedTiming& operator=(const ScopedTiming&) = delete;
+
+    private:
+        Timing m_timing;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    static Telemetry& instance();
+
+    void record(Timing timing, uint64_t usecs);
+    void set(Gauge gauge, uint64_t value);
+    void add(Counter counter, uint64_t value = 1);
+    [[nodiscard]] Snapshot snapshot() const;
+    void reset();
+
+    static const char* name(Timing timing);
+    static const char* name(Gauge gauge);
+    static const char* name(Counter counter);
+
+private:
+    mutable std::mutex m_mutex;
+    std::array<nucleus::utils::Histogram, size_t(Timing::Count)> m_timings;
+    std::array<uint64_t, size_t(Gauge::Count)> m_gauges = {};
+    std::array<nucleus::utils::Histogram, size_t(Gauge::Count)> m_gauge_histograms;
+    std::array<uint64_t, size_t(Counter::Count)> m_counters = {};
+};
+
+} // namespace nucleus::tile_scheduler
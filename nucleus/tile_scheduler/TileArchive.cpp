@@ -0,0 +1,155 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "TileArchive.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+#include <QSaveFile>
+#include <fmt/format.h>
+
+using namespace nucleus::tile_scheduler;
+
+namespace {
+static_assert(std::endian::native == std::endian::little, "the archive is read in place, big endian would need byte swapping.");
+static_assert(sizeof(TileArchive::Entry) == 24);
+
+constexpr char magic[4] = { 'A', 'L', 'P', 'A' };
+constexpr size_t header_size = 16;
+
+uint64_t spread_bits(uint32_t v)
+{
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+} // namespace
+
+TileArchive::~TileArchive() { close(); }
+
+uint64_t TileArchive::key(const tile::Id& id)
+{
+    assert(id.zoom_level <= 29);
+    return (uint64_t(id.zoom_level) << 58) | spread_bits(id.coords.x) | (spread_bits(id.coords.y) << 1);
+}
+
+tl::expected<void, std::string> TileArchive::open(const std::filesystem::path& path)
+{
+    close();
+    const auto fail = [&](const std::string& message) -> tl::expected<void, std::string> {
+        close();
+        return tl::unexpected(fmt::format("Tile archive '{}': {}", path.string(), message));
+    };
+
+    m_file.setFileName(QString::fromStdString(path.string()));
+    if (!m_file.open(QIODeviceBase::ReadOnly))
+        return fail("couldn't open file for reading!");
+    const auto file_size = uint64_t(m_file.size());
+    if (file_size < header_size)
+        return fail("file is too small!");
+    m_data = m_file.map(0, qint64(file_size));
+    if (!m_data)
+        return fail("couldn't map file!");
+
+    uint32_t file_version = 0;
+    uint64_t n_entries = 0;
+    std::memcpy(&file_version, m_data + 4, sizeof(file_version));
+    std::memcpy(&n_entries, m_data + 8, sizeof(n_entries));
+    if (std::memcmp(m_data, magic, sizeof(magic)) != 0)
+        return fail("not a tile archive!");
+    if (file_version != version)
+        return fail(fmt::format("incompatible version {} (expected {})!", file_version, version));
+    if (n_entries > (file_size - header_size) / sizeof(Entry))
+        return fail("index is truncated!");
+
+    // the index is validated once here, lookups trust it.
+    const auto* index = reinterpret_cast<const Entry*>(m_data + header_size);
+    for (size_t i = 0; i < n_entries; ++i) {
+        if (index[i].offset > file_size || index[i].size > file_size - index[i].offset)
+            return fail("entry points outside of the file!");
+        if (i > 0 && index[i - 1].key >= index[i].key)
+            return fail("index is not sorted!");
+    }
+    m_index = index;
+    m_n_entries = size_t(n_entries);
+    return {};
+}
+
+void TileArchive::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    m_file.close();
+    m_data = nullptr;
+    m_index = nullptr;
+    m_n_entries = 0;
+}
+
+bool TileArchive::is_open() const { return m_data != nullptr; }
+
+size_t TileArchive::n_tiles() const { return m_n_entries; }
+
+std::optional<QByteArrayView> TileArchive::find(const tile::Id& id) const
+{
+    const auto k = key(id);
+    const auto* end = m_index + m_n_entries;
+    const auto* entry = std::lower_bound(m_index, end, k, [](const Entry& e, uint64_t value) { return e.key < value; });
+    if (entry == end || entry->key != k)
+        return {};
+    return QByteArrayView(m_data + entry->offset, qsizetype(entry->size));
+}
+
+tl::expected<void, std::string> TileArchive::write(const std::filesystem::path& path, const std::vector<std::pair<tile::Id, QByteArray>>& tiles)
+{
+    std::vector<std::pair<uint64_t, const QByteArray*>> sorted;
+    sorted.reserve(tiles.size());
+    for (const auto& [id, data] : tiles)
+        sorted.emplace_back(key(id), &data);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    if (std::adjacent_find(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first == b.first; }) != sorted.end())
+        return tl::unexpected(fmt::format("Tile archive '{}': duplicated tile!", path.string()));
+
+    std::vector<Entry> index;
+    index.reserve(sorted.size());
+    uint64_t offset = header_size + sorted.size() * sizeof(Entry);
+    for (const auto& [k, data] : sorted) {
+        index.push_back({ k, offset, uint64_t(data->size()) });
+        offset += uint64_t(data->size());
+    }
+
+    QSaveFile file(QString::fromStdString(path.string()));
+    if (!file.open(QIODeviceBase::WriteOnly))
+        return tl::unexpected(fmt::format("Tile archive '{}': couldn't open file for writing!", path.string()));
+    const uint64_t n_entries = index.size();
+    file.write(magic, sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(&n_entries), sizeof(n_entries));
+    file.write(reinterpret_cast<const char*>(index.data()), qint64(index.size() * sizeof(Entry)));
+    for (const auto& item : sorted)
+        file.write(*item.second);
+    if (!file.commit())
+        return tl::unexpected(fmt::format("Tile archive '{}': couldn't write file!", path.string()));
+    return {};
+}
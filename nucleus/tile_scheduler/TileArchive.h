@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <QByteArray>
+#include <QFile>
+#include <tl/expected.hpp>
+
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+/// read only store of many tiles in one memory mapped file, for offline installs and reproducible benchmarks.
+/// layout (little endian): char[4] magic "ALPA", uint32 version, uint64 n_entries, n_entries * Entry, payload.
+/// entries are sorted by key(), i.e., by zoom level and then in morton order, so a lookup is a binary search in the mapped index
+/// and tiles that are close on the map are close in the file.
+/// find() doesn't modify the archive, it can be called from several threads.
+class TileArchive {
+public:
+    struct Entry {
+        uint64_t key;
+        uint64_t offset; // from the beginning of the file
+        uint64_t size;
+    };
+    static constexpr uint32_t version = 1;
+
+    TileArchive() = default;
+    TileArchive(const TileArchive&) = delete;
+    TileArchive& operator=(const TileArchive&) = delete;
+    ~TileArchive();
+
+    [[nodiscard]] tl::expected<void, std::string> open(const std::filesystem::path& path);
+    void close();
+    [[nodiscard]] bool is_open() const;
+    [[nodiscard]] size_t n_tiles() const;
+    /// the view points into the mapped file and is valid until the archive is closed.
+    [[nodiscard]] std::optional<QByteArrayView> find(const tile::Id& id) const;
+
+    /// zoom level in the upper 6 bits, the interleaved x/y coordinates below. supports zoom levels up to 29.
+    [[nodiscard]] static uint64_t key(const tile::Id& id);
+    [[nodiscard]] static tl::expected<void, std::string> write(const std::filesystem::path& path, const std::vector<std::pair<tile::Id, QByteArray>>& tiles);
+
+private:
+    QFile m_file;
+    const uchar* m_data = nullptr;
+    const Entry* m_index = nullptr;
+    size_t m_n_entries = 0;
+};
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,53 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "TileArchiveService.h"
+
+#include <QDebug>
+
+#include "utils.h"
+
+using namespace nucleus::tile_scheduler;
+
+TileArchiveService::TileArchiveService(const std::filesystem::path& archive_path)
+{
+    const auto result = m_archive.open(archive_path);
+    if (!result.has_value())
+        qWarning() << result.error().c_str();
+}
+
+TileArchiveService::~TileArchiveService() = default;
+
+bool TileArchiveService::is_open() const { return m_archive.is_open(); }
+
+void TileArchiveService::load(const tile::Id& tile_id)
+{
+    const auto timestamp = utils::time_since_epoch();
+    tile_types::TileLayer tile;
+    if (const auto data = m_archive.find(tile_id))
+        tile = { tile_id, { tile_types::NetworkInfo::Status::Good, timestamp }, std::make_shared<QByteArray>(data->toByteArray()) };
+    else
+        tile = { tile_id, { tile_types::NetworkInfo::Status::NotFound, timestamp }, std::make_shared<QByteArray>() };
+    QMetaObject::invokeMethod(this, [this, tile]() { emit load_finished(tile); }, Qt::QueuedConnection);
+}
+
+void TileArchiveService::load_quad(const tile::Id& quad_id)
+{
+    for (const auto& child_id : quad_id.children())
+        load(child_id);
+}
@@ -0,0 +1,48 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <QObject>
+
+#include "TileArchive.h"
+#include "tile_types.h"
+
+namespace nucleus::tile_scheduler {
+
+/// serves tiles from a TileArchive, with the same interface as the TileLoadService. tiles missing in the archive are reported as NotFound.
+/// load_finished is emitted from the event loop, not from within load, so the pipeline behaves as with network requests.
+class TileArchiveService : public QObject {
+    Q_OBJECT
+public:
+    explicit TileArchiveService(const std::filesystem::path& archive_path);
+    ~TileArchiveService() override;
+    /// false if the archive couldn't be opened, the reason is logged.
+    [[nodiscard]] bool is_open() const;
+
+public slots:
+    void load(const tile::Id& tile_id);
+    void load_quad(const tile::Id& quad_id);
+
+signals:
+    void load_finished(tile_types::TileLayer tile);
+
+private:
+    TileArchive m_archive;
+};
+}
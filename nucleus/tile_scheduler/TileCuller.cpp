@@ -0,0 +1,315 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "TileCuller.h"
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__) || defined(__AVX2__))
+#define ALP_TILE_CULLER_AVX2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define ALP_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ALP_TARGET_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ALP_TILE_CULLER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace nucleus::tile_scheduler {
+
+#if defined(ALP_TILE_CULLER_AVX2)
+namespace {
+    bool has_avx2()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+#else
+        return true; // msvc, compiled with /arch:AVX2
+#endif
+    }
+} // namespace
+#endif
+
+void TileCuller::Bounds::push_back(const tile::SrsAndHeightBounds& aabb)
+{
+    min_x.push_back(aabb.min.x);
+    min_y.push_back(aabb.min.y);
+    min_z.push_back(aabb.min.z);
+    max_x.push_back(aabb.max.x);
+    max_y.push_back(aabb.max.y);
+    max_z.push_back(aabb.max.z);
+}
+
+void TileCuller::Bounds::reserve(size_t n)
+{
+    for (auto* v : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z })
+        v->reserve(n);
+}
+
+void TileCuller::Bounds::clear()
+{
+    for (auto* v : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z })
+        v->clear();
+}
+
+size_t TileCuller::Bounds::size() const
+{
+    return min_x.size();
+}
+
+TileCuller::TileCuller(const camera::Definition& camera, double tile_size)
+    : m_position(camera.position())
+{
+    constexpr auto sqrt2 = 1.414213562373095;
+    const auto frustum = camera.frustum();
+    m_planes = frustum.clipping_planes;
+    m_error_factor = double(camera.viewport_size().y) * 0.5 * double(camera.distance_scale_factor()) * sqrt2 / tile_size;
+
+    const auto add_axis = [&](const glm::dvec3& direction) {
+        auto& axis = m_axes[m_n_axes++];
+        axis.direction = direction;
+        axis.frustum_min = std::numeric_limits<double>::max();
+        axis.frustum_max = std::numeric_limits<double>::lowest();
+        for (const auto& c : frustum.corners) {
+            const auto p = glm::dot(c, direction);
+            axis.frustum_min = std::min(axis.frustum_min, p);
+            axis.frustum_max = std::max(axis.frustum_max, p);
+        }
+    };
+    const auto& c = frustum.corners;
+    const auto frustum_edges = std::array {
+        glm::normalize(c[4] - c[0]), glm::normalize(c[5] - c[1]), glm::normalize(c[6] - c[2]),
+        glm::normalize(c[7] - c[3]), glm::normalize(c[1] - c[0]), glm::normalize(c[3] - c[0]),
+    };
+    constexpr auto aabb_edges = std::array { glm::dvec3 { 1., 0., 0. }, glm::dvec3 { 0., 1., 0. }, glm::dvec3 { 0., 0., 1. } };
+    for (const auto& direction : aabb_edges)
+        add_axis(direction);
+    for (const auto& fe : frustum_edges) {
+        for (const auto& ae : aabb_edges) {
+            const glm::dvec3 direction = glm::cross(fe, ae);
+            if (std::abs(direction.x) < geometry::epsilon<double> && std::abs(direction.y) < geometry::epsilon<double>
+                && std::abs(direction.z) < geometry::epsilon<double>)
+                continue; // parallel
+            add_axis(direction);
+        }
+    }
+}
+
+bool TileCuller::contains(const tile::SrsAndHeightBounds& aabb) const
+{
+    const auto corner_in_direction = [&aabb](const glm::dvec3& direction) {
+        return glm::dvec3 { direction.x > 0 ? aabb.max.x : aabb.min.x, direction.y > 0 ? aabb.max.y : aabb.min.y, direction.z > 0 ? aabb.max.z : aabb.min.z };
+    };
+    bool all_inside = true;
+    for (const auto& p : m_planes) {
+        if (glm::dot(p.normal, corner_in_direction(p.normal)) + p.distance <= 0)
+            return false;
+        all_inside = all_inside && (glm::dot(p.normal, corner_in_direction(-p.normal)) + p.distance > 0);
+    }
+    if (all_inside)
+        return true;
+    for (unsigned a = 0; a < m_n_axes; ++a) {
+        const auto& axis = m_axes[a];
+        const auto aabb_max = glm::dot(axis.direction, corner_in_direction(axis.direction));
+        const auto aabb_min = glm::dot(axis.direction, corner_in_direction(-axis.direction));
+        if (!(aabb_min <= axis.frustum_max && axis.frustum_min <= aabb_max))
+            return false;
+    }
+    return true;
+}
+
+float TileCuller::screen_space_error(const tile::SrsAndHeightBounds& aabb) const
+{
+    const auto delta = glm::max(glm::max(aabb.min - m_position, glm::dvec3(0)), m_position - aabb.max);
+    return float(m_error_factor * (aabb.max.x - aabb.min.x) / std::sqrt(glm::dot(delta, delta)));
+}
+
+void TileCuller::evaluate(const Bounds& bounds, std::span<uint8_t> visible, std::span<float> screen_space_error) const
+{
+    assert(visible.size() == bounds.size());
+    assert(screen_space_error.size() == bounds.size());
+    const auto n_simd = evaluate_simd(bounds, visible.data(), screen_space_error.data());
+    evaluate_range(bounds, n_simd, bounds.size(), visible.data(), screen_space_error.data());
+}
+
+void TileCuller::evaluate_scalar(const Bounds& bounds, std::span<uint8_t> visible, std::span<float> screen_space_error) const
+{
+    assert(visible.size() == bounds.size());
+    assert(screen_space_error.size() == bounds.size());
+    evaluate_range(bounds, 0, bounds.size(), visible.data(), screen_space_error.data());
+}
+
+void TileCuller::evaluate_visibility(const Bounds& bounds, std::span<uint8_t> visible) const
+{
+    assert(visible.size() == bounds.size());
+    const auto n_simd = evaluate_simd(bounds, visible.data(), nullptr);
+    evaluate_range(bounds, n_simd, bounds.size(), visible.data(), nullptr);
+}
+
+const char* TileCuller::instruction_set()
+{
+#if defined(ALP_TILE_CULLER_AVX2)
+    return has_avx2() ? "avx2" : "scalar";
+#elif defined(ALP_TILE_CULLER_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void TileCuller::evaluate_range(const Bounds& bounds, size_t begin, size_t end, uint8_t* visible, float* screen_space_error) const
+{
+    for (size_t i = begin; i < end; ++i) {
+        const auto aabb = tile::SrsAndHeightBounds { .min = { bounds.min_x[i], bounds.min_y[i], bounds.min_z[i] }, .max = { bounds.max_x[i], bounds.max_y[i], bounds.max_z[i] } };
+        visible[i] = contains(aabb);
+        if (screen_space_error)
+            screen_space_error[i] = this->screen_space_error(aabb);
+    }
+}
+
+#if defined(ALP_TILE_CULLER_AVX2)
+namespace {
+    inline bool picks_max(double d, bool towards) { return towards ? d > 0 : d < 0; }
+
+    // dot product of direction with the aabb corner furthest along it (towards) or along -direction, in the same order as glm::dot.
+    // no lambdas with vector code in the avx2 functions, they don't inherit the target attribute.
+    ALP_TARGET_AVX2 inline __m256d project(const __m256d* min, const __m256d* max, const glm::dvec3& direction, bool towards)
+    {
+        auto p = _mm256_mul_pd(_mm256_set1_pd(direction.x), picks_max(direction.x, towards) ? max[0] : min[0]);
+        p = _mm256_add_pd(p, _mm256_mul_pd(_mm256_set1_pd(direction.y), picks_max(direction.y, towards) ? max[1] : min[1]));
+        return _mm256_add_pd(p, _mm256_mul_pd(_mm256_set1_pd(direction.z), picks_max(direction.z, towards) ? max[2] : min[2]));
+    }
+} // namespace
+
+ALP_TARGET_AVX2 size_t TileCuller::evaluate_simd(const Bounds& bounds, uint8_t* visible, float* screen_space_error) const
+{
+    if (!has_avx2())
+        return 0;
+    const auto n = bounds.size() / 4 * 4;
+    const auto zero = _mm256_setzero_pd();
+    const auto all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    const __m256d position[3] = { _mm256_set1_pd(m_position.x), _mm256_set1_pd(m_position.y), _mm256_set1_pd(m_position.z) };
+    const auto error_factor = _mm256_set1_pd(m_error_factor);
+    for (size_t i = 0; i < n; i += 4) {
+        const __m256d min[3] = { _mm256_loadu_pd(&bounds.min_x[i]), _mm256_loadu_pd(&bounds.min_y[i]), _mm256_loadu_pd(&bounds.min_z[i]) };
+        const __m256d max[3] = { _mm256_loadu_pd(&bounds.max_x[i]), _mm256_loadu_pd(&bounds.max_y[i]), _mm256_loadu_pd(&bounds.max_z[i]) };
+
+        auto outside = zero;
+        auto inside = all;
+        for (const auto& p : m_planes) {
+            const auto distance = _mm256_set1_pd(p.distance);
+            outside = _mm256_or_pd(outside, _mm256_cmp_pd(_mm256_add_pd(project(min, max, p.normal, true), distance), zero, _CMP_LE_OQ));
+            inside = _mm256_and_pd(inside, _mm256_cmp_pd(_mm256_add_pd(project(min, max, p.normal, false), distance), zero, _CMP_GT_OQ));
+        }
+        auto separated = zero;
+        // the separating axes are needed only for tiles intersecting a clipping plane
+        const auto decided = _mm256_movemask_pd(_mm256_or_pd(outside, inside)) == 0xF;
+        for (unsigned a = 0; a < (decided ? 0 : m_n_axes); ++a) {
+            const auto& axis = m_axes[a];
+            const auto overlap = _mm256_and_pd(_mm256_cmp_pd(project(min, max, axis.direction, false), _mm256_set1_pd(axis.frustum_max), _CMP_LE_OQ),
+                _mm256_cmp_pd(_mm256_set1_pd(axis.frustum_min), project(min, max, axis.direction, true), _CMP_LE_OQ));
+            separated = _mm256_or_pd(separated, _mm256_andnot_pd(overlap, all));
+        }
+        const auto is_visible = _mm256_andnot_pd(outside, _mm256_or_pd(inside, _mm256_andnot_pd(separated, all)));
+        const auto mask = _mm256_movemask_pd(is_visible);
+        for (int lane = 0; lane < 4; ++lane)
+            visible[i + size_t(lane)] = uint8_t((mask >> lane) & 1);
+        if (!screen_space_error)
+            continue;
+
+        __m256d delta[3];
+        for (int c = 0; c < 3; ++c)
+            delta[c] = _mm256_max_pd(_mm256_max_pd(_mm256_sub_pd(min[c], position[c]), zero), _mm256_sub_pd(position[c], max[c]));
+        auto distance = _mm256_mul_pd(delta[0], delta[0]);
+        distance = _mm256_add_pd(distance, _mm256_mul_pd(delta[1], delta[1]));
+        distance = _mm256_sqrt_pd(_mm256_add_pd(distance, _mm256_mul_pd(delta[2], delta[2])));
+        const auto error = _mm256_div_pd(_mm256_mul_pd(error_factor, _mm256_sub_pd(max[0], min[0])), distance);
+        _mm_storeu_ps(&screen_space_error[i], _mm256_cvtpd_ps(error));
+    }
+    return n;
+}
+#elif defined(ALP_TILE_CULLER_NEON)
+namespace {
+    // dot product of direction with the aabb corner furthest along it (towards) or along -direction, in the same order as glm::dot
+    inline float64x2_t project(const float64x2_t* min, const float64x2_t* max, const glm::dvec3& direction, bool towards)
+    {
+        const auto pick = [&](double d) { return towards ? d > 0 : d < 0; };
+        auto p = vmulq_f64(vdupq_n_f64(direction.x), pick(direction.x) ? max[0] : min[0]);
+        p = vaddq_f64(p, vmulq_f64(vdupq_n_f64(direction.y), pick(direction.y) ? max[1] : min[1]));
+        return vaddq_f64(p, vmulq_f64(vdupq_n_f64(direction.z), pick(direction.z) ? max[2] : min[2]));
+    }
+} // namespace
+
+size_t TileCuller::evaluate_simd(const Bounds& bounds, uint8_t* visible, float* screen_space_error) const
+{
+    const auto n = bounds.size() / 2 * 2;
+    const auto zero = vdupq_n_f64(0);
+    const auto all = vdupq_n_u64(~uint64_t(0));
+    const float64x2_t position[3] = { vdupq_n_f64(m_position.x), vdupq_n_f64(m_position.y), vdupq_n_f64(m_position.z) };
+    const auto error_factor = vdupq_n_f64(m_error_factor);
+    for (size_t i = 0; i < n; i += 2) {
+        const float64x2_t min[3] = { vld1q_f64(&bounds.min_x[i]), vld1q_f64(&bounds.min_y[i]), vld1q_f64(&bounds.min_z[i]) };
+        const float64x2_t max[3] = { vld1q_f64(&bounds.max_x[i]), vld1q_f64(&bounds.max_y[i]), vld1q_f64(&bounds.max_z[i]) };
+
+        auto outside = vdupq_n_u64(0);
+        auto inside = all;
+        for (const auto& p : m_planes) {
+            const auto distance = vdupq_n_f64(p.distance);
+            outside = vorrq_u64(outside, vcleq_f64(vaddq_f64(project(min, max, p.normal, true), distance), zero));
+            inside = vandq_u64(inside, vcgtq_f64(vaddq_f64(project(min, max, p.normal, false), distance), zero));
+        }
+        auto separated = vdupq_n_u64(0);
+        // the separating axes are needed only for tiles intersecting a clipping plane
+        const auto decided = vminvq_u32(vreinterpretq_u32_u64(vorrq_u64(outside, inside))) != 0;
+        for (unsigned a = 0; a < (decided ? 0 : m_n_axes); ++a) {
+            const auto& axis = m_axes[a];
+            const auto overlap = vandq_u64(vcleq_f64(project(min, max, axis.direction, false), vdupq_n_f64(axis.frustum_max)),
+                vcleq_f64(vdupq_n_f64(axis.frustum_min), project(min, max, axis.direction, true)));
+            separated = vorrq_u64(separated, vbicq_u64(all, overlap));
+        }
+        const auto is_visible = vbicq_u64(vorrq_u64(inside, vbicq_u64(all, separated)), outside);
+        visible[i] = uint8_t(vgetq_lane_u64(is_visible, 0) & 1);
+        visible[i + 1] = uint8_t(vgetq_lane_u64(is_visible, 1) & 1);
+        if (!screen_space_error)
+            continue;
+
+        float64x2_t delta[3];
+        for (int c = 0; c < 3; ++c)
+            delta[c] = vmaxq_f64(vmaxq_f64(vsubq_f64(min[c], position[c]), zero), vsubq_f64(position[c], max[c]));
+        auto distance = vmulq_f64(delta[0], delta[0]);
+        distance = vaddq_f64(distance, vmulq_f64(delta[1], delta[1]));
+        distance = vsqrtq_f64(vaddq_f64(distance, vmulq_f64(delta[2], delta[2])));
+        const auto error = vdivq_f64(vmulq_f64(error_factor, vsubq_f64(max[0], min[0])), distance);
+        vst1_f32(&screen_space_error[i], vcvt_f32_f64(error));
+    }
+    return n;
+}
+#else
+size_t TileCuller::evaluate_simd(const Bounds&, uint8_t*, float*) const
+{
+    return 0;
+}
+#endif
+
+} // namespace nucleus::tile_scheduler
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "nucleus/camera/Definition.h"
+#include "radix/geometry.h"
+#include "radix/tile.h"
+
+namespace nucleus::tile_scheduler {
+
+/// Frustum culling and screen space error of tile bounds for one camera. The clipping planes, the separating axes (aabb axes and their cross
+/// products with the frustum edges) and the extent of the frustum along them are computed once in the constructor. evaluate tests bounds in
+/// structure of arrays layout, 4 at a time with avx2 (if the cpu has it) or 2 with neon, and scalar otherwise.
+/// Visibility is the same as utils::camera_frustum_contains_tile, the error the same as in utils::refineFunctor.
+class TileCuller {
+public:
+    struct Bounds {
+        std::vector<double> min_x;
+        std::vector<double> min_y;
+        std::vector<double> min_z;
+        std::vector<double> max_x;
+        std::vector<double> max_y;
+        std::vector<double> max_z;
+
+        void push_back(const tile::SrsAndHeightBounds& aabb);
+        void reserve(size_t n);
+        void clear();
+        [[nodiscard]] size_t size() const;
+    };
+
+    explicit TileCuller(const camera::Definition& camera, double tile_size = 256);
+
+    [[nodiscard]] bool contains(const tile::SrsAndHeightBounds& aabb) const;
+    /// in pixels, infinite if the camera is inside.
+    [[nodiscard]] float screen_space_error(const tile::SrsAndHeightBounds& aabb) const;
+    /// visibility (0 or 1) and screen space error of all bounds in one pass. the spans must have bounds.size() elements.
+    void evaluate(const Bounds& bounds, std::span<uint8_t> visible, std::span<float> screen_space_error) const;
+    void evaluate_scalar(const Bounds& bounds, std::span<uint8_t> visible, std::span<float> screen_space_error) const;
+    /// only the visibility, for when the lod is decided elsewhere (e.g., the draw list).
+    void evaluate_visibility(const Bounds& bounds, std::span<uint8_t> visible) const;
+
+    /// "avx2", "neon" or "scalar", whichever evaluate uses on this machine.
+    [[nodiscard]] static const char* instruction_set();
+
+private:
+    struct Axis {
+        glm::dvec3 direction = {};
+        double frustum_min = 0;
+        double frustum_max = 0;
+    };
+
+    /// screen_space_error may be nullptr, then only the visibility is computed.
+    void evaluate_range(const Bounds& bounds, size_t begin, size_t end, uint8_t* visible, float* screen_space_error) const;
+    /// the simd part of evaluate, returns the number of evaluated bounds (a multiple of the lane count).
+    size_t evaluate_simd(const Bounds& bounds, uint8_t* visible, float* screen_space_error) const;
+
+    std::array<geometry::Plane<double>, 6> m_planes;
+    std::array<Axis, 3 + 6 * 3> m_axes;
+    unsigned m_n_axes = 0;
+    glm::dvec3 m_position = {};
+    double m_error_factor = 0; // screen space error = m_error_factor * width / distance
+};
+
+} // namespace nucleus::tile_scheduler
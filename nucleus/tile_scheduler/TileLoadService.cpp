@@ -18,6 +18,8 @@
 
 #include "TileLoadService.h"
 
+#include <algorithm>
+
 #include <QDebug>
 #include <QImage>
 #include <QNetworkAccessManager>
@@ -25,9 +27,25 @@
 #include <QtVersionChecks>
 
 #include "../srs.h"
+#include "Telemetry.h"
+#include "quad_bundle.h"
 
 using namespace nucleus::tile_scheduler;
 
+namespace {
+// call before reading the reply, the whole body is available once it is finished.
+void record_telemetry(const QNetworkReply* reply, std::chrono::steady_clock::time_point requested_at)
+{
+    auto& telemetry = Telemetry::instance();
+    const auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - requested_at);
+    telemetry.record(Telemetry::Timing::NetworkRtt, uint64_t(rtt.count()));
+    telemetry.add(Telemetry::Counter::NetworkRequests);
+    telemetry.add(Telemetry::Counter::BytesReceived, uint64_t(std::max(reply->bytesAvailable(), qint64(0))));
+    if (reply->error() != QNetworkReply::NoError && reply->error() != QNetworkReply::ContentNotFoundError)
+        telemetry.add(Telemetry::Counter::NetworkErrors);
+}
+} // namespace
+
 TileLoadService::TileLoadService(const QString& base_url, UrlPattern url_pattern, const QString& file_ending, const LoadBalancingTargets& load_balancing_targets)
     : m_network_manager(new QNetworkAccessManager(this))
     , m_base_url(base_url)
@@ -39,17 +57,29 @@ TileLoadService::TileLoadService(const QString& base_url, UrlPattern url_pattern
 
 TileLoadService::~TileLoadService() = default;
 
-void TileLoadService::load(const tile::Id& tile_id)
+QNetworkRequest TileLoadService::build_request(const QString& url) const
 {
-    QNetworkRequest request(QUrl(build_tile_url(tile_id)));
+    QNetworkRequest request((QUrl(url)));
     request.setTransferTimeout(int(m_transfer_timeout));
     request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferCache);
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
     request.setAttribute(QNetworkRequest::UseCredentialsAttribute, false);
 #endif
+    return request;
+}
 
-    QNetworkReply* reply = m_network_manager->get(request);
-    connect(reply, &QNetworkReply::finished, [tile_id, reply, this]() {
+void TileLoadService::load(const tile::Id& tile_id)
+{
+    QNetworkReply* reply = m_network_manager->get(build_request(build_tile_url(tile_id)));
+    m_tile_replies[tile_id] = reply;
+    connect(reply, &QNetworkReply::finished, [tile_id, reply, this, requested_at = std::chrono::steady_clock::now()]() {
+        const auto in_flight = m_tile_replies.find(tile_id);
+        if (in_flight == m_tile_replies.end() || in_flight->second != reply) {
+            reply->deleteLater(); // cancelled
+            return;
+        }
+        m_tile_replies.erase(in_flight);
+        record_telemetry(reply, requested_at);
         const auto error = reply->error();
         const auto timestamp = utils::time_since_epoch();
         if (error == QNetworkReply::NoError) {
@@ -69,7 +99,73 @@ void TileLoadService::load(const tile::Id& tile_id)
     });
 }
 
+void TileLoadService::load_quad(const tile::Id& quad_id)
+{
+    if (!quad_bundles_enabled()) {
+        for (const auto& child_id : quad_id.children())
+            load(child_id);
+        return;
+    }
+
+    QNetworkReply* reply = m_network_manager->get(build_request(build_quad_bundle_url(quad_id)));
+    m_quad_bundle_replies[quad_id] = reply;
+    connect(reply, &QNetworkReply::finished, [quad_id, reply, this, requested_at = std::chrono::steady_clock::now()]() {
+        const auto in_flight = m_quad_bundle_replies.find(quad_id);
+        if (in_flight == m_quad_bundle_replies.end() || in_flight->second != reply) {
+            reply->deleteLater(); // cancelled
+            return;
+        }
+        m_quad_bundle_replies.erase(in_flight);
+        record_telemetry(reply, requested_at);
+        const auto error = reply->error();
+        const auto timestamp = utils::time_since_epoch();
+        if (error == QNetworkReply::NoError) {
+            if (const auto tiles = quad_bundle::unpack(reply->readAll(), quad_id, timestamp)) {
+                for (const auto& tile : *tiles)
+                    emit load_finished(tile);
+                reply->deleteLater();
+                return;
+            }
+        }
+        const auto not_supported = error == QNetworkReply::NoError // not a bundle, e.g., an html page
+            || error == QNetworkReply::ContentNotFoundError || error == QNetworkReply::ContentOperationNotPermittedError
+            || error == QNetworkReply::OperationNotImplementedError || error == QNetworkReply::UnknownContentError;
+        if (not_supported) {
+            // the server answered, but doesn't know about bundles. it won't change its mind, so don't ask again.
+            qDebug() << reply->url().toString() << ": quad bundles not supported, falling back to tile requests (" << error << ")";
+            m_quad_bundles_supported = false;
+            for (const auto& child_id : quad_id.children())
+                load(child_id);
+        } else {
+            for (const auto& child_id : quad_id.children())
+                emit load_finished({ child_id, { tile_types::NetworkInfo::Status::NetworkError, timestamp }, std::make_shared<QByteArray>() });
+        }
+        reply->deleteLater();
+    });
+}
+
+void TileLoadService::cancel_quad(const tile::Id& quad_id)
+{
+    // abort() emits finished synchronously, the handlers drop replies that are no longer in the maps.
+    if (const auto node = m_quad_bundle_replies.extract(quad_id))
+        node.mapped()->abort();
+    for (const auto& child_id : quad_id.children()) {
+        if (const auto node = m_tile_replies.extract(child_id))
+            node.mapped()->abort();
+    }
+}
+
 QString TileLoadService::build_tile_url(const tile::Id& tile_id) const
+{
+    return build_url(tile_id, m_file_ending);
+}
+
+QString TileLoadService::build_quad_bundle_url(const tile::Id& quad_id) const
+{
+    return build_url(quad_id, m_quad_bundle_file_ending);
+}
+
+QString TileLoadService::build_url(const tile::Id& tile_id, const QString& file_ending) const
 {
     QString tile_address;
     const auto n_y_tiles = srs::number_of_vertical_tiles_for_zoom_level(tile_id.zoom_level);
@@ -91,9 +187,9 @@ QString TileLoadService::build_tile_url(const tile::Id& tile_id) const
         const unsigned hash = qHash(tile_address) % 1024;
         const auto index = unsigned((float(hash) / 1024.1f) * float(m_load_balancing_targets.size()));
         assert(index < m_load_balancing_targets.size());
-        return m_base_url.arg(m_load_balancing_targets[index]) + tile_address + m_file_ending;
+        return m_base_url.arg(m_load_balancing_targets[index]) + tile_address + file_ending;
     }
-    return m_base_url + tile_address + m_file_ending;
+    return m_base_url + tile_address + file_ending;
 }
 
 unsigned int TileLoadService::transfer_timeout() const
@@ -106,3 +202,14 @@ void TileLoadService::set_transfer_timeout(unsigned int new_transfer_timeout)
     assert(new_transfer_timeout < unsigned(std::numeric_limits<int>::max()));
     m_transfer_timeout = new_transfer_timeout;
 }
+
+void TileLoadService::set_quad_bundle_file_ending(const QString& file_ending)
+{
+    m_quad_bundle_file_ending = file_ending;
+    m_quad_bundles_supported = true;
+}
+
+bool TileLoadService::quad_bundles_enabled() const
+{
+    return m_quad_bundles_supported && !m_quad_bundle_file_ending.isEmpty();
+}
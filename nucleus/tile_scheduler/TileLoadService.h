@@ -19,6 +19,7 @@
 #pragma once
 
 #include <memory>
+#include <unordered_map>
 
 #include <QObject>
 
@@ -26,6 +27,8 @@
 #include "tile_types.h"
 
 class QNetworkAccessManager;
+class QNetworkReply;
+class QNetworkRequest;
 
 namespace nucleus::tile_scheduler {
 
@@ -47,18 +50,35 @@ public:
     [[nodiscard]] unsigned int transfer_timeout() const;
     void set_transfer_timeout(unsigned int new_transfer_timeout);
 
+    /// enables quad bundles (see quad_bundle.h), they are requested from the quad's url with this file ending. empty disables bundles.
+    void set_quad_bundle_file_ending(const QString& file_ending);
+    [[nodiscard]] QString build_quad_bundle_url(const tile::Id& quad_id) const;
+    /// false if bundles are disabled, or the server didn't deliver a valid bundle (in which case load_quad falls back to per tile requests).
+    [[nodiscard]] bool quad_bundles_enabled() const;
+
 public slots:
     void load(const tile::Id& tile_id);
+    /// loads the four children of quad_id, either in one bundle request or in four tile requests. emits load_finished for every child.
+    void load_quad(const tile::Id& quad_id);
+    /// aborts the requests for the children of quad_id (or its bundle). load_finished is not emitted for them.
+    void cancel_quad(const tile::Id& quad_id);
 
 signals:
     void load_finished(tile_types::TileLayer tile);
 
 private:
+    [[nodiscard]] QString build_url(const tile::Id& tile_id, const QString& file_ending) const;
+    [[nodiscard]] QNetworkRequest build_request(const QString& url) const;
+
     unsigned m_transfer_timeout = tile_scheduler::constants::default_network_timeout;
     std::shared_ptr<QNetworkAccessManager> m_network_manager;
     QString m_base_url;
     UrlPattern m_url_pattern;
     QString m_file_ending;
     LoadBalancingTargets m_load_balancing_targets;
+    QString m_quad_bundle_file_ending;
+    bool m_quad_bundles_supported = true;
+    std::unordered_map<tile::Id, QNetworkReply*, tile::Id::Hasher> m_tile_replies;
+    std::unordered_map<tile::Id, QNetworkReply*, tile::Id::Hasher> m_quad_bundle_replies;
 };
 }
@@ -0,0 +1,161 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "TranscodedTextureCache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+#include <fmt/format.h>
+#include <zpp_bits.h>
+
+using namespace nucleus::tile_scheduler;
+using nucleus::utils::texture_compression::Algorithm;
+
+namespace {
+struct Entry {
+    std::array<char, 25> version;
+    uint64_t source_timestamp;
+    tile_types::GpuTexture texture;
+};
+
+const char* algorithm_name(Algorithm algorithm)
+{
+    switch (algorithm) {
+    case Algorithm::Uncompressed_RGBA:
+        return "rgba";
+    case Algorithm::ETC1:
+        return "etc1";
+    case Algorithm::DXT1:
+        return "dxt1";
+    }
+    return "unknown";
+}
+} // namespace
+
+TranscodedTextureCache::TranscodedTextureCache(const std::filesystem::path& base_path, Algorithm algorithm)
+    : m_path(base_path / algorithm_name(algorithm))
+    , m_algorithm(algorithm)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_path, ec);
+}
+
+std::optional<tile_types::GpuTexture> TranscodedTextureCache::read(const tile::Id& id, uint64_t source_timestamp) const
+{
+    const auto path = tile_path(id);
+    QFile file(path);
+    if (!file.open(QIODeviceBase::ReadOnly))
+        return {};
+    const auto bytes = file.readAll();
+    zpp::bits::in in(bytes);
+    Entry entry;
+    if (failure(in(entry)))
+        return {};
+    if (entry.version != version_information || entry.source_timestamp != source_timestamp || entry.texture.format != m_algorithm)
+        return {};
+    if (entry.texture.levels.empty())
+        return {};
+    // the modification time orders the entries for remove_unless.
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return std::move(entry.texture);
+}
+
+tl::expected<void, std::string> TranscodedTextureCache::write(const tile::Id& id, uint64_t source_timestamp, const tile_types::GpuTexture& texture) const
+{
+    std::vector<char> bytes;
+    zpp::bits::out out(bytes);
+    const auto r = out(Entry { version_information, source_timestamp, texture });
+    if (failure(r))
+        return tl::unexpected(std::make_error_code(r).message());
+
+    // write and rename, so that readers never see half written files.
+    const auto path = tile_path(id);
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        QFile file(temp_path);
+        if (!file.open(QIODeviceBase::WriteOnly))
+            return tl::unexpected(fmt::format("Couldn't open file '{}' for writing!", temp_path.string()));
+        if (file.write(bytes.data(), qint64(bytes.size())) != qint64(bytes.size()))
+            return tl::unexpected(fmt::format("Couldn't write to '{}'!", temp_path.string()));
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec)
+        return tl::unexpected(fmt::format("Couldn't rename '{}': {}", temp_path.string(), ec.message()));
+    return {};
+}
+
+void TranscodedTextureCache::remove_unless(const std::function<bool(const tile::Id&)>& keep, uint64_t max_bytes) const
+{
+    struct KeptEntry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type used;
+        uint64_t size;
+    };
+    const auto now = std::filesystem::file_time_type::clock::now();
+    std::vector<KeptEntry> kept;
+    uint64_t n_bytes = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_path, ec)) {
+        const auto used = entry.last_write_time(ec);
+        if (entry.path().extension() == ".tmp" && !ec && now - used < std::chrono::minutes(1))
+            continue; // probably being written
+        const auto parts = QString::fromStdString(entry.path().stem().string()).split('_');
+        bool ok = parts.size() == 3;
+        tile::Id id = {};
+        if (ok)
+            id.zoom_level = parts[0].toUInt(&ok);
+        if (ok)
+            id.coords.x = parts[1].toUInt(&ok);
+        if (ok)
+            id.coords.y = parts[2].toUInt(&ok);
+        if (!ok || entry.path().extension() != ".alp_texture" || !keep(id)) {
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        const auto size = entry.file_size(ec);
+        kept.push_back({ entry.path(), used, ec ? 0 : size });
+        n_bytes += kept.back().size;
+    }
+    if (n_bytes <= max_bytes)
+        return;
+
+    std::sort(kept.begin(), kept.end(), [](const KeptEntry& a, const KeptEntry& b) { return a.used < b.used; });
+    for (const auto& entry : kept) {
+        if (n_bytes <= max_bytes)
+            break;
+        if (std::filesystem::remove(entry.path, ec))
+            n_bytes -= entry.size;
+    }
+}
+
+const std::filesystem::path& TranscodedTextureCache::path() const
+{
+    return m_path;
+}
+
+std::filesystem::path TranscodedTextureCache::tile_path(const tile::Id& id) const
+{
+    return m_path / fmt::format("{}_{}_{}.alp_texture", id.zoom_level, id.coords.x, id.coords.y);
+}
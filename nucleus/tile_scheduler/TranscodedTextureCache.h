@@ -0,0 +1,59 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+
+#include <tl/expected.hpp>
+
+#include "radix/tile.h"
+#include "tile_types.h"
+
+namespace nucleus::tile_scheduler {
+
+/// disk cache for block compressed ortho textures, so they are transcoded only once per tile and format.
+/// entries are keyed by tile id and tagged with the timestamp of the source texture, stale entries are ignored.
+/// the class has no state besides the path, it can be used from several threads as long as they work on different tiles (remove_unless
+/// only loses entries that are read or written at the same time).
+class TranscodedTextureCache {
+public:
+    TranscodedTextureCache(const std::filesystem::path& base_path, nucleus::utils::texture_compression::Algorithm algorithm);
+
+    [[nodiscard]] std::optional<tile_types::GpuTexture> read(const tile::Id& id, uint64_t source_timestamp) const;
+    [[nodiscard]] tl::expected<void, std::string> write(const tile::Id& id, uint64_t source_timestamp, const tile_types::GpuTexture& texture) const;
+    /// removes the entries of all tiles for which keep returns false, and then the least recently used ones until the rest fits into max_bytes.
+    /// walks the whole directory, so better not on the main thread.
+    void remove_unless(const std::function<bool(const tile::Id&)>& keep, uint64_t max_bytes = std::numeric_limits<uint64_t>::max()) const;
+
+    [[nodiscard]] const std::filesystem::path& path() const;
+
+    static constexpr std::array<char, 25> version_information = { "TranscodedTexture, v0.1" };
+
+private:
+    [[nodiscard]] std::filesystem::path tile_path(const tile::Id& id) const;
+
+    std::filesystem::path m_path;
+    nucleus::utils::texture_compression::Algorithm m_algorithm;
+};
+
+} // namespace nucleus::tile_scheduler
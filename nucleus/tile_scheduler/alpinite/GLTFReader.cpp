@@ -1,38 +1,110 @@
 #include "GLTFReader.h"
 #include "qdebug.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <span>
+
+#include <QThread>
+#include <QThreadPool>
+
+#include "nucleus/tile_scheduler/Telemetry.h"
+#include "nucleus/utils/mesh_optimisation.h"
+
 #define CGLTF_IMPLEMENTATION
 #include "cgltf.h"
 
 using namespace nucleus::tile_scheduler;
+namespace mesh_optimisation = nucleus::utils::mesh_optimisation;
+
+namespace {
+// owns the memory behind all byte arrays of a decoded tile. indices, positions, uvs and texture are non-owning views into storage.
+// never write through them, that would detach and copy.
+struct TileArena {
+    QByteArray storage;
+    QByteArray indices;
+    QByteArray positions;
+    QByteArray uvs;
+    QByteArray texture;
+};
+} // namespace
 
 GLTFReader::GLTFReader(QObject* parent)
     : QObject { parent }
+    , m_thread_pool(std::make_unique<QThreadPool>())
 {
+    set_n_worker_threads(default_n_worker_threads());
 }
 
-void GLTFReader::deliver_tile(const tile_types::TileLayer& tile)
+GLTFReader::~GLTFReader()
 {
-    tile_types::LayeredTile dummy = { tile.id, tile.network_info, std::make_shared<QByteArray>(), std::make_shared<QByteArray>(),
-        std::make_shared<QByteArray>(), std::make_shared<QByteArray>() };
+    // workers post their results back to this object, they must be done before it goes away.
+    m_thread_pool->waitForDone();
+}
 
-    if (tile.network_info.status == tile_types::NetworkInfo::Status::Good) {
-        // qDebug() << "RECV TILE: " << tile.id.zoom_level << "/" << tile.id.coords.x << "/" << tile.id.coords.y << " " << (uint64_t)tile.network_info.status
-        //          << " Size: " << tile.data->size();
+void GLTFReader::set_n_worker_threads(unsigned int n_worker_threads)
+{
+    m_n_worker_threads = n_worker_threads;
+    if (m_n_worker_threads > 0)
+        m_thread_pool->setMaxThreadCount(int(m_n_worker_threads));
+}
 
-        tile_types::LayeredTile loaded_tile = load_tile_from_gltf(tile);
+unsigned GLTFReader::n_worker_threads() const
+{
+    return m_n_worker_threads;
+}
 
-        emit tile_read(loaded_tile);
-    } else {
+size_t GLTFReader::n_items_in_flight() const
+{
+    return m_n_items_in_flight;
+}
+
+unsigned GLTFReader::default_n_worker_threads()
+{
+#ifdef ALP_ENABLE_THREADING
+    return unsigned(std::clamp(QThread::idealThreadCount(), 1, 8));
+#else
+    return 0;
+#endif
+}
+
+void GLTFReader::deliver_tile(const tile_types::TileLayer& tile)
+{
+    if (tile.network_info.status != tile_types::NetworkInfo::Status::Good) {
         // qDebug() << "Emitting dummy tile";
-        emit tile_read(dummy);
+        emit tile_read({ tile.id, tile.network_info, std::make_shared<QByteArray>(), std::make_shared<QByteArray>(), std::make_shared<QByteArray>(),
+            std::make_shared<QByteArray>(), {}, {} });
+        return;
     }
+    // qDebug() << "RECV TILE: " << tile.id.zoom_level << "/" << tile.id.coords.x << "/" << tile.id.coords.y << " " << (uint64_t)tile.network_info.status
+    //          << " Size: " << tile.data->size();
+
+    if (m_n_worker_threads == 0) {
+        emit tile_read(load_tile_from_gltf(tile));
+        return;
+    }
+
+    ++m_n_items_in_flight;
+    Telemetry::instance().set(Telemetry::Gauge::GltfReaderInFlight, m_n_items_in_flight);
+    m_thread_pool->start([this, tile]() {
+        auto loaded_tile = load_tile_from_gltf(tile);
+        QMetaObject::invokeMethod(
+            this,
+            [this, loaded_tile = std::move(loaded_tile)]() {
+                --m_n_items_in_flight;
+                Telemetry::instance().set(Telemetry::Gauge::GltfReaderInFlight, m_n_items_in_flight);
+                emit tile_read(loaded_tile);
+            },
+            Qt::QueuedConnection);
+    });
 }
 
 tile_types::LayeredTile GLTFReader::load_tile_from_gltf(const tile_types::TileLayer& tile)
 {
+    const Telemetry::ScopedTiming timing(Telemetry::Timing::GltfDecode);
     tile_types::LayeredTile dummy = { tile.id, tile.network_info, std::make_shared<QByteArray>(), std::make_shared<QByteArray>(),
-        std::make_shared<QByteArray>(), std::make_shared<QByteArray>() };
+        std::make_shared<QByteArray>(), std::make_shared<QByteArray>(), {}, {} };
 
     void* buf = (void*)tile.data->constData(); /* Pointer to glb or gltf file data */
     size_t size = tile.data->size(); /* Size of the file data */
@@ -91,21 +163,19 @@ tile_types::LayeredTile GLTFReader::load_tile_from_gltf(const tile_types::TileLa
         first_buffer.size = data.bin_size;
     }
 
+    // the mesh optimisation below indexes arrays sized by the vertex count, so broken meshes are rejected in release builds as well.
+    if (mesh_primitive.indices == nullptr || position_attr == nullptr || uv_attr == nullptr) {
+        cgltf_free(data_ptr);
+        return dummy;
+    }
     cgltf_accessor& index_accessor = *mesh_primitive.indices;
-    std::vector<glm::uvec3> indices;
-    indices.resize(index_accessor.count / 3);
-    cgltf_accessor_unpack_indices(
-        &index_accessor, reinterpret_cast<unsigned int*>(indices.data()), cgltf_component_size(index_accessor.component_type), indices.size() * 3);
-
     cgltf_accessor& position_accessor = *position_attr->data;
     cgltf_accessor& uv_accessor = *uv_attr->data;
     assert(position_accessor.buffer_view == uv_accessor.buffer_view);
-    std::vector<glm::vec3> positions;
-    positions.resize(position_accessor.count);
-    cgltf_accessor_unpack_floats(&position_accessor, reinterpret_cast<float*>(positions.data()), positions.size() * 3);
-    std::vector<glm::vec2> uvs;
-    uvs.resize(uv_accessor.count);
-    cgltf_accessor_unpack_floats(&uv_accessor, reinterpret_cast<float*>(uvs.data()), uvs.size() * 2);
+    if (index_accessor.count % 3 != 0 || position_accessor.count == 0 || uv_accessor.count != position_accessor.count) {
+        cgltf_free(data_ptr);
+        return dummy;
+    }
 
     assert(data.scenes_count == 1);
     assert(data.scenes[0].nodes_count == 1);
@@ -127,61 +197,99 @@ tile_types::LayeredTile GLTFReader::load_tile_from_gltf(const tile_types::TileLa
     assert(material.pbr_metallic_roughness.base_color_texture.texture != nullptr);
     cgltf_texture& albedo_texture = *material.pbr_metallic_roughness.base_color_texture.texture;
     cgltf_image& albedo_image = *albedo_texture.image;
-
-    std::shared_ptr<QByteArray> qb_raw_texture
-        = std::make_shared<QByteArray>((char*)cgltf_buffer_view_data(albedo_image.buffer_view), albedo_image.buffer_view->size);
-
-    // OLD CONVERT FROM FLOAT + OFFSET TO DOUBLE
-    // std::vector<glm::dvec3> positionsd;
-    // positionsd.resize(positions.size());
-    // for (unsigned int i = 0; i < positionsd.size(); i++) {
-    //     positionsd[i] = glm::dvec3(positions[i]) + offset;
-    // }
-
-    // std::vector<glm::dvec2> uvsd;
-    // uvsd.resize(uvs.size());
-    // for (unsigned int i = 0; i < uvsd.size(); i++) {
-    //     uvsd[i] = glm::dvec2(uvs[i]);
-    // }
-
-    // NEW CONVERT FROM FLOAT + OFFSET TO FLOAT, TO KEEP THE FLOAT WORKFLOW IN THE SHADERS
-    for (unsigned int i = 0; i < positions.size(); i++) {
-        positions[i] = (glm::vec3)(glm::dvec3(positions[i]) + offset);
+    if (albedo_image.buffer_view == nullptr) {
+        cgltf_free(data_ptr);
+        return dummy;
     }
 
-    unsigned int max_index = positions.size() - 1;
-    for (unsigned int i = 0; i < indices.size(); i++) {
-        if (indices[i].x > max_index) {
-            // qDebug() << "Index[" << i << "].x > max_index !!! " << indices[i].x << " > " << max_index;
-            assert(false);
-        }
-        if (indices[i].y > max_index) {
-            // qDebug() << "Index[" << i << "].y > max_index !!! " << indices[i].y << " > " << max_index;
-            assert(false);
-        }
-        if (indices[i].z > max_index) {
-            // qDebug() << "Index[" << i << "].z > max_index !!! " << indices[i].z << " > " << max_index;
-            assert(false);
+    // local bounds of the mesh, the quantisation grid spans exactly this box.
+    glm::vec3 local_min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 local_max = glm::vec3(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < position_accessor.count; i++) {
+        glm::vec3 p;
+        cgltf_accessor_read_float(&position_accessor, i, &p.x, 3);
+        local_min = glm::min(local_min, p);
+        local_max = glm::max(local_max, p);
+    }
+    const auto position_offset = offset + glm::dvec3(local_min);
+    const auto position_scale = local_max - local_min;
+
+    // all mesh data is written straight into one buffer in the compact mesh_format, followed by a copy of the encoded texture, so the
+    // received glb can be dropped. the QByteArrays handed out are views into it and share ownership of the arena through aliasing shared_ptrs.
+    const auto index_size = tile_types::mesh_format::index_size(position_accessor.count);
+    const auto indices_size = qsizetype(index_accessor.count * index_size);
+    const auto positions_size = qsizetype(position_accessor.count * tile_types::mesh_format::position_size);
+    const auto uvs_size = qsizetype(uv_accessor.count * tile_types::mesh_format::uv_size);
+    const auto texture_size = qsizetype(albedo_image.buffer_view->size);
+    auto arena = std::make_shared<TileArena>();
+    arena->storage = QByteArray(indices_size + positions_size + uvs_size + texture_size, Qt::Uninitialized);
+    char* const storage = arena->storage.data(); // detaches once, while we are the only owner
+    assert(reinterpret_cast<uintptr_t>(storage) % alignof(uint32_t) == 0);
+
+    bool indices_valid = true;
+    if (index_accessor.component_type == cgltf_component_type_r_32u && index_size == sizeof(uint16_t)) {
+        // cgltf doesn't narrow when unpacking
+        auto* indices = reinterpret_cast<uint16_t*>(storage);
+        for (size_t i = 0; i < index_accessor.count; i++) {
+            const auto index = cgltf_accessor_read_index(&index_accessor, i);
+            indices_valid &= index < position_accessor.count;
+            indices[i] = uint16_t(index);
         }
+    } else {
+        indices_valid = cgltf_accessor_unpack_indices(&index_accessor, storage, index_size, index_accessor.count) == index_accessor.count;
+        const auto check = [&](const auto* indices) {
+            for (size_t i = 0; i < index_accessor.count; i++)
+                indices_valid &= indices[i] < position_accessor.count;
+        };
+        if (indices_valid)
+            index_size == sizeof(uint16_t) ? check(reinterpret_cast<const uint16_t*>(storage)) : check(reinterpret_cast<const uint32_t*>(storage));
+    }
+    if (!indices_valid) {
+        cgltf_free(data_ptr);
+        return dummy;
     }
-    // qDebug() << "All " << indices.size() << " indices are correct!";
-
-    // OLD USE OF DOUBLE DATA
-    // std::shared_ptr<QByteArray> qb_indices = std::make_shared<QByteArray>(reinterpret_cast<const char*>(indices.data()), indices.size());
-    // std::shared_ptr<QByteArray> qb_positions = std::make_shared<QByteArray>(reinterpret_cast<const char*>(positionsd.data()), positionsd.size());
-    // std::shared_ptr<QByteArray> qb_uvs = std::make_shared<QByteArray>(reinterpret_cast<const char*>(uvsd.data()), uvsd.size());
 
-    // NEW FLOAT ONLY DATA
-    std::shared_ptr<QByteArray> qb_indices = std::make_shared<QByteArray>((char*)indices.data(), indices.size() * sizeof(glm::uvec3));
-    std::shared_ptr<QByteArray> qb_positions = std::make_shared<QByteArray>((char*)positions.data(), positions.size() * sizeof(glm::vec3));
-    std::shared_ptr<QByteArray> qb_uvs = std::make_shared<QByteArray>((char*)uvs.data(), uvs.size() * sizeof(glm::vec2));
+    // reorder triangles for the post-transform cache, then number the vertices in the order they are fetched.
+    // the vertex data is written below in that new order.
+    const auto optimise = [&](auto* indices) {
+        const auto span = std::span(indices, index_accessor.count);
+        mesh_optimisation::optimise_vertex_cache(span, position_accessor.count);
+        return mesh_optimisation::optimise_vertex_fetch(span, position_accessor.count);
+    };
+    const auto vertex_remap = index_size == sizeof(uint16_t) ? optimise(reinterpret_cast<uint16_t*>(storage)) : optimise(reinterpret_cast<uint32_t*>(storage));
+
+    const auto to_unorm16 = [](float v) { return uint16_t(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f)); };
+    const auto inv_scale = glm::vec3(position_scale.x > 0 ? 1.0f / position_scale.x : 0.0f,
+        position_scale.y > 0 ? 1.0f / position_scale.y : 0.0f,
+        position_scale.z > 0 ? 1.0f / position_scale.z : 0.0f);
+    auto* positions = reinterpret_cast<uint16_t*>(storage + indices_size);
+    for (size_t i = 0; i < position_accessor.count; i++) {
+        glm::vec3 p;
+        cgltf_accessor_read_float(&position_accessor, i, &p.x, 3);
+        const auto n = (p - local_min) * inv_scale;
+        const auto v = vertex_remap[i];
+        positions[v * 3 + 0] = to_unorm16(n.x);
+        positions[v * 3 + 1] = to_unorm16(n.y);
+        positions[v * 3 + 2] = to_unorm16(n.z);
+    }
+    auto* uvs = reinterpret_cast<uint16_t*>(storage + indices_size + positions_size);
+    for (size_t i = 0; i < uv_accessor.count; i++) {
+        glm::vec2 uv;
+        cgltf_accessor_read_float(&uv_accessor, i, &uv.x, 2);
+        const auto v = vertex_remap[i];
+        uvs[v * 2 + 0] = to_unorm16(uv.x);
+        uvs[v * 2 + 1] = to_unorm16(uv.y);
+    }
 
-    // qDebug() << "Indices Buffer Size: " << qb_indices->size();
-    // qDebug() << "Positions Buffer Size: " << qb_positions->size();
-    // qDebug() << "UVs Buffer Size: " << qb_uvs->size();
-    // qDebug() << "Texture Buffer Size: " << qb_raw_texture->size();
+    auto* texture = storage + indices_size + positions_size + uvs_size;
+    std::memcpy(texture, cgltf_buffer_view_data(albedo_image.buffer_view), size_t(texture_size));
+    arena->indices = QByteArray::fromRawData(storage, indices_size);
+    arena->positions = QByteArray::fromRawData(storage + indices_size, positions_size);
+    arena->uvs = QByteArray::fromRawData(storage + indices_size + positions_size, uvs_size);
+    arena->texture = QByteArray::fromRawData(texture, texture_size);
 
     cgltf_free(data_ptr);
 
-    return { tile.id, tile.network_info, qb_indices, qb_positions, qb_uvs, qb_raw_texture };
+    return { tile.id, tile.network_info, std::shared_ptr<QByteArray>(arena, &arena->indices), std::shared_ptr<QByteArray>(arena, &arena->positions),
+        std::shared_ptr<QByteArray>(arena, &arena->uvs), std::shared_ptr<QByteArray>(arena, &arena->texture), position_offset, position_scale };
 }
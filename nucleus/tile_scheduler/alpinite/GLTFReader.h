@@ -4,12 +4,25 @@
 #include "tile_scheduler/tile_types.h"
 #include <QObject>
 
+class QThreadPool;
+
 namespace nucleus::tile_scheduler {
 
+/// Decodes glb tiles on a bounded pool of worker threads. tile_read is always emitted from the thread owning the reader.
+/// The pool has no queue limit of its own, the SlotLimiter in front of the QuadAssembler bounds the number of tiles in flight
+/// (a slot is only released once the decoded quad is delivered), so a slow decoder throttles the TileLoadService.
 class GLTFReader : public QObject {
     Q_OBJECT
 public:
     explicit GLTFReader(QObject* parent = nullptr);
+    ~GLTFReader() override;
+
+    /// 0 decodes synchronously in deliver_tile.
+    void set_n_worker_threads(unsigned n_worker_threads);
+    [[nodiscard]] unsigned n_worker_threads() const;
+    [[nodiscard]] size_t n_items_in_flight() const;
+
+    static tile_types::LayeredTile load_tile_from_gltf(const tile_types::TileLayer& tile);
 
 public slots:
     void deliver_tile(const tile_types::TileLayer& tile);
@@ -17,7 +30,11 @@ signals:
     void tile_read(const tile_types::LayeredTile& tile);
 
 private:
-    tile_types::LayeredTile load_tile_from_gltf(const tile_types::TileLayer& tile);
+    static unsigned default_n_worker_threads();
+
+    std::unique_ptr<QThreadPool> m_thread_pool;
+    unsigned m_n_worker_threads = 0;
+    size_t m_n_items_in_flight = 0;
 };
 
 } // namespace nucleus::tile_scheduler
@@ -30,7 +30,8 @@ inline float query_altitude(MemoryCache* cache, const glm::dvec2& lat_long)
 {
     const auto world_space = srs::lat_long_to_world(lat_long);
     nucleus::tile_scheduler::tile_types::TileQuad selected_quad;
-    cache->visit([&](const nucleus::tile_scheduler::tile_types::TileQuad& tile) {
+    // called from the gui and render threads, the snapshot doesn't contend with the scheduler for the cache lock.
+    cache->snapshot()->visit([&](const nucleus::tile_scheduler::tile_types::TileQuad& tile) {
         if (srs::tile_bounds(tile.id).contains(world_space)) {
             selected_quad = tile;
             return true;
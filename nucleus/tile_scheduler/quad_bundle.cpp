@@ -0,0 +1,89 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "quad_bundle.h"
+
+#include <algorithm>
+
+#include <QDataStream>
+
+namespace nucleus::tile_scheduler::quad_bundle {
+
+namespace {
+    constexpr char magic[4] = { 'A', 'L', 'P', 'Q' };
+    constexpr uint32_t n_entries = 4;
+    constexpr qsizetype header_size = 4 + 2 * sizeof(uint32_t);
+    constexpr qsizetype entry_size = 6 * sizeof(uint32_t);
+} // namespace
+
+QByteArray pack(const std::array<tile_types::TileLayer, 4>& tiles)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(magic, sizeof(magic));
+    stream << version << n_entries;
+    uint32_t offset = 0;
+    for (const auto& tile : tiles) {
+        const auto size = tile.data ? uint32_t(tile.data->size()) : 0u;
+        stream << uint32_t(tile.id.zoom_level) << uint32_t(tile.id.coords.x) << uint32_t(tile.id.coords.y) << uint32_t(tile.network_info.status) << offset << size;
+        offset += size;
+    }
+    for (const auto& tile : tiles) {
+        if (tile.data)
+            stream.writeRawData(tile.data->constData(), int(tile.data->size()));
+    }
+    return data;
+}
+
+std::optional<std::array<tile_types::TileLayer, 4>> unpack(const QByteArray& data, const tile::Id& quad_id, uint64_t timestamp)
+{
+    constexpr qsizetype payload_start = header_size + n_entries * entry_size;
+    if (data.size() < payload_start || !data.startsWith(QByteArrayView(magic, sizeof(magic))))
+        return {};
+
+    QDataStream stream(data);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.skipRawData(sizeof(magic));
+    uint32_t file_version = 0;
+    uint32_t file_n_entries = 0;
+    stream >> file_version >> file_n_entries;
+    if (file_version != version || file_n_entries != n_entries)
+        return {};
+
+    const auto children = quad_id.children();
+    std::array<tile_types::TileLayer, 4> tiles;
+    std::array<bool, 4> found = {};
+    const auto payload_size = uint64_t(data.size() - payload_start);
+    for (uint32_t i = 0; i < n_entries; ++i) {
+        uint32_t zoom_level = 0, x = 0, y = 0, status = 0, offset = 0, size = 0;
+        stream >> zoom_level >> x >> y >> status >> offset >> size;
+        const auto id = tile::Id { .zoom_level = zoom_level, .coords = { x, y } };
+        const auto child = std::find(children.begin(), children.end(), id);
+        if (child == children.end() || status > uint32_t(tile_types::NetworkInfo::Status::NetworkError) || uint64_t(offset) + size > payload_size)
+            return {};
+        const auto index = size_t(child - children.begin());
+        if (found[index])
+            return {};
+        found[index] = true;
+        tiles[index] = { id, { tile_types::NetworkInfo::Status(status), timestamp }, std::make_shared<QByteArray>(data.sliced(payload_start + offset, size)) };
+    }
+    return tiles;
+}
+
+} // namespace nucleus::tile_scheduler::quad_bundle
@@ -0,0 +1,43 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <optional>
+
+#include <QByteArray>
+
+#include "tile_types.h"
+
+/// A quad bundle carries the four children of a quad in one http response, so that a quad costs one request instead of four.
+/// Layout (little endian):
+///     char[4] magic "ALPQ", uint32 version, uint32 n_entries (always 4)
+///     n_entries * { uint32 zoom_level, uint32 x, uint32 y, uint32 status, uint32 offset, uint32 size }
+///     payload, offsets are relative to the start of the payload.
+/// Status is NetworkInfo::Status, i.e., the server reports missing children as NotFound with an empty payload.
+namespace nucleus::tile_scheduler::quad_bundle {
+
+constexpr uint32_t version = 1;
+
+QByteArray pack(const std::array<tile_types::TileLayer, 4>& tiles);
+
+/// returns nullopt if the data is not a well formed bundle of the children of quad_id. the tiles are returned in the order of tile::Id::children().
+std::optional<std::array<tile_types::TileLayer, 4>> unpack(const QByteArray& data, const tile::Id& quad_id, uint64_t timestamp);
+
+} // namespace nucleus::tile_scheduler::quad_bundle
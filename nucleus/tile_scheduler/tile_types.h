@@ -19,8 +19,11 @@
 #pragma once
 
 #include "nucleus/tile_scheduler/utils.h"
+#include "nucleus/utils/texture_compression.h"
 #include "radix/tile.h"
 
+#include <vector>
+
 #include <QByteArray>
 
 class QImage;
@@ -67,6 +70,15 @@ concept SerialisableTile = requires(T t) {
     requires std::is_same<std::remove_reference_t<decltype(T::version_information)>, const std::array<char, 25>>::value;
 };
 
+/// compact vertex format shared by the ram cache, the disk cache and the gpu.
+/// positions are unorm16 xyz relative to the tile aabb (pos = position_offset + (q / 65535) * position_scale),
+/// uvs are unorm16, indices are uint16 if the tile has few enough vertices, otherwise uint32.
+namespace mesh_format {
+    constexpr size_t position_size = 3 * sizeof(uint16_t);
+    constexpr size_t uv_size = 2 * sizeof(uint16_t);
+    constexpr size_t index_size(size_t n_vertices) { return n_vertices <= std::numeric_limits<uint16_t>::max() ? sizeof(uint16_t) : sizeof(uint32_t); }
+} // namespace mesh_format
+
 struct TileLayer {
     tile::Id id;
     NetworkInfo network_info;
@@ -77,10 +89,12 @@ static_assert(NamedTile<TileLayer>);
 struct LayeredTile {
     tile::Id id;
     NetworkInfo network_info;
-    std::shared_ptr<QByteArray> indices;
+    std::shared_ptr<QByteArray> indices; // see mesh_format
     std::shared_ptr<QByteArray> positions;
     std::shared_ptr<QByteArray> uvs;
     std::shared_ptr<QByteArray> texture;
+    glm::dvec3 position_offset = {};
+    glm::vec3 position_scale = {};
 };
 static_assert(NamedTile<LayeredTile>);
 
@@ -91,30 +105,73 @@ struct TileQuad {
     NetworkInfo network_info() const {
         return NetworkInfo::join(tiles[0].network_info, tiles[1].network_info, tiles[2].network_info, tiles[3].network_info);
     }
-    static constexpr std::array<char, 25> version_information = {"TileQuad, version 0.3"};
+    /// payload bytes, i.e., without the structs themselves.
+    size_t n_bytes() const
+    {
+        size_t n = 0;
+        for (const auto& tile : tiles) {
+            for (const auto& array : { tile.indices, tile.positions, tile.uvs, tile.texture })
+                n += array ? size_t(array->size()) : 0;
+        }
+        return n;
+    }
+    static constexpr std::array<char, 25> version_information = {"TileQuad, version 0.4"};
 };
 static_assert(NamedTile<TileQuad>);
 static_assert(SerialisableTile<TileQuad>);
 
 struct GpuCacheInfo {
     tile::Id id;
+    size_t n_bytes_on_gpu = 0; // estimated from the upload, corrected once the gpu reports (see Scheduler::update_gpu_quad_size)
+    size_t n_bytes() const { return n_bytes_on_gpu; }
 };
 static_assert(NamedTile<GpuCacheInfo>);
 
+/// ready for upload, level 0 first. uncompressed levels are tightly packed RGBA8888 rows.
+struct GpuTexture {
+    nucleus::utils::texture_compression::Algorithm format = nucleus::utils::texture_compression::Algorithm::Uncompressed_RGBA;
+    unsigned width = 0;
+    unsigned height = 0;
+    std::vector<QByteArray> levels;
+};
+
 struct GpuLayeredTile {
     tile::Id id;
     tile::SrsAndHeightBounds bounds = {};
-    std::shared_ptr<QByteArray> indices; // uvec3
-    std::shared_ptr<QByteArray> positions; // vec3
-    std::shared_ptr<QByteArray> uvs; // vec2
-    std::shared_ptr<QImage> texture; // png
+    std::shared_ptr<QByteArray> indices; // u16 or u32, see mesh_format
+    std::shared_ptr<QByteArray> positions; // unorm16 x 3
+    std::shared_ptr<QByteArray> uvs; // unorm16 x 2
+    std::shared_ptr<const GpuTexture> texture;
+    glm::dvec3 position_offset = {};
+    glm::vec3 position_scale = {};
 };
 static_assert(NamedTile<GpuLayeredTile>);
 
 struct GpuTileQuad {
     tile::Id id;
     std::array<GpuLayeredTile, 4> tiles;
+    /// buffers and all texture levels, i.e., what the upload allocates.
+    size_t n_bytes() const
+    {
+        size_t n = 0;
+        for (const auto& tile : tiles) {
+            for (const auto& array : { tile.indices, tile.positions, tile.uvs })
+                n += array ? size_t(array->size()) : 0;
+            if (tile.texture) {
+                for (const auto& level : tile.texture->levels)
+                    n += size_t(level.size());
+            }
+        }
+        return n;
+    }
 };
 static_assert(NamedTile<GpuTileQuad>);
 
+/// a quad the scheduler wants loaded. requests with a higher priority are sent to the network first (see utils::priorityFunctor).
+/// visible quads have a positive priority, prefetched ones (predicted camera positions) a negative one.
+struct QuadRequest {
+    tile::Id id;
+    float priority = 0;
+};
+
 } // namespace nucleus::tile_scheduler::tile_types
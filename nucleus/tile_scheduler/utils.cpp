@@ -18,4 +18,56 @@
 
 #include "utils.h"
 
+namespace nucleus::tile_scheduler::utils {
 
+AabbDecorator::AabbDecorator(TileHeights tile_heights)
+{
+    auto coarse = std::make_shared<Coarse>();
+    coarse->tile_heights = std::move(tile_heights);
+    for (unsigned zoom_level = 0; zoom_level <= altitude_factor_zoom_level; ++zoom_level) {
+        auto& factors = coarse->altitude_factors[zoom_level];
+        factors.resize(size_t(1) << zoom_level);
+        for (unsigned row = 0; row < factors.size(); ++row) {
+            const auto srs_bounds = srs::tile_bounds({ zoom_level, { 0, row } });
+            factors[row] = float(altitude_factor(std::max(srs_bounds.max.y, -srs_bounds.min.y)));
+        }
+    }
+    m_coarse = std::move(coarse);
+}
+
+tile::SrsAndHeightBounds AabbDecorator::aabb(const tile::Id& id) const
+{
+    const auto srs_bounds = srs::tile_bounds(id);
+    if (const auto* mesh_heights = m_mesh_heights.find(id))
+        return { .min = { srs_bounds.min, mesh_heights->first }, .max = { srs_bounds.max, mesh_heights->second } };
+
+    const auto heights = m_coarse->tile_heights.query({ id.zoom_level, id.coords });
+    // rows mirror at the equator, so the factors are the same for both y directions (tms and xyz).
+    const auto zoom_level = std::min(id.zoom_level, altitude_factor_zoom_level);
+    const auto factor = m_coarse->altitude_factors[zoom_level][id.coords.y >> (id.zoom_level - zoom_level)];
+    const auto max_altitude = heights.second * factor + 0.5f; // +0.5 to account for float inaccuracy
+    const auto min_altitude = heights.first - 0.5f; // conservative, see make_bounds
+    return { .min = { srs_bounds.min, min_altitude }, .max = { srs_bounds.max, max_altitude } };
+}
+
+void AabbDecorator::set_mesh_heights(const tile::Id& id, double min_z, double max_z)
+{
+    m_mesh_heights[id] = { min_z, max_z };
+}
+
+bool AabbDecorator::remove_mesh_heights(const tile::Id& id)
+{
+    return m_mesh_heights.erase(id);
+}
+
+bool AabbDecorator::has_mesh_heights(const tile::Id& id) const
+{
+    return m_mesh_heights.contains(id);
+}
+
+size_t AabbDecorator::n_mesh_heights() const
+{
+    return m_mesh_heights.size();
+}
+
+} // namespace nucleus::tile_scheduler::utils
@@ -25,6 +25,8 @@
 #include <QByteArray>
 #include <QDebug>
 
+#include "FlatQuadTree.h"
+#include "TileCuller.h"
 #include "constants.h"
 #include "nucleus/camera/Definition.h"
 #include "nucleus/srs.h"
@@ -81,58 +83,60 @@ namespace utils {
     concept same_as = std::same_as<T, U>;
 #endif
 
-    inline tile::SrsAndHeightBounds make_bounds(const tile::Id& id, float min_height, float max_height)
+    /// 1 / cos(latitude) at the world (webmercator) y coordinate, webmercator stretches altitudes by that. it's cosh of the mercator
+    /// coordinate, which is cheaper than going through the latitude with atan, exp and cos.
+    inline double altitude_factor(double world_y)
     {
-        const auto comp_scaled_alt = [](float world_y, float altitude) {
-            // unoptimised version:
-            //            const auto lat = srs::world_to_lat_long({ 0.0, world_y }).x;
-            //            return srs::lat_long_alt_to_world({ lat, 0.0, altitude }).z;
-
-            // optimised version:
-            constexpr double pi = 3.1415926535897932384626433;
-            constexpr unsigned int cSemiMajorAxis = 6378137;
-            constexpr double cEarthCircumference = 2 * pi * cSemiMajorAxis;
-            constexpr double cOriginShift = cEarthCircumference / 2.0;
-
-            const float mercN = world_y * float(pi / cOriginShift);
-            const float lat_rad = 2.0f * (std::atan(std::exp(mercN)) - float(pi / 4.0));
-            return altitude / std::abs(std::cos(lat_rad));
-        };
+        constexpr double pi = 3.1415926535897932384626433;
+        constexpr unsigned int cSemiMajorAxis = 6378137;
+        constexpr double cEarthCircumference = 2 * pi * cSemiMajorAxis;
+        constexpr double cOriginShift = cEarthCircumference / 2.0;
+        return std::cosh(world_y * (pi / cOriginShift));
+    }
 
+    inline tile::SrsAndHeightBounds make_bounds(const tile::Id& id, float min_height, float max_height)
+    {
         const auto srs_bounds = srs::tile_bounds(id);
-        const auto max_world_y = [&srs_bounds]() {
-            return float(std::max(srs_bounds.max.y, -srs_bounds.min.y));
-        }();
-        //        const auto min_world_y = [&srs_bounds, &id]() {
-        //            if (id.zoom_level == 0)
-        //                return 0.;
-        //            return std::min(std::abs(srs_bounds.min.y), std::abs(srs_bounds.max.y));    // max can have a smaller abs value in the southern hemisphere
-        //        }();
-
-        const auto max_altitude = comp_scaled_alt(max_world_y, max_height) + 0.5f; // +0.5 to account for float inaccuracy
+        const auto max_altitude = float(max_height * altitude_factor(std::max(srs_bounds.max.y, -srs_bounds.min.y))) + 0.5f; // +0.5 to account for float inaccuracy
         const auto min_altitude = min_height - 0.5f; // we are allowed to be conservative with the AABBs! old code: comp_scaled_alt(min_world_y, min_height);
         return { .min = { srs_bounds.min, min_altitude }, .max = { srs_bounds.max, max_altitude } };
     }
 
     class AabbDecorator;
     using AabbDecoratorPtr = std::shared_ptr<AabbDecorator>;
+    /// Bounds of tiles from the coarse min / max heights of TileHeights (height_data.atb), replaced by the heights of the actual mesh once a
+    /// tile was loaded (set_mesh_heights). The latitude factors for altitudes are tabulated per row down to altitude_factor_zoom_level, deeper
+    /// tiles use the row of their ancestor on that level (a bit larger, so still conservative).
+    /// Copies share the coarse heights and factors, but have their own mesh heights. Setting mesh heights isn't thread safe, so every thread
+    /// refining bounds works on its own copy (see Scheduler::set_aabb_decorator).
+    /// Mesh heights are tighter than the coarse ones, so the bounds of a tile don't necessarily contain those of its children any more. Users
+    /// of LodCut reset it when mesh heights change. Mesh heights are removed when the tile leaves the cache of the user.
     class AabbDecorator {
-        TileHeights tile_heights;
-
     public:
-        explicit inline AabbDecorator(TileHeights tile_heights)
-            : tile_heights(std::move(tile_heights))
-        {
-        }
-        inline tile::SrsAndHeightBounds aabb(const tile::Id& id) const
-        {
-            const auto heights = tile_heights.query({ id.zoom_level, id.coords });
-            return make_bounds(id, heights.first, heights.second);
-        }
+        static constexpr unsigned altitude_factor_zoom_level = 12;
+
+        explicit AabbDecorator(TileHeights tile_heights);
+
+        [[nodiscard]] tile::SrsAndHeightBounds aabb(const tile::Id& id) const;
+        /// the world space z range of the loaded mesh of id. these bounds are used instead of the coarse ones from then on.
+        void set_mesh_heights(const tile::Id& id, double min_z, double max_z);
+        /// back to the coarse heights. returns whether id had mesh heights.
+        bool remove_mesh_heights(const tile::Id& id);
+        [[nodiscard]] bool has_mesh_heights(const tile::Id& id) const;
+        [[nodiscard]] size_t n_mesh_heights() const;
+
         static inline AabbDecoratorPtr make(TileHeights heights)
         {
             return std::make_shared<AabbDecorator>(std::move(heights));
         }
+
+    private:
+        struct Coarse {
+            TileHeights tile_heights;
+            std::array<std::vector<float>, altitude_factor_zoom_level + 1> altitude_factors; // per zoom level and row
+        };
+        std::shared_ptr<const Coarse> m_coarse;
+        FlatQuadTree<std::pair<double, double>> m_mesh_heights;
     };
 
     inline auto camera_frustum_contains_tile_old(const nucleus::camera::Frustum& frustum, const tile::SrsAndHeightBounds& aabb)
@@ -273,8 +277,8 @@ namespace utils {
         double tile_size = 256)
     {
         constexpr auto sqrt2 = 1.414213562373095;
-        const auto camera_frustum = camera.frustum();
-        auto refine = [&camera, camera_frustum, error_threshold_px, tile_size, aabb_decorator](const tile::Id& tile) {
+        const auto culler = TileCuller(camera, tile_size);
+        auto refine = [&camera, culler, error_threshold_px, tile_size, aabb_decorator](const tile::Id& tile) {
             // qDebug() << "[REFINEMENT] Checking tile " << tile.zoom_level << "/" << tile.coords[0] << "/" << tile.coords[1];
             // if (tile.zoom_level < 19) {
             //     qDebug() << "    Refining, because tile level is smaller than 19";
@@ -286,7 +290,7 @@ namespace utils {
             }
 
             const auto aabb = aabb_decorator->aabb(tile);
-            if (!tile_scheduler::utils::camera_frustum_contains_tile(camera_frustum, aabb)) {
+            if (!culler.contains(aabb)) {
                 // qDebug() << "    Not refining, because tile is not in frustum";
                 return false;
             }
@@ -301,6 +305,29 @@ namespace utils {
         return refine;
     }
 
+    /// larger is more urgent. the projected screen space error of the tile, damped by the distance of its centre to the centre of the screen
+    /// (in ndc), so that the tile under the view centre is sharpened first. visible tiles are in [1, inf), tiles outside the frustum are mapped
+    /// into [0, 1), so they come after all visible ones regardless of their error.
+    inline auto priorityFunctor(const nucleus::camera::Definition& camera, const AabbDecoratorPtr& aabb_decorator, double tile_size = 256)
+    {
+        constexpr auto sqrt2 = 1.414213562373095;
+        const auto culler = TileCuller(camera, tile_size);
+        const auto world_view_projection = camera.world_view_projection_matrix();
+        return [&camera, culler, world_view_projection, tile_size, aabb_decorator](const tile::Id& tile) {
+            const auto aabb = aabb_decorator->aabb(tile);
+            const auto distance = float(geometry::distance(aabb, camera.position()));
+            const auto pixel_size = float(sqrt2 * aabb.size().x / tile_size);
+            const auto screen_space_error = camera.to_screen_space(pixel_size, distance);
+
+            const auto centre = world_view_projection * glm::dvec4((aabb.min + aabb.max) * 0.5, 1.0);
+            const auto offset_from_view_centre = centre.w > 0 ? float(glm::length(glm::dvec2(centre) / centre.w)) : 2.f;
+            const auto centre_factor = 1.f / ((1.f + offset_from_view_centre) * (1.f + offset_from_view_centre));
+
+            const auto priority = screen_space_error * centre_factor;
+            return culler.contains(aabb) ? 1.f + priority : priority / (1.f + priority);
+        };
+    }
+
     inline uint64_t time_since_epoch()
     {
         return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
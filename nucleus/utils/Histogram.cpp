@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "Histogram.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+
+namespace nucleus::utils {
+
+unsigned Histogram::bucket_index(uint64_t value)
+{
+    value = std::min(value, max_value);
+    if (value < 2 * sub_bucket_count)
+        return unsigned(value);
+    // shift, such that value >> shift is in [sub_bucket_count, 2 * sub_bucket_count)
+    const auto shift = unsigned(std::bit_width(value)) - sub_bucket_bits - 1;
+    return 2 * sub_bucket_count + (shift - 1) * sub_bucket_count + unsigned(value >> shift) - sub_bucket_count;
+}
+
+uint64_t Histogram::highest_equivalent_value(unsigned bucket_index)
+{
+    assert(bucket_index < n_buckets);
+    if (bucket_index < 2 * sub_bucket_count)
+        return bucket_index;
+    const auto shift = (bucket_index - 2 * sub_bucket_count) / sub_bucket_count + 1;
+    const auto sub_bucket = uint64_t((bucket_index - 2 * sub_bucket_count) % sub_bucket_count + sub_bucket_count);
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value, uint64_t count)
+{
+    if (count == 0)
+        return;
+    value = std::min(value, max_value);
+    m_counts[bucket_index(value)] += count;
+    m_min = m_count == 0 ? value : std::min(m_min, value);
+    m_max = m_count == 0 ? value : std::max(m_max, value);
+    m_count += count;
+    m_sum += value * count;
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    if (other.m_count == 0)
+        return;
+    for (unsigned i = 0; i < n_buckets; ++i)
+        m_counts[i] += other.m_counts[i];
+    m_min = m_count == 0 ? other.m_min : std::min(m_min, other.m_min);
+    m_max = m_count == 0 ? other.m_max : std::max(m_max, other.m_max);
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+}
+
+void Histogram::reset()
+{
+    *this = {};
+}
+
+uint64_t Histogram::count() const
+{
+    return m_count;
+}
+
+uint64_t Histogram::min() const
+{
+    return m_min;
+}
+
+uint64_t Histogram::max() const
+{
+    return m_max;
+}
+
+double Histogram::mean() const
+{
+    return m_count == 0 ? 0.0 : double(m_sum) / double(m_count);
+}
+
+uint64_t Histogram::percentile(double percentile) const
+{
+    if (m_count == 0)
+        return 0;
+    percentile = std::clamp(percentile, 0.0, 100.0);
+    const auto rank = std::max(uint64_t(1), uint64_t(std::ceil(percentile / 100.0 * double(m_count))));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < n_buckets; ++i) {
+        seen += m_counts[i];
+        if (seen >= rank)
+            return std::clamp(highest_equivalent_value(i), m_min, m_max);
+    }
+    return m_max;
+}
+
+} // namespace nucleus::utils
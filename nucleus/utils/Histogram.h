@@ -0,0 +1,58 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace nucleus::utils {
+
+/// fixed memory histogram with logarithmic buckets, similar to hdr histogram with a precision of 5 bits (~3% relative error).
+/// values up to 63 are exact, larger values are clamped to max_value. not thread safe.
+class Histogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr unsigned sub_bucket_count = 1u << sub_bucket_bits;
+    static constexpr unsigned max_value_bits = 40;
+    static constexpr uint64_t max_value = (uint64_t(1) << max_value_bits) - 1;
+    static constexpr unsigned n_buckets = 2 * sub_bucket_count + (max_value_bits - sub_bucket_bits - 1) * sub_bucket_count;
+
+    void record(uint64_t value, uint64_t count = 1);
+    void merge(const Histogram& other);
+    void reset();
+
+    [[nodiscard]] uint64_t count() const;
+    [[nodiscard]] uint64_t min() const;
+    [[nodiscard]] uint64_t max() const;
+    [[nodiscard]] double mean() const;
+    /// percentile in [0, 100]. returns the highest value that is equivalent (same bucket) to the value at that percentile. 0 if empty.
+    [[nodiscard]] uint64_t percentile(double percentile) const;
+
+    [[nodiscard]] static unsigned bucket_index(uint64_t value);
+    [[nodiscard]] static uint64_t highest_equivalent_value(unsigned bucket_index);
+
+private:
+    std::array<uint64_t, n_buckets> m_counts = {};
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = 0;
+    uint64_t m_max = 0;
+};
+
+} // namespace nucleus::utils
@@ -0,0 +1,114 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "RangeAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace nucleus::utils {
+
+RangeAllocator::RangeAllocator(size_t capacity)
+{
+    grow(capacity);
+}
+
+std::optional<size_t> RangeAllocator::allocate(size_t size, size_t alignment)
+{
+    assert(alignment > 0);
+    if (size == 0)
+        return {};
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+        const auto [free_offset, free_size] = *it;
+        const auto offset = (free_offset + alignment - 1) / alignment * alignment;
+        if (offset + size > free_offset + free_size)
+            continue;
+        m_free.erase(it);
+        // the padding in front and the rest behind stay free
+        if (offset > free_offset)
+            m_free.emplace(free_offset, offset - free_offset);
+        if (offset + size < free_offset + free_size)
+            m_free.emplace(offset + size, free_offset + free_size - offset - size);
+        m_n_allocated += size;
+        return offset;
+    }
+    return {};
+}
+
+void RangeAllocator::free(size_t offset, size_t size)
+{
+    if (size == 0)
+        return;
+    assert(offset + size <= m_capacity);
+    assert(m_n_allocated >= size);
+    m_n_allocated -= size;
+    auto [it, inserted] = m_free.emplace(offset, size);
+    assert(inserted);
+    (void)inserted;
+    if (const auto next = std::next(it); next != m_free.end()) {
+        assert(it->first + it->second <= next->first);
+        if (it->first + it->second == next->first) {
+            it->second += next->second;
+            m_free.erase(next);
+        }
+    }
+    if (it != m_free.begin()) {
+        const auto previous = std::prev(it);
+        assert(previous->first + previous->second <= it->first);
+        if (previous->first + previous->second == it->first) {
+            previous->second += it->second;
+            m_free.erase(it);
+        }
+    }
+}
+
+void RangeAllocator::grow(size_t new_capacity)
+{
+    if (new_capacity <= m_capacity)
+        return;
+    const auto old_capacity = m_capacity;
+    m_capacity = new_capacity;
+    m_n_allocated += new_capacity - old_capacity; // free takes it off again
+    free(old_capacity, new_capacity - old_capacity);
+}
+
+size_t RangeAllocator::capacity() const
+{
+    return m_capacity;
+}
+
+size_t RangeAllocator::n_allocated() const
+{
+    return m_n_allocated;
+}
+
+size_t RangeAllocator::n_free_ranges() const
+{
+    return m_free.size();
+}
+
+size_t RangeAllocator::largest_free_range() const
+{
+    size_t largest = 0;
+    for (const auto& [offset, size] : m_free)
+        largest = std::max(largest, size);
+    return largest;
+}
+
+} // namespace nucleus::utils
@@ -0,0 +1,51 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <optional>
+
+namespace nucleus::utils {
+
+/// First fit sub allocation of the range [0, capacity) in any unit (bytes, vertices, ..), e.g., of a large gpu buffer. The free ranges are
+/// kept sorted by offset and merged with their neighbours on free, so freed space is reusable for larger allocations.
+class RangeAllocator {
+public:
+    explicit RangeAllocator(size_t capacity = 0);
+
+    /// the offset, a multiple of alignment. nothing if no free range is large enough, grow then.
+    [[nodiscard]] std::optional<size_t> allocate(size_t size, size_t alignment = 1);
+    /// offset and size must be those of an allocation.
+    void free(size_t offset, size_t size);
+    /// appends [capacity, new_capacity) to the free space.
+    void grow(size_t new_capacity);
+
+    [[nodiscard]] size_t capacity() const;
+    [[nodiscard]] size_t n_allocated() const;
+    [[nodiscard]] size_t n_free_ranges() const;
+    [[nodiscard]] size_t largest_free_range() const;
+
+private:
+    std::map<size_t, size_t> m_free; // offset -> size
+    size_t m_capacity = 0;
+    size_t m_n_allocated = 0;
+};
+
+} // namespace nucleus::utils
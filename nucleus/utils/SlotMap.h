@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace nucleus::utils {
+
+/// Values in a dense vector (iteration without holes, erase swaps the last value in) that are addressed by stable keys. A key is a slot
+/// index plus the generation of the slot, so keys of erased values don't alias values inserted later into the same slot.
+template <typename T>
+class SlotMap {
+public:
+    struct Key {
+        uint32_t index = uint32_t(-1);
+        uint32_t generation = 0;
+        bool operator==(const Key&) const = default;
+    };
+
+    Key insert(T value)
+    {
+        uint32_t index = 0;
+        if (m_free_slots.empty()) {
+            index = uint32_t(m_slots.size());
+            m_slots.push_back({});
+        } else {
+            index = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        auto& slot = m_slots[index];
+        slot.value_index = uint32_t(m_values.size());
+        m_values.push_back(std::move(value));
+        m_value_slots.push_back(index);
+        return { index, slot.generation };
+    }
+
+    bool erase(const Key& key)
+    {
+        if (!contains(key))
+            return false;
+        auto& slot = m_slots[key.index];
+        const auto value_index = slot.value_index;
+        if (value_index + 1 != m_values.size()) {
+            m_values[value_index] = std::move(m_values.back());
+            m_value_slots[value_index] = m_value_slots.back();
+            m_slots[m_value_slots[value_index]].value_index = value_index;
+        }
+        m_values.pop_back();
+        m_value_slots.pop_back();
+        ++slot.generation;
+        slot.value_index = no_value;
+        m_free_slots.push_back(key.index);
+        return true;
+    }
+
+    [[nodiscard]] bool contains(const Key& key) const
+    {
+        return key.index < m_slots.size() && m_slots[key.index].generation == key.generation && m_slots[key.index].value_index != no_value;
+    }
+    T* find(const Key& key) { return contains(key) ? &m_values[m_slots[key.index].value_index] : nullptr; }
+    const T* find(const Key& key) const { return contains(key) ? &m_values[m_slots[key.index].value_index] : nullptr; }
+
+    void clear()
+    {
+        for (uint32_t index : m_value_slots) {
+            ++m_slots[index].generation;
+            m_slots[index].value_index = no_value;
+            m_free_slots.push_back(index);
+        }
+        m_values.clear();
+        m_value_slots.clear();
+    }
+
+    [[nodiscard]] size_t size() const { return m_values.size(); }
+    [[nodiscard]] bool empty() const { return m_values.empty(); }
+    /// dense, in no particular order.
+    [[nodiscard]] const std::vector<T>& values() const { return m_values; }
+    auto begin() { return m_values.begin(); }
+    auto end() { return m_values.end(); }
+    auto begin() const { return m_values.begin(); }
+    auto end() const { return m_values.end(); }
+
+private:
+    static constexpr uint32_t no_value = uint32_t(-1);
+    struct Slot {
+        uint32_t value_index = no_value;
+        uint32_t generation = 0;
+    };
+    std::vector<T> m_values;
+    std::vector<uint32_t> m_value_slots; // slot of each value
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free_slots;
+};
+
+} // namespace nucleus::utils
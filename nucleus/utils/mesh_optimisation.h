@@ -0,0 +1,166 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+// functions in this file reorder triangle meshes for faster rendering. they work in place on index buffers of any unsigned type.
+// triangles keep their winding, only their order and the vertex numbering changes.
+
+namespace nucleus::utils::mesh_optimisation {
+
+// average cache miss ratio: simulated misses of a fifo post-transform vertex cache per triangle.
+// 3 is the worst case, ~0.6-0.7 is about the best achievable for regular grids.
+template <typename Index>
+double acmr(std::span<const Index> indices, unsigned cache_size = 16)
+{
+    assert(indices.size() % 3 == 0);
+    if (indices.empty())
+        return 0;
+    std::vector<Index> fifo(cache_size, std::numeric_limits<Index>::max());
+    size_t fifo_head = 0;
+    size_t misses = 0;
+    for (const auto index : indices) {
+        bool hit = false;
+        for (const auto cached : fifo)
+            hit = hit || cached == index;
+        if (hit)
+            continue;
+        ++misses;
+        fifo[fifo_head] = index;
+        fifo_head = (fifo_head + 1) % cache_size;
+    }
+    return double(misses) / double(indices.size() / 3);
+}
+
+// reorders triangles for the post-transform vertex cache.
+// tipsify, from Sander, Nehab and Barczak, "Fast triangle reordering for vertex locality and reduced overdraw", 2007.
+// linear in the number of triangles.
+template <typename Index>
+void optimise_vertex_cache(std::span<Index> indices, size_t n_vertices, unsigned cache_size = 16)
+{
+    assert(indices.size() % 3 == 0);
+    const auto n_triangles = indices.size() / 3;
+    if (n_triangles == 0)
+        return;
+
+    // vertex -> triangle adjacency, compressed rows
+    std::vector<uint32_t> live(n_vertices, 0);
+    for (const auto index : indices) {
+        assert(index < n_vertices);
+        ++live[index];
+    }
+    std::vector<uint32_t> offsets(n_vertices + 1, 0);
+    for (size_t v = 0; v < n_vertices; ++v)
+        offsets[v + 1] = offsets[v] + live[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+        auto fill = std::vector<uint32_t>(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    const std::vector<Index> input(indices.begin(), indices.end());
+    std::vector<bool> emitted(n_triangles, false);
+    std::vector<uint64_t> cache_time(n_vertices, 0);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    uint64_t time_stamp = cache_size + 1;
+    size_t cursor = 0;
+    size_t out = 0;
+
+    const auto skip_dead_end = [&]() -> int64_t {
+        while (!dead_end.empty()) {
+            const auto d = dead_end.back();
+            dead_end.pop_back();
+            if (live[d] > 0)
+                return d;
+        }
+        while (cursor < n_vertices) {
+            if (live[cursor] > 0)
+                return int64_t(cursor++);
+            ++cursor;
+        }
+        return -1;
+    };
+
+    int64_t fanning = skip_dead_end();
+    while (fanning >= 0) {
+        candidates.clear();
+        for (auto a = offsets[size_t(fanning)]; a < offsets[size_t(fanning) + 1]; ++a) {
+            const auto t = adjacency[a];
+            if (emitted[t])
+                continue;
+            emitted[t] = true;
+            for (unsigned k = 0; k < 3; ++k) {
+                const auto v = input[t * 3 + k];
+                indices[out++] = v;
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time_stamp - cache_time[v] > cache_size)
+                    cache_time[v] = time_stamp++;
+            }
+        }
+
+        // next fanning vertex: the one that stays longest in the cache, if all its remaining triangles still fit.
+        int64_t next = -1;
+        int64_t best_priority = -1;
+        for (const auto v : candidates) {
+            if (live[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (time_stamp - cache_time[v] + 2 * live[v] <= cache_size)
+                priority = int64_t(time_stamp - cache_time[v]);
+            if (priority > best_priority) {
+                best_priority = priority;
+                next = v;
+            }
+        }
+        fanning = next >= 0 ? next : skip_dead_end();
+    }
+    assert(out == indices.size());
+}
+
+// renumbers the vertices in the order of their first use, so that vertex fetches walk linearly through memory.
+// returns the new index of every old vertex, unused vertices are moved to the end. use it to reorder the vertex data.
+template <typename Index>
+std::vector<uint32_t> optimise_vertex_fetch(std::span<Index> indices, size_t n_vertices)
+{
+    constexpr auto unassigned = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(n_vertices, unassigned);
+    uint32_t next = 0;
+    for (auto& index : indices) {
+        assert(index < n_vertices);
+        if (remap[index] == unassigned)
+            remap[index] = next++;
+        index = Index(remap[index]);
+    }
+    for (auto& r : remap) {
+        if (r == unassigned)
+            r = next++;
+    }
+    return remap;
+}
+
+} // namespace nucleus::utils::mesh_optimisation
@@ -0,0 +1,365 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <limits>
+
+#include <QImage>
+
+namespace nucleus::utils::texture_compression {
+
+namespace {
+    using Rgb = std::array<int, 3>;
+    using Block = std::array<Rgb, 16>; // pixel (x, y) is at y * 4 + x
+
+    int squared_error(const Rgb& a, const Rgb& b)
+    {
+        const auto dr = a[0] - b[0];
+        const auto dg = a[1] - b[1];
+        const auto db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db;
+    }
+
+    int clamp_255(int v) { return std::clamp(v, 0, 255); }
+
+    // etc1, see the khronos data format specification, section "ETC1 compressed texture image formats".
+    constexpr std::array<std::array<int, 2>, 8> etc1_modifier_table = { { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } } };
+
+    // pixel index (msb, lsb): 0 -> +a, 1 -> +b, 2 -> -a, 3 -> -b
+    int etc1_modifier(unsigned table, unsigned index)
+    {
+        const auto m = etc1_modifier_table[table][index & 1u];
+        return (index & 2u) ? -m : m;
+    }
+
+    unsigned etc1_subblock(unsigned x, unsigned y, bool flip) { return (flip ? y : x) / 2; }
+
+    int expand_4(int v) { return (v << 4) | v; }
+    int expand_5(int v) { return (v << 3) | (v >> 2); }
+
+    struct Etc1SubblockFit {
+        unsigned table = 0;
+        std::array<unsigned, 16> indices = {};
+        int error = std::numeric_limits<int>::max();
+    };
+
+    Etc1SubblockFit etc1_fit_subblock(const Block& block, bool flip, unsigned subblock, const Rgb& base)
+    {
+        Etc1SubblockFit best;
+        for (unsigned table = 0; table < 8; ++table) {
+            Etc1SubblockFit fit;
+            fit.table = table;
+            fit.error = 0;
+            for (unsigned y = 0; y < 4; ++y) {
+                for (unsigned x = 0; x < 4; ++x) {
+                    if (etc1_subblock(x, y, flip) != subblock)
+                        continue;
+                    const auto& pixel = block[y * 4 + x];
+                    auto best_pixel_error = std::numeric_limits<int>::max();
+                    for (unsigned index = 0; index < 4; ++index) {
+                        const auto m = etc1_modifier(table, index);
+                        const auto e = squared_error(pixel, { clamp_255(base[0] + m), clamp_255(base[1] + m), clamp_255(base[2] + m) });
+                        if (e < best_pixel_error) {
+                            best_pixel_error = e;
+                            fit.indices[y * 4 + x] = index;
+                        }
+                    }
+                    fit.error += best_pixel_error;
+                }
+            }
+            if (fit.error < best.error)
+                best = fit;
+        }
+        return best;
+    }
+
+    std::array<uint8_t, 8> etc1_compress_block(const Block& block)
+    {
+        std::array<uint8_t, 8> best_bytes = {};
+        auto best_error = std::numeric_limits<int>::max();
+        for (const bool flip : { false, true }) {
+            std::array<Rgb, 2> average = {};
+            for (unsigned y = 0; y < 4; ++y) {
+                for (unsigned x = 0; x < 4; ++x) {
+                    for (unsigned c = 0; c < 3; ++c)
+                        average[etc1_subblock(x, y, flip)][c] += block[y * 4 + x][c];
+                }
+            }
+            std::array<Rgb, 2> q4 = {};
+            std::array<Rgb, 2> q5 = {};
+            for (unsigned s = 0; s < 2; ++s) {
+                for (unsigned c = 0; c < 3; ++c) {
+                    // sum of 8 pixels -> rounded 4 and 5 bit quantisation of the mean
+                    q4[s][c] = std::clamp((average[s][c] * 15 + 255 * 4) / (255 * 8), 0, 15);
+                    q5[s][c] = std::clamp((average[s][c] * 31 + 255 * 4) / (255 * 8), 0, 31);
+                }
+            }
+            Rgb delta = {};
+            bool differential_possible = true;
+            for (unsigned c = 0; c < 3; ++c) {
+                delta[c] = q5[1][c] - q5[0][c];
+                differential_possible = differential_possible && delta[c] >= -4 && delta[c] <= 3;
+            }
+
+            for (const bool differential : { false, true }) {
+                if (differential && !differential_possible)
+                    continue;
+                std::array<Rgb, 2> base;
+                for (unsigned s = 0; s < 2; ++s) {
+                    for (unsigned c = 0; c < 3; ++c)
+                        base[s][c] = differential ? expand_5(q5[s][c]) : expand_4(q4[s][c]);
+                }
+                const auto fit_0 = etc1_fit_subblock(block, flip, 0, base[0]);
+                const auto fit_1 = etc1_fit_subblock(block, flip, 1, base[1]);
+                if (fit_0.error + fit_1.error >= best_error)
+                    continue;
+                best_error = fit_0.error + fit_1.error;
+
+                std::array<uint8_t, 8> bytes = {};
+                for (unsigned c = 0; c < 3; ++c) {
+                    if (differential)
+                        bytes[c] = uint8_t((q5[0][c] << 3) | (delta[c] & 7));
+                    else
+                        bytes[c] = uint8_t((q4[0][c] << 4) | q4[1][c]);
+                }
+                bytes[3] = uint8_t((fit_0.table << 5) | (fit_1.table << 2) | (differential ? 2u : 0u) | (flip ? 1u : 0u));
+                uint32_t index_bits = 0;
+                for (unsigned y = 0; y < 4; ++y) {
+                    for (unsigned x = 0; x < 4; ++x) {
+                        const auto index = etc1_subblock(x, y, flip) == 0 ? fit_0.indices[y * 4 + x] : fit_1.indices[y * 4 + x];
+                        const auto bit = x * 4 + y; // pixels are enumerated column major
+                        index_bits |= ((index >> 1) & 1u) << (16 + bit);
+                        index_bits |= (index & 1u) << bit;
+                    }
+                }
+                for (unsigned i = 0; i < 4; ++i)
+                    bytes[4 + i] = uint8_t(index_bits >> (24 - 8 * i));
+                best_bytes = bytes;
+            }
+        }
+        return best_bytes;
+    }
+
+    Block etc1_decompress_block(const uint8_t* bytes)
+    {
+        const bool differential = bytes[3] & 2u;
+        const bool flip = bytes[3] & 1u;
+        const std::array<unsigned, 2> table = { unsigned(bytes[3] >> 5), unsigned((bytes[3] >> 2) & 7u) };
+        std::array<Rgb, 2> base;
+        for (unsigned c = 0; c < 3; ++c) {
+            if (differential) {
+                const auto q = bytes[c] >> 3;
+                const auto delta = int(bytes[c] & 7u) - ((bytes[c] & 4u) ? 8 : 0);
+                base[0][c] = expand_5(q);
+                base[1][c] = expand_5(std::clamp(q + delta, 0, 31));
+            } else {
+                base[0][c] = expand_4(bytes[c] >> 4);
+                base[1][c] = expand_4(bytes[c] & 15);
+            }
+        }
+        const auto index_bits = uint32_t(bytes[4]) << 24 | uint32_t(bytes[5]) << 16 | uint32_t(bytes[6]) << 8 | uint32_t(bytes[7]);
+        Block block;
+        for (unsigned y = 0; y < 4; ++y) {
+            for (unsigned x = 0; x < 4; ++x) {
+                const auto bit = x * 4 + y;
+                const auto index = ((index_bits >> (16 + bit)) & 1u) << 1 | ((index_bits >> bit) & 1u);
+                const auto s = etc1_subblock(x, y, flip);
+                const auto m = etc1_modifier(table[s], index);
+                block[y * 4 + x] = { clamp_255(base[s][0] + m), clamp_255(base[s][1] + m), clamp_255(base[s][2] + m) };
+            }
+        }
+        return block;
+    }
+
+    // dxt1 / bc1, see the s3tc extension spec
+    uint16_t to_565(const Rgb& c)
+    {
+        const auto r = (c[0] * 31 + 127) / 255;
+        const auto g = (c[1] * 63 + 127) / 255;
+        const auto b = (c[2] * 31 + 127) / 255;
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    Rgb from_565(uint16_t v)
+    {
+        const auto r = (v >> 11) & 31;
+        const auto g = (v >> 5) & 63;
+        const auto b = v & 31;
+        return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+    }
+
+    std::array<Rgb, 4> dxt1_palette(uint16_t c0, uint16_t c1)
+    {
+        const auto a = from_565(c0);
+        const auto b = from_565(c1);
+        std::array<Rgb, 4> palette = { a, b, Rgb {}, Rgb {} };
+        for (unsigned c = 0; c < 3; ++c) {
+            if (c0 > c1) {
+                palette[2][c] = (2 * a[c] + b[c]) / 3;
+                palette[3][c] = (a[c] + 2 * b[c]) / 3;
+            } else {
+                palette[2][c] = (a[c] + b[c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        return palette;
+    }
+
+    std::array<uint8_t, 8> dxt1_compress_block(const Block& block)
+    {
+        // bounding box of the colours, inset a bit, with the diagonal chosen by the sign of the covariance with the dominant channel.
+        Rgb min = block[0];
+        Rgb max = block[0];
+        Rgb sum = {};
+        for (const auto& p : block) {
+            for (unsigned c = 0; c < 3; ++c) {
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+                sum[c] += p[c];
+            }
+        }
+        unsigned dominant = 0;
+        for (unsigned c = 1; c < 3; ++c) {
+            if (max[c] - min[c] > max[dominant] - min[dominant])
+                dominant = c;
+        }
+        Rgb covariance = {};
+        for (const auto& p : block) {
+            for (unsigned c = 0; c < 3; ++c)
+                covariance[c] += (p[dominant] * 16 - sum[dominant]) * (p[c] * 16 - sum[c]);
+        }
+        for (unsigned c = 0; c < 3; ++c) {
+            const auto inset = (max[c] - min[c]) / 16;
+            min[c] += inset;
+            max[c] -= inset;
+            if (covariance[c] < 0)
+                std::swap(min[c], max[c]);
+        }
+
+        auto c0 = to_565(max);
+        auto c1 = to_565(min);
+        if (c0 < c1)
+            std::swap(c0, c1);
+        uint32_t index_bits = 0;
+        if (c0 != c1) {
+            const auto palette = dxt1_palette(c0, c1);
+            for (unsigned i = 0; i < 16; ++i) {
+                unsigned best_index = 0;
+                auto best_error = std::numeric_limits<int>::max();
+                for (unsigned index = 0; index < 4; ++index) {
+                    const auto e = squared_error(block[i], palette[index]);
+                    if (e < best_error) {
+                        best_error = e;
+                        best_index = index;
+                    }
+                }
+                index_bits |= best_index << (2 * i);
+            }
+        }
+        return { uint8_t(c0 & 0xff), uint8_t(c0 >> 8), uint8_t(c1 & 0xff), uint8_t(c1 >> 8), uint8_t(index_bits), uint8_t(index_bits >> 8),
+            uint8_t(index_bits >> 16), uint8_t(index_bits >> 24) };
+    }
+
+    Block dxt1_decompress_block(const uint8_t* bytes)
+    {
+        const auto c0 = uint16_t(bytes[0] | bytes[1] << 8);
+        const auto c1 = uint16_t(bytes[2] | bytes[3] << 8);
+        const auto index_bits = uint32_t(bytes[4]) | uint32_t(bytes[5]) << 8 | uint32_t(bytes[6]) << 16 | uint32_t(bytes[7]) << 24;
+        const auto palette = dxt1_palette(c0, c1);
+        Block block;
+        for (unsigned i = 0; i < 16; ++i)
+            block[i] = palette[(index_bits >> (2 * i)) & 3u];
+        return block;
+    }
+
+    unsigned n_blocks(unsigned size) { return (size + 3) / 4; }
+} // namespace
+
+size_t compressed_size(unsigned width, unsigned height, Algorithm algorithm)
+{
+    if (algorithm == Algorithm::Uncompressed_RGBA)
+        return size_t(width) * height * 4;
+    return size_t(n_blocks(width)) * n_blocks(height) * 8;
+}
+
+QByteArray compress(const QImage& rgba8888, Algorithm algorithm)
+{
+    assert(rgba8888.format() == QImage::Format_RGBA8888);
+    const auto width = unsigned(rgba8888.width());
+    const auto height = unsigned(rgba8888.height());
+    QByteArray data(qsizetype(compressed_size(width, height, algorithm)), Qt::Uninitialized);
+    if (algorithm == Algorithm::Uncompressed_RGBA) {
+        for (unsigned y = 0; y < height; ++y)
+            std::copy_n(rgba8888.constScanLine(int(y)), width * 4, data.data() + size_t(y) * width * 4);
+        return data;
+    }
+
+    auto* out = reinterpret_cast<uint8_t*>(data.data());
+    for (unsigned block_y = 0; block_y < n_blocks(height); ++block_y) {
+        for (unsigned block_x = 0; block_x < n_blocks(width); ++block_x) {
+            Block block;
+            for (unsigned y = 0; y < 4; ++y) {
+                const auto* row = rgba8888.constScanLine(int(std::min(block_y * 4 + y, height - 1)));
+                for (unsigned x = 0; x < 4; ++x) {
+                    const auto* pixel = row + std::min(block_x * 4 + x, width - 1) * 4;
+                    block[y * 4 + x] = { pixel[0], pixel[1], pixel[2] };
+                }
+            }
+            const auto bytes = algorithm == Algorithm::ETC1 ? etc1_compress_block(block) : dxt1_compress_block(block);
+            out = std::copy(bytes.begin(), bytes.end(), out);
+        }
+    }
+    return data;
+}
+
+QImage decompress(const QByteArray& data, unsigned width, unsigned height, Algorithm algorithm)
+{
+    assert(size_t(data.size()) == compressed_size(width, height, algorithm));
+    QImage image(int(width), int(height), QImage::Format_RGBA8888);
+    if (algorithm == Algorithm::Uncompressed_RGBA) {
+        for (unsigned y = 0; y < height; ++y)
+            std::copy_n(data.constData() + size_t(y) * width * 4, width * 4, image.scanLine(int(y)));
+        return image;
+    }
+
+    const auto* in = reinterpret_cast<const uint8_t*>(data.constData());
+    for (unsigned block_y = 0; block_y < n_blocks(height); ++block_y) {
+        for (unsigned block_x = 0; block_x < n_blocks(width); ++block_x) {
+            const auto block = algorithm == Algorithm::ETC1 ? etc1_decompress_block(in) : dxt1_decompress_block(in);
+            in += 8;
+            for (unsigned y = 0; y < 4 && block_y * 4 + y < height; ++y) {
+                auto* row = image.scanLine(int(block_y * 4 + y));
+                for (unsigned x = 0; x < 4 && block_x * 4 + x < width; ++x) {
+                    auto* pixel = row + (block_x * 4 + x) * 4;
+                    const auto& p = block[y * 4 + x];
+                    pixel[0] = uchar(p[0]);
+                    pixel[1] = uchar(p[1]);
+                    pixel[2] = uchar(p[2]);
+                    pixel[3] = 255;
+                }
+            }
+        }
+    }
+    return image;
+}
+
+} // namespace nucleus::utils::texture_compression
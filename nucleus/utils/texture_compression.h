@@ -0,0 +1,45 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+
+#include <QByteArray>
+
+class QImage;
+
+/// block compression of ortho textures. both formats store 4x4 pixel blocks in 8 bytes (rgb only, alpha is dropped).
+/// etc1 blocks are valid etc2 blocks, so they can be uploaded as GL_COMPRESSED_RGB8_ETC2 (mandatory in GLES3).
+/// dxt1 (bc1) is for desktop gl with GL_EXT_texture_compression_s3tc.
+/// astc and bc7 are left out on purpose: their encoders are an order of magnitude slower on the cpu, and the ortho photos don't need alpha or
+/// the better quality at 8 bpp.
+namespace nucleus::utils::texture_compression {
+
+enum class Algorithm : uint32_t { Uncompressed_RGBA, ETC1, DXT1 };
+
+/// size in bytes of one level with the given dimensions. edge blocks are padded.
+size_t compressed_size(unsigned width, unsigned height, Algorithm algorithm);
+
+/// compresses an image in QImage::Format_RGBA8888. for Algorithm::Uncompressed_RGBA the pixels are copied without row padding.
+QByteArray compress(const QImage& rgba8888, Algorithm algorithm);
+
+/// inverse of compress, returns an image in QImage::Format_RGBA8888. mostly for testing and as a fallback.
+QImage decompress(const QByteArray& data, unsigned width, unsigned height, Algorithm algorithm);
+
+} // namespace nucleus::utils::texture_compression
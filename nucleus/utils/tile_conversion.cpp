@@ -18,6 +18,8 @@
 
 #include "tile_conversion.h"
 
+#include <algorithm>
+
 namespace nucleus::utils::tile_conversion {
 
 Raster<glm::u8vec4> toRasterRGBA(const QByteArray& byte_array)
@@ -48,4 +50,30 @@ Raster<uint16_t> qImage2uint16Raster(const QImage& qimage)
     return raster;
 }
 
+std::vector<QImage> toMipChainRGBA(const QByteArray& byte_array)
+{
+    auto level_0 = toQImage(byte_array);
+    if (level_0.isNull())
+        return {};
+    std::vector<QImage> chain;
+    chain.push_back(level_0.convertedTo(QImage::Format_RGBA8888));
+    while (chain.back().width() > 1 || chain.back().height() > 1) {
+        const QImage& src = chain.back();
+        QImage dst(std::max(1, src.width() / 2), std::max(1, src.height() / 2), QImage::Format_RGBA8888);
+        for (int y = 0; y < dst.height(); ++y) {
+            const auto* row_0 = reinterpret_cast<const glm::u8vec4*>(src.constScanLine(std::min(2 * y, src.height() - 1)));
+            const auto* row_1 = reinterpret_cast<const glm::u8vec4*>(src.constScanLine(std::min(2 * y + 1, src.height() - 1)));
+            auto* out = reinterpret_cast<glm::u8vec4*>(dst.scanLine(y));
+            for (int x = 0; x < dst.width(); ++x) {
+                const auto x_0 = std::min(2 * x, src.width() - 1);
+                const auto x_1 = std::min(2 * x + 1, src.width() - 1);
+                const auto sum = glm::uvec4(row_0[x_0]) + glm::uvec4(row_0[x_1]) + glm::uvec4(row_1[x_0]) + glm::uvec4(row_1[x_1]);
+                out[x] = glm::u8vec4((sum + 2u) / 4u);
+            }
+        }
+        chain.push_back(std::move(dst));
+    }
+    return chain;
+}
+
 }
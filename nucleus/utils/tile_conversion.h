@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <glm/glm.hpp>
 
 #include <QImage>
@@ -29,6 +31,9 @@ namespace nucleus::utils::tile_conversion {
 inline QImage toQImage(const QByteArray& byte_array) { return QImage::fromData(byte_array); }
 Raster<glm::u8vec4> toRasterRGBA(const QByteArray& byte_array);
 Raster<uint16_t> qImage2uint16Raster(const QImage& byte_array);
+/// decodes the image and builds the full mip chain down to 1x1 with a 2x2 box filter. level 0 first, all levels are RGBA8888.
+/// returns an empty vector if the image can't be decoded.
+std::vector<QImage> toMipChainRGBA(const QByteArray& byte_array);
 
 inline glm::u8vec4 float2alpineRGBA(float height)
 {
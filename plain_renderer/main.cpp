@@ -50,7 +50,10 @@
 
 #include <iostream>
 
+#include <QDebug>
+#include <QFile>
 #include <QGuiApplication>
+#include <QJsonDocument>
 #include <QObject>
 #include <QOpenGLContext>
 #include <QScreen>
@@ -61,6 +64,7 @@
 #include "Window.h"
 #include "nucleus/Controller.h"
 #include "nucleus/camera/Controller.h"
+#include "nucleus/tile_scheduler/Telemetry.h"
 
 
 // This example demonstrates easy, cross-platform usage of OpenGL ES 3.0 functions via
@@ -115,5 +119,17 @@ int main(int argc, char* argv[])
     if (glWindow.width() > 0 && glWindow.height() > 0)
         controller.camera_controller()->set_viewport({ glWindow.width(), glWindow.height() });
 
+    // tile pipeline telemetry (latency histograms, queue depths, byte counters) is written to this file on exit.
+    if (const auto telemetry_path = qEnvironmentVariable("ALP_TELEMETRY_JSON"); !telemetry_path.isEmpty()) {
+        QObject::connect(&app, &QGuiApplication::aboutToQuit, [telemetry_path]() {
+            QFile file(telemetry_path);
+            if (!file.open(QIODevice::WriteOnly)) {
+                qDebug() << "Writing telemetry to" << telemetry_path << "failed:" << file.errorString();
+                return;
+            }
+            file.write(QJsonDocument(nucleus::tile_scheduler::Telemetry::instance().snapshot().to_json()).toJson());
+        });
+    }
+
     return QGuiApplication::exec();
 }
@@ -0,0 +1,127 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <QByteArray>
+#include <QOpenGLContext>
+#include <catch2/catch_test_macros.hpp>
+
+#include "gl_engine/GeometryArena.h"
+#include "nucleus/tile_scheduler/tile_types.h"
+
+#include "UnittestGLContext.h"
+
+using gl_engine::GeometryArena;
+namespace mesh_format = nucleus::tile_scheduler::tile_types::mesh_format;
+
+namespace {
+struct Mesh {
+    QByteArray indices;
+    QByteArray positions;
+    QByteArray uvs;
+};
+Mesh make_mesh(size_t n_vertices, size_t n_indices)
+{
+    const auto index_size = mesh_format::index_size(n_vertices);
+    return { QByteArray(qsizetype(n_indices * index_size), '\0'), QByteArray(qsizetype(n_vertices * mesh_format::position_size), '\0'),
+        QByteArray(qsizetype(n_vertices * mesh_format::uv_size), '\0') };
+}
+} // namespace
+
+TEST_CASE("gl geometry arena")
+{
+    UnittestGLContext::initialise();
+    REQUIRE(QOpenGLContext::currentContext());
+
+    GeometryArena arena;
+    arena.init(1000, 1000);
+    CHECK(arena.n_used_bytes() == 0);
+    const auto n_bytes = arena.n_bytes();
+
+    SECTION("allocations don't overlap")
+    {
+        const auto mesh = make_mesh(400, 300);
+        const auto a = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        const auto b = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        CHECK(a.n_vertices == 400);
+        CHECK(a.n_indices == 300);
+        CHECK(a.index_type == GL_UNSIGNED_SHORT);
+        CHECK((a.first_vertex + a.n_vertices <= b.first_vertex || b.first_vertex + b.n_vertices <= a.first_vertex));
+        CHECK((a.index_offset + a.n_index_bytes <= b.index_offset || b.index_offset + b.n_index_bytes <= a.index_offset));
+        CHECK(arena.n_used_bytes() == a.n_bytes() + b.n_bytes());
+
+        arena.remove(a);
+        const auto c = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        CHECK(c.first_vertex == a.first_vertex); // the freed range is reused
+        CHECK(arena.n_bytes() == n_bytes);
+    }
+
+    SECTION("grows when full")
+    {
+        const auto mesh = make_mesh(800, 600);
+        const auto a = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        const auto b = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        CHECK(arena.n_bytes() > n_bytes);
+        CHECK(a.first_vertex != b.first_vertex);
+        arena.remove(a);
+        arena.remove(b);
+        CHECK(arena.n_used_bytes() == 0);
+    }
+
+    SECTION("empty meshes aren't allocated")
+    {
+        const auto empty = Mesh {};
+        const auto a = arena.add(empty.indices, empty.positions, empty.uvs);
+        CHECK(a.empty());
+        CHECK(a.n_bytes() == 0);
+        CHECK(arena.n_used_bytes() == 0);
+        CHECK(arena.n_bytes() == n_bytes);
+        arena.bind();
+        arena.draw(a);
+        arena.release();
+        arena.remove(a);
+        CHECK(arena.n_used_bytes() == 0);
+
+        const auto mesh = make_mesh(100, 30);
+        const auto b = arena.add(mesh.indices, mesh.positions, mesh.uvs);
+        CHECK(!b.empty());
+        CHECK(arena.n_used_bytes() == b.n_bytes());
+    }
+
+    SECTION("base vertex draws are used where the context has them")
+    {
+#ifdef __EMSCRIPTEN__
+        CHECK(!arena.uses_base_vertex());
+#else
+        const auto* context = QOpenGLContext::currentContext();
+        const auto has_base_vertex = context->format().version() >= qMakePair(3, 2) || context->hasExtension("GL_EXT_draw_elements_base_vertex")
+            || context->hasExtension("GL_OES_draw_elements_base_vertex") || context->hasExtension("GL_ARB_draw_elements_base_vertex");
+        CHECK(arena.uses_base_vertex() == has_base_vertex);
+#endif
+    }
+
+    SECTION("u32 indices are aligned")
+    {
+        const auto small = make_mesh(10, 3);
+        const auto large = make_mesh(70000, 9);
+        const auto first = arena.add(small.indices, small.positions, small.uvs);
+        CHECK(first.index_type == GL_UNSIGNED_SHORT);
+        const auto a = arena.add(large.indices, large.positions, large.uvs);
+        CHECK(a.index_type == GL_UNSIGNED_INT);
+        CHECK(a.index_offset % sizeof(uint32_t) == 0);
+    }
+}
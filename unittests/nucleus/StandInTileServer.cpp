@@ -0,0 +1,116 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "StandInTileServer.h"
+
+#include <cassert>
+
+#include <QTcpSocket>
+#include <QTimer>
+
+using namespace unittests;
+
+StandInTileServer::StandInTileServer(Handler handler, unsigned service_time)
+    : m_handler(std::move(handler))
+    , m_service_time(service_time)
+{
+    const auto listening = m_server.listen(QHostAddress::LocalHost);
+    assert(listening);
+    Q_UNUSED(listening);
+    connect(&m_server, &QTcpServer::newConnection, this, [this]() {
+        while (QTcpSocket* socket = m_server.nextPendingConnection()) {
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { read_request(socket); });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+    });
+}
+
+StandInTileServer::~StandInTileServer() = default;
+
+QString StandInTileServer::base_url() const
+{
+    return QString("http://127.0.0.1:%1/").arg(m_server.serverPort());
+}
+
+unsigned StandInTileServer::n_requests() const
+{
+    return m_n_requests;
+}
+
+void StandInTileServer::reset_n_requests()
+{
+    m_n_requests = 0;
+}
+
+void StandInTileServer::set_latency(unsigned msecs)
+{
+    m_latency = msecs;
+}
+
+void StandInTileServer::set_bandwidth(unsigned bytes_per_second)
+{
+    m_bandwidth = bytes_per_second;
+}
+
+void StandInTileServer::read_request(QTcpSocket* socket)
+{
+    // only the request line is of interest. every response closes the connection, so there is at most one request per socket.
+    if (!socket->canReadLine() || socket->property("request_read").toBool())
+        return;
+    socket->setProperty("request_read", true);
+    const auto request_line = QString::fromLatin1(socket->readLine()).split(' ');
+    const auto path = request_line.size() >= 2 ? request_line[1] : QString();
+    m_n_requests++;
+    if (m_latency == 0)
+        enqueue(socket, path);
+    else
+        QTimer::singleShot(m_latency, this, [this, socket = QPointer<QTcpSocket>(socket), path]() { enqueue(socket, path); });
+}
+
+void StandInTileServer::enqueue(QPointer<QTcpSocket> socket, const QString& path)
+{
+    m_queue.emplace_back(socket, path);
+    if (!m_busy)
+        process_next();
+}
+
+void StandInTileServer::process_next()
+{
+    if (m_queue.empty()) {
+        m_busy = false;
+        return;
+    }
+    m_busy = true;
+    const auto [socket, path] = m_queue.front();
+    m_queue.pop_front();
+    const auto response = m_handler(path);
+    QByteArray data = QString("HTTP/1.1 %1 %2\r\nContent-Type: application/octet-stream\r\nContent-Length: %3\r\nConnection: close\r\n\r\n")
+                          .arg(response.status)
+                          .arg(response.status == 200 ? "OK" : "Error")
+                          .arg(response.body.size())
+                          .toLatin1();
+    data.append(response.body);
+    const auto transmission_time = m_bandwidth == 0 ? 0u : unsigned(uint64_t(data.size()) * 1000u / m_bandwidth);
+    QTimer::singleShot(m_service_time + transmission_time, this, [this, socket, data]() {
+        if (socket) {
+            socket->write(data);
+            socket->disconnectFromHost();
+        }
+        process_next();
+    });
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#pragma once
+
+#include <deque>
+#include <functional>
+
+#include <QObject>
+#include <QPointer>
+#include <QTcpServer>
+
+class QTcpSocket;
+
+namespace unittests {
+
+/// minimal http server on localhost for testing the TileLoadService without touching the internet.
+/// every request first waits for the latency (in parallel, models the round trip). then the responses are sent one after the other,
+/// each taking service_time milliseconds plus its size divided by the bandwidth. this models a server (or link) that is bound by
+/// per request overhead or bandwidth, which is what quad bundles and the adaptive slot limit are supposed to deal with.
+class StandInTileServer : public QObject {
+    Q_OBJECT
+public:
+    struct Response {
+        int status = 200;
+        QByteArray body;
+    };
+    using Handler = std::function<Response(const QString& path)>;
+
+    StandInTileServer(Handler handler, unsigned service_time = 0);
+    ~StandInTileServer() override;
+
+    [[nodiscard]] QString base_url() const;
+    [[nodiscard]] unsigned n_requests() const;
+    void reset_n_requests();
+    void set_latency(unsigned msecs);
+    /// 0 is unlimited
+    void set_bandwidth(unsigned bytes_per_second);
+
+private:
+    void read_request(QTcpSocket* socket);
+    void enqueue(QPointer<QTcpSocket> socket, const QString& path);
+    void process_next();
+
+    Handler m_handler;
+    unsigned m_service_time = 0;
+    unsigned m_latency = 0;
+    unsigned m_bandwidth = 0;
+    unsigned m_n_requests = 0;
+    bool m_busy = false;
+    QTcpServer m_server;
+    std::deque<std::pair<QPointer<QTcpSocket>, QString>> m_queue;
+};
+}
@@ -16,11 +16,15 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *****************************************************************************/
 
+#include <atomic>
+#include <thread>
 #include <unordered_set>
 #include <sstream>
 
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <fmt/core.h>
+#include <QFile>
 #include <QStandardPaths>
 #include <QThread>
 
@@ -33,6 +37,11 @@ struct TestTile {
     tile::Id id;
     std::string data;
 };
+struct SizedTestTile {
+    tile::Id id;
+    size_t size = 0;
+    size_t n_bytes() const { return size; }
+};
 struct DiskWriteTestTileInner {
     tile::Id id;
     std::shared_ptr<QByteArray> data;
@@ -252,6 +261,61 @@ TEST_CASE("nucleus/tile_scheduler/cache")
         CHECK(cache.contains({ 1, { 0, 0 } }));
     }
 
+    SECTION("n_bytes and purge_bytes")
+    {
+        nucleus::tile_scheduler::Cache<SizedTestTile> cache;
+        cache.insert(SizedTestTile { { 0, { 0, 0 } }, 100 });
+        cache.insert(SizedTestTile { { 1, { 0, 0 } }, 200 });
+        cache.insert(SizedTestTile { { 2, { 0, 0 } }, 300 });
+        cache.insert(SizedTestTile { { 3, { 0, 0 } }, 400 });
+        CHECK(cache.n_bytes() == 1000);
+        cache.insert(SizedTestTile { { 3, { 0, 0 } }, 500 });
+        CHECK(cache.n_bytes() == 1100);
+        cache.set_n_bytes({ 3, { 0, 0 } }, 400);
+        cache.set_n_bytes({ 4, { 0, 0 } }, 400); // not cached, ignored
+        CHECK(cache.n_bytes() == 1000);
+
+        CHECK(cache.purge_bytes(1000).empty());
+        // all visited at the same time, coarser ones are kept
+        cache.visit([](const SizedTestTile&) { return true; });
+        const auto purged = cache.purge_bytes(650);
+        REQUIRE(purged.size() == 2);
+        CHECK(cache.n_cached_objects() == 2);
+        CHECK(cache.contains({ 0, { 0, 0 } }));
+        CHECK(cache.contains({ 1, { 0, 0 } }));
+        CHECK(cache.n_bytes() == 300);
+        CHECK(cache.purge_bytes(0).size() == 2);
+        CHECK(cache.n_bytes() == 0);
+    }
+
+    SECTION("snapshots are immutable versions of the tiles in ram")
+    {
+        nucleus::tile_scheduler::Cache<TestTile> cache;
+        const auto empty = cache.snapshot();
+        cache.insert(TestTile { { 0, { 0, 0 } }, "green" });
+        cache.insert(TestTile { { 1, { 0, 0 } }, "green" });
+        const auto first = cache.snapshot();
+        CHECK(empty->size() == 0);
+        CHECK(first->size() == 2);
+        CHECK(first->version() > empty->version());
+        REQUIRE(first->find({ 1, { 0, 0 } }));
+        CHECK(first->find({ 1, { 0, 0 } })->data == "green");
+
+        cache.insert(TestTile { { 1, { 0, 0 } }, "red" });
+        CHECK(cache.snapshot()->find({ 1, { 0, 0 } })->data == "red");
+        cache.purge(0);
+        const auto second = cache.snapshot();
+        CHECK(second->size() == 0);
+        CHECK(second->find({ 1, { 0, 0 } }) == nullptr);
+        CHECK(first->find({ 1, { 0, 0 } })->data == "green");
+        unsigned n_visited = 0;
+        first->visit([&n_visited](const TestTile&) {
+            ++n_visited;
+            return true;
+        });
+        CHECK(n_visited == 2);
+    }
+
     SECTION("insert: insert overwrites existing objects")
     {
         nucleus::tile_scheduler::Cache<TestTile> cache;
@@ -479,4 +543,373 @@ TEST_CASE("nucleus/tile_scheduler/cache")
         }
         std::filesystem::remove_all(path);
     }
+
+    SECTION("reading only the index and loading on demand")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        std::filesystem::remove_all(path);
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            for (unsigned i = 0; i < 4; ++i)
+                cache.insert(create_test_tile({ i, { 0, 0 } }));
+            CHECK(cache.write_to_disk(path).has_value());
+        }
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        CHECK(cache.read_index_from_disk(path).has_value());
+        CHECK(cache.n_cached_objects() == 0);
+        CHECK(cache.n_disk_only_objects() == 4);
+        CHECK(!cache.contains({ 0, { 0, 0 } }));
+        CHECK(cache.is_on_disk_only({ 0, { 0, 0 } }));
+        CHECK(cache.disk_only_ids().size() == 4);
+
+        CHECK(cache.load_from_disk({ { 0, { 0, 0 } }, { 1, { 0, 0 } }, { 7, { 0, 0 } } }).has_value());
+        CHECK(cache.n_cached_objects() == 2);
+        CHECK(cache.n_disk_only_objects() == 2);
+        verify_tile(cache, { 0, { 0, 0 } });
+        verify_tile(cache, { 1, { 0, 0 } });
+
+        // a fresh tile replaces the one on disk
+        QThread::msleep(2);
+        cache.insert(create_test_tile({ 2, { 0, 0 } }, 2));
+        CHECK(!cache.is_on_disk_only({ 2, { 0, 0 } }));
+        CHECK(cache.load_from_disk({ { 2, { 0, 0 } } }).has_value());
+        verify_tile(cache, { 2, { 0, 0 } }, 2);
+
+        // tiles on disk only are kept by write_to_disk
+        CHECK(cache.write_to_disk(path).has_value());
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            CHECK(cache.read_from_disk(path).has_value());
+            CHECK(cache.n_cached_objects() == 4);
+            verify_tile(cache, { 2, { 0, 0 } }, 2);
+            verify_tile(cache, { 3, { 0, 0 } });
+        }
+
+        // and ranked by purge, they are the least recently visited ones here
+        cache.visit([](const auto&) { return true; });
+        CHECK(cache.purge(3).empty());
+        CHECK(cache.n_disk_only_objects() == 0);
+        CHECK(cache.n_cached_objects() == 3);
+        CHECK(cache.write_to_disk(path).has_value());
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            CHECK(cache.read_from_disk(path).has_value());
+            CHECK(cache.n_cached_objects() == 3);
+            CHECK(!cache.contains({ 3, { 0, 0 } }));
+        }
+        std::filesystem::remove_all(path);
+    }
+
+    SECTION("only dirty tiles are written, in batches")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        std::filesystem::remove_all(path);
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        for (unsigned i = 0; i < 4; ++i)
+            cache.insert(create_test_tile({ i, { 0, 0 } }));
+        CHECK(cache.n_dirty_objects() == 4);
+        CHECK(cache.write_to_disk(path, 1).has_value()); // one commit per tile
+        CHECK(cache.n_dirty_objects() == 0);
+
+        cache.visit([](const DiskWriteTestTile& tile) { return tile.id.zoom_level < 2; });
+        CHECK(cache.n_dirty_objects() == 2);
+        QThread::msleep(2);
+        cache.insert(create_test_tile({ 3, { 0, 0 } }, 3));
+        cache.insert(create_test_tile({ 4, { 0, 0 } }, 4));
+        cache.purge(4);
+        CHECK(cache.n_cached_objects() == 4);
+        CHECK(cache.write_to_disk(path, 1).has_value());
+        CHECK(cache.n_dirty_objects() == 0);
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            CHECK(cache.read_from_disk(path).has_value());
+            CHECK(cache.n_cached_objects() == 4);
+            verify_tile(cache, { 0, { 0, 0 } });
+            verify_tile(cache, { 1, { 0, 0 } });
+            verify_tile(cache, { 3, { 0, 0 } }, 3);
+            verify_tile(cache, { 4, { 0, 0 } }, 4);
+        }
+        std::filesystem::remove_all(path);
+    }
+
+    SECTION("purge_bytes keeps tiles that are on disk as disk only tiles")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        std::filesystem::remove_all(path);
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        for (unsigned i = 0; i < 4; ++i) {
+            cache.insert(create_test_tile({ i, { 0, 0 } }));
+            cache.set_n_bytes({ i, { 0, 0 } }, 100);
+        }
+        CHECK(cache.write_to_disk(path).has_value());
+        QThread::msleep(2);
+        cache.insert(create_test_tile({ 4, { 0, 0 } }, 4)); // not written yet
+        cache.set_n_bytes({ 4, { 0, 0 } }, 100);
+        cache.visit([](const DiskWriteTestTile& tile) { return tile.id.zoom_level < 2; });
+
+        CHECK(cache.purge_bytes(300).size() == 2);
+        CHECK(cache.n_cached_objects() == 3);
+        CHECK(cache.n_bytes() == 300);
+        CHECK(cache.is_on_disk_only({ 2, { 0, 0 } }));
+        CHECK(cache.is_on_disk_only({ 3, { 0, 0 } }));
+        CHECK(cache.n_disk_only_bytes() == 200);
+
+        CHECK(cache.purge_bytes(0).size() == 3);
+        CHECK(cache.n_disk_only_objects() == 4);
+        CHECK(!cache.is_on_disk_only({ 4, { 0, 0 } }));
+        CHECK(cache.load_from_disk({ { 2, { 0, 0 } } }).has_value());
+        verify_tile(cache, { 2, { 0, 0 } });
+
+        // the most recently visited one is kept
+        cache.purge_disk_only_bytes(100);
+        CHECK(cache.n_disk_only_objects() == 1);
+        CHECK(cache.is_on_disk_only({ 0, { 0, 0 } }));
+        CHECK(cache.write_to_disk(path).has_value());
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            CHECK(cache.read_from_disk(path).has_value());
+            CHECK(cache.n_cached_objects() == 2);
+            verify_tile(cache, { 0, { 0, 0 } });
+            verify_tile(cache, { 2, { 0, 0 } });
+        }
+        std::filesystem::remove_all(path);
+    }
+
+    SECTION("disk only tiles that are missing in the disk cache are dropped when loading")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        const auto other_path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache_2";
+        std::filesystem::remove_all(path);
+        std::filesystem::remove_all(other_path);
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        for (unsigned i = 0; i < 2; ++i) {
+            cache.insert(create_test_tile({ i, { 0, 0 } }));
+            cache.set_n_bytes({ i, { 0, 0 } }, 100);
+        }
+        CHECK(cache.write_to_disk(path).has_value());
+        cache.visit([](const DiskWriteTestTile& tile) { return tile.id.zoom_level == 0; });
+        CHECK(cache.purge_bytes(100).size() == 1);
+        CHECK(cache.is_on_disk_only({ 1, { 0, 0 } }));
+
+        // the disk only tile has no entry in the new disk cache
+        CHECK(cache.write_to_disk(other_path).has_value());
+        CHECK(cache.load_from_disk({ { 1, { 0, 0 } } }).has_value());
+        CHECK(!cache.is_on_disk_only({ 1, { 0, 0 } }));
+        CHECK(!cache.contains({ 1, { 0, 0 } }));
+        CHECK(cache.n_disk_only_objects() == 0);
+        CHECK(cache.n_disk_only_bytes() == 0);
+        std::filesystem::remove_all(path);
+        std::filesystem::remove_all(other_path);
+    }
+
+    SECTION("clear_disk removes the files and forgets the disk only tiles")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        std::filesystem::remove_all(path);
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            for (unsigned i = 0; i < 2; ++i)
+                cache.insert(create_test_tile({ i, { 0, 0 } }));
+            CHECK(cache.write_to_disk(path).has_value());
+        }
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        CHECK(cache.read_index_from_disk(path).has_value());
+        CHECK(cache.load_from_disk({ { 0, { 0, 0 } } }).has_value());
+        CHECK(cache.n_disk_only_objects() == 1);
+
+        cache.clear_disk(path);
+        CHECK(!std::filesystem::exists(path));
+        CHECK(cache.n_disk_only_objects() == 0);
+        CHECK(cache.n_disk_only_bytes() == 0);
+        CHECK(cache.contains({ 0, { 0, 0 } }));
+
+        // the tiles in ram are written again
+        CHECK(cache.write_to_disk(path).has_value());
+        {
+            nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+            CHECK(cache.read_from_disk(path).has_value());
+            CHECK(cache.n_cached_objects() == 1);
+            verify_tile(cache, { 0, { 0, 0 } });
+        }
+        std::filesystem::remove_all(path);
+    }
+
+    SECTION("a disk cache in the old one file per tile format is rejected")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache";
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+        QFile(QString::fromStdString((path / "meta_info.alp").string())).open(QIODevice::WriteOnly);
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+        CHECK(!cache.read_from_disk(path).has_value());
+        std::filesystem::remove_all(path);
+    }
+}
+
+// the pack store against the old one file per quad format.
+TEST_CASE("nucleus/tile_scheduler/cache disk format benchmark")
+{
+    constexpr unsigned n_quads = 1000;
+    const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_tile_cache_benchmark";
+    std::filesystem::remove_all(path);
+    const auto create_tile = [](unsigned i) {
+        const auto id = tile::Id { 16, { i % 256, i / 256 } };
+        auto t = DiskWriteTestTile { id, 0, 0, {} };
+        for (const auto& child_id : id.children())
+            t.tiles[t.n_children++] = { child_id, std::make_shared<QByteArray>(512, char('a' + i % 26)) };
+        return t;
+    };
+    nucleus::tile_scheduler::Cache<DiskWriteTestTile> cache;
+    for (unsigned i = 0; i < n_quads; ++i)
+        cache.insert(create_tile(i));
+
+    const auto legacy_path = path / "legacy";
+    std::filesystem::create_directories(legacy_path);
+    const auto legacy_file_path = [&legacy_path](const tile::Id& id) {
+        return QString::fromStdString((legacy_path / fmt::format("{}_{}_{}.alp_tile", id.zoom_level, id.coords.x, id.coords.y)).string());
+    };
+    BENCHMARK("one file per quad: persist")
+    {
+        unsigned n_written = 0;
+        for (unsigned i = 0; i < n_quads; ++i) {
+            const auto tile = cache.peak_at(create_tile(i).id);
+            std::vector<char> bytes;
+            zpp::bits::out out(bytes);
+            (void)out(DiskWriteTestTile::version_information);
+            (void)out(tile);
+            QFile file(legacy_file_path(tile.id));
+            n_written += file.open(QIODevice::WriteOnly) && file.write(bytes.data(), qint64(bytes.size())) == qint64(bytes.size());
+        }
+        return n_written;
+    };
+    BENCHMARK("one file per quad: startup")
+    {
+        unsigned n_read = 0;
+        for (unsigned i = 0; i < n_quads; ++i) {
+            QFile file(legacy_file_path(create_tile(i).id));
+            if (!file.open(QIODevice::ReadOnly))
+                continue;
+            const auto bytes = file.readAll();
+            zpp::bits::in in(std::span<const char>(bytes.constData(), size_t(bytes.size())));
+            std::remove_cvref_t<decltype(DiskWriteTestTile::version_information)> version = {};
+            DiskWriteTestTile tile;
+            n_read += !failure(in(version)) && !failure(in(tile));
+        }
+        return n_read;
+    };
+
+    const auto pack_path = path / "pack";
+    BENCHMARK("pack store: persist")
+    {
+        cache.clear_disk(pack_path);
+        return cache.write_to_disk(pack_path).has_value();
+    };
+    // the same 100 quads again, as if they were received anew.
+    BENCHMARK("pack store: persist 100 new quads")
+    {
+        for (unsigned i = 0; i < 100; ++i)
+            cache.insert(create_tile(i));
+        return cache.write_to_disk(pack_path).has_value();
+    };
+    BENCHMARK("pack store: startup")
+    {
+        nucleus::tile_scheduler::Cache<DiskWriteTestTile> read_cache;
+        (void)read_cache.read_from_disk(pack_path);
+        return read_cache.n_cached_objects();
+    };
+    std::filesystem::remove_all(path);
+}
+
+// the in memory operations at typical and large cache sizes.
+TEST_CASE("nucleus/tile_scheduler/cache size benchmark")
+{
+    for (const unsigned n_tiles : { 15000u, 50000u, 200000u }) {
+        // breadth first, so that all tiles are connected to the root
+        std::vector<tile::Id> ids = { { 0, { 0, 0 } } };
+        for (size_t i = 0; ids.size() < n_tiles; ++i) {
+            for (const auto& child : ids[i].children()) {
+                if (ids.size() < n_tiles)
+                    ids.push_back(child);
+            }
+        }
+        const auto fill = [&ids](nucleus::tile_scheduler::Cache<SizedTestTile>* cache) {
+            for (const auto& id : ids)
+                cache->insert({ id, 1000 });
+        };
+        nucleus::tile_scheduler::Cache<SizedTestTile> cache;
+        fill(&cache);
+        const auto suffix = " (" + std::to_string(n_tiles) + " tiles)";
+
+        BENCHMARK("insert" + suffix)
+        {
+            nucleus::tile_scheduler::Cache<SizedTestTile> c;
+            fill(&c);
+            return c.n_cached_objects();
+        };
+        BENCHMARK("full visit" + suffix)
+        {
+            unsigned n_visited = 0;
+            cache.visit([&n_visited](const SizedTestTile&) {
+                ++n_visited;
+                return true;
+            });
+            return n_visited;
+        };
+        BENCHMARK("contains" + suffix)
+        {
+            unsigned n_found = 0;
+            for (const auto& id : ids)
+                n_found += cache.contains(id);
+            return n_found;
+        };
+        BENCHMARK_ADVANCED("purge half" + suffix)(Catch::Benchmark::Chronometer meter)
+        {
+            std::vector<std::unique_ptr<nucleus::tile_scheduler::Cache<SizedTestTile>>> caches;
+            for (int i = 0; i < meter.runs(); ++i) {
+                caches.push_back(std::make_unique<nucleus::tile_scheduler::Cache<SizedTestTile>>());
+                fill(caches.back().get());
+            }
+            meter.measure([&](int i) { return caches[size_t(i)]->purge_bytes(size_t(n_tiles) * 1000 / 2).size(); });
+        };
+    }
+}
+
+// a point query (as in cache_queries::query_altitude) while another thread streams tiles in, visits the whole cache and purges,
+// through the cache lock (as before snapshots) and through a snapshot.
+TEST_CASE("nucleus/tile_scheduler/cache snapshot query latency benchmark")
+{
+    constexpr unsigned n_tiles = 50000;
+    std::vector<tile::Id> ids = { { 0, { 0, 0 } } };
+    for (size_t i = 0; ids.size() < n_tiles; ++i) {
+        for (const auto& child : ids[i].children())
+            ids.push_back(child);
+    }
+    nucleus::tile_scheduler::Cache<SizedTestTile> cache;
+    for (const auto& id : ids)
+        cache.insert({ id, 1000 });
+
+    std::atomic<bool> stop = false;
+    std::thread streamer([&]() {
+        for (size_t i = 0; !stop; ++i) {
+            for (unsigned j = 0; j < 64; ++j)
+                cache.insert({ ids[(i * 64 + j) % ids.size()], 1000 });
+            cache.visit([](const SizedTestTile&) { return true; });
+            cache.purge(unsigned(ids.size()));
+        }
+    });
+
+    const auto target = ids.back();
+    const auto on_path = [&target](const SizedTestTile& tile) {
+        return tile.id.zoom_level <= target.zoom_level && tile::Id { tile.id.zoom_level, { target.coords.x >> (target.zoom_level - tile.id.zoom_level), target.coords.y >> (target.zoom_level - tile.id.zoom_level) } } == tile.id;
+    };
+    BENCHMARK("point query through the cache lock, while streaming")
+    {
+        cache.visit(on_path);
+    };
+    BENCHMARK("point query through a snapshot, while streaming")
+    {
+        cache.snapshot()->visit(on_path);
+    };
+    stop = true;
+    streamer.join();
 }
@@ -0,0 +1,211 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <cmath>
+#include <filesystem>
+#include <unordered_set>
+
+#include <QStandardPaths>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/srs.h"
+#include "nucleus/tile_scheduler/Cache.h"
+#include "nucleus/tile_scheduler/EvictionPolicy.h"
+
+using namespace nucleus::tile_scheduler;
+
+namespace {
+struct ReplayTile {
+    tile::Id id;
+    size_t size = 0;
+    size_t n_bytes() const { return size; }
+    static constexpr std::array<char, 25> version_information = { "ReplayTile" };
+};
+
+glm::dvec2 centre(const tile::Id& id)
+{
+    const auto bounds = nucleus::srs::tile_bounds(id);
+    return (bounds.min + bounds.max) * 0.5;
+}
+
+EvictionCandidate candidate(const tile::Id& id, uint64_t visited_msecs, size_t n_bytes, RefetchSource source = RefetchSource::Network)
+{
+    return { id, visited_msecs * 100 - id.zoom_level, n_bytes, source };
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/eviction policy")
+{
+    const auto vienna = tile::Id { 14, { 8936, 10784 } };
+    const auto camera_position = glm::dvec3(centre(vienna), 1000.0);
+
+    SECTION("lru ranks by the visited stamp")
+    {
+        LruEvictionPolicy policy;
+        CHECK(!policy.is_pinned({ 0, { 0, 0 } }));
+        CHECK(policy.retention_value(candidate(vienna, 2000, 10)) > policy.retention_value(candidate(vienna, 1000, 10)));
+        // visited at the same time, finer levels go first
+        CHECK(policy.retention_value(candidate(vienna.parent(), 1000, 10)) > policy.retention_value(candidate(vienna, 1000, 10)));
+    }
+
+    SECTION("cost aware pins coarse levels")
+    {
+        CostAwareEvictionPolicy policy({ .pinned_zoom_level = 6 });
+        CHECK(policy.is_pinned({ 0, { 0, 0 } }));
+        CHECK(policy.is_pinned({ 6, { 35, 41 } }));
+        CHECK(!policy.is_pinned({ 7, { 70, 83 } }));
+    }
+
+    SECTION("cost aware weighs refetch cost, size, age, distance and the visible cut")
+    {
+        CostAwareEvictionPolicy policy;
+        policy.update_view(camera_position, { vienna.parent() }, 100'000);
+        const auto value = [&](const EvictionCandidate& c) { return policy.retention_value(c); };
+
+        CHECK(policy.refetch_cost(candidate(vienna, 0, 1024 * 1024, RefetchSource::Network)) > policy.refetch_cost(candidate(vienna, 0, 1024 * 1024, RefetchSource::Disk)));
+        CHECK(policy.refetch_cost(candidate(vienna, 0, 1024 * 1024, RefetchSource::Disk)) > policy.refetch_cost(candidate(vienna, 0, 1024 * 1024, RefetchSource::Ram)));
+        CHECK(value(candidate(vienna, 100'000, 100'000, RefetchSource::Network)) > value(candidate(vienna, 100'000, 100'000, RefetchSource::Disk)));
+
+        // per byte, a large tile frees more
+        CHECK(value(candidate(vienna, 100'000, 20'000)) > value(candidate(vienna, 100'000, 2'000'000)));
+        // older ones go first
+        CHECK(value(candidate(vienna, 100'000, 100'000)) > value(candidate(vienna, 10'000, 100'000)));
+        // far away ones go first
+        const auto far_away = tile::Id { 14, { 8936 + 100, 10784 } };
+        CHECK(value(candidate(vienna, 100'000, 100'000)) > value(candidate(far_away, 100'000, 100'000)));
+        // the visible cut is kept longer
+        const auto sibling = tile::Id { 13, { 4468 + 1, 5392 } };
+        CHECK(value(candidate(vienna.parent(), 100'000, 100'000)) > value(candidate(sibling, 100'000, 100'000)));
+    }
+
+    SECTION("cache keeps pinned tiles, even over budget")
+    {
+        CostAwareEvictionPolicy policy({ .pinned_zoom_level = 1 });
+        Cache<ReplayTile> cache;
+        cache.insert({ { 0, { 0, 0 } }, 500 });
+        cache.insert({ { 1, { 0, 0 } }, 500 });
+        cache.insert({ { 2, { 0, 0 } }, 500 });
+        cache.insert({ { 3, { 0, 0 } }, 500 });
+        policy.update_view({}, {}, nucleus::tile_scheduler::utils::time_since_epoch());
+        const auto purged = cache.purge_bytes(600, policy);
+        CHECK(purged.size() == 2);
+        CHECK(cache.contains({ 0, { 0, 0 } }));
+        CHECK(cache.contains({ 1, { 0, 0 } }));
+        CHECK(cache.n_bytes() == 1000);
+        CHECK(cache.purge_bytes(0, policy).empty());
+    }
+
+    SECTION("cache keeps a persisted parent at least as long as its children")
+    {
+        const auto path = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_eviction_policy_cache";
+        std::filesystem::remove_all(path);
+        CostAwareEvictionPolicy policy({ .pinned_zoom_level = 0 });
+        Cache<ReplayTile> cache;
+        const auto parent = vienna.parent();
+        cache.insert({ parent, 1000 });
+        REQUIRE(cache.write_to_disk(path).has_value());
+        for (const auto& child : parent.children())
+            cache.insert({ child, 1000 });
+        const auto now = nucleus::tile_scheduler::utils::time_since_epoch();
+        policy.update_view(camera_position, {}, now);
+        // on its own, the parent is far cheaper to get back
+        CHECK(policy.retention_value(candidate(parent, now, 1000, RefetchSource::Disk)) < policy.retention_value(candidate(vienna, now, 1000)));
+
+        const auto purged = cache.purge_bytes(3000, policy);
+        CHECK(purged.size() == 2);
+        CHECK(cache.contains(parent));
+        for (const auto& tile : purged)
+            CHECK(tile.id.parent() == parent);
+        std::filesystem::remove_all(path);
+    }
+}
+
+// replays a synthetic flight (laps around Vienna at changing altitudes, with a trip to Innsbruck every 100 steps) through the ram cache with each
+// policy. the result is the number of bytes that had to be fetched again.
+TEST_CASE("nucleus/tile_scheduler/eviction policy replay benchmark")
+{
+    constexpr unsigned n_steps = 300;
+    constexpr size_t budget = 64u * 1024 * 1024;
+    const auto vienna = glm::dvec2(1822577.0, 6141664.0);
+    const auto innsbruck = glm::dvec2(1265000.0, 5955000.0);
+
+    const auto camera_at = [&](unsigned step) {
+        const auto base = (step % 100) >= 80 ? innsbruck : vienna;
+        const auto angle = double(step) * 2 * 3.14159265358979 / 60;
+        const auto altitude = 3000.0 + 2500.0 * std::sin(double(step) / 3.7);
+        return glm::dvec3(base + 30'000.0 * glm::dvec2(std::cos(angle), std::sin(angle)), altitude);
+    };
+    // a quad is refined if it is large compared to its distance from the camera, like refineFunctor but without heights and frustum.
+    const auto visible_cut = [](const glm::dvec3& camera) {
+        std::vector<tile::Id> cut;
+        std::vector<tile::Id> stack = { { 0, { 0, 0 } } };
+        while (!stack.empty()) {
+            const auto id = stack.back();
+            stack.pop_back();
+            cut.push_back(id);
+            const auto bounds = nucleus::srs::tile_bounds(id);
+            const auto distance = glm::distance((bounds.min + bounds.max) * 0.5, glm::dvec2(camera)) + camera.z;
+            if (id.zoom_level < 17 && bounds.size().x > distance * 0.5) {
+                for (const auto& child : id.children())
+                    stack.push_back(child);
+            }
+        }
+        return cut;
+    };
+    std::vector<std::vector<tile::Id>> cuts;
+    for (unsigned step = 0; step < n_steps; ++step)
+        cuts.push_back(visible_cut(camera_at(step)));
+    // 20 KiB at zoom 6, growing to about 1 MiB at zoom 16, +-50%
+    const auto tile_size = [](const tile::Id& id) {
+        const auto jitter = 0.5 + double(tile::Id::Hasher()(id) % 1000) / 1000;
+        return size_t(20.0 * 1024 * std::pow(1.5, double(id.zoom_level) - 6) * jitter);
+    };
+
+    const auto replay = [&](EvictionPolicy& policy) {
+        Cache<ReplayTile> cache;
+        size_t n_fetched_bytes = 0;
+        for (unsigned step = 0; step < n_steps; ++step) {
+            const auto& cut = cuts[step];
+            const auto cut_set = std::unordered_set<tile::Id, tile::Id::Hasher>(cut.cbegin(), cut.cend());
+            for (const auto& id : cut) {
+                if (cache.contains(id))
+                    continue;
+                const auto size = tile_size(id);
+                n_fetched_bytes += size;
+                cache.insert({ id, size });
+            }
+            cache.visit([&cut_set](const ReplayTile& tile) { return cut_set.contains(tile.id); });
+            policy.update_view(camera_at(step), cut, nucleus::tile_scheduler::utils::time_since_epoch());
+            cache.purge_bytes(budget, policy);
+        }
+        return n_fetched_bytes;
+    };
+
+    BENCHMARK("lru")
+    {
+        LruEvictionPolicy lru;
+        return replay(lru);
+    };
+    // a replay takes a few dozen msecs, the age halves a few times during one.
+    BENCHMARK("cost aware")
+    {
+        CostAwareEvictionPolicy cost_aware({ .age_half_life = 10 });
+        return replay(cost_aware);
+    };
+}
@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <map>
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/FlatQuadTree.h"
+
+using namespace nucleus::tile_scheduler;
+
+TEST_CASE("nucleus/tile_scheduler/flat quad tree")
+{
+    SECTION("morton keys")
+    {
+        for (const auto& id : { tile::Id { 0, { 0, 0 } }, tile::Id { 1, { 1, 0 } }, tile::Id { 18, { 142985, 166736 } }, tile::Id { 29, { (1u << 29) - 1, 7 } } })
+            CHECK(morton::decode(morton::encode(id)) == id);
+        CHECK(morton::encode({ 1, { 1, 0 } }) == ((uint64_t(1) << 58) | 1));
+        CHECK(morton::encode({ 1, { 0, 1 } }) == ((uint64_t(1) << 58) | 2));
+        // the quadrants along the path from the root
+        const auto key = morton::encode({ 3, { 5, 2 } }); // x = 101, y = 010
+        CHECK(morton::quadrant(key, 1) == 1);
+        CHECK(morton::quadrant(key, 2) == 2);
+        CHECK(morton::quadrant(key, 3) == 1);
+    }
+
+    SECTION("insert, find and erase")
+    {
+        FlatQuadTree<int> tree;
+        CHECK(tree.size() == 0);
+        CHECK(!tree.contains({ 0, { 0, 0 } }));
+        tree[{ 2, { 1, 3 } }] = 5;
+        CHECK(tree.size() == 1);
+        CHECK(tree.contains({ 2, { 1, 3 } }));
+        // the nodes on the way are not in the tree
+        CHECK(!tree.contains({ 0, { 0, 0 } }));
+        CHECK(!tree.contains({ 1, { 0, 1 } }));
+        CHECK(tree.find({ 2, { 1, 2 } }) == nullptr);
+        CHECK(tree.at({ 2, { 1, 3 } }) == 5);
+        CHECK_THROWS(tree.at({ 2, { 1, 2 } }));
+
+        tree[{ 0, { 0, 0 } }] = 1;
+        tree[{ 2, { 1, 3 } }] += 1;
+        CHECK(tree.size() == 2);
+        CHECK(*tree.find({ 2, { 1, 3 } }) == 6);
+
+        CHECK(!tree.erase({ 1, { 0, 1 } }));
+        CHECK(tree.erase({ 2, { 1, 3 } }));
+        CHECK(!tree.erase({ 2, { 1, 3 } }));
+        CHECK(tree.size() == 1);
+        CHECK(tree.contains({ 0, { 0, 0 } }));
+        tree.clear();
+        CHECK(tree.size() == 0);
+        CHECK(!tree.contains({ 0, { 0, 0 } }));
+    }
+
+    SECTION("visit descends through the tree only")
+    {
+        FlatQuadTree<int> tree;
+        tree[{ 0, { 0, 0 } }] = 0;
+        for (const auto& child : tile::Id { 0, { 0, 0 } }.children())
+            tree[child] = 1;
+        tree[{ 2, { 0, 0 } }] = 2;
+        tree[{ 3, { 0, 0 } }] = 3;
+        tree[{ 5, { 0, 0 } }] = 5; // not connected
+        std::vector<tile::Id> visited;
+        tree.visit([&visited](const tile::Id& id, int& value) {
+            CHECK(int(id.zoom_level) == value);
+            visited.push_back(id);
+            return id.zoom_level < 2;
+        });
+        REQUIRE(visited.size() == 6);
+        CHECK(visited.front() == tile::Id { 0, { 0, 0 } });
+        // depth first
+        CHECK(visited[1] == tile::Id { 1, { 0, 0 } });
+        CHECK(visited[2] == tile::Id { 2, { 0, 0 } });
+
+        unsigned n = 0;
+        tree.for_each([&n](const tile::Id&, const int&) { ++n; });
+        CHECK(n == 8);
+    }
+
+    SECTION("matches std::map under random inserts and erases")
+    {
+        std::mt19937 rng(1);
+        FlatQuadTree<unsigned> tree;
+        std::map<std::tuple<unsigned, unsigned, unsigned>, unsigned> reference;
+        for (unsigned i = 0; i < 20000; ++i) {
+            const auto zoom_level = unsigned(rng() % 10);
+            const auto id = tile::Id { zoom_level, { unsigned(rng() % (1u << zoom_level)), unsigned(rng() % (1u << zoom_level)) } };
+            const auto key = std::make_tuple(id.zoom_level, id.coords.x, id.coords.y);
+            if (rng() % 3 == 0) {
+                CHECK(tree.erase(id) == (reference.erase(key) == 1));
+            } else {
+                tree[id] = i;
+                reference[key] = i;
+            }
+        }
+        CHECK(tree.size() == reference.size());
+        size_t n = 0;
+        tree.for_each([&](const tile::Id& id, unsigned value) {
+            ++n;
+            CHECK(reference.at({ id.zoom_level, id.coords.x, id.coords.y }) == value);
+        });
+        CHECK(n == reference.size());
+        for (const auto& [key, value] : reference)
+            tree.erase({ std::get<0>(key), { std::get<1>(key), std::get<2>(key) } });
+        CHECK(tree.size() == 0);
+    }
+}
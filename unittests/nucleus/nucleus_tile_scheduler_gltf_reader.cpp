@@ -0,0 +1,349 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <unordered_set>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSignalSpy>
+#include <QThread>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/srs.h"
+#include "nucleus/tile_scheduler/alpinite/GLTFReader.h"
+#include "nucleus/tile_scheduler/utils.h"
+#include "nucleus/utils/mesh_optimisation.h"
+
+using Catch::Approx;
+using namespace nucleus::tile_scheduler;
+using tile_types::NetworkInfo;
+
+namespace {
+QByteArray ortho_jpeg()
+{
+    QFile file(QString("%1%2").arg(ALP_TEST_DATA_DIR, "test-tile_ortho.jpeg"));
+    file.open(QIODevice::ReadOnly);
+    return file.readAll();
+}
+
+// builds a glb with the same layout as the ones served by the alpinite tile server:
+// 3 nested nodes with translations, one triangle primitive with interleaved position/uv and an embedded albedo texture.
+// out_of_range_index makes the first index point past the last vertex.
+QByteArray make_glb(const tile::Id& id, unsigned n_edge_vertices, const QByteArray& image, bool out_of_range_index = false)
+{
+    const auto bounds = nucleus::srs::tile_bounds(id);
+    const auto size = bounds.size();
+    std::vector<uint32_t> indices;
+    std::vector<float> vertices; // x, y, z, u, v
+    for (unsigned row = 0; row < n_edge_vertices; ++row) {
+        for (unsigned col = 0; col < n_edge_vertices; ++col) {
+            const auto u = float(col) / float(n_edge_vertices - 1);
+            const auto v = float(row) / float(n_edge_vertices - 1);
+            vertices.insert(vertices.end(), { float(size.x) * u, float(size.y) * v, 1000.f + float(row + col), u, v });
+        }
+    }
+    for (unsigned row = 0; row + 1 < n_edge_vertices; ++row) {
+        for (unsigned col = 0; col + 1 < n_edge_vertices; ++col) {
+            const auto i = row * n_edge_vertices + col;
+            indices.insert(indices.end(), { i, i + 1, i + n_edge_vertices, i + 1, i + n_edge_vertices + 1, i + n_edge_vertices });
+        }
+    }
+
+    if (out_of_range_index)
+        indices.front() = n_edge_vertices * n_edge_vertices;
+
+    const auto pad = [](QByteArray* a, char c) {
+        while (a->size() % 4)
+            a->append(c);
+    };
+    QByteArray bin;
+    const auto index_offset = bin.size();
+    bin.append(reinterpret_cast<const char*>(indices.data()), qsizetype(indices.size() * sizeof(uint32_t)));
+    const auto vertex_offset = bin.size();
+    bin.append(reinterpret_cast<const char*>(vertices.data()), qsizetype(vertices.size() * sizeof(float)));
+    const auto image_offset = bin.size();
+    bin.append(image);
+    pad(&bin, '\0');
+
+    const auto buffer_view = [](qsizetype offset, qsizetype length) {
+        return QJsonObject { { "buffer", 0 }, { "byteOffset", offset }, { "byteLength", length } };
+    };
+    auto vertex_view = buffer_view(vertex_offset, image_offset - vertex_offset);
+    vertex_view["byteStride"] = 5 * int(sizeof(float));
+
+    const auto n_indices = qsizetype(indices.size());
+    const auto n_vertices = qsizetype(vertices.size() / 5);
+    QJsonObject json {
+        { "asset", QJsonObject { { "version", "2.0" } } },
+        { "scene", 0 },
+        { "scenes", QJsonArray { QJsonObject { { "nodes", QJsonArray { 0 } } } } },
+        { "nodes",
+            QJsonArray {
+                QJsonObject { { "translation", QJsonArray { bounds.min.x, 0.0, 0.0 } }, { "children", QJsonArray { 1 } } },
+                QJsonObject { { "translation", QJsonArray { 0.0, bounds.min.y, 0.0 } }, { "children", QJsonArray { 2 } } },
+                QJsonObject { { "translation", QJsonArray { 0.0, 0.0, 0.0 } }, { "mesh", 0 } },
+            } },
+        { "meshes",
+            QJsonArray { QJsonObject { { "primitives",
+                QJsonArray { QJsonObject {
+                    { "attributes", QJsonObject { { "POSITION", 1 }, { "TEXCOORD_0", 2 } } }, { "indices", 0 }, { "material", 0 } } } } } } },
+        { "materials", QJsonArray { QJsonObject { { "pbrMetallicRoughness", QJsonObject { { "baseColorTexture", QJsonObject { { "index", 0 } } } } } } } },
+        { "textures", QJsonArray { QJsonObject { { "source", 0 } } } },
+        { "images", QJsonArray { QJsonObject { { "bufferView", 2 }, { "mimeType", "image/jpeg" } } } },
+        { "accessors",
+            QJsonArray {
+                QJsonObject { { "bufferView", 0 }, { "componentType", 5125 }, { "count", n_indices }, { "type", "SCALAR" } },
+                QJsonObject { { "bufferView", 1 }, { "byteOffset", 0 }, { "componentType", 5126 }, { "count", n_vertices }, { "type", "VEC3" } },
+                QJsonObject { { "bufferView", 1 }, { "byteOffset", 12 }, { "componentType", 5126 }, { "count", n_vertices }, { "type", "VEC2" } },
+            } },
+        { "bufferViews", QJsonArray { buffer_view(index_offset, vertex_offset - index_offset), vertex_view, buffer_view(image_offset, image.size()) } },
+        { "buffers", QJsonArray { QJsonObject { { "byteLength", bin.size() } } } },
+    };
+    QByteArray json_chunk = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    pad(&json_chunk, ' ');
+
+    QByteArray glb;
+    const auto append_u32 = [&glb](uint32_t v) { glb.append(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    append_u32(0x46546C67); // "glTF"
+    append_u32(2);
+    append_u32(uint32_t(12 + 8 + json_chunk.size() + 8 + bin.size()));
+    append_u32(uint32_t(json_chunk.size()));
+    append_u32(0x4E4F534A); // "JSON"
+    glb.append(json_chunk);
+    append_u32(uint32_t(bin.size()));
+    append_u32(0x004E4942); // "BIN"
+    glb.append(bin);
+    return glb;
+}
+
+tile_types::TileLayer good_layer(const tile::Id& id, const QByteArray& glb)
+{
+    return { id, { NetworkInfo::Status::Good, utils::time_since_epoch() }, std::make_shared<QByteArray>(glb) };
+}
+
+std::vector<tile::Id> example_ids(unsigned n)
+{
+    std::vector<tile::Id> ids;
+    for (unsigned i = 0; i < n; ++i)
+        ids.push_back(tile::Id { 14, { 8930 + i % 16, 11350 + i / 16 } });
+    return ids;
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/GLTFReader")
+{
+    const auto image = ortho_jpeg();
+    REQUIRE(image.size() > 0);
+
+    SECTION("decodes synchronously without worker threads")
+    {
+        GLTFReader reader;
+        reader.set_n_worker_threads(0);
+        QSignalSpy spy(&reader, &GLTFReader::tile_read);
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        reader.deliver_tile(good_layer(id, make_glb(id, 17, image)));
+        REQUIRE(spy.size() == 1);
+        const auto tile = spy.constFirst().constFirst().value<tile_types::LayeredTile>();
+        CHECK(tile.id == id);
+        CHECK(tile.network_info.status == NetworkInfo::Status::Good);
+        REQUIRE(tile.indices);
+        REQUIRE(tile.positions);
+        REQUIRE(tile.uvs);
+        REQUIRE(tile.texture);
+        CHECK(tile.indices->size() == 16 * 16 * 2 * 3 * 2);
+        CHECK(tile.positions->size() == 17 * 17 * 3 * 2);
+        CHECK(tile.uvs->size() == 17 * 17 * 2 * 2);
+        CHECK(*tile.texture == image);
+
+        const auto bounds = nucleus::srs::tile_bounds(id);
+        CHECK(tile.position_offset.x == Approx(bounds.min.x));
+        CHECK(tile.position_offset.y == Approx(bounds.min.y));
+        CHECK(tile.position_offset.z == Approx(1000.0));
+        CHECK(tile.position_scale.x == Approx(bounds.size().x));
+        CHECK(tile.position_scale.y == Approx(bounds.size().y));
+        CHECK(tile.position_scale.z == Approx(32.0));
+
+        // vertices are reordered during decoding, but every vertex must still be consistent: height = 1000 + row + col
+        const auto* positions = reinterpret_cast<const uint16_t*>(tile.positions->constData());
+        const auto* uvs = reinterpret_cast<const uint16_t*>(tile.uvs->constData());
+        const auto dequantise = [&](unsigned vertex) {
+            const auto q = glm::dvec3(positions[vertex * 3 + 0], positions[vertex * 3 + 1], positions[vertex * 3 + 2]) / 65535.0;
+            return tile.position_offset + q * glm::dvec3(tile.position_scale);
+        };
+        glm::dvec3 min = dequantise(0);
+        glm::dvec3 max = dequantise(0);
+        for (unsigned v = 0; v < 17 * 17; ++v) {
+            const auto p = dequantise(v);
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+            const auto col = std::round(uvs[v * 2 + 0] / 65535.0 * 16);
+            const auto row = std::round(uvs[v * 2 + 1] / 65535.0 * 16);
+            CHECK(p.x == Approx(bounds.min.x + bounds.size().x * col / 16).epsilon(0.0001));
+            CHECK(p.y == Approx(bounds.min.y + bounds.size().y * row / 16).epsilon(0.0001));
+            CHECK(p.z == Approx(1000.0 + row + col).margin(0.01));
+        }
+        CHECK(min.x == Approx(bounds.min.x));
+        CHECK(min.y == Approx(bounds.min.y));
+        CHECK(min.z == Approx(1000.0));
+        CHECK(max.x == Approx(bounds.max.x));
+        CHECK(max.y == Approx(bounds.max.y));
+        CHECK(max.z == Approx(1032.0));
+    }
+
+    SECTION("meshes are reordered for the vertex cache and for vertex fetches")
+    {
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        const auto tile = GLTFReader::load_tile_from_gltf(good_layer(id, make_glb(id, 65, image)));
+        const auto indices = std::span(reinterpret_cast<const uint16_t*>(tile.indices->constData()), size_t(tile.indices->size()) / 2);
+        CHECK(nucleus::utils::mesh_optimisation::acmr(indices) < 0.7);
+        uint16_t next_new_vertex = 0;
+        for (const auto index : indices) {
+            REQUIRE(index <= next_new_vertex);
+            if (index == next_new_vertex)
+                ++next_new_vertex;
+        }
+        CHECK(next_new_vertex == 65 * 65);
+    }
+
+    SECTION("meshes with too many vertices for 16 bit indices keep 32 bit indices")
+    {
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        const auto tile = GLTFReader::load_tile_from_gltf(good_layer(id, make_glb(id, 257, image)));
+        CHECK(tile.indices->size() == 256 * 256 * 2 * 3 * 4);
+        CHECK(tile.positions->size() == 257 * 257 * 3 * 2);
+        const auto* indices = reinterpret_cast<const uint32_t*>(tile.indices->constData());
+        CHECK(*std::max_element(indices, indices + 256 * 256 * 6) == 257 * 257 - 1);
+    }
+
+    SECTION("meshes with indices past the last vertex are rejected")
+    {
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        const auto small = GLTFReader::load_tile_from_gltf(good_layer(id, make_glb(id, 17, image, true)));
+        CHECK(small.id == id);
+        CHECK(small.indices->isEmpty());
+        CHECK(small.positions->isEmpty());
+        CHECK(small.texture->isEmpty());
+        const auto large = GLTFReader::load_tile_from_gltf(good_layer(id, make_glb(id, 257, image, true)));
+        CHECK(large.indices->isEmpty());
+        CHECK(large.positions->isEmpty());
+    }
+
+    SECTION("mesh data and texture share one buffer that doesn't keep the glb alive")
+    {
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        const auto layer = good_layer(id, make_glb(id, 17, image));
+        const auto tile = GLTFReader::load_tile_from_gltf(layer);
+        const auto* glb_begin = layer.data->constData();
+        const auto* glb_end = glb_begin + layer.data->size();
+        CHECK((tile.texture->constData() >= glb_end || tile.texture->constData() + tile.texture->size() <= glb_begin));
+        CHECK(*tile.texture == image);
+        CHECK(layer.data->isDetached()); // the arena holds no reference to the glb
+
+        CHECK(tile.positions->constData() == tile.indices->constData() + tile.indices->size());
+        CHECK(tile.uvs->constData() == tile.positions->constData() + tile.positions->size());
+        CHECK(tile.texture->constData() == tile.uvs->constData() + tile.uvs->size());
+        CHECK(tile.indices.use_count() == tile.texture.use_count()); // all aliasing the same arena
+    }
+
+    SECTION("decoded views stay valid after the tile and the received data are gone")
+    {
+        const auto id = tile::Id { 14, { 8936, 11354 } };
+        std::shared_ptr<QByteArray> texture;
+        std::shared_ptr<QByteArray> positions;
+        {
+            auto layer = good_layer(id, make_glb(id, 17, image));
+            const auto tile = GLTFReader::load_tile_from_gltf(layer);
+            layer.data.reset();
+            texture = tile.texture;
+            positions = tile.positions;
+        }
+        CHECK(*texture == image);
+        CHECK(positions->size() == 17 * 17 * 3 * 2);
+    }
+
+    SECTION("tiles that were not found are passed on empty")
+    {
+        GLTFReader reader;
+        QSignalSpy spy(&reader, &GLTFReader::tile_read);
+        reader.deliver_tile({ tile::Id { 3, { 4, 5 } }, { NetworkInfo::Status::NotFound, utils::time_since_epoch() }, std::make_shared<QByteArray>() });
+        REQUIRE(spy.size() == 1);
+        const auto tile = spy.constFirst().constFirst().value<tile_types::LayeredTile>();
+        CHECK(tile.id == tile::Id { 3, { 4, 5 } });
+        CHECK(tile.network_info.status == NetworkInfo::Status::NotFound);
+        CHECK(tile.texture->isEmpty());
+        CHECK(tile.positions->isEmpty());
+    }
+
+    SECTION("worker pool delivers every tile on the owning thread")
+    {
+        GLTFReader reader;
+        reader.set_n_worker_threads(4);
+        QSignalSpy spy(&reader, &GLTFReader::tile_read);
+        std::vector<const QThread*> emitting_threads;
+        QObject::connect(&reader, &GLTFReader::tile_read, &reader, [&emitting_threads]() { emitting_threads.push_back(QThread::currentThread()); });
+
+        const auto ids = example_ids(32);
+        for (const auto& id : ids)
+            reader.deliver_tile(good_layer(id, make_glb(id, 17, image)));
+        CHECK(reader.n_items_in_flight() <= ids.size());
+        while (spy.size() < int(ids.size()) && spy.wait(5000)) { }
+
+        REQUIRE(spy.size() == int(ids.size()));
+        CHECK(reader.n_items_in_flight() == 0);
+        std::unordered_set<tile::Id, tile::Id::Hasher> received;
+        for (const auto& s : spy) {
+            const auto tile = s.constFirst().value<tile_types::LayeredTile>();
+            CHECK(tile.positions->size() == 17 * 17 * 3 * 2);
+            received.insert(tile.id);
+        }
+        CHECK(received.size() == ids.size());
+        for (const auto* thread : emitting_threads)
+            CHECK(thread == QThread::currentThread());
+    }
+}
+
+TEST_CASE("nucleus/tile_scheduler/GLTFReader benchmarks")
+{
+    const auto image = ortho_jpeg();
+    const auto ids = example_ids(64);
+    std::vector<tile_types::TileLayer> layers;
+    for (const auto& id : ids)
+        layers.push_back(good_layer(id, make_glb(id, 129, image)));
+
+    const auto decode_all = [&layers](unsigned n_threads) {
+        GLTFReader reader;
+        reader.set_n_worker_threads(n_threads);
+        QSignalSpy spy(&reader, &GLTFReader::tile_read);
+        for (const auto& layer : layers)
+            reader.deliver_tile(layer);
+        while (spy.size() < int(layers.size()) && spy.wait(5000)) { }
+        return spy.size();
+    };
+
+    BENCHMARK("load_tile_from_gltf (129x129 vertices)") { return GLTFReader::load_tile_from_gltf(layers.front()); };
+    BENCHMARK("decode 64 tiles synchronously") { return decode_all(0); };
+    BENCHMARK("decode 64 tiles with 2 workers") { return decode_all(2); };
+    BENCHMARK("decode 64 tiles with 8 workers") { return decode_all(8); };
+}
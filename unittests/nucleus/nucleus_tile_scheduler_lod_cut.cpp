@@ -0,0 +1,252 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <QFile>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/camera/PositionStorage.h"
+#include "nucleus/tile_scheduler/LodCut.h"
+#include "radix/quad_tree.h"
+
+using namespace nucleus::tile_scheduler;
+
+namespace {
+utils::AabbDecoratorPtr height_data_decorator()
+{
+    QFile file(":/map/height_data.atb");
+    const auto open = file.open(QIODeviceBase::OpenModeFlag::ReadOnly);
+    assert(open);
+    Q_UNUSED(open);
+    return utils::AabbDecorator::make(TileHeights::deserialise(file.readAll()));
+}
+
+using TileSet = std::unordered_set<tile::Id, tile::Id::Hasher>;
+
+// the refined tiles of a traversal from the root
+TileSet traverse(const nucleus::camera::Definition& camera, const utils::AabbDecoratorPtr& decorator, float error_threshold_px)
+{
+    TileSet refined;
+    const auto refine = utils::refineFunctor(camera, decorator, error_threshold_px);
+    quad_tree::onTheFlyTraverse(tile::Id { 0, { 0, 0 } }, refine, [&refined](const tile::Id& v) {
+        refined.insert(v);
+        return v.children();
+    });
+    return refined;
+}
+
+TileSet to_set(const std::vector<tile::Id>& ids) { return { ids.begin(), ids.end() }; }
+
+// like quads arriving from the network: the finest refined tiles without mesh heights get bounds tighter than the coarse ones.
+void receive_mesh_heights(LodCut* cut, utils::AabbDecorator* decorator, unsigned n_tiles)
+{
+    const auto refined = cut->refined_tiles();
+    for (auto it = refined.rbegin(); it != refined.rend() && n_tiles > 0; ++it) {
+        if (decorator->has_mesh_heights(*it))
+            continue;
+        const auto aabb = decorator->aabb(*it);
+        const auto margin = (aabb.max.z - aabb.min.z) * 0.2;
+        decorator->set_mesh_heights(*it, aabb.min.z + margin, aabb.max.z - margin);
+        cut->invalidate(*it);
+        --n_tiles;
+    }
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/lod cut")
+{
+    const auto decorator = height_data_decorator();
+    const auto camera_positions = std::vector {
+        nucleus::camera::stored_positions::stephansdom_closeup(),
+        nucleus::camera::stored_positions::karwendel(),
+        nucleus::camera::stored_positions::grossglockner(),
+        nucleus::camera::stored_positions::schneeberg(),
+        nucleus::camera::stored_positions::wien(),
+    };
+
+    SECTION("matches a traversal from the root")
+    {
+        LodCut cut;
+        for (const auto& camera : camera_positions) {
+            cut.update(camera, decorator, 1.0);
+            CHECK(to_set(cut.refined_tiles()) == traverse(camera, decorator, 1.0));
+        }
+        // and back, merging
+        for (auto it = camera_positions.rbegin(); it != camera_positions.rend(); ++it) {
+            cut.update(*it, decorator, 1.0);
+            CHECK(to_set(cut.refined_tiles()) == traverse(*it, decorator, 1.0));
+        }
+    }
+
+    SECTION("matches a traversal from the root while moving")
+    {
+        LodCut cut;
+        auto camera = nucleus::camera::stored_positions::grossglockner();
+        for (unsigned i = 0; i < 60; ++i) {
+            if (i < 20)
+                camera.move(camera.z_axis() * -30.0); // forward
+            else if (i < 40)
+                camera.move(camera.x_axis() * 50.0);
+            else
+                camera.move(camera.z_axis() * 200.0);
+            cut.update(camera, decorator, 2.0);
+            CHECK(to_set(cut.refined_tiles()) == traverse(camera, decorator, 2.0));
+        }
+    }
+
+    SECTION("matches a traversal from the root while moving and receiving mesh heights")
+    {
+        LodCut cut;
+        const auto mesh_decorator = std::make_shared<utils::AabbDecorator>(*decorator);
+        auto camera = nucleus::camera::stored_positions::grossglockner();
+        for (unsigned i = 0; i < 40; ++i) {
+            camera.move(camera.z_axis() * -30.0 + camera.x_axis() * 20.0);
+            cut.update(camera, mesh_decorator, 2.0);
+            CHECK(to_set(cut.refined_tiles()) == traverse(camera, mesh_decorator, 2.0));
+            receive_mesh_heights(&cut, mesh_decorator.get(), 16);
+        }
+        CHECK(mesh_decorator->n_mesh_heights() > 0);
+    }
+
+    SECTION("parents come before their children")
+    {
+        LodCut cut;
+        cut.update(camera_positions.front(), decorator, 1.0);
+        const auto tiles = cut.refined_tiles();
+        REQUIRE(!tiles.empty());
+        CHECK(tiles.front() == tile::Id { 0, { 0, 0 } });
+        for (size_t i = 1; i < tiles.size(); ++i) {
+            CHECK(cut.is_refined(tiles[i].parent()));
+            CHECK(std::find(tiles.begin(), tiles.begin() + long(i), tiles[i].parent()) != tiles.begin() + long(i));
+        }
+        CHECK(cut.n_refined_tiles() == tiles.size());
+    }
+
+    SECTION("small camera moves evaluate only a few tiles")
+    {
+        LodCut cut;
+        auto camera = camera_positions.front();
+        cut.update(camera, decorator, 1.0);
+        const auto n_full = cut.n_evaluations();
+        CHECK(n_full > 0);
+
+        CHECK(!cut.update(camera, decorator, 1.0));
+        CHECK(cut.n_evaluations() == 0);
+
+        camera.move(camera.x_axis() * 0.5);
+        cut.update(camera, decorator, 1.0);
+        CHECK(cut.n_evaluations() < n_full / 2);
+        CHECK(to_set(cut.refined_tiles()) == traverse(camera, decorator, 1.0));
+    }
+
+    SECTION("invalidating tiles with changed bounds matches a traversal from the root")
+    {
+        const auto camera = camera_positions[1];
+        const auto mesh_decorator = std::make_shared<utils::AabbDecorator>(*decorator);
+        LodCut cut;
+        cut.update(camera, mesh_decorator, 1.0);
+        const auto n_full = cut.n_evaluations();
+
+        // flatten some refined tiles and inflate some leaves, neither keeps the aabbs nested.
+        unsigned n_changed = 0;
+        for (const auto& id : cut.refined_tiles()) {
+            if (id.zoom_level < 8 || (id.coords.x + id.coords.y) % 5 != 0)
+                continue;
+            const auto aabb = mesh_decorator->aabb(id);
+            mesh_decorator->set_mesh_heights(id, aabb.min.z, aabb.min.z + 1);
+            cut.invalidate(id);
+            for (const auto& child : id.children()) {
+                if (cut.is_refined(child) || (child.coords.x + child.coords.y) % 3 != 0)
+                    continue;
+                mesh_decorator->set_mesh_heights(child, -1000, 9000);
+                cut.invalidate(child);
+            }
+            ++n_changed;
+        }
+        REQUIRE(n_changed > 0);
+        cut.update(camera, mesh_decorator, 1.0);
+        CHECK(to_set(cut.refined_tiles()) == traverse(camera, mesh_decorator, 1.0));
+        CHECK(cut.n_evaluations() < n_full);
+
+        // and back
+        for (const auto& id : cut.refined_tiles()) {
+            if (mesh_decorator->remove_mesh_heights(id))
+                cut.invalidate(id);
+        }
+        cut.update(camera, mesh_decorator, 1.0);
+        CHECK(to_set(cut.refined_tiles()) == traverse(camera, mesh_decorator, 1.0));
+    }
+
+    SECTION("generic refine function and reset")
+    {
+        LodCut cut;
+        const auto refine = [](const tile::Id& id) { return id.zoom_level < 3; };
+        CHECK(cut.update(refine));
+        CHECK(cut.n_refined_tiles() == 1 + 4 + 16);
+        CHECK(!cut.update(refine));
+        cut.update([](const tile::Id& id) { return id.zoom_level < 1; });
+        CHECK(cut.n_refined_tiles() == 1);
+        cut.reset();
+        CHECK(cut.n_refined_tiles() == 0);
+        CHECK(!cut.is_refined({ 0, { 0, 0 } }));
+    }
+}
+
+// a slow flight forward and sideways, the incremental cut against a traversal from the root, and with mesh heights arriving between frames.
+TEST_CASE("nucleus/tile_scheduler/lod cut benchmark")
+{
+    constexpr unsigned n_frames = 60;
+    const auto decorator = height_data_decorator();
+    const auto camera_at = [](unsigned frame) {
+        auto camera = nucleus::camera::stored_positions::grossglockner();
+        camera.move(camera.z_axis() * (-2.0 * frame) + camera.x_axis() * (1.0 * frame));
+        return camera;
+    };
+
+    BENCHMARK("traversal from the root, 60 frames")
+    {
+        size_t n_leaves = 0;
+        for (unsigned frame = 0; frame < n_frames; ++frame) {
+            const auto refine = utils::refineFunctor(camera_at(frame), decorator, 1.0);
+            n_leaves += quad_tree::onTheFlyTraverse(tile::Id { 0, { 0, 0 } }, refine, [](const tile::Id& v) { return v.children(); }).size();
+        }
+        return n_leaves;
+    };
+
+    BENCHMARK("incremental lod cut, 60 frames")
+    {
+        LodCut cut;
+        for (unsigned frame = 0; frame < n_frames; ++frame)
+            cut.update(camera_at(frame), decorator, 1.0);
+        return cut.n_refined_tiles();
+    };
+
+    BENCHMARK("incremental lod cut, 60 frames receiving 16 mesh heights each")
+    {
+        LodCut cut;
+        const auto mesh_decorator = std::make_shared<utils::AabbDecorator>(*decorator);
+        for (unsigned frame = 0; frame < n_frames; ++frame) {
+            cut.update(camera_at(frame), mesh_decorator, 1.0);
+            receive_mesh_heights(&cut, mesh_decorator.get(), 16);
+        }
+        return cut.n_refined_tiles();
+    };
+}
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <QFile>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/MemoryGovernor.h"
+
+using namespace nucleus::tile_scheduler;
+
+namespace {
+constexpr size_t mib = 1024 * 1024;
+
+class FakeMemorySource : public AbstractMemorySource {
+public:
+    std::optional<MemoryReading> reading;
+    std::optional<MemoryReading> read() override { return reading; }
+};
+
+void write_file(const std::filesystem::path& path, const QByteArray& content)
+{
+    std::filesystem::create_directories(path.parent_path());
+    QFile file(QString::fromStdString(path.string()));
+    REQUIRE(file.open(QIODeviceBase::WriteOnly));
+    file.write(content);
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/memory governor")
+{
+    SECTION("budget computation")
+    {
+        const auto reading = MemoryReading { 1000 * mib, 400 * mib }; // 600 available, 150 reserve
+        CHECK(MemoryGovernor::next_budget(4096, 100 * mib, reading, 128, 4096, 0.15f, 0.1f) == 550);
+        CHECK(MemoryGovernor::next_budget(500, 100 * mib, reading, 128, 4096, 0.15f, 0.1f) == 550);
+        CHECK(MemoryGovernor::next_budget(200, 100 * mib, reading, 128, 4096, 0.15f, 0.1f) == 220);
+        CHECK(MemoryGovernor::next_budget(550, 100 * mib, reading, 128, 500, 0.15f, 0.1f) == 500);
+        // nothing free, the cache has to give up what is missing from the reserve
+        CHECK(MemoryGovernor::next_budget(1000, 400 * mib, MemoryReading { 1000 * mib, 950 * mib }, 128, 4096, 0.15f, 0.1f) == 300);
+        CHECK(MemoryGovernor::next_budget(1000, 0, MemoryReading { 1000 * mib, 1000 * mib }, 128, 4096, 0.15f, 0.1f) == 128);
+    }
+
+    SECTION("ram budget follows the source")
+    {
+        auto source = std::make_unique<FakeMemorySource>();
+        auto* fake = source.get();
+        MemoryGovernor governor(std::move(source));
+        auto settings = governor.settings();
+        settings.max_ram_budget = 2048;
+        governor.set_settings(settings);
+        CHECK(governor.ram_budget() == 2048);
+        QSignalSpy ram_spy(&governor, &MemoryGovernor::ram_budget_changed);
+        QSignalSpy gpu_spy(&governor, &MemoryGovernor::gpu_budget_changed);
+        QSignalSpy pressure_spy(&governor, &MemoryGovernor::pressure_rising);
+
+        governor.update(); // no reading, nothing changes
+        CHECK(ram_spy.empty());
+
+        fake->reading = MemoryReading { 8000 * mib, 2000 * mib };
+        governor.update_cache_usage(1000 * mib, 0);
+        governor.update();
+        CHECK(ram_spy.empty()); // 5800 MiB would be allowed, but the maximum is 2048
+        CHECK(governor.ram_budget() == 2048);
+
+        // another process takes memory
+        fake->reading = MemoryReading { 8000 * mib, 7400 * mib };
+        governor.update();
+        REQUIRE(ram_spy.size() == 1);
+        CHECK(ram_spy[0][0].toUInt() == 400);
+        CHECK(governor.ram_budget() == 400);
+        CHECK(pressure_spy.size() == 1);
+        CHECK(gpu_spy.empty());
+
+        // and gives it back, the budget grows slowly
+        fake->reading = MemoryReading { 8000 * mib, 2000 * mib };
+        governor.update();
+        CHECK(governor.ram_budget() == 440);
+        governor.update();
+        CHECK(governor.ram_budget() == 484);
+        CHECK(pressure_spy.size() == 1);
+
+        governor.set_max_ram_budget(300);
+        CHECK(governor.ram_budget() == 300);
+        CHECK(ram_spy.back()[0].toUInt() == 300);
+    }
+
+    SECTION("gpu budget follows the reported vram")
+    {
+        MemoryGovernor governor(std::make_unique<FakeMemorySource>());
+        QSignalSpy gpu_spy(&governor, &MemoryGovernor::gpu_budget_changed);
+        QSignalSpy pressure_spy(&governor, &MemoryGovernor::pressure_rising);
+        governor.update_gpu_memory(4000 * mib, 1000 * mib);
+        governor.update_cache_usage(0, 500 * mib);
+        governor.update();
+        REQUIRE(gpu_spy.size() == 1);
+        CHECK(governor.gpu_budget() == 900); // 500 + 1000 - 600 reserve
+        CHECK(pressure_spy.empty());
+
+        governor.update_gpu_memory(4000 * mib, 100 * mib);
+        governor.update();
+        CHECK(governor.gpu_budget() == governor.settings().min_gpu_budget);
+        CHECK(pressure_spy.size() == 1);
+
+        // unknown again, the budget stays
+        governor.update_gpu_memory(0, 0);
+        governor.update();
+        CHECK(gpu_spy.size() == 2);
+    }
+
+    SECTION("system memory source")
+    {
+        const auto root = std::filesystem::path(QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString()) / "test_memory_source";
+        std::filesystem::remove_all(root);
+        CHECK(!SystemMemorySource(root).read().has_value());
+
+        write_file(root / "proc/meminfo", "MemTotal:       16000000 kB\nMemFree:         1000000 kB\nMemAvailable:    4000000 kB\n");
+        auto reading = SystemMemorySource(root).read();
+        REQUIRE(reading.has_value());
+        CHECK(reading->total == 16000000ull * 1024);
+        CHECK(reading->available() == 4000000ull * 1024);
+
+        // the container is limited by its parent cgroup
+        write_file(root / "proc/self/cgroup", "0::/container/app\n");
+        write_file(root / "sys/fs/cgroup/container/app/memory.current", "1073741824\n");
+        write_file(root / "sys/fs/cgroup/container/app/memory.max", "max\n");
+        CHECK(!SystemMemorySource::read_cgroup(root).has_value());
+        write_file(root / "sys/fs/cgroup/container/memory.max", "2147483648\n");
+        reading = SystemMemorySource(root).read();
+        REQUIRE(reading.has_value());
+        CHECK(reading->total == 2048 * mib);
+        CHECK(reading->used == 1024 * mib);
+
+        // a limit above the physical memory is no limit
+        write_file(root / "sys/fs/cgroup/container/memory.max", "68719476736\n");
+        reading = SystemMemorySource(root).read();
+        REQUIRE(reading.has_value());
+        CHECK(reading->total == 16000000ull * 1024);
+        std::filesystem::remove_all(root);
+    }
+}
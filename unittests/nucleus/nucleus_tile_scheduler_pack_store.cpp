@@ -0,0 +1,244 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <QFile>
+#include <QTemporaryDir>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/PackStore.h"
+
+using nucleus::tile_scheduler::PackStore;
+
+namespace {
+QByteArray payload(const tile::Id& id, int size = 100) { return QString("%1/%2/%3").arg(id.zoom_level).arg(id.coords.x).arg(id.coords.y).toLatin1().leftJustified(size, '.'); }
+
+std::filesystem::path temp_path(const QTemporaryDir& dir) { return std::filesystem::path(dir.path().toStdString()) / "pack"; }
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/PackStore")
+{
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const auto path = temp_path(dir);
+
+    SECTION("put, commit and read back after reopening")
+    {
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+            CHECK(store.entries().empty());
+            for (unsigned i = 0; i < 10; ++i)
+                REQUIRE(store.put({ i, { 0, 0 } }, payload({ i, { 0, 0 } }), { i, 100 + i }).has_value());
+            // readable before the commit
+            CHECK(store.read({ 3, { 0, 0 } }).value() == payload({ 3, { 0, 0 } }));
+            REQUIRE(store.commit().has_value());
+        }
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        REQUIRE(store.entries().size() == 10);
+        for (unsigned i = 0; i < 10; ++i) {
+            CHECK(store.read({ i, { 0, 0 } }).value() == payload({ i, { 0, 0 } }));
+            CHECK(store.entries().at({ i, { 0, 0 } }).meta.visited == i);
+            CHECK(store.entries().at({ i, { 0, 0 } }).meta.created == 100 + i);
+        }
+        CHECK(!store.read({ 10, { 0, 0 } }).has_value());
+    }
+
+    SECTION("updates, meta data changes and removals survive reopening")
+    {
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+            REQUIRE(store.put({ 1, { 0, 0 } }, payload({ 1, { 0, 0 } }), { 1, 1 }).has_value());
+            REQUIRE(store.put({ 1, { 1, 0 } }, payload({ 1, { 1, 0 } }), { 1, 1 }).has_value());
+            REQUIRE(store.put({ 1, { 0, 1 } }, payload({ 1, { 0, 1 } }), { 1, 1 }).has_value());
+            REQUIRE(store.commit().has_value());
+            REQUIRE(store.put({ 1, { 0, 0 } }, "updated", { 2, 2 }).has_value());
+            store.update_meta({ 1, { 1, 0 } }, { 5, 1 });
+            store.remove({ 1, { 0, 1 } });
+            REQUIRE(store.commit().has_value());
+        }
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        REQUIRE(store.entries().size() == 2);
+        CHECK(store.read({ 1, { 0, 0 } }).value() == "updated");
+        CHECK(store.entries().at({ 1, { 0, 0 } }).meta.created == 2);
+        CHECK(store.entries().at({ 1, { 1, 0 } }).meta.visited == 5);
+        CHECK(!store.entries().contains({ 1, { 0, 1 } }));
+    }
+
+    SECTION("uncommitted changes are lost, but don't damage the store")
+    {
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+            REQUIRE(store.put({ 1, { 0, 0 } }, payload({ 1, { 0, 0 } }), {}).has_value());
+            REQUIRE(store.commit().has_value());
+            REQUIRE(store.put({ 1, { 1, 0 } }, payload({ 1, { 1, 0 } }), {}).has_value());
+        }
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        CHECK(store.entries().size() == 1);
+        CHECK(store.read({ 1, { 0, 0 } }).value() == payload({ 1, { 0, 0 } }));
+        // appending after the garbage of the lost write works
+        REQUIRE(store.put({ 2, { 0, 0 } }, payload({ 2, { 0, 0 } }), {}).has_value());
+        CHECK(store.read({ 2, { 0, 0 } }).value() == payload({ 2, { 0, 0 } }));
+    }
+
+    SECTION("an interrupted index commit is dropped when opening")
+    {
+        uint64_t committed_size = 0;
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+            REQUIRE(store.put({ 1, { 0, 0 } }, payload({ 1, { 0, 0 } }), {}).has_value());
+            REQUIRE(store.commit().has_value());
+            committed_size = store.journal_size();
+            REQUIRE(store.put({ 1, { 1, 0 } }, payload({ 1, { 1, 0 } }), {}).has_value());
+            REQUIRE(store.commit().has_value());
+        }
+        {
+            // cut the last block in half, as if the process died while writing it
+            QFile index(QString::fromStdString(PackStore::index_path(path).string()));
+            REQUIRE(index.open(QIODevice::ReadWrite));
+            REQUIRE(index.resize(qint64(committed_size + (uint64_t(index.size()) - committed_size) / 2)));
+        }
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        CHECK(store.entries().size() == 1);
+        CHECK(store.entries().contains({ 1, { 0, 0 } }));
+        CHECK(store.journal_size() == committed_size);
+    }
+
+    SECTION("a different format fails to open")
+    {
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+        }
+        PackStore store;
+        CHECK(!store.open(path, "format 2").has_value());
+        CHECK(!store.is_open());
+    }
+
+    SECTION("compaction moves live records out of segments with much garbage")
+    {
+        PackStore store;
+        store.set_max_segment_size(1000);
+        REQUIRE(store.open(path, "format 1").has_value());
+        // fill more than one segment
+        const auto big = QByteArray(120, 'x');
+        for (unsigned i = 0; i < 12; ++i)
+            REQUIRE(store.put({ 5, { i, 0 } }, big, {}).has_value());
+        REQUIRE(store.commit().has_value());
+        REQUIRE(store.segments().size() == 2);
+        const auto first_segment = store.segments().begin()->first;
+
+        // remove most of the first segment
+        for (unsigned i = 1; i < 7; ++i)
+            store.remove({ 5, { i, 0 } });
+        const auto r = store.compact_step();
+        REQUIRE(r.has_value());
+        CHECK(!*r);
+        CHECK(!store.segments().contains(first_segment));
+        CHECK(!std::filesystem::exists(PackStore::segment_path(path, first_segment)));
+        REQUIRE(store.entries().size() == 6);
+        CHECK(store.entries().at({ 5, { 0, 0 } }).segment != first_segment);
+        CHECK(store.read({ 5, { 0, 0 } }).value() == big);
+
+        // nothing left to do
+        const auto segments = store.segments().size();
+        REQUIRE(store.compact_step().has_value());
+        CHECK(store.segments().size() == segments);
+
+        store.close();
+        REQUIRE(store.open(path, "format 1").has_value());
+        CHECK(store.entries().size() == 6);
+        CHECK(store.read({ 5, { 0, 0 } }).value() == big);
+        CHECK(store.read({ 5, { 11, 0 } }).value() == big);
+    }
+
+    SECTION("compaction in bounded steps")
+    {
+        PackStore store;
+        store.set_max_segment_size(1000);
+        REQUIRE(store.open(path, "format 1").has_value());
+        const auto big = QByteArray(120, 'x');
+        for (unsigned i = 0; i < 12; ++i)
+            REQUIRE(store.put({ 5, { i, 0 } }, big, {}).has_value());
+        REQUIRE(store.commit().has_value());
+        const auto first_segment = store.segments().begin()->first;
+        for (unsigned i = 3; i < 7; ++i)
+            store.remove({ 5, { i, 0 } });
+
+        // 3 live records, one per step, then the segment is removed
+        unsigned n_steps = 0;
+        for (;;) {
+            const auto r = store.compact_step(0.5f, 120);
+            REQUIRE(r.has_value());
+            ++n_steps;
+            for (unsigned i = 0; i < 3; ++i)
+                CHECK(store.read({ 5, { i, 0 } }).value() == big);
+            if (!*r)
+                break;
+            CHECK(store.segments().contains(first_segment));
+        }
+        CHECK(n_steps == 3);
+        CHECK(!store.segments().contains(first_segment));
+        CHECK(store.entries().size() == 8);
+    }
+
+    SECTION("segments the index doesn't reference are removed when opening")
+    {
+        {
+            PackStore store;
+            REQUIRE(store.open(path, "format 1").has_value());
+            REQUIRE(store.put({ 1, { 0, 0 } }, payload({ 1, { 0, 0 } }), {}).has_value());
+            REQUIRE(store.commit().has_value());
+        }
+        // left overs of a compaction that crashed after committing. the last segment is kept, new records are appended to it.
+        REQUIRE(std::filesystem::copy_file(PackStore::segment_path(path, 0), PackStore::segment_path(path, 3)));
+        REQUIRE(std::filesystem::copy_file(PackStore::segment_path(path, 0), PackStore::segment_path(path, 7)));
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        CHECK(std::filesystem::exists(PackStore::segment_path(path, 0)));
+        CHECK(!std::filesystem::exists(PackStore::segment_path(path, 3)));
+        CHECK(std::filesystem::exists(PackStore::segment_path(path, 7)));
+        CHECK(store.read({ 1, { 0, 0 } }).value() == payload({ 1, { 0, 0 } }));
+        REQUIRE(store.put({ 2, { 0, 0 } }, payload({ 2, { 0, 0 } }), {}).has_value());
+        CHECK(store.entries().at({ 2, { 0, 0 } }).segment == 7);
+    }
+
+    SECTION("the journal is checkpointed when it grows much larger than the index")
+    {
+        PackStore store;
+        REQUIRE(store.open(path, "format 1").has_value());
+        REQUIRE(store.put({ 1, { 0, 0 } }, payload({ 1, { 0, 0 } }), {}).has_value());
+        uint64_t max_journal_size = 0;
+        for (uint64_t i = 0; i < 20; ++i) {
+            for (uint64_t j = 0; j < 500; ++j)
+                store.update_meta({ 1, { 0, 0 } }, { i * 500 + j, 0 });
+            REQUIRE(store.commit().has_value());
+            max_journal_size = std::max(max_journal_size, store.journal_size());
+        }
+        CHECK(max_journal_size < 100 * 1024);
+        store.close();
+        REQUIRE(store.open(path, "format 1").has_value());
+        CHECK(store.entries().at({ 1, { 0, 0 } }).meta.visited == 9999);
+    }
+}
@@ -89,6 +89,26 @@ TEST_CASE("nucleus/tile_scheduler/rate limiter")
             CHECK(spy[i][0].value<tile::Id>() == tile::Id { unsigned(i), { 0, 0 } });
     }
 
+    SECTION("queued requests are sent in the order of their priority")
+    {
+        RateLimiter rl;
+        rl.set_limit(1, 4 * timing_multiplicator);
+        QSignalSpy spy(&rl, &RateLimiter::quad_requested);
+        rl.request_quad(tile::Id { 0, { 0, 0 } }, 1.f); // sent immediately
+        rl.request_quad(tile::Id { 1, { 0, 0 } }, 1.f);
+        rl.request_quad(tile::Id { 2, { 0, 0 } }, 9.f);
+        rl.request_quad(tile::Id { 3, { 0, 0 } }, 4.f);
+        rl.request_quad(tile::Id { 4, { 0, 0 } }, 1.f);
+        REQUIRE(spy.size() == 1);
+        test_helpers::process_events_for(30 * timing_multiplicator);
+        REQUIRE(spy.size() == 5);
+        CHECK(spy[0][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
+        CHECK(spy[1][0].value<tile::Id>() == tile::Id { 2, { 0, 0 } });
+        CHECK(spy[2][0].value<tile::Id>() == tile::Id { 3, { 0, 0 } });
+        CHECK(spy[3][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
+        CHECK(spy[4][0].value<tile::Id>() == tile::Id { 4, { 0, 0 } });
+    }
+
     SECTION("request queue is handled correctly, when requests come in one after the other")
     {
         {
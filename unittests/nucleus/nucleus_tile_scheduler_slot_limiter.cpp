@@ -20,9 +20,61 @@
 #include <QThread>
 #include <catch2/catch_test_macros.hpp>
 
+#include "StandInTileServer.h"
+#include "nucleus/tile_scheduler/QuadAssembler.h"
 #include "nucleus/tile_scheduler/SlotLimiter.h"
+#include "nucleus/tile_scheduler/TileLoadService.h"
+#include "nucleus/tile_scheduler/quad_bundle.h"
 #include "nucleus/tile_scheduler/tile_types.h"
 #include "radix/tile.h"
+#include "test_helpers.h"
+
+namespace {
+using namespace nucleus::tile_scheduler;
+
+// slot limiter -> quad assembler -> tile load service (quad bundles, so one request per quad) -> stand in server, and back.
+struct AdaptiveHarness {
+    unittests::StandInTileServer server;
+    TileLoadService service;
+    QuadAssembler assembler;
+    SlotLimiter limiter;
+    unsigned n_delivered = 0;
+
+    AdaptiveHarness(int status, unsigned start_limit)
+        : server([status](const QString& path) -> unittests::StandInTileServer::Response {
+            // paths are /zoom/y/x.quad
+            const auto parts = QString(path).remove(".quad").split('/', Qt::SkipEmptyParts);
+            if (status != 200 || !path.endsWith(".quad") || parts.size() != 3)
+                return { status == 200 ? 404 : status, {} };
+            const auto children = tile::Id { parts[0].toUInt(), { parts[2].toUInt(), parts[1].toUInt() } }.children();
+            std::array<tile_types::TileLayer, 4> tiles;
+            for (unsigned i = 0; i < 4; ++i)
+                tiles[i] = { children[i], { tile_types::NetworkInfo::Status::Good, 0 }, std::make_shared<QByteArray>(1000, 'x') };
+            return { 200, quad_bundle::pack(tiles) };
+        })
+        , service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb")
+    {
+        service.set_quad_bundle_file_ending(".quad");
+        limiter.set_limit(start_limit);
+        limiter.set_adaptive_limit_range(2, 64);
+        limiter.set_limit_mode(SlotLimiter::LimitMode::Adaptive);
+        QObject::connect(&limiter, &SlotLimiter::quad_requested, &assembler, &QuadAssembler::load);
+        QObject::connect(&assembler, &QuadAssembler::quad_requested, &service, &TileLoadService::load_quad);
+        QObject::connect(&service, &TileLoadService::load_finished, &assembler, [this](const tile_types::TileLayer& tile) {
+            assembler.deliver_tile(tile_types::LayeredTile { tile.id, tile.network_info });
+        });
+        QObject::connect(&assembler, &QuadAssembler::quad_loaded, &limiter, &SlotLimiter::deliver_quad);
+        QObject::connect(&limiter, &SlotLimiter::quad_delivered, &limiter, [this]() { n_delivered++; });
+
+        std::vector<tile_types::QuadRequest> requests;
+        for (unsigned y = 0; y < 64; ++y) {
+            for (unsigned x = 0; x < 64; ++x)
+                requests.push_back({ tile::Id { 12, { x, y } } });
+        }
+        limiter.request_quads(requests);
+    }
+};
+} // namespace
 
 TEST_CASE("nucleus/tile_scheduler/slot limiter")
 {
@@ -39,8 +91,8 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
     {
         SlotLimiter sl;
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } } });
         REQUIRE(spy.size() == 2);
         CHECK(spy[0][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
         CHECK(spy[1][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
@@ -52,15 +104,15 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         SlotLimiter sl;
         sl.set_limit(2);
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } },
-            tile::Id { 1, { 0, 1 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } },
+            { tile::Id { 1, { 0, 1 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 2);
         CHECK(spy[0][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
         CHECK(spy[1][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
 
-        sl.request_quads({ tile::Id { 1, { 1, 0 } } });
+        sl.request_quads({ { tile::Id { 1, { 1, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         CHECK(spy.size() == 2);
     }
@@ -70,8 +122,8 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         SlotLimiter sl;
         sl.set_limit(2);
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 2);
 
@@ -86,10 +138,10 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         SlotLimiter sl;
         sl.set_limit(2);
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } },
-            tile::Id { 1, { 0, 1 } },
-            tile::Id { 2, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } },
+            { tile::Id { 1, { 0, 1 } } },
+            { tile::Id { 2, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 2);
 
@@ -110,8 +162,8 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         CHECK(sl.slots_taken() == 0);
         CHECK(spy.size() == 4);
 
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 6);
         CHECK(spy[4][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
@@ -123,13 +175,13 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         SlotLimiter sl;
         sl.set_limit(2);
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } },
-            tile::Id { 2, { 0, 0 } },
-            tile::Id { 3, { 0, 0 } },
-            tile::Id { 4, { 0, 0 } },
-            tile::Id { 5, { 0, 0 } },
-            tile::Id { 6, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } },
+            { tile::Id { 2, { 0, 0 } } },
+            { tile::Id { 3, { 0, 0 } } },
+            { tile::Id { 4, { 0, 0 } } },
+            { tile::Id { 5, { 0, 0 } } },
+            { tile::Id { 6, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 2);
         CHECK(spy[0][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
@@ -153,8 +205,8 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         CHECK(sl.slots_taken() == 0);
         CHECK(spy.size() == 7);
 
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
         REQUIRE(spy.size() == 9);
         CHECK(spy[7][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
@@ -166,17 +218,17 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         SlotLimiter sl;
         sl.set_limit(2);
         QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } },
-            tile::Id { 1, { 0, 0 } },
-            tile::Id { 2, { 0, 0 } },
-            tile::Id { 3, { 0, 0 } } });
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } },
+            { tile::Id { 1, { 0, 0 } } },
+            { tile::Id { 2, { 0, 0 } } },
+            { tile::Id { 3, { 0, 0 } } } });
         CHECK(sl.slots_taken() == 2);
 
         REQUIRE(spy.size() == 2);
-        sl.request_quads({ tile::Id { 0, { 0, 0 } }, // already requested
-            tile::Id { 1, { 0, 0 } }, // already requested
-            tile::Id { 2, { 1, 0 } }, // new, should go next
-            tile::Id { 3, { 1, 0 } } }); // new, should go next
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } } }, // already requested
+            { tile::Id { 1, { 0, 0 } } }, // already requested
+            { tile::Id { 2, { 1, 0 } } }, // new, should go next
+            { tile::Id { 3, { 1, 0 } } } }); // new, should go next
         CHECK(sl.slots_taken() == 2);
 
         sl.deliver_quad(tile_types::TileQuad { tile::Id { 0, { 0, 0 } } });
@@ -197,6 +249,93 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         CHECK(sl.slots_taken() == 0);
     }
 
+    SECTION("requests are sent in the order of their priority")
+    {
+        SlotLimiter sl;
+        sl.set_limit(2);
+        QSignalSpy spy(&sl, &SlotLimiter::quad_requested);
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } }, 1.f },
+            { tile::Id { 1, { 0, 0 } }, 5.f },
+            { tile::Id { 1, { 0, 1 } }, 3.f },
+            { tile::Id { 1, { 1, 0 } }, 8.f },
+            { tile::Id { 1, { 1, 1 } }, 3.f } });
+        REQUIRE(spy.size() == 2);
+        CHECK(spy[0][0].value<tile::Id>() == tile::Id { 1, { 1, 0 } });
+        CHECK(spy[0][1].value<float>() == 8.f);
+        CHECK(spy[1][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
+
+        // equal priorities keep the order of the request
+        sl.deliver_quad(tile_types::TileQuad { tile::Id { 1, { 1, 0 } } });
+        sl.deliver_quad(tile_types::TileQuad { tile::Id { 1, { 0, 0 } } });
+        REQUIRE(spy.size() == 4);
+        CHECK(spy[2][0].value<tile::Id>() == tile::Id { 1, { 0, 1 } });
+        CHECK(spy[3][0].value<tile::Id>() == tile::Id { 1, { 1, 1 } });
+
+        // a new request list reorders the queue
+        sl.request_quads({ { tile::Id { 0, { 0, 0 } }, 1.f }, { tile::Id { 2, { 0, 0 } }, 0.5f }, { tile::Id { 2, { 1, 1 } }, 100.f } });
+        sl.deliver_quad(tile_types::TileQuad { tile::Id { 1, { 0, 1 } } });
+        REQUIRE(spy.size() == 5);
+        CHECK(spy[4][0].value<tile::Id>() == tile::Id { 2, { 1, 1 } });
+        sl.deliver_quad(tile_types::TileQuad { tile::Id { 1, { 1, 1 } } });
+        REQUIRE(spy.size() == 6);
+        CHECK(spy[5][0].value<tile::Id>() == tile::Id { 0, { 0, 0 } });
+    }
+
+    SECTION("stale quads are cancelled after the grace period and free their slot")
+    {
+        SlotLimiter sl;
+        sl.set_limit(2);
+        sl.set_cancellation_grace_period(50);
+        QSignalSpy spy_requested(&sl, &SlotLimiter::quad_requested);
+        QSignalSpy spy_cancelled(&sl, &SlotLimiter::quad_cancelled);
+        sl.request_quads({ { tile::Id { 1, { 0, 0 } } }, { tile::Id { 1, { 0, 1 } } } });
+        REQUIRE(spy_requested.size() == 2);
+
+        // 1/0/0 drops out, 1/0/1 stays. nothing is cancelled within the grace period
+        sl.request_quads({ { tile::Id { 1, { 0, 1 } } }, { tile::Id { 2, { 0, 0 } } } });
+        CHECK(spy_cancelled.size() == 0);
+        CHECK(sl.slots_taken() == 2);
+        CHECK(spy_requested.size() == 2);
+
+        spy_cancelled.wait(1000);
+        REQUIRE(spy_cancelled.size() == 1);
+        CHECK(spy_cancelled[0][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
+        // the slot went to the queued quad right away
+        CHECK(sl.slots_taken() == 2);
+        REQUIRE(spy_requested.size() == 3);
+        CHECK(spy_requested[2][0].value<tile::Id>() == tile::Id { 2, { 0, 0 } });
+
+        // a late delivery of the cancelled quad is still sent on, but doesn't take anybody's slot
+        QSignalSpy spy_delivered(&sl, &SlotLimiter::quad_delivered);
+        sl.deliver_quad(tile_types::TileQuad { tile::Id { 1, { 0, 0 } } });
+        CHECK(spy_delivered.size() == 1);
+        CHECK(sl.slots_taken() == 2);
+    }
+
+    SECTION("quads requested again within the grace period are not cancelled")
+    {
+        SlotLimiter sl;
+        sl.set_cancellation_grace_period(50);
+        QSignalSpy spy_cancelled(&sl, &SlotLimiter::quad_cancelled);
+        sl.request_quads({ { tile::Id { 1, { 0, 0 } } } });
+        sl.request_quads({});
+        sl.request_quads({ { tile::Id { 1, { 0, 0 } } } });
+        CHECK(!spy_cancelled.wait(200));
+        CHECK(sl.slots_taken() == 1);
+    }
+
+    SECTION("grace period of 0 cancels with the next request list")
+    {
+        SlotLimiter sl;
+        sl.set_cancellation_grace_period(0);
+        QSignalSpy spy_cancelled(&sl, &SlotLimiter::quad_cancelled);
+        sl.request_quads({ { tile::Id { 1, { 0, 0 } } } });
+        sl.request_quads({ { tile::Id { 1, { 1, 0 } } } });
+        REQUIRE(spy_cancelled.size() == 1);
+        CHECK(spy_cancelled[0][0].value<tile::Id>() == tile::Id { 1, { 0, 0 } });
+        CHECK(sl.slots_taken() == 1);
+    }
+
     SECTION("delivered quads are sent on")
     {
         SlotLimiter sl;
@@ -210,3 +349,51 @@ TEST_CASE("nucleus/tile_scheduler/slot limiter")
         CHECK(spy[1][0].value<tile_types::TileQuad>().id == tile::Id { 1, { 2, 3 } });
     }
 }
+
+TEST_CASE("nucleus/tile_scheduler/slot limiter adaptive mode")
+{
+    using namespace nucleus::tile_scheduler;
+    SECTION("fixed is the default and set_limit is the starting point of adaptive mode")
+    {
+        SlotLimiter sl;
+        CHECK(sl.limit_mode() == SlotLimiter::LimitMode::Fixed);
+        sl.set_limit(100);
+        sl.set_adaptive_limit_range(4, 32);
+        CHECK(sl.limit() == 100);
+        sl.set_limit_mode(SlotLimiter::LimitMode::Adaptive);
+        CHECK(sl.limit() == 32);
+        sl.set_limit(1);
+        sl.set_limit_mode(SlotLimiter::LimitMode::Adaptive);
+        CHECK(sl.limit() == 4);
+        CHECK(sl.adaptive_limit_range() == std::pair(4u, 32u));
+        CHECK(sl.smoothed_latency() == 0);
+    }
+
+    SECTION("grows on a high latency link")
+    {
+        AdaptiveHarness h(200, 2);
+        h.server.set_latency(100);
+        test_helpers::process_events_for(3000);
+        CHECK(h.n_delivered > 0);
+        CHECK(h.limiter.smoothed_latency() >= 100);
+        CHECK(h.limiter.limit() >= 5);
+    }
+
+    SECTION("shrinks when the link is bandwidth bound")
+    {
+        AdaptiveHarness h(200, 32);
+        h.server.set_bandwidth(200'000); // ~20ms per quad, sent one after the other
+        test_helpers::process_events_for(4000);
+        CHECK(h.n_delivered > 0);
+        CHECK(h.limiter.limit() <= 10);
+    }
+
+    SECTION("shrinks to the minimum when the server fails")
+    {
+        AdaptiveHarness h(500, 16);
+        h.server.set_latency(5);
+        test_helpers::process_events_for(500);
+        CHECK(h.n_delivered > 0);
+        CHECK(h.limiter.limit() == 2);
+    }
+}
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/Telemetry.h"
+#include "nucleus/utils/Histogram.h"
+
+using nucleus::tile_scheduler::Telemetry;
+using nucleus::utils::Histogram;
+
+TEST_CASE("nucleus/utils/Histogram")
+{
+    SECTION("empty")
+    {
+        Histogram h;
+        CHECK(h.count() == 0);
+        CHECK(h.percentile(50) == 0);
+        CHECK(h.mean() == 0);
+    }
+
+    SECTION("small values are exact")
+    {
+        Histogram h;
+        for (uint64_t v = 1; v <= 50; ++v)
+            h.record(v);
+        CHECK(h.count() == 50);
+        CHECK(h.min() == 1);
+        CHECK(h.max() == 50);
+        CHECK(h.mean() == 25.5);
+        CHECK(h.percentile(50) == 25);
+        CHECK(h.percentile(100) == 50);
+        CHECK(h.percentile(0) == 1);
+    }
+
+    SECTION("buckets cover all values with a bounded relative error")
+    {
+        for (uint64_t v = 0; v < 100'000; v = v * 2 + 1) {
+            for (uint64_t w : { v, v + 1, v * 3 / 2 }) {
+                const auto index = Histogram::bucket_index(w);
+                CHECK(Histogram::highest_equivalent_value(index) >= w);
+                CHECK(double(Histogram::highest_equivalent_value(index) - w) <= double(w) / Histogram::sub_bucket_count);
+                if (index > 0)
+                    CHECK(Histogram::highest_equivalent_value(index - 1) < w);
+            }
+        }
+        CHECK(Histogram::bucket_index(Histogram::max_value) == Histogram::n_buckets - 1);
+        CHECK(Histogram::bucket_index(std::numeric_limits<uint64_t>::max()) == Histogram::n_buckets - 1);
+    }
+
+    SECTION("percentiles of a uniform distribution")
+    {
+        Histogram h;
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<uint64_t> dist(0, 1'000'000);
+        for (unsigned i = 0; i < 100'000; ++i)
+            h.record(dist(rng));
+        CHECK(std::abs(double(h.percentile(50)) - 500'000.0) < 500'000.0 * 0.05);
+        CHECK(std::abs(double(h.percentile(95)) - 950'000.0) < 950'000.0 * 0.05);
+        CHECK(std::abs(double(h.percentile(99)) - 990'000.0) < 990'000.0 * 0.05);
+        CHECK(h.percentile(100) == h.max());
+    }
+
+    SECTION("merge")
+    {
+        Histogram a;
+        Histogram b;
+        a.record(10, 3);
+        b.record(1000);
+        a.merge(b);
+        CHECK(a.count() == 4);
+        CHECK(a.min() == 10);
+        CHECK(a.max() == 1000);
+        CHECK(a.percentile(75) == 10);
+        CHECK(a.percentile(76) >= 1000);
+        a.reset();
+        CHECK(a.count() == 0);
+    }
+}
+
+TEST_CASE("nucleus/tile_scheduler/Telemetry")
+{
+    auto& telemetry = Telemetry::instance();
+    telemetry.reset();
+
+    SECTION("records from several threads")
+    {
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < 4; ++t) {
+            threads.emplace_back([&telemetry]() {
+                for (uint64_t i = 1; i <= 1000; ++i) {
+                    telemetry.record(Telemetry::Timing::GltfDecode, i);
+                    telemetry.add(Telemetry::Counter::BytesReceived, 2);
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        const auto s = telemetry.snapshot();
+        const auto& decode = s.timings[size_t(Telemetry::Timing::GltfDecode)];
+        CHECK(decode.count == 4000);
+        CHECK(decode.min == 1);
+        CHECK(decode.max == 1000);
+        CHECK(decode.p50 >= 500);
+        CHECK(decode.p50 <= 516);
+        CHECK(decode.p99 >= 990);
+        CHECK(s.counters[size_t(Telemetry::Counter::BytesReceived)] == 8000);
+    }
+
+    SECTION("gauges keep the current value and a distribution")
+    {
+        telemetry.set(Telemetry::Gauge::SlotLimiterQueued, 10);
+        telemetry.set(Telemetry::Gauge::SlotLimiterQueued, 30);
+        telemetry.set(Telemetry::Gauge::SlotLimiterQueued, 20);
+        const auto s = telemetry.snapshot();
+        CHECK(s.gauges[size_t(Telemetry::Gauge::SlotLimiterQueued)] == 20);
+        CHECK(s.gauge_distributions[size_t(Telemetry::Gauge::SlotLimiterQueued)].count == 3);
+        CHECK(s.gauge_distributions[size_t(Telemetry::Gauge::SlotLimiterQueued)].max == 30);
+    }
+
+    SECTION("cache hit ratio and json")
+    {
+        CHECK(telemetry.snapshot().cache_hit_ratio() == 0);
+        telemetry.add(Telemetry::Counter::CacheHits, 3);
+        telemetry.add(Telemetry::Counter::CacheMisses, 1);
+        telemetry.record(Telemetry::Timing::NetworkRtt, 1500);
+        const auto s = telemetry.snapshot();
+        CHECK(s.cache_hit_ratio() == 0.75);
+
+        const auto json = s.to_json();
+        CHECK(json["cache_hit_ratio"].toDouble() == 0.75);
+        CHECK(json["counters"].toObject()["cache_hits"].toInteger() == 3);
+        CHECK(json["timings_us"].toObject()["network_rtt"].toObject()["count"].toInteger() == 1);
+        CHECK(json["timings_us"].toObject()["network_rtt"].toObject()["p99"].toInteger() >= 1500);
+        CHECK(json["gauges"].toObject().contains("gpu_bytes"));
+        CHECK(json["gauges"].toObject()["gpu_bytes"].toObject().contains("current"));
+    }
+
+    SECTION("scoped timing")
+    {
+        {
+            const Telemetry::ScopedTiming timing(Telemetry::Timing::GpuUpload);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        const auto& upload = telemetry.snapshot().timings[size_t(Telemetry::Timing::GpuUpload)];
+        CHECK(upload.count == 1);
+        CHECK(upload.min >= 2000);
+    }
+    telemetry.reset();
+}
@@ -0,0 +1,220 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/TileArchive.h"
+#include "nucleus/tile_scheduler/TileArchiveService.h"
+#include "nucleus/tile_scheduler/utils.h"
+
+using namespace nucleus::tile_scheduler;
+using nucleus::tile_scheduler::tile_types::TileLayer;
+
+namespace {
+QByteArray example_data(const tile::Id& id) { return QString("tile %1/%2/%3").arg(id.zoom_level).arg(id.coords.x).arg(id.coords.y).toLatin1().repeated(int(id.coords.x % 7 + 1)); }
+
+// all tiles of zoom levels 0 to max_zoom_level, in reverse order to make sure the writer sorts.
+std::vector<std::pair<tile::Id, QByteArray>> example_tiles(unsigned max_zoom_level)
+{
+    std::vector<std::pair<tile::Id, QByteArray>> tiles;
+    for (unsigned z = 0; z <= max_zoom_level; ++z) {
+        for (unsigned x = 0; x < (1u << z); ++x) {
+            for (unsigned y = 0; y < (1u << z); ++y) {
+                const auto id = tile::Id { .zoom_level = z, .coords = { x, y } };
+                tiles.emplace_back(id, example_data(id));
+            }
+        }
+    }
+    std::reverse(tiles.begin(), tiles.end());
+    return tiles;
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/TileArchive")
+{
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const auto path = std::filesystem::path(dir.path().toStdString()) / "tiles.alp_archive";
+
+    SECTION("key")
+    {
+        CHECK(TileArchive::key({ .zoom_level = 0, .coords = { 0, 0 } }) == 0);
+        // siblings are consecutive
+        const auto parent = tile::Id { .zoom_level = 10, .coords = { 545, 355 } };
+        std::vector<uint64_t> keys;
+        for (const auto& child : parent.children())
+            keys.push_back(TileArchive::key(child));
+        std::sort(keys.begin(), keys.end());
+        CHECK(keys[3] - keys[0] == 3);
+        // zoom levels don't mix
+        CHECK(TileArchive::key({ .zoom_level = 4, .coords = { 15, 15 } }) < TileArchive::key({ .zoom_level = 5, .coords = { 0, 0 } }));
+        CHECK(TileArchive::key({ .zoom_level = 29, .coords = { (1u << 29) - 1, (1u << 29) - 1 } }) > TileArchive::key({ .zoom_level = 28, .coords = { 0, 0 } }));
+    }
+
+    SECTION("round trip")
+    {
+        const auto tiles = example_tiles(6);
+        REQUIRE(TileArchive::write(path, tiles).has_value());
+
+        TileArchive archive;
+        CHECK(!archive.is_open());
+        CHECK(!archive.find({ .zoom_level = 0, .coords = { 0, 0 } }).has_value());
+        REQUIRE(archive.open(path).has_value());
+        CHECK(archive.is_open());
+        CHECK(archive.n_tiles() == tiles.size());
+        for (const auto& [id, data] : tiles) {
+            const auto found = archive.find(id);
+            REQUIRE(found.has_value());
+            CHECK(found->toByteArray() == data);
+        }
+        CHECK(!archive.find({ .zoom_level = 7, .coords = { 0, 0 } }).has_value());
+        CHECK(!archive.find({ .zoom_level = 3, .coords = { 8, 0 } }).has_value());
+        archive.close();
+        CHECK(!archive.is_open());
+    }
+
+    SECTION("empty archive")
+    {
+        REQUIRE(TileArchive::write(path, {}).has_value());
+        TileArchive archive;
+        REQUIRE(archive.open(path).has_value());
+        CHECK(archive.n_tiles() == 0);
+        CHECK(!archive.find({ .zoom_level = 0, .coords = { 0, 0 } }).has_value());
+    }
+
+    SECTION("rejects duplicates")
+    {
+        auto tiles = example_tiles(1);
+        tiles.push_back(tiles.front());
+        CHECK(!TileArchive::write(path, tiles).has_value());
+    }
+
+    SECTION("rejects broken files")
+    {
+        TileArchive archive;
+        CHECK(!archive.open(path).has_value()); // missing
+
+        REQUIRE(TileArchive::write(path, example_tiles(2)).has_value());
+        QByteArray bytes;
+        {
+            QFile file(path);
+            REQUIRE(file.open(QIODeviceBase::ReadOnly));
+            bytes = file.readAll();
+        }
+        const auto write_and_open = [&](const QByteArray& data) {
+            archive.close(); // don't truncate a mapped file
+            {
+                QFile file(path);
+                REQUIRE(file.open(QIODeviceBase::WriteOnly));
+                file.write(data);
+            }
+            return archive.open(path);
+        };
+        CHECK(write_and_open(bytes).has_value());
+        CHECK(!write_and_open(bytes.first(10)).has_value());
+        CHECK(!write_and_open(bytes.first(16 + 24 * 3)).has_value()); // truncated index
+        CHECK(!write_and_open(bytes.first(bytes.size() - 1)).has_value()); // last tile reaches past the end
+        CHECK(!write_and_open(QByteArray("<html>not an archive</html>")).has_value());
+        CHECK(!archive.is_open());
+        auto wrong_version = bytes;
+        wrong_version[4] = 99;
+        CHECK(!write_and_open(wrong_version).has_value());
+    }
+}
+
+TEST_CASE("nucleus/tile_scheduler/TileArchiveService")
+{
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const auto path = std::filesystem::path(dir.path().toStdString()) / "tiles.alp_archive";
+    REQUIRE(TileArchive::write(path, example_tiles(4)).has_value());
+
+    SECTION("missing archive")
+    {
+        TileArchiveService service(path.parent_path() / "does_not_exist.alp_archive");
+        CHECK(!service.is_open());
+    }
+
+    SECTION("load")
+    {
+        TileArchiveService service(path);
+        REQUIRE(service.is_open());
+        QSignalSpy spy(&service, &TileArchiveService::load_finished);
+        const auto available = tile::Id { .zoom_level = 3, .coords = { 5, 2 } };
+        const auto unavailable = tile::Id { .zoom_level = 5, .coords = { 5, 2 } };
+        service.load(available);
+        service.load(unavailable);
+        CHECK(spy.count() == 0); // emitted from the event loop
+        while (spy.count() < 2 && spy.wait(5000)) { }
+        REQUIRE(spy.count() == 2);
+
+        const auto tile = spy.at(0).at(0).value<TileLayer>();
+        CHECK(tile.id == available);
+        CHECK(tile.network_info.status == tile_types::NetworkInfo::Status::Good);
+        CHECK(utils::time_since_epoch() - tile.network_info.timestamp < 10'000);
+        CHECK(*tile.data == example_data(available));
+
+        const auto missing = spy.at(1).at(0).value<TileLayer>();
+        CHECK(missing.id == unavailable);
+        CHECK(missing.network_info.status == tile_types::NetworkInfo::Status::NotFound);
+        CHECK(missing.data->isEmpty());
+    }
+
+    SECTION("load quad")
+    {
+        TileArchiveService service(path);
+        QSignalSpy spy(&service, &TileArchiveService::load_finished);
+        const auto quad_id = tile::Id { .zoom_level = 3, .coords = { 5, 2 } };
+        service.load_quad(quad_id);
+        while (spy.count() < 4 && spy.wait(5000)) { }
+        REQUIRE(spy.count() == 4);
+        for (unsigned i = 0; i < 4; ++i) {
+            const auto tile = spy.at(i).at(0).value<TileLayer>();
+            CHECK(tile.id == quad_id.children()[i]);
+            CHECK(*tile.data == example_data(tile.id));
+        }
+    }
+}
+
+TEST_CASE("nucleus/tile_scheduler/TileArchive benchmarks")
+{
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const auto path = std::filesystem::path(dir.path().toStdString()) / "tiles.alp_archive";
+    const auto tiles = example_tiles(9); // ~350k tiles
+    REQUIRE(TileArchive::write(path, tiles).has_value());
+    TileArchive archive;
+    REQUIRE(archive.open(path).has_value());
+
+    unsigned i = 0;
+    BENCHMARK("find (350k tiles)") { return archive.find(tiles[(i++ * 7919) % tiles.size()].first)->size(); };
+
+    TileArchiveService service(path);
+    QSignalSpy spy(&service, &TileArchiveService::load_finished);
+    BENCHMARK("service load, including the event loop round trip")
+    {
+        spy.clear();
+        service.load(tiles[(i++ * 7919) % tiles.size()].first);
+        spy.wait(1000);
+        return spy.count();
+    };
+}
@@ -21,9 +21,12 @@
 
 #include <QRegularExpression>
 #include <QSignalSpy>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 
+#include "StandInTileServer.h"
 #include "nucleus/tile_scheduler/TileLoadService.h"
+#include "nucleus/tile_scheduler/quad_bundle.h"
 #include "nucleus/utils/tile_conversion.h"
 
 using namespace nucleus::tile_scheduler;
@@ -35,6 +38,58 @@ inline std::ostream& operator<<(std::ostream& os, const QString& value)
     return os;
 }
 
+namespace {
+QByteArray stand_in_tile_data(const tile::Id& id) { return QString("tile %1/%2/%3").arg(id.zoom_level).arg(id.coords.x).arg(id.coords.y).toLatin1(); }
+
+// serves paths of the form /zoom/y/x.glb (ZYX), and /zoom/y/x.quad if with_bundles is set. tiles below zoom level 10 don't exist.
+unittests::StandInTileServer::Handler stand_in_handler(bool with_bundles)
+{
+    return [with_bundles](const QString& path) -> unittests::StandInTileServer::Response {
+        const auto match = QRegularExpression("^/(\\d+)/(\\d+)/(\\d+)\\.(glb|quad)$").match(path);
+        if (!match.hasMatch())
+            return { 404, {} };
+        const auto id = tile::Id { .zoom_level = match.captured(1).toUInt(), .coords = { match.captured(3).toUInt(), match.captured(2).toUInt() } };
+        const auto tile = [](const tile::Id& id) -> TileLayer {
+            if (id.zoom_level >= 10)
+                return { id, { tile_types::NetworkInfo::Status::NotFound, 0 }, std::make_shared<QByteArray>() };
+            return { id, { tile_types::NetworkInfo::Status::Good, 0 }, std::make_shared<QByteArray>(stand_in_tile_data(id)) };
+        };
+        if (match.captured(4) == "glb") {
+            const auto t = tile(id);
+            return { t.network_info.status == tile_types::NetworkInfo::Status::Good ? 200 : 404, *t.data };
+        }
+        if (!with_bundles)
+            return { 404, {} };
+        const auto children = id.children();
+        return { 200, quad_bundle::pack({ tile(children[0]), tile(children[1]), tile(children[2]), tile(children[3]) }) };
+    };
+}
+
+std::vector<TileLayer> wait_for_tiles(QSignalSpy& spy, int n_tiles)
+{
+    while (spy.count() < n_tiles && spy.wait(5000)) { }
+    std::vector<TileLayer> tiles;
+    for (const auto& arguments : spy)
+        tiles.push_back(arguments.at(0).value<TileLayer>());
+    return tiles;
+}
+
+void check_quad_tiles(std::vector<TileLayer> tiles, const tile::Id& quad_id)
+{
+    REQUIRE(tiles.size() == 4);
+    for (const auto& child_id : quad_id.children()) {
+        const auto tile = std::find_if(tiles.begin(), tiles.end(), [&](const TileLayer& t) { return t.id == child_id; });
+        REQUIRE(tile != tiles.end());
+        if (child_id.zoom_level < 10) {
+            CHECK(tile->network_info.status == tile_types::NetworkInfo::Status::Good);
+            CHECK(*tile->data == stand_in_tile_data(child_id));
+        } else {
+            CHECK(tile->network_info.status == tile_types::NetworkInfo::Status::NotFound);
+            CHECK(tile->data->isEmpty());
+        }
+    }
+}
+} // namespace
 
 TEST_CASE("nucleus/tile_scheduler/TileLoadService")
 {
@@ -255,4 +310,147 @@ TEST_CASE("nucleus/tile_scheduler/TileLoadService")
         const auto image = nucleus::utils::tile_conversion::toQImage(*tile.data);
         REQUIRE(image.sizeInBytes() == 0);
     }
+
+    SECTION("quad bundle pack and unpack")
+    {
+        const auto quad_id = tile::Id { .zoom_level = 5, .coords = { 3, 7 } };
+        const auto c = quad_id.children();
+        const std::array<TileLayer, 4> tiles = { TileLayer { c[2], { tile_types::NetworkInfo::Status::Good, 0 }, std::make_shared<QByteArray>("c2") },
+            TileLayer { c[0], { tile_types::NetworkInfo::Status::Good, 0 }, std::make_shared<QByteArray>("child 0") },
+            TileLayer { c[3], { tile_types::NetworkInfo::Status::NotFound, 0 }, std::make_shared<QByteArray>() },
+            TileLayer { c[1], { tile_types::NetworkInfo::Status::Good, 0 }, std::make_shared<QByteArray>(QByteArray(1000, 'x')) } };
+        const auto bundle = quad_bundle::pack(tiles);
+
+        const auto unpacked = quad_bundle::unpack(bundle, quad_id, 123);
+        REQUIRE(unpacked.has_value());
+        for (unsigned i = 0; i < 4; ++i) {
+            CHECK(unpacked->at(i).id == c[i]);
+            CHECK(unpacked->at(i).network_info.timestamp == 123);
+        }
+        CHECK(*unpacked->at(0).data == "child 0");
+        CHECK(*unpacked->at(1).data == QByteArray(1000, 'x'));
+        CHECK(*unpacked->at(2).data == "c2");
+        CHECK(unpacked->at(3).data->isEmpty());
+        CHECK(unpacked->at(3).network_info.status == tile_types::NetworkInfo::Status::NotFound);
+
+        CHECK(!quad_bundle::unpack(bundle, c[0], 123).has_value()); // wrong quad
+        CHECK(!quad_bundle::unpack(bundle.first(bundle.size() - 1), quad_id, 123).has_value()); // truncated
+        CHECK(!quad_bundle::unpack(QByteArray("<html>not found</html>"), quad_id, 123).has_value());
+        CHECK(!quad_bundle::unpack(QByteArray(), quad_id, 123).has_value());
+        auto duplicated = tiles;
+        duplicated[1].id = c[2];
+        CHECK(!quad_bundle::unpack(quad_bundle::pack(duplicated), quad_id, 123).has_value());
+    }
+
+    SECTION("load quad as bundle")
+    {
+        unittests::StandInTileServer server(stand_in_handler(true));
+        TileLoadService service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb");
+        service.set_quad_bundle_file_ending(".quad");
+        CHECK(service.build_quad_bundle_url({ .zoom_level = 2, .coords = { 1, 3 } }) == server.base_url() + "2/3/1.quad");
+
+        for (const auto& quad_id : { tile::Id { .zoom_level = 5, .coords = { 3, 7 } }, tile::Id { .zoom_level = 9, .coords = { 300, 200 } } }) {
+            server.reset_n_requests();
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            service.load_quad(quad_id);
+            check_quad_tiles(wait_for_tiles(spy, 4), quad_id);
+            CHECK(server.n_requests() == 1);
+        }
+        CHECK(service.quad_bundles_enabled());
+    }
+
+    SECTION("load quad falls back to tile requests")
+    {
+        unittests::StandInTileServer server(stand_in_handler(false));
+        TileLoadService service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb");
+        const auto quad_id = tile::Id { .zoom_level = 9, .coords = { 300, 200 } };
+        {
+            // bundles not enabled
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            service.load_quad(quad_id);
+            check_quad_tiles(wait_for_tiles(spy, 4), quad_id);
+            CHECK(server.n_requests() == 4);
+        }
+        service.set_quad_bundle_file_ending(".quad");
+        CHECK(service.quad_bundles_enabled());
+        {
+            // the first quad discovers, that the server doesn't support bundles
+            server.reset_n_requests();
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            service.load_quad(quad_id);
+            check_quad_tiles(wait_for_tiles(spy, 4), quad_id);
+            CHECK(server.n_requests() == 5);
+            CHECK(!service.quad_bundles_enabled());
+        }
+        {
+            server.reset_n_requests();
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            service.load_quad(quad_id);
+            check_quad_tiles(wait_for_tiles(spy, 4), quad_id);
+            CHECK(server.n_requests() == 4);
+        }
+    }
+
+    SECTION("cancel quad")
+    {
+        for (const auto with_bundles : { false, true }) {
+            unittests::StandInTileServer server(stand_in_handler(true), 50);
+            TileLoadService service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb");
+            if (with_bundles)
+                service.set_quad_bundle_file_ending(".quad");
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            const auto cancelled_quad = tile::Id { .zoom_level = 5, .coords = { 3, 7 } };
+            const auto kept_quad = tile::Id { .zoom_level = 5, .coords = { 4, 7 } };
+            service.load_quad(cancelled_quad);
+            service.load_quad(kept_quad);
+            service.cancel_quad(cancelled_quad);
+            service.cancel_quad({ .zoom_level = 7, .coords = { 3, 7 } }); // not in flight, no-op
+            const auto tiles = wait_for_tiles(spy, 4);
+            check_quad_tiles(tiles, kept_quad);
+            CHECK(!spy.wait(300)); // nothing arrives for the cancelled quad
+        }
+    }
+
+    SECTION("quad bundles reduce request count")
+    {
+        constexpr auto n_quads = 8;
+        const auto n_requests = [](bool with_bundles) {
+            unittests::StandInTileServer server(stand_in_handler(true));
+            TileLoadService service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb");
+            if (with_bundles)
+                service.set_quad_bundle_file_ending(".quad");
+            QSignalSpy spy(&service, &TileLoadService::load_finished);
+            for (unsigned i = 0; i < n_quads; ++i)
+                service.load_quad({ .zoom_level = 8, .coords = { 100 + i, 100 } });
+            CHECK(wait_for_tiles(spy, n_quads * 4).size() == n_quads * 4);
+            return server.n_requests();
+        };
+        CHECK(n_requests(true) == n_quads);
+        CHECK(n_requests(false) == n_quads * 4);
+    }
+}
+
+TEST_CASE("nucleus/tile_scheduler/TileLoadService benchmark")
+{
+    // every request costs the stand in server 10ms, and it handles one request at a time.
+    constexpr auto n_quads = 8;
+    const auto load_quads = [](bool with_bundles) {
+        unittests::StandInTileServer server(stand_in_handler(true), 10);
+        TileLoadService service(server.base_url(), TileLoadService::UrlPattern::ZYX, ".glb");
+        if (with_bundles)
+            service.set_quad_bundle_file_ending(".quad");
+        QSignalSpy spy(&service, &TileLoadService::load_finished);
+        for (unsigned i = 0; i < n_quads; ++i)
+            service.load_quad({ .zoom_level = 8, .coords = { 100 + i, 100 } });
+        return wait_for_tiles(spy, n_quads * 4).size();
+    };
+
+    BENCHMARK("quad bundles")
+    {
+        return load_quads(true);
+    };
+    BENCHMARK("tile requests")
+    {
+        return load_quads(false);
+    };
 }
@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <chrono>
+#include <filesystem>
+
+#include <QColor>
+#include <QImage>
+#include <QTemporaryDir>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/tile_scheduler/TranscodedTextureCache.h"
+
+using namespace nucleus::tile_scheduler;
+using nucleus::utils::texture_compression::Algorithm;
+
+namespace {
+tile_types::GpuTexture example_texture(Algorithm algorithm)
+{
+    QImage image(16, 16, QImage::Format_RGBA8888);
+    image.fill(QColor(10, 200, 30));
+    tile_types::GpuTexture texture { algorithm, 16, 16, {} };
+    texture.levels.push_back(nucleus::utils::texture_compression::compress(image, algorithm));
+    texture.levels.push_back(nucleus::utils::texture_compression::compress(image.scaled(8, 8), algorithm));
+    return texture;
+}
+} // namespace
+
+TEST_CASE("nucleus/tile_scheduler/TranscodedTextureCache")
+{
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const auto base_path = std::filesystem::path(dir.path().toStdString());
+    const auto id = tile::Id { 12, { 2193, 1400 } };
+
+    SECTION("round trip")
+    {
+        const TranscodedTextureCache cache(base_path, Algorithm::ETC1);
+        CHECK(!cache.read(id, 42).has_value());
+        const auto texture = example_texture(Algorithm::ETC1);
+        REQUIRE(cache.write(id, 42, texture).has_value());
+        const auto read = cache.read(id, 42);
+        REQUIRE(read.has_value());
+        CHECK(read->format == Algorithm::ETC1);
+        CHECK(read->width == 16);
+        CHECK(read->height == 16);
+        CHECK(read->levels == texture.levels);
+    }
+
+    SECTION("entries of an older source texture are ignored")
+    {
+        const TranscodedTextureCache cache(base_path, Algorithm::DXT1);
+        REQUIRE(cache.write(id, 42, example_texture(Algorithm::DXT1)).has_value());
+        CHECK(!cache.read(id, 43).has_value());
+    }
+
+    SECTION("formats are cached separately")
+    {
+        const TranscodedTextureCache etc(base_path, Algorithm::ETC1);
+        const TranscodedTextureCache dxt(base_path, Algorithm::DXT1);
+        REQUIRE(etc.write(id, 42, example_texture(Algorithm::ETC1)).has_value());
+        CHECK(!dxt.read(id, 42).has_value());
+        CHECK(etc.path() != dxt.path());
+    }
+
+    SECTION("remove_unless")
+    {
+        const TranscodedTextureCache cache(base_path, Algorithm::ETC1);
+        const auto other_id = tile::Id { 12, { 2194, 1400 } };
+        REQUIRE(cache.write(id, 42, example_texture(Algorithm::ETC1)).has_value());
+        REQUIRE(cache.write(other_id, 42, example_texture(Algorithm::ETC1)).has_value());
+        cache.remove_unless([&](const tile::Id& i) { return i == other_id; });
+        CHECK(!cache.read(id, 42).has_value());
+        CHECK(cache.read(other_id, 42).has_value());
+    }
+
+    SECTION("remove_unless applies the byte budget, least recently used first")
+    {
+        const TranscodedTextureCache cache(base_path, Algorithm::ETC1);
+        const auto old_id = tile::Id { 12, { 2194, 1400 } };
+        REQUIRE(cache.write(old_id, 42, example_texture(Algorithm::ETC1)).has_value());
+        REQUIRE(cache.write(id, 42, example_texture(Algorithm::ETC1)).has_value());
+        const auto old_path = cache.path() / "12_2194_1400.alp_texture";
+        REQUIRE(std::filesystem::exists(old_path));
+        const auto entry_size = std::filesystem::file_size(old_path);
+        std::filesystem::last_write_time(old_path, std::filesystem::last_write_time(old_path) - std::chrono::hours(1));
+
+        cache.remove_unless([](const tile::Id&) { return true; }, 2 * entry_size);
+        CHECK(std::filesystem::exists(old_path)); // reading would make it the most recently used
+        cache.remove_unless([](const tile::Id&) { return true; }, entry_size);
+        CHECK(!cache.read(old_id, 42).has_value());
+        CHECK(cache.read(id, 42).has_value());
+    }
+}
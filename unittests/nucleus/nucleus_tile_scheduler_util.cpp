@@ -16,6 +16,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *****************************************************************************/
 
+#include <algorithm>
+
 #include <QBuffer>
 #include <QFile>
 #include <QImage>
@@ -26,6 +28,7 @@
 #include <nucleus/camera/Definition.h>
 
 #include "nucleus/camera/PositionStorage.h"
+#include "nucleus/tile_scheduler/TileCuller.h"
 #include "nucleus/tile_scheduler/utils.h"
 #include "nucleus/utils/tile_conversion.h"
 #include "radix/quad_tree.h"
@@ -50,6 +53,63 @@ TEST_CASE("nucleus/tile_scheduler/utils/make_bounds altitude correction")
     }
 }
 
+TEST_CASE("nucleus/tile_scheduler/utils/AabbDecorator")
+{
+    TileHeights h;
+    h.emplace({ 0, { 0, 0 } }, { 100, 4000 });
+    h.emplace({ 8, { 139, 166 } }, { 200, 3700 });
+    const auto decorator = utils::AabbDecorator::make(std::move(h));
+
+    SECTION("tabulated latitude factors give the same bounds as make_bounds")
+    {
+        for (const auto& id : { tile::Id { 0, { 0, 0 } }, tile::Id { 3, { 4, 5 } }, tile::Id { 8, { 139, 166 } }, tile::Id { 12, { 2230, 2665 } } }) {
+            const auto bounds = decorator->aabb(id);
+            const auto heights = id.zoom_level >= 8 ? std::pair { 200.f, 3700.f } : std::pair { 100.f, 4000.f };
+            const auto expected = utils::make_bounds(id, heights.first, heights.second);
+            CHECK(bounds.min == expected.min);
+            CHECK(bounds.max.x == expected.max.x);
+            CHECK(bounds.max.y == expected.max.y);
+            CHECK(bounds.max.z == Approx(expected.max.z).epsilon(0.00001));
+        }
+    }
+    SECTION("deeper tiles use the factor of their ancestor, which is conservative")
+    {
+        const auto id = tile::Id { 18, { 142985, 170484 } };
+        const auto bounds = decorator->aabb(id);
+        const auto expected = utils::make_bounds(id, 200, 3700);
+        CHECK(bounds.min == expected.min);
+        CHECK(bounds.max.z >= expected.max.z);
+        CHECK(bounds.max.z == Approx(expected.max.z).epsilon(0.01));
+    }
+    SECTION("mesh heights replace the coarse heights")
+    {
+        const auto id = tile::Id { 14, { 8936, 10650 } };
+        auto copy = std::make_shared<utils::AabbDecorator>(*decorator);
+        copy->set_mesh_heights(id, 1500, 2200);
+        CHECK(copy->has_mesh_heights(id));
+        CHECK(copy->n_mesh_heights() == 1);
+        CHECK(copy->aabb(id).min.z == 1500);
+        CHECK(copy->aabb(id).max.z == 2200);
+        CHECK(copy->aabb(id).min.x == decorator->aabb(id).min.x);
+        CHECK(copy->aabb(id.parent()).max.z == decorator->aabb(id.parent()).max.z);
+        // the original is untouched
+        CHECK(!decorator->has_mesh_heights(id));
+        CHECK(decorator->aabb(id).max.z > 3700);
+    }
+    SECTION("removed mesh heights fall back to the coarse heights")
+    {
+        const auto id = tile::Id { 14, { 8936, 10650 } };
+        auto copy = std::make_shared<utils::AabbDecorator>(*decorator);
+        copy->set_mesh_heights(id, 1500, 2200);
+        CHECK(copy->remove_mesh_heights(id));
+        CHECK(!copy->remove_mesh_heights(id));
+        CHECK(!copy->has_mesh_heights(id));
+        CHECK(copy->n_mesh_heights() == 0);
+        CHECK(copy->aabb(id).min == decorator->aabb(id).min);
+        CHECK(copy->aabb(id).max == decorator->aabb(id).max);
+    }
+}
+
 TEST_CASE("tile_scheduler/utils/refine_functor")
 {
     // todo: optimise / benchmark refine functor
@@ -89,6 +149,42 @@ TEST_CASE("tile_scheduler/utils/refine_functor")
     };
 }
 
+TEST_CASE("tile_scheduler/utils/priority_functor")
+{
+    auto camera = nucleus::camera::stored_positions::stephansdom_closeup();
+
+    QFile file(":/map/height_data.atb");
+    const auto open = file.open(QIODeviceBase::OpenModeFlag::ReadOnly);
+    assert(open);
+    Q_UNUSED(open);
+    const QByteArray data = file.readAll();
+    const auto decorator = nucleus::tile_scheduler::utils::AabbDecorator::make(TileHeights::deserialise(data));
+
+    std::vector<tile::Id> inner_nodes;
+    quad_tree::onTheFlyTraverse(tile::Id { 0, { 0, 0 } }, utils::refineFunctor(camera, decorator, 1.0), [&inner_nodes](const tile::Id& v) {
+        inner_nodes.push_back(v);
+        return v.children();
+    });
+    REQUIRE(inner_nodes.size() > 20);
+
+    const auto priority = utils::priorityFunctor(camera, decorator);
+    const auto frustum = camera.frustum();
+    float lowest_visible = std::numeric_limits<float>::max();
+    for (const auto& id : inner_nodes) {
+        const auto p = priority(id);
+        CHECK(p >= 1);
+        lowest_visible = std::min(lowest_visible, p);
+    }
+
+    // vienna is in view, a tile of the same zoom level on another continent isn't.
+    const auto stephansdom_tile = inner_nodes.back();
+    const auto far_away = tile::Id { stephansdom_tile.zoom_level, { stephansdom_tile.coords.x / 2, stephansdom_tile.coords.y / 2 } };
+    REQUIRE(!utils::camera_frustum_contains_tile(frustum, decorator->aabb(far_away)));
+    CHECK(priority(far_away) < lowest_visible);
+    CHECK(priority(far_away) >= 0);
+    CHECK(priority(far_away) < 1);
+}
+
 TEST_CASE("tile_scheduler/utils/camera_frustum_contains_tile")
 {
     QFile file(":/map/height_data.atb");
@@ -207,5 +303,53 @@ TEST_CASE("tile_scheduler/utils/camera_frustum_contains_tile")
             }
             return retval;
         };
+
+        TileCuller::Bounds bounds;
+        for (const auto& tile_id : tile_ids)
+            bounds.push_back(decorator->aabb(tile_id));
+        std::vector<uint8_t> visible(bounds.size());
+        std::vector<uint8_t> visible_scalar(bounds.size());
+        std::vector<float> screen_space_error(bounds.size());
+        std::vector<float> screen_space_error_scalar(bounds.size());
+        std::vector<uint8_t> visible_only(bounds.size());
+        for (const auto& camera : camera_positions) {
+            const auto culler = TileCuller(camera);
+            culler.evaluate(bounds, visible, screen_space_error);
+            culler.evaluate_scalar(bounds, visible_scalar, screen_space_error_scalar);
+            culler.evaluate_visibility(bounds, visible_only);
+            CHECK(visible_only == visible);
+            const auto camera_frustum = camera.frustum();
+            for (size_t i = 0; i < tile_ids.size(); ++i) {
+                const auto aabb = decorator->aabb(tile_ids[i]);
+                const auto expected = nucleus::tile_scheduler::utils::camera_frustum_contains_tile(camera_frustum, aabb);
+                CHECK(bool(visible[i]) == expected);
+                CHECK(bool(visible_scalar[i]) == expected);
+                CHECK(culler.contains(aabb) == expected);
+                CHECK(screen_space_error[i] == screen_space_error_scalar[i]);
+                const auto distance = float(geometry::distance(aabb, camera.position()));
+                if (distance > 0)
+                    CHECK(screen_space_error[i] == Approx(camera.to_screen_space(float(1.414213562373095 * aabb.size().x / 256), distance)).epsilon(0.0001));
+            }
+        }
+
+        BENCHMARK(std::string("TileCuller::evaluate (") + TileCuller::instruction_set() + ")")
+        {
+            unsigned n_visible = 0;
+            for (const auto& camera : camera_positions) {
+                TileCuller(camera).evaluate(bounds, visible, screen_space_error);
+                n_visible += unsigned(std::count(visible.begin(), visible.end(), 1));
+            }
+            return n_visible;
+        };
+
+        BENCHMARK("TileCuller::evaluate_scalar")
+        {
+            unsigned n_visible = 0;
+            for (const auto& camera : camera_positions) {
+                TileCuller(camera).evaluate_scalar(bounds, visible, screen_space_error);
+                n_visible += unsigned(std::count(visible.begin(), visible.end(), 1));
+            }
+            return n_visible;
+        };
     }
 }
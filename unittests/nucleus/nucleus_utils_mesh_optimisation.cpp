@@ -0,0 +1,139 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <array>
+#include <random>
+#include <set>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/utils/mesh_optimisation.h"
+
+using namespace nucleus::utils::mesh_optimisation;
+
+namespace {
+// row by row, like the tiles coming from the server
+std::vector<uint32_t> grid_indices(unsigned n_edge_vertices)
+{
+    std::vector<uint32_t> indices;
+    for (unsigned row = 0; row + 1 < n_edge_vertices; ++row) {
+        for (unsigned col = 0; col + 1 < n_edge_vertices; ++col) {
+            const auto i = row * n_edge_vertices + col;
+            indices.insert(indices.end(), { i, i + 1, i + n_edge_vertices, i + 1, i + n_edge_vertices + 1, i + n_edge_vertices });
+        }
+    }
+    return indices;
+}
+
+std::vector<uint32_t> shuffled_triangles(std::vector<uint32_t> indices)
+{
+    std::mt19937 rng(42);
+    for (size_t t = indices.size() / 3 - 1; t > 0; --t) {
+        const auto j = rng() % (t + 1);
+        std::swap_ranges(indices.begin() + long(t * 3), indices.begin() + long(t * 3 + 3), indices.begin() + long(j * 3));
+    }
+    return indices;
+}
+
+// triangles rotated so that the smallest index comes first, that keeps the winding comparable
+std::multiset<std::array<uint32_t, 3>> triangle_set(const std::vector<uint32_t>& indices)
+{
+    std::multiset<std::array<uint32_t, 3>> triangles;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+        std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        triangles.insert(t);
+    }
+    return triangles;
+}
+} // namespace
+
+TEST_CASE("nucleus/utils/mesh_optimisation")
+{
+    SECTION("acmr")
+    {
+        CHECK(acmr<uint32_t>(std::vector<uint32_t> { 0, 1, 2 }) == 3.0);
+        CHECK(acmr<uint32_t>(std::vector<uint32_t> { 0, 1, 2, 2, 1, 3 }) == 2.0);
+        CHECK(acmr<uint32_t>(std::vector<uint32_t> {}) == 0.0);
+        CHECK(acmr<uint32_t>(grid_indices(65)) > 1.0);
+    }
+
+    SECTION("vertex cache optimisation keeps triangles and winding")
+    {
+        const auto input = shuffled_triangles(grid_indices(17));
+        auto indices = input;
+        optimise_vertex_cache<uint32_t>(indices, 17 * 17);
+        CHECK(triangle_set(indices) == triangle_set(input));
+    }
+
+    SECTION("vertex cache optimisation reduces the acmr")
+    {
+        for (const auto n : { 17u, 65u, 129u }) {
+            for (auto indices : { grid_indices(n), shuffled_triangles(grid_indices(n)) }) {
+                const auto before = acmr<uint32_t>(indices);
+                optimise_vertex_cache<uint32_t>(indices, n * n);
+                const auto after = acmr<uint32_t>(indices);
+                CHECK(after < before);
+                CHECK(after < 0.7);
+            }
+        }
+    }
+
+    SECTION("vertex fetch optimisation numbers vertices in order of first use")
+    {
+        std::vector<uint16_t> indices = { 5, 3, 4, 3, 5, 1 };
+        const auto remap = optimise_vertex_fetch<uint16_t>(indices, 7);
+        CHECK(indices == std::vector<uint16_t> { 0, 1, 2, 1, 0, 3 });
+        REQUIRE(remap.size() == 7);
+        CHECK(remap[5] == 0);
+        CHECK(remap[3] == 1);
+        CHECK(remap[4] == 2);
+        CHECK(remap[1] == 3);
+        // unused vertices go to the end
+        CHECK(std::set<uint32_t> { remap[0], remap[2], remap[6] } == std::set<uint32_t> { 4, 5, 6 });
+    }
+
+    SECTION("vertex fetch optimisation keeps the acmr")
+    {
+        auto indices = shuffled_triangles(grid_indices(65));
+        optimise_vertex_cache<uint32_t>(indices, 65 * 65);
+        const auto before = acmr<uint32_t>(indices);
+        optimise_vertex_fetch<uint32_t>(indices, 65 * 65);
+        CHECK(acmr<uint32_t>(indices) == before);
+    }
+}
+
+TEST_CASE("nucleus/utils/mesh_optimisation benchmarks")
+{
+    for (const auto n : { 65u, 257u }) {
+        const auto input = shuffled_triangles(grid_indices(n));
+        BENCHMARK("optimise_vertex_cache " + std::to_string(n) + "x" + std::to_string(n))
+        {
+            auto indices = input;
+            optimise_vertex_cache<uint32_t>(indices, n * n);
+            return indices;
+        };
+        BENCHMARK("optimise_vertex_fetch " + std::to_string(n) + "x" + std::to_string(n))
+        {
+            auto indices = input;
+            return optimise_vertex_fetch<uint32_t>(indices, n * n);
+        };
+    }
+}
@@ -0,0 +1,107 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <random>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/utils/RangeAllocator.h"
+
+using nucleus::utils::RangeAllocator;
+
+TEST_CASE("nucleus/utils/RangeAllocator")
+{
+    SECTION("first fit and alignment")
+    {
+        RangeAllocator allocator(100);
+        CHECK(allocator.allocate(10) == 0u);
+        CHECK(allocator.allocate(6, 4) == 12u); // 10 and 11 stay free
+        CHECK(allocator.allocate(2) == 10u);
+        CHECK(allocator.n_allocated() == 18);
+        CHECK(!allocator.allocate(83).has_value());
+        CHECK(allocator.allocate(82) == 18u);
+        CHECK(allocator.largest_free_range() == 0);
+        CHECK(!allocator.allocate(1).has_value());
+        CHECK(!allocator.allocate(0).has_value());
+    }
+    SECTION("freed ranges are merged with their neighbours")
+    {
+        RangeAllocator allocator(30);
+        const auto a = *allocator.allocate(10);
+        const auto b = *allocator.allocate(10);
+        const auto c = *allocator.allocate(10);
+        allocator.free(a, 10);
+        allocator.free(c, 10);
+        CHECK(allocator.n_free_ranges() == 2);
+        CHECK(!allocator.allocate(20).has_value());
+        allocator.free(b, 10);
+        CHECK(allocator.n_free_ranges() == 1);
+        CHECK(allocator.n_allocated() == 0);
+        CHECK(allocator.allocate(30) == 0u);
+    }
+    SECTION("grow appends free space")
+    {
+        RangeAllocator allocator(10);
+        const auto a = *allocator.allocate(6);
+        CHECK(!allocator.allocate(6).has_value());
+        allocator.grow(20);
+        CHECK(allocator.capacity() == 20);
+        CHECK(allocator.n_free_ranges() == 1); // [6, 20)
+        CHECK(allocator.allocate(6) == 6u);
+        allocator.free(a, 6);
+        CHECK(allocator.n_allocated() == 6);
+    }
+    SECTION("random allocations don't overlap and everything is merged again")
+    {
+        constexpr size_t capacity = 1 << 16;
+        RangeAllocator allocator(capacity);
+        std::vector<std::pair<size_t, size_t>> allocations;
+        std::vector<bool> used(capacity, false);
+        std::mt19937 rng(7);
+        for (unsigned i = 0; i < 5000; ++i) {
+            if (!allocations.empty() && rng() % 3 == 0) {
+                const auto index = rng() % allocations.size();
+                const auto [offset, size] = allocations[index];
+                for (size_t j = offset; j < offset + size; ++j)
+                    used[j] = false;
+                allocator.free(offset, size);
+                allocations[index] = allocations.back();
+                allocations.pop_back();
+                continue;
+            }
+            const auto size = size_t(1 + rng() % 200);
+            const auto alignment = size_t(1) << (rng() % 3);
+            const auto offset = allocator.allocate(size, alignment);
+            if (!offset)
+                continue;
+            REQUIRE(*offset % alignment == 0);
+            REQUIRE(*offset + size <= capacity);
+            for (size_t j = *offset; j < *offset + size; ++j) {
+                REQUIRE(!used[j]);
+                used[j] = true;
+            }
+            allocations.emplace_back(*offset, size);
+        }
+        for (const auto& [offset, size] : allocations)
+            allocator.free(offset, size);
+        CHECK(allocator.n_allocated() == 0);
+        CHECK(allocator.n_free_ranges() == 1);
+        CHECK(allocator.largest_free_range() == capacity);
+    }
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/utils/SlotMap.h"
+
+using nucleus::utils::SlotMap;
+
+TEST_CASE("nucleus/utils/SlotMap")
+{
+    SlotMap<std::string> map;
+    const auto a = map.insert("a");
+    const auto b = map.insert("b");
+    const auto c = map.insert("c");
+    CHECK(map.size() == 3);
+    REQUIRE(map.find(b));
+    CHECK(*map.find(b) == "b");
+
+    SECTION("erase keeps the other keys valid and the values dense")
+    {
+        CHECK(map.erase(a));
+        CHECK(!map.erase(a));
+        CHECK(!map.contains(a));
+        CHECK(map.find(a) == nullptr);
+        CHECK(map.size() == 2);
+        CHECK(*map.find(b) == "b");
+        CHECK(*map.find(c) == "c");
+        CHECK(map.values().size() == 2);
+    }
+    SECTION("reused slots don't alias old keys")
+    {
+        map.erase(b);
+        const auto d = map.insert("d");
+        CHECK(d.index == b.index);
+        CHECK(!map.contains(b));
+        CHECK(map.find(b) == nullptr);
+        CHECK(*map.find(d) == "d");
+    }
+    SECTION("clear")
+    {
+        map.clear();
+        CHECK(map.empty());
+        CHECK(!map.contains(a));
+        const auto e = map.insert("e");
+        CHECK(*map.find(e) == "e");
+        CHECK(map.size() == 1);
+    }
+}
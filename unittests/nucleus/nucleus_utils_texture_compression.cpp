@@ -0,0 +1,129 @@
+/*****************************************************************************
+ * Alpine Terrain Renderer
+ * Copyright (C) 2024 Adam Celarek
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include <cmath>
+
+#include <QColor>
+#include <QFile>
+#include <QImage>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "nucleus/utils/texture_compression.h"
+
+using namespace nucleus::utils::texture_compression;
+
+namespace {
+QImage ortho_image()
+{
+    QFile file(QString("%1%2").arg(ALP_TEST_DATA_DIR, "test-tile_ortho.jpeg"));
+    file.open(QIODevice::ReadOnly);
+    return QImage::fromData(file.readAll()).convertedTo(QImage::Format_RGBA8888);
+}
+
+double psnr(const QImage& a, const QImage& b)
+{
+    double squared_error = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        const auto* row_a = a.constScanLine(y);
+        const auto* row_b = b.constScanLine(y);
+        for (int x = 0; x < a.width() * 4; ++x) {
+            if (x % 4 == 3)
+                continue;
+            const auto d = double(row_a[x]) - double(row_b[x]);
+            squared_error += d * d;
+        }
+    }
+    const auto mse = squared_error / (a.width() * a.height() * 3);
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+} // namespace
+
+TEST_CASE("nucleus/utils/texture_compression")
+{
+    SECTION("compressed size")
+    {
+        CHECK(compressed_size(256, 256, Algorithm::Uncompressed_RGBA) == 256 * 256 * 4);
+        CHECK(compressed_size(256, 256, Algorithm::ETC1) == 64 * 64 * 8);
+        CHECK(compressed_size(256, 256, Algorithm::DXT1) == 64 * 64 * 8);
+        CHECK(compressed_size(2, 1, Algorithm::ETC1) == 8);
+        CHECK(compressed_size(5, 9, Algorithm::DXT1) == 2 * 3 * 8);
+    }
+
+    SECTION("uncompressed is a plain copy")
+    {
+        const auto image = ortho_image();
+        const auto data = compress(image, Algorithm::Uncompressed_RGBA);
+        CHECK(size_t(data.size()) == compressed_size(256, 256, Algorithm::Uncompressed_RGBA));
+        CHECK(decompress(data, 256, 256, Algorithm::Uncompressed_RGBA) == image);
+    }
+
+    SECTION("solid colours survive")
+    {
+        for (const auto algorithm : { Algorithm::ETC1, Algorithm::DXT1 }) {
+            for (const auto colour : { QColor(0, 0, 0), QColor(255, 255, 255), QColor(120, 180, 40), QColor(13, 77, 201) }) {
+                QImage image(8, 8, QImage::Format_RGBA8888);
+                image.fill(colour);
+                const auto decoded = decompress(compress(image, algorithm), 8, 8, algorithm);
+                const auto pixel = decoded.pixelColor(5, 3);
+                CHECK(std::abs(pixel.red() - colour.red()) <= 8);
+                CHECK(std::abs(pixel.green() - colour.green()) <= 8);
+                CHECK(std::abs(pixel.blue() - colour.blue()) <= 8);
+            }
+        }
+    }
+
+    SECTION("ortho tiles keep their quality")
+    {
+        const auto image = ortho_image();
+        REQUIRE(image.width() == 256);
+        for (const auto algorithm : { Algorithm::ETC1, Algorithm::DXT1 }) {
+            const auto data = compress(image, algorithm);
+            CHECK(size_t(data.size()) == compressed_size(256, 256, algorithm));
+            const auto decoded = decompress(data, 256, 256, algorithm);
+            CHECK(decoded.size() == image.size());
+            CHECK(psnr(image, decoded) > 26.0);
+        }
+    }
+
+    SECTION("small mip levels are padded to whole blocks")
+    {
+        QImage image(2, 3, QImage::Format_RGBA8888);
+        image.fill(QColor(200, 100, 50));
+        for (const auto algorithm : { Algorithm::ETC1, Algorithm::DXT1 }) {
+            const auto data = compress(image, algorithm);
+            CHECK(data.size() == 8);
+            const auto decoded = decompress(data, 2, 3, algorithm);
+            CHECK(decoded.size() == QSize(2, 3));
+            CHECK(std::abs(decoded.pixelColor(1, 2).red() - 200) <= 8);
+        }
+    }
+}
+
+TEST_CASE("nucleus/utils/texture_compression benchmarks")
+{
+    const auto image = ortho_image();
+    BENCHMARK("etc1 256x256")
+    {
+        return compress(image, Algorithm::ETC1);
+    };
+    BENCHMARK("dxt1 256x256")
+    {
+        return compress(image, Algorithm::DXT1);
+    };
+}
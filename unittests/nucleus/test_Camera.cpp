@@ -17,9 +17,13 @@
  *****************************************************************************/
 
 
+#include <QSignalSpy>
+#include <QThread>
 #include <catch2/catch_test_macros.hpp>
 
+#include "nucleus/camera/Controller.h"
 #include "nucleus/camera/Definition.h"
+#include "nucleus/camera/LinearCameraAnimation.h"
 #include "radix/geometry.h"
 #include "test_helpers.h"
 
@@ -335,3 +339,46 @@ TEST_CASE("nucleus/camera: Definition")
         }
     }
 }
+
+TEST_CASE("nucleus/camera: prediction")
+{
+    using nucleus::camera::Definition;
+    SECTION("linear animation path ends at the target")
+    {
+        const auto start = Definition({ 0, -1000, 1000 }, { 0, 0, 0 });
+        const auto end = Definition({ 50'000, 20'000, 3000 }, { 50'000, 21'000, 0 });
+        nucleus::camera::LinearCameraAnimation animation(start, end);
+        const auto path = animation.predicted_path(start);
+        REQUIRE(path.size() == 2);
+        CHECK(equals(path.back().position(), end.position()));
+        CHECK(equals(path.back().z_axis(), end.z_axis()));
+        // half way in time is half way in space, the easing is symmetric
+        CHECK(equals(path.front().position(), (start.position() + end.position()) * 0.5));
+    }
+
+    SECTION("camera controller extrapolates the movement")
+    {
+        nucleus::camera::Controller controller(Definition({ 0, 0, 1000 }, { 0, 1000, 0 }), nullptr, nullptr);
+        QSignalSpy spy(&controller, &nucleus::camera::Controller::predicted_definitions_changed);
+        CHECK(controller.predicted_definitions().empty());
+        controller.update();
+        CHECK(spy.empty()); // nothing predicted, nothing emitted
+
+        for (int i = 0; i < 5; ++i) {
+            QThread::msleep(20);
+            controller.move({ 10, 0, 0 });
+        }
+        const auto predicted = controller.predicted_definitions();
+        REQUIRE(predicted.size() == 1);
+        CHECK(predicted.front().position().x > controller.definition().position().x + 50);
+        CHECK(predicted.front().position().y == Approx(controller.definition().position().y));
+        CHECK(!spy.empty());
+
+        // standing still ends the prediction
+        QThread::msleep(600);
+        controller.update();
+        CHECK(controller.predicted_definitions().empty());
+        REQUIRE(!spy.empty());
+        CHECK(spy.back().at(0).value<std::vector<Definition>>().empty());
+    }
+}
@@ -68,6 +68,45 @@ TEST_CASE("nucleus/utils/tile_conversion")
         CHECK(raster.buffer().front().w == 255);
     }
 
+    SECTION("byte array to RGBA mip chain")
+    {
+        QString filepath = QString("%1%2").arg(ALP_TEST_DATA_DIR, "test-tile_ortho.jpeg");
+        QFile file(filepath);
+        file.open(QIODevice::ReadOnly);
+        QByteArray ba = file.readAll();
+        REQUIRE(ba.size() > 0);
+        const auto chain = nucleus::utils::tile_conversion::toMipChainRGBA(ba);
+        REQUIRE(chain.size() == 9);
+        for (size_t i = 0; i < chain.size(); ++i) {
+            CHECK(chain[i].width() == 256 >> i);
+            CHECK(chain[i].height() == 256 >> i);
+            CHECK(chain[i].format() == QImage::Format_RGBA8888);
+        }
+        const auto level_0 = nucleus::utils::tile_conversion::toQImage(ba).convertedTo(QImage::Format_RGBA8888);
+        CHECK(chain[0] == level_0);
+        const auto pixel = [](const QImage& image, int x, int y) { return reinterpret_cast<const glm::u8vec4*>(image.constScanLine(y))[x]; };
+        const auto sum = glm::uvec4(pixel(level_0, 6, 10)) + glm::uvec4(pixel(level_0, 7, 10)) + glm::uvec4(pixel(level_0, 6, 11))
+            + glm::uvec4(pixel(level_0, 7, 11));
+        CHECK(pixel(chain[1], 3, 5) == glm::u8vec4((sum + 2u) / 4u));
+    }
+
+    SECTION("mip chain of non power of two images goes down to 1x1")
+    {
+        QString filepath = QString("%1%2").arg(ALP_TEST_DATA_DIR, "170px-Jeune_bouquetin_de_face.jpg");
+        QFile file(filepath);
+        file.open(QIODevice::ReadOnly);
+        const auto chain = nucleus::utils::tile_conversion::toMipChainRGBA(file.readAll());
+        REQUIRE(chain.size() == 8);
+        CHECK(chain[1].size() == QSize(85, 113));
+        CHECK(chain[6].size() == QSize(2, 3));
+        CHECK(chain[7].size() == QSize(1, 1));
+    }
+
+    SECTION("mip chain of invalid data is empty")
+    {
+        CHECK(nucleus::utils::tile_conversion::toMipChainRGBA(QByteArray("not an image")).empty());
+    }
+
     SECTION("float to alpine raster RGBA conversion math")
     {
         const auto one_red = 32.0f;